@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Measures throughput of parsing list_all_removable_devices response on client side:
+ * parsing each line into allocated dt_command_t and moving remainder of buffer after each line,
+ * versus parsing lines in place with arguments taken from arena and moving remainder once per read.
+ * In both cases device list is built same way library builds it.
+ * Results are meaningful only for optimized build, e.g. with CMAKE_BUILD_TYPE=Release,
+ * without optimization difference between approaches is much smaller.
+ */
+
+#include "library/dt-parse-helpers.h"
+#include "library/dt-print-helpers.h"
+#include "library/dtmd-misc.h"
+
+#include <dtmd.h>
+#include <dt-command.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define partitions_per_disk 3
+#define devices_per_round 100000
+
+typedef struct parse_state
+{
+	char buffer[dtmd_command_max_length + 1];
+	size_t cur_pos;
+	size_t buffer_start;
+	dt_helper_arena_t arena;
+	dtmd_removable_media_t *devices;
+	size_t devices_count;
+} parse_state_t;
+
+static char* generate_response(size_t disks_count, size_t *size)
+{
+	char *response;
+	size_t capacity;
+	size_t used = 0;
+	size_t i, j;
+	char parent_path[64];
+	char path[sizeof(parent_path) + 24];
+	char label[64];
+	char mnt_point[sizeof(label) + 8];
+	const char *mnt_point_ptr;
+	const char *mnt_opts_ptr;
+
+	capacity = (disks_count * (partitions_per_disk + 1) + 2) * 256;
+
+	response = (char*) malloc(capacity);
+	if (response == NULL)
+	{
+		return NULL;
+	}
+
+	used += snprintf(&(response[used]), capacity - used, dtmd_response_started "(%zu " dtmd_command_list_all_removable_devices ")\n",
+		strlen(dtmd_command_list_all_removable_devices));
+
+	for (i = 0; i < disks_count; ++i)
+	{
+		snprintf(parent_path, sizeof(parent_path), "/dev/sd%zu", i);
+
+		used += snprintf(&(response[used]), capacity - used, "%s(%d%s%s, %d%s%s, %d%s%s, %d%s%s)\n",
+			dtmd_response_argument_removable_device,
+			dt_helper_print_with_all_checks(dtmd_root_device_path),
+			dt_helper_print_with_all_checks(parent_path),
+			dt_helper_print_with_all_checks(dtmd_device_type_to_string(dtmd_removable_media_type_stateless_device)),
+			dt_helper_print_with_all_checks(dtmd_device_subtype_to_string(dtmd_removable_media_subtype_removable_disk)));
+
+		for (j = 1; j <= partitions_per_disk; ++j)
+		{
+			snprintf(path, sizeof(path), "%s%zu", parent_path, j);
+			snprintf(label, sizeof(label), "Volume %zu-%zu", i, j);
+			snprintf(mnt_point, sizeof(mnt_point), "/media/%s", label);
+
+			// only first partition of each disk is mounted
+			mnt_point_ptr = (j == 1) ? mnt_point : NULL;
+			mnt_opts_ptr = (j == 1) ? "rw,nosuid,nodev" : NULL;
+
+			used += snprintf(&(response[used]), capacity - used, "%s(%d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s)\n",
+				dtmd_response_argument_removable_device,
+				dt_helper_print_with_all_checks(parent_path),
+				dt_helper_print_with_all_checks(path),
+				dt_helper_print_with_all_checks(dtmd_device_type_to_string(dtmd_removable_media_type_device_partition)),
+				dt_helper_print_with_all_checks("vfat"),
+				dt_helper_print_with_all_checks(label),
+				dt_helper_print_with_all_checks(mnt_point_ptr),
+				dt_helper_print_with_all_checks(mnt_opts_ptr));
+		}
+	}
+
+	used += snprintf(&(response[used]), capacity - used, dtmd_response_finished "(%zu " dtmd_command_list_all_removable_devices ")\n",
+		strlen(dtmd_command_list_all_removable_devices));
+
+	*size = used;
+	return response;
+}
+
+static int take_string(char **where, char **from, int is_copy)
+{
+	if ((!is_copy) || (*from == NULL))
+	{
+		*where = *from;
+		*from = NULL;
+		return 1;
+	}
+
+	*where = strdup(*from);
+	return (*where != NULL);
+}
+
+/* list is kept flat, lookup of parent isn't what is measured here */
+static int add_device(parse_state_t *state, dt_command_t *cmd, int is_copy)
+{
+	dtmd_removable_media_t *media_ptr;
+
+	if ((strcmp(cmd->cmd, dtmd_response_argument_removable_device) != 0) || (cmd->args_count < 4))
+	{
+		return 1;
+	}
+
+	media_ptr = (dtmd_removable_media_t*) calloc(1, sizeof(dtmd_removable_media_t));
+	if (media_ptr == NULL)
+	{
+		return 0;
+	}
+
+	media_ptr->next_node = state->devices;
+	state->devices = media_ptr;
+	++(state->devices_count);
+
+	media_ptr->type = dtmd_string_to_device_type(cmd->args[2]);
+
+	if (!take_string(&(media_ptr->path), &(cmd->args[1]), is_copy))
+	{
+		return 0;
+	}
+
+	if (media_ptr->type == dtmd_removable_media_type_device_partition)
+	{
+		return (cmd->args_count == 7)
+			&& take_string(&(media_ptr->fstype), &(cmd->args[3]), is_copy)
+			&& take_string(&(media_ptr->label), &(cmd->args[4]), is_copy)
+			&& take_string(&(media_ptr->mnt_point), &(cmd->args[5]), is_copy)
+			&& take_string(&(media_ptr->mnt_opts), &(cmd->args[6]), is_copy);
+	}
+
+	media_ptr->subtype = dtmd_string_to_device_subtype(cmd->args[3]);
+	return 1;
+}
+
+static void free_devices(parse_state_t *state)
+{
+	dtmd_removable_media_t *media_ptr;
+
+	while (state->devices != NULL)
+	{
+		media_ptr = state->devices;
+		state->devices = media_ptr->next_node;
+
+		free(media_ptr->path);
+		free(media_ptr->fstype);
+		free(media_ptr->label);
+		free(media_ptr->mnt_point);
+		free(media_ptr->mnt_opts);
+		free(media_ptr);
+	}
+
+	state->devices_count = 0;
+}
+
+/* simulates read from socket */
+static size_t fill_buffer(parse_state_t *state, const char *response, size_t size, size_t offset)
+{
+	size_t length;
+
+	length = dtmd_command_max_length - state->cur_pos;
+	if (length > size - offset)
+	{
+		length = size - offset;
+	}
+
+	memcpy(&(state->buffer[state->cur_pos]), &(response[offset]), length);
+	state->cur_pos += length;
+	state->buffer[state->cur_pos] = 0;
+
+	return offset + length;
+}
+
+static int parse_allocating(parse_state_t *state, const char *response, size_t size)
+{
+	dt_command_t *cmd;
+	char *eol;
+	size_t offset = 0;
+	int rc;
+
+	state->cur_pos = 0;
+	state->buffer[0] = 0;
+
+	while (offset < size)
+	{
+		offset = fill_buffer(state, response, size, offset);
+
+		while ((eol = strchr(state->buffer, '\n')) != NULL)
+		{
+			if (!dt_validate_command(state->buffer))
+			{
+				return 0;
+			}
+
+			cmd = dt_parse_command(state->buffer);
+
+			state->cur_pos -= (eol + 1 - state->buffer);
+			memmove(state->buffer, eol + 1, state->cur_pos + 1);
+
+			if (cmd == NULL)
+			{
+				return 0;
+			}
+
+			rc = add_device(state, cmd, 0);
+			dt_free_command(cmd);
+
+			if (!rc)
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+static int parse_in_place(parse_state_t *state, const char *response, size_t size)
+{
+	dt_command_t cmd;
+	char *line;
+	char *eol;
+	size_t offset = 0;
+
+	state->cur_pos = 0;
+	state->buffer_start = 0;
+	state->buffer[0] = 0;
+
+	while (offset < size)
+	{
+		if (state->buffer_start > 0)
+		{
+			state->cur_pos -= state->buffer_start;
+			memmove(state->buffer, &(state->buffer[state->buffer_start]), state->cur_pos + 1);
+			state->buffer_start = 0;
+		}
+
+		dt_helper_arena_reset(&(state->arena));
+
+		offset = fill_buffer(state, response, size, offset);
+
+		for (;;)
+		{
+			line = &(state->buffer[state->buffer_start]);
+
+			eol = strchr(line, '\n');
+			if (eol == NULL)
+			{
+				break;
+			}
+
+			state->buffer_start = eol + 1 - state->buffer;
+
+			if ((dt_helper_parse_command_in_place(line, eol, &(state->arena), &cmd) <= 0)
+				|| (!add_device(state, &cmd, 1)))
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (double) (end->tv_sec - start->tv_sec) * 1e9 + (double) (end->tv_nsec - start->tv_nsec);
+}
+
+static int run(parse_state_t *state, int (*parse_func)(parse_state_t*, const char*, size_t), const char *response, size_t size, size_t disks_count, double *result)
+{
+	struct timespec start, end;
+	double total = 0;
+	size_t rounds;
+	size_t round;
+
+	rounds = devices_per_round / (disks_count * (partitions_per_disk + 1));
+	if (rounds == 0)
+	{
+		rounds = 1;
+	}
+
+	for (round = 0; round < rounds; ++round)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		if (!parse_func(state, response, size))
+		{
+			fprintf(stderr, "Failed to parse response\n");
+			free_devices(state);
+			return 0;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		total += elapsed_ns(&start, &end);
+
+		if (state->devices_count != disks_count * (partitions_per_disk + 1))
+		{
+			fprintf(stderr, "Parsed %zu devices instead of %zu\n", state->devices_count, disks_count * (partitions_per_disk + 1));
+			free_devices(state);
+			return 0;
+		}
+
+		free_devices(state);
+	}
+
+	// megabytes per second
+	*result = ((double) size * rounds / 1e6) / (total / 1e9);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t counts[] = { 10, 100, 1000, 10000 };
+	static parse_state_t state;
+	double allocating, in_place;
+	char *response;
+	size_t size;
+	size_t i;
+	int result = EXIT_FAILURE;
+
+	state.devices = NULL;
+	state.devices_count = 0;
+	dt_helper_arena_init(&(state.arena));
+
+	printf("%8s %12s %24s %24s\n", "devices", "bytes", "allocating parse, MB/s", "in-place parse, MB/s");
+
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+	{
+		response = generate_response(counts[i], &size);
+		if (response == NULL)
+		{
+			fprintf(stderr, "Memory allocation failure\n");
+			goto main_exit;
+		}
+
+		if ((!run(&state, &parse_allocating, response, size, counts[i], &allocating))
+			|| (!run(&state, &parse_in_place, response, size, counts[i], &in_place)))
+		{
+			free(response);
+			goto main_exit;
+		}
+
+		printf("%8zu %12zu %24.1f %24.1f\n", counts[i] * (partitions_per_disk + 1), size, allocating, in_place);
+
+		free(response);
+	}
+
+	result = EXIT_SUCCESS;
+
+main_exit:
+	dt_helper_arena_free(&(state.arena));
+
+	return result;
+}
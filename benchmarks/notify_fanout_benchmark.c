@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Measures cost of sending one notification to N clients:
+ * formatting it separately for each client versus formatting it once and sharing the buffer.
+ */
+
+#include "daemon/client_io.h"
+#include "daemon/config_file.h"
+#include "daemon/event_loop.h"
+#include "daemon/lists.h"
+#include "daemon/mount_jobs.h"
+#include "daemon/return_codes.h"
+
+#include "library/dt-print-helpers.h"
+#include "library/dtmd-misc.h"
+
+#include <dtmd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define rounds_count 2000
+
+int use_syslog = 0;
+int daemonize = 0;
+
+enum client_overflow_policy_enum client_overflow_policy = client_overflow_resync;
+size_t client_queue_size = 1024 * 1024;
+
+struct client *client_root = NULL;
+size_t clients_count = 0;
+size_t clients_scheduled_for_removal = 0;
+
+static int peers[1000];
+
+void remove_client(struct client *client_ptr)
+{
+}
+
+void mount_jobs_detach_client(struct client *client_ptr)
+{
+}
+
+static int append_notification(client_message_t **message_ptr)
+{
+	return client_message_append(message_ptr, "%s(%d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s)\n",
+		dtmd_notification_removable_device_changed,
+		dt_helper_print_with_all_checks("/dev/sr0"),
+		dt_helper_print_with_all_checks("/dev/sr0"),
+		dt_helper_print_with_all_checks(dtmd_device_type_to_string(dtmd_removable_media_type_stateful_device)),
+		dt_helper_print_with_all_checks(dtmd_device_subtype_to_string(dtmd_removable_media_subtype_cdrom)),
+		dt_helper_print_with_all_checks(dtmd_device_state_to_string(dtmd_removable_media_state_ok)),
+		dt_helper_print_with_all_checks("iso9660"),
+		dt_helper_print_with_all_checks("Some rather long disc label"),
+		dt_helper_print_with_all_checks("/media/Some rather long disc label"),
+		dt_helper_print_with_all_checks("ro,nosuid,nodev,noexec"));
+}
+
+static void drain_peers(size_t count)
+{
+	char buffer[65536];
+	size_t i;
+
+	for (i = 0; i < count; ++i)
+	{
+		while (recv(peers[i], buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+		{
+		}
+	}
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (double) (end->tv_sec - start->tv_sec) * 1e9 + (double) (end->tv_nsec - start->tv_nsec);
+}
+
+static int run_per_client(size_t count, double *result)
+{
+	struct timespec start, end;
+	double total = 0;
+	struct client *cur_client;
+	client_message_t *message;
+	size_t round;
+
+	for (round = 0; round < rounds_count; ++round)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (cur_client = client_root; cur_client != NULL; cur_client = cur_client->next_node)
+		{
+			message = client_message_new();
+			if ((message == NULL) || is_result_failure(append_notification(&message)))
+			{
+				client_message_unref(message);
+				return result_fatal_error;
+			}
+
+			client_notify(cur_client, message);
+			client_message_unref(message);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		total += elapsed_ns(&start, &end);
+
+		drain_peers(count);
+	}
+
+	*result = total / (rounds_count * count);
+	return result_success;
+}
+
+static int run_shared(size_t count, double *result)
+{
+	struct timespec start, end;
+	double total = 0;
+	struct client *cur_client;
+	client_message_t *message;
+	size_t round;
+
+	for (round = 0; round < rounds_count; ++round)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		message = client_message_new();
+		if ((message == NULL) || is_result_failure(append_notification(&message)))
+		{
+			client_message_unref(message);
+			return result_fatal_error;
+		}
+
+		for (cur_client = client_root; cur_client != NULL; cur_client = cur_client->next_node)
+		{
+			client_notify(cur_client, message);
+		}
+
+		client_message_unref(message);
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		total += elapsed_ns(&start, &end);
+
+		drain_peers(count);
+	}
+
+	*result = total / (rounds_count * count);
+	return result_success;
+}
+
+static int create_clients(size_t count)
+{
+	struct client *cur_client;
+	int fds[2];
+
+	while (clients_count < count)
+	{
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0)
+		{
+			fprintf(stderr, "Failed to create socket pair\n");
+			return result_fatal_error;
+		}
+
+		cur_client = (struct client*) calloc(1, sizeof(struct client));
+		if (cur_client == NULL)
+		{
+			fprintf(stderr, "Memory allocation failure\n");
+			close(fds[0]);
+			close(fds[1]);
+			return result_fatal_error;
+		}
+
+		cur_client->clientfd = fds[0];
+		peers[clients_count] = fds[1];
+
+		if (is_result_failure(event_loop_add(cur_client->clientfd, event_loop_read, cur_client)))
+		{
+			close(fds[0]);
+			close(fds[1]);
+			free(cur_client);
+			return result_fatal_error;
+		}
+
+		cur_client->next_node = client_root;
+		if (client_root != NULL)
+		{
+			client_root->prev_node = cur_client;
+		}
+
+		client_root = cur_client;
+		++clients_count;
+	}
+
+	return result_success;
+}
+
+static void destroy_clients(void)
+{
+	struct client *cur_client;
+	size_t i;
+
+	while (client_root != NULL)
+	{
+		cur_client = client_root;
+		client_root = client_root->next_node;
+
+		client_free_queue(cur_client);
+		close(cur_client->clientfd);
+		free(cur_client);
+	}
+
+	for (i = 0; i < clients_count; ++i)
+	{
+		close(peers[i]);
+	}
+
+	clients_count = 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t counts[] = { 1, 10, 100, 1000 };
+	double per_client, shared;
+	size_t i;
+	int result = EXIT_FAILURE;
+
+	if (is_result_failure(event_loop_init()))
+	{
+		return EXIT_FAILURE;
+	}
+
+	printf("%8s %24s %24s\n", "clients", "per-client format, ns", "shared message, ns");
+
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+	{
+		if (is_result_failure(create_clients(counts[i])))
+		{
+			goto main_exit;
+		}
+
+		if (is_result_failure(run_per_client(counts[i], &per_client))
+			|| is_result_failure(run_shared(counts[i], &shared)))
+		{
+			goto main_exit;
+		}
+
+		printf("%8zu %24.1f %24.1f\n", counts[i], per_client, shared);
+	}
+
+	result = EXIT_SUCCESS;
+
+main_exit:
+	destroy_clients();
+	event_loop_deinit();
+
+	return result;
+}
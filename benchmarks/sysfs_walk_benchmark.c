@@ -0,0 +1,596 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Measures cost of reading attributes of usb disks in sysfs:
+ * absolute paths with stdio versus descriptor-relative access with sysfs accessor.
+ * Fake sysfs tree is created in temporary directory,
+ * number of system calls is counted by tracing child process with ptrace.
+ */
+
+#include "daemon/modules/unix-userspace/sysfs.h"
+#include "daemon/return_codes.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define disks_count 16
+#define rounds_count 200
+
+static char root_path[64];
+
+static int write_file(const char *path, const char *data)
+{
+	FILE *file;
+
+	file = fopen(path, "w");
+	if (file == NULL)
+	{
+		return result_fail;
+	}
+
+	fputs(data, file);
+	fclose(file);
+
+	return result_success;
+}
+
+static int make_path(char *path)
+{
+	char *slash;
+
+	for (slash = strchr(path + strlen(root_path) + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+	{
+		*slash = 0;
+
+		if ((mkdir(path, 0755) != 0) && (access(path, F_OK) != 0))
+		{
+			return result_fail;
+		}
+
+		*slash = '/';
+	}
+
+	return result_success;
+}
+
+static int create_tree(void)
+{
+	char path[PATH_MAX + 1];
+	char devpath[256];
+	char data[64];
+	int i;
+
+	strcpy(root_path, "/tmp/dtmd-sysfs-XXXXXX");
+	if (mkdtemp(root_path) == NULL)
+	{
+		return result_fail;
+	}
+
+	for (i = 0; i < disks_count; ++i)
+	{
+		snprintf(devpath, sizeof(devpath), "devices/pci0000:00/0000:00:14.0/usb1/1-%d", i + 1);
+
+		snprintf(path, sizeof(path), "%s/%s/1-%d:1.0/host%d/target%d:0:0/%d:0:0:0/block/sd%c/", root_path, devpath, i + 1, i, i, i, 'a' + i);
+		if (is_result_failure(make_path(path)))
+		{
+			return result_fail;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s/subsystem", root_path, devpath);
+		if (symlink("../../../../../bus/usb", path) != 0)
+		{
+			return result_fail;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s/uevent", root_path, devpath);
+		if (is_result_failure(write_file(path, "MAJOR=189\nMINOR=1\nDEVNAME=bus/usb/001/002\nDEVTYPE=usb_device\nDRIVER=usb\n")))
+		{
+			return result_fail;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s/1-%d:1.0/host%d/target%d:0:0/%d:0:0:0/type", root_path, devpath, i + 1, i, i, i);
+		if (is_result_failure(write_file(path, "0\n")))
+		{
+			return result_fail;
+		}
+
+		snprintf(devpath + strlen(devpath), sizeof(devpath) - strlen(devpath), "/1-%d:1.0/host%d/target%d:0:0/%d:0:0:0/block/sd%c", i + 1, i, i, i, 'a' + i);
+
+		snprintf(path, sizeof(path), "%s/%s/device", root_path, devpath);
+		if (symlink("../..", path) != 0)
+		{
+			return result_fail;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s/dev", root_path, devpath);
+		snprintf(data, sizeof(data), "8:%d\n", i * 16);
+		if (is_result_failure(write_file(path, data)))
+		{
+			return result_fail;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s/removable", root_path, devpath);
+		if (is_result_failure(write_file(path, "1\n")))
+		{
+			return result_fail;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s/size", root_path, devpath);
+		if (is_result_failure(write_file(path, "15633408\n")))
+		{
+			return result_fail;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s/diskseq", root_path, devpath);
+		snprintf(data, sizeof(data), "%d\n", i + 1);
+		if (is_result_failure(write_file(path, data)))
+		{
+			return result_fail;
+		}
+
+		snprintf(path, sizeof(path), "%s/class/block/", root_path);
+		if (is_result_failure(make_path(path)))
+		{
+			return result_fail;
+		}
+
+		snprintf(path, sizeof(path), "%s/class/block/sd%c", root_path, 'a' + i);
+		snprintf(data, sizeof(data), "../../");
+		if (strlen(data) + strlen(devpath) + 1 > sizeof(devpath))
+		{
+			return result_fail;
+		}
+
+		memmove(devpath + strlen(data), devpath, strlen(devpath) + 1);
+		memcpy(devpath, data, strlen(data));
+
+		if (symlink(devpath, path) != 0)
+		{
+			return result_fail;
+		}
+	}
+
+	return result_success;
+}
+
+static void remove_tree(void)
+{
+	char command[PATH_MAX + 16];
+
+	snprintf(command, sizeof(command), "rm -rf '%s'", root_path);
+	if (system(command) != 0)
+	{
+		fprintf(stderr, "Failed to remove '%s'\n", root_path);
+	}
+}
+
+/* Reading with absolute paths, the way devices were read before sysfs accessor */
+
+static int path_read_int(const char *filename)
+{
+	FILE *file;
+	int value = 0;
+	int read_val;
+
+	file = fopen(filename, "r");
+	if (file == NULL)
+	{
+		return -1;
+	}
+
+	while (((read_val = fgetc(file)) != EOF) && (read_val >= '0') && (read_val <= '9'))
+	{
+		value = (value * 10) + (read_val - '0');
+	}
+
+	fclose(file);
+
+	return value;
+}
+
+static int path_read_unsigned(const char *filename, unsigned long long *value)
+{
+	FILE *file;
+	int result;
+
+	file = fopen(filename, "r");
+	if (file == NULL)
+	{
+		return result_fail;
+	}
+
+	result = (fscanf(file, "%llu", value) == 1) ? result_success : result_fail;
+	fclose(file);
+
+	return result;
+}
+
+static int path_has_line(const char *filename, const char *line)
+{
+	char buffer[4096];
+	FILE *file;
+	int result = result_fail;
+
+	file = fopen(filename, "r");
+	if (file == NULL)
+	{
+		return result_fail;
+	}
+
+	while (fgets(buffer, sizeof(buffer), file) != NULL)
+	{
+		buffer[strcspn(buffer, "\n")] = 0;
+
+		if (strcmp(buffer, line) == 0)
+		{
+			result = result_success;
+			break;
+		}
+	}
+
+	fclose(file);
+
+	return result;
+}
+
+static char* path_get_usb_parent(const char *path)
+{
+	char file_name[PATH_MAX + 1];
+	char link_buffer[PATH_MAX + 1];
+	struct stat stat_entry;
+	ssize_t link_size;
+	size_t curlen;
+	char *slash;
+
+	if (realpath(path, file_name) == NULL)
+	{
+		return NULL;
+	}
+
+	curlen = strlen(file_name);
+
+	while (curlen > strlen(root_path))
+	{
+		strcpy(file_name + curlen, "/subsystem");
+
+		if (lstat(file_name, &stat_entry) == 0)
+		{
+			link_size = readlink(file_name, link_buffer, sizeof(link_buffer) - 1);
+			if ((link_size > 4) && (strncmp(&link_buffer[link_size - 4], "/usb", 4) == 0))
+			{
+				strcpy(file_name + curlen, "/uevent");
+
+				if (is_result_successful(path_has_line(file_name, "DEVTYPE=usb_device")))
+				{
+					file_name[curlen] = 0;
+					return strdup(file_name);
+				}
+			}
+		}
+
+		file_name[curlen] = 0;
+
+		slash = strrchr(file_name, '/');
+		if (slash == NULL)
+		{
+			break;
+		}
+
+		*slash = 0;
+		curlen = slash - file_name;
+	}
+
+	return NULL;
+}
+
+static int read_disk_by_path(const char *name)
+{
+	char file_name[PATH_MAX + 1];
+	char type[16];
+	struct stat stat_entry;
+	unsigned long long size;
+	unsigned long long diskseq;
+	char *usb_parent;
+	FILE *file;
+	size_t len;
+
+	snprintf(file_name, sizeof(file_name), "%s/class/block/%s/", root_path, name);
+	len = strlen(file_name);
+
+	strcpy(file_name + len, "dev");
+	if (stat(file_name, &stat_entry) != 0)
+	{
+		return result_fail;
+	}
+
+	strcpy(file_name + len, "removable");
+	if (path_read_int(file_name) != 1)
+	{
+		return result_fail;
+	}
+
+	strcpy(file_name + len, "device/type");
+	file = fopen(file_name, "r");
+	if ((file == NULL) || (fgets(type, sizeof(type), file) == NULL))
+	{
+		if (file != NULL)
+		{
+			fclose(file);
+		}
+
+		return result_fail;
+	}
+
+	fclose(file);
+
+	file_name[len] = 0;
+	usb_parent = path_get_usb_parent(file_name);
+	if (usb_parent == NULL)
+	{
+		return result_fail;
+	}
+
+	free(usb_parent);
+
+	strcpy(file_name + len, "size");
+	if (is_result_failure(path_read_unsigned(file_name, &size)))
+	{
+		return result_fail;
+	}
+
+	strcpy(file_name + len, "diskseq");
+	if (is_result_failure(path_read_unsigned(file_name, &diskseq)))
+	{
+		return result_fail;
+	}
+
+	return result_success;
+}
+
+/* Reading relative to descriptors */
+
+static int read_disk_by_accessor(sysfs_accessor_t *sysfs, const char *name)
+{
+	char file_name[PATH_MAX + 1];
+	const char *type;
+	const char *devpath;
+	unsigned long long size;
+	unsigned long long diskseq;
+	char *usb_parent;
+	int removable;
+	int device_fd;
+	int result = result_fail;
+
+	device_fd = openat(sysfs->root->class_block_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (device_fd < 0)
+	{
+		return result_fail;
+	}
+
+	if (is_result_failure(sysfs_file_exists(device_fd, "dev"))
+		|| is_result_failure(sysfs_read_int(sysfs, device_fd, "removable", &removable))
+		|| (removable != 1)
+		|| is_result_failure(sysfs_read_string(sysfs, device_fd, "device/type", &type))
+		|| is_result_failure(sysfs_get_block_devpath(sysfs, name, &devpath)))
+	{
+		goto read_disk_by_accessor_exit;
+	}
+
+	usb_parent = sysfs_get_usb_parent_syspath(sysfs, devpath);
+	if (usb_parent == NULL)
+	{
+		goto read_disk_by_accessor_exit;
+	}
+
+	free(usb_parent);
+
+	snprintf(file_name, sizeof(file_name), "%s/size", name);
+	if (is_result_failure(sysfs_read_unsigned(sysfs, sysfs->root->class_block_fd, file_name, &size)))
+	{
+		goto read_disk_by_accessor_exit;
+	}
+
+	snprintf(file_name, sizeof(file_name), "%s/diskseq", name);
+	if (is_result_failure(sysfs_read_unsigned(sysfs, sysfs->root->class_block_fd, file_name, &diskseq)))
+	{
+		goto read_disk_by_accessor_exit;
+	}
+
+	result = result_success;
+
+read_disk_by_accessor_exit:
+	close(device_fd);
+
+	return result;
+}
+
+static int run_workload(sysfs_accessor_t *sysfs)
+{
+	char name[8];
+	int i;
+
+	for (i = 0; i < disks_count; ++i)
+	{
+		snprintf(name, sizeof(name), "sd%c", 'a' + i);
+
+		if (is_result_failure((sysfs != NULL) ? read_disk_by_accessor(sysfs, name) : read_disk_by_path(name)))
+		{
+			return result_fail;
+		}
+	}
+
+	return result_success;
+}
+
+/* returns number of system calls done by workload or -1 on failure */
+static long count_syscalls(sysfs_accessor_t *sysfs)
+{
+	pid_t child;
+	int status;
+	long count = 0;
+	int in_syscall = 0;
+
+	child = fork();
+	if (child < 0)
+	{
+		return -1;
+	}
+
+	if (child == 0)
+	{
+		ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+		raise(SIGSTOP);
+		_exit(is_result_successful(run_workload(sysfs)) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	if ((waitpid(child, &status, 0) != child) || (!WIFSTOPPED(status)))
+	{
+		return -1;
+	}
+
+	ptrace(PTRACE_SETOPTIONS, child, NULL, (void*) (PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL));
+
+	for (;;)
+	{
+		if (ptrace(PTRACE_SYSCALL, child, NULL, NULL) != 0)
+		{
+			return -1;
+		}
+
+		if (waitpid(child, &status, 0) != child)
+		{
+			return -1;
+		}
+
+		if (WIFEXITED(status))
+		{
+			break;
+		}
+
+		if (WIFSTOPPED(status) && (WSTOPSIG(status) == (SIGTRAP | 0x80)))
+		{
+			if (!in_syscall)
+			{
+				++count;
+			}
+
+			in_syscall = !in_syscall;
+		}
+	}
+
+	if (WEXITSTATUS(status) != EXIT_SUCCESS)
+	{
+		return -1;
+	}
+
+	// exclude final exit_group()
+	return count - 1;
+}
+
+static double elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (double) (end->tv_sec - start->tv_sec) * 1e9 + (double) (end->tv_nsec - start->tv_nsec);
+}
+
+static int measure_time(sysfs_accessor_t *sysfs, double *result)
+{
+	struct timespec start, end;
+	size_t round;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (round = 0; round < rounds_count; ++round)
+	{
+		if (is_result_failure(run_workload(sysfs)))
+		{
+			return result_fail;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	*result = elapsed_ns(&start, &end) / (rounds_count * disks_count);
+
+	return result_success;
+}
+
+int main(int argc, char **argv)
+{
+	sysfs_root_t root;
+	sysfs_accessor_t sysfs;
+	long path_syscalls, accessor_syscalls;
+	double path_time, accessor_time;
+	int result = EXIT_FAILURE;
+
+	if (is_result_failure(create_tree()))
+	{
+		fprintf(stderr, "Failed to create sysfs tree\n");
+		remove_tree();
+		return EXIT_FAILURE;
+	}
+
+	if (is_result_failure(sysfs_root_init(&root, root_path)))
+	{
+		fprintf(stderr, "Failed to open sysfs tree\n");
+		goto main_exit_1;
+	}
+
+	sysfs_accessor_init(&sysfs, &root);
+
+	path_syscalls     = count_syscalls(NULL);
+	accessor_syscalls = count_syscalls(&sysfs);
+
+	if ((path_syscalls < 0) || (accessor_syscalls < 0))
+	{
+		fprintf(stderr, "Failed to count system calls\n");
+		goto main_exit_2;
+	}
+
+	if (is_result_failure(measure_time(NULL, &path_time))
+		|| is_result_failure(measure_time(&sysfs, &accessor_time)))
+	{
+		fprintf(stderr, "Failed to read devices\n");
+		goto main_exit_2;
+	}
+
+	printf("%10s %20s %20s\n", "method", "syscalls per disk", "ns per disk");
+	printf("%10s %20.1f %20.1f\n", "paths", (double) path_syscalls / disks_count, path_time);
+	printf("%10s %20.1f %20.1f\n", "accessor", (double) accessor_syscalls / disks_count, accessor_time);
+
+	result = EXIT_SUCCESS;
+
+main_exit_2:
+	sysfs_root_free(&root);
+
+main_exit_1:
+	remove_tree();
+
+	return result;
+}
@@ -147,6 +147,11 @@ void client_callback(dtmd_t *library, void *arg, const dt_command_t *cmd)
 			print_first(first);
 			fprintf(stdout, "Device unmounted\nPath: %s\nMount point: %s\n", cmd->args[0], cmd->args[1]);
 		}
+		else if ((strcmp(cmd->cmd, dtmd_notification_resync_required) == 0) && (cmd->args_count == 0))
+		{
+			print_first(first);
+			fprintf(stdout, "Some notifications were lost, list of devices should be requested again\n");
+		}
 	}
 }
 
@@ -68,6 +68,9 @@ Control::Control()
 	QObject::connect(this, &Control::dtmdDisconnected,
 		this, &Control::slotDtmdDisconnected, Qt::QueuedConnection);
 
+	QObject::connect(this, &Control::dtmdResyncRequired,
+		this, &Control::slotDtmdResyncRequired, Qt::QueuedConnection);
+
 	QObject::connect(this,&Control::exitSignalled,
 		this, &Control::slotExitSignalled, Qt::QueuedConnection);
 
@@ -432,6 +435,18 @@ void Control::dtmd_callback(const dtmd::library &library_instance, void *arg, co
 	{
 		std::tuple<bool, QString, QString> result(false, QString(), QString());
 
+		if (cmd.cmd == dtmd_notification_resync_required)
+		{
+			{ // lock
+				QMutexLocker devices_locker(&(ptr->m_devices_mutex));
+				ptr->m_devices_initialized = false;
+				ptr->m_saved_commands.clear();
+			} // unlock
+
+			emit ptr->dtmdResyncRequired();
+			return;
+		}
+
 		{ // lock
 			QMutexLocker devices_locker(&(ptr->m_devices_mutex));
 
@@ -707,6 +722,13 @@ void Control::slotDtmdConnected()
 	this->showMessage(success, QObject::tr("Connected to DTMD daemon"), QString(), QSystemTrayIcon::Information, Control::defaultTimeout);
 }
 
+void Control::slotDtmdResyncRequired()
+{
+	populate_devices();
+
+	BuildMenu();
+}
+
 void Control::slotDtmdDisconnected()
 {
 	{ // lock
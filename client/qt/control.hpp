@@ -108,6 +108,7 @@ private slots:
 	void exit();
 	void slotDtmdConnected();
 	void slotDtmdDisconnected();
+	void slotDtmdResyncRequired();
 	void slotExitSignalled(QString title, QString message);
 
 signals:
@@ -116,6 +117,7 @@ signals:
 
 	void dtmdConnected();
 	void dtmdDisconnected();
+	void dtmdResyncRequired();
 	void exitSignalled(QString title, QString message);
 };
 
@@ -18,12 +18,9 @@
  *
  */
 
-#if (defined OS_FreeBSD)
-#define _WITH_DPRINTF
-#endif /* (defined OS_FreeBSD) */
-
 #include "daemon/actions.h"
 
+#include "daemon/client_io.h"
 #include "daemon/filesystem_mnt.h"
 #include "daemon/filesystem_opts.h"
 #include "daemon/poweroff.h"
@@ -36,7 +33,7 @@
 #include <string.h>
 
 static int print_removable_device_common(const char *action,
-	struct client *client_ptr,
+	client_message_t **message_ptr,
 	const char *parent_path,
 	const char *path,
 	dtmd_removable_media_type_t media_type,
@@ -47,9 +44,13 @@ static int print_removable_device_common(const char *action,
 	const char *mnt_point,
 	const char *mnt_opts);
 
-static int print_all_removable_devices_recursive(struct client *client_ptr, dtmd_removable_media_t *media_ptr);
+static int print_all_removable_devices_recursive(client_message_t **message_ptr, dtmd_removable_media_t *media_ptr);
+
+static int print_all_removable_devices(client_message_t **message_ptr);
+
+static int send_removable_devices(struct client *client_ptr, dtmd_removable_media_t *media_ptr);
 
-static int print_all_removable_devices(struct client *client_ptr);
+static int invoke_tagged_command(struct client *client_ptr, dt_command_t *cmd);
 
 int invoke_command(struct client *client_ptr, dt_command_t *cmd)
 {
@@ -60,20 +61,22 @@ int invoke_command(struct client *client_ptr, dt_command_t *cmd)
 
 	if ((strcmp(cmd->cmd, dtmd_command_list_all_removable_devices) == 0) && (cmd->args_count == 0))
 	{
-		if (dprintf(client_ptr->clientfd, dtmd_response_started "(%zu " dtmd_command_list_all_removable_devices ")\n",
-			strlen(dtmd_command_list_all_removable_devices)) < 0)
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_started "(%s%zu " dtmd_command_list_all_removable_devices ")\n",
+			client_ptr->request_tag,
+			strlen(dtmd_command_list_all_removable_devices))))
 		{
 			return result_client_error;
 		}
 
-		rc = print_all_removable_devices(client_ptr);
+		rc = send_removable_devices(client_ptr, NULL);
 		if (is_result_failure(rc))
 		{
 			return rc;
 		}
 
-		if (dprintf(client_ptr->clientfd, dtmd_response_finished "(%zu " dtmd_command_list_all_removable_devices ")\n",
-			strlen(dtmd_command_list_all_removable_devices)) < 0)
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_finished "(%s%zu " dtmd_command_list_all_removable_devices ")\n",
+			client_ptr->request_tag,
+			strlen(dtmd_command_list_all_removable_devices))))
 		{
 			return result_client_error;
 		}
@@ -88,13 +91,14 @@ int invoke_command(struct client *client_ptr, dt_command_t *cmd)
 		}
 		else
 		{
-			media_ptr = dtmd_find_media(cmd->args[0], removable_media_root);
+			media_ptr = find_media(cmd->args[0]);
 			if (media_ptr == NULL)
 			{
-				if (dprintf(client_ptr->clientfd, dtmd_response_failed "(%zu " dtmd_command_list_removable_device ", %d%s%s, %d%s%s)\n",
+				if (is_result_failure(client_printf(client_ptr, dtmd_response_failed "(%s%zu " dtmd_command_list_removable_device ", %d%s%s, %d%s%s)\n",
+					client_ptr->request_tag,
 					strlen(dtmd_command_list_removable_device),
 					dt_helper_print_with_all_checks(cmd->args[0]),
-					dt_helper_print_with_all_checks(dtmd_error_code_to_string(dtmd_error_code_no_such_removable_device))) < 0)
+					dt_helper_print_with_all_checks(dtmd_error_code_to_string(dtmd_error_code_no_such_removable_device)))))
 				{
 					return result_client_error;
 				}
@@ -103,30 +107,25 @@ int invoke_command(struct client *client_ptr, dt_command_t *cmd)
 			}
 		}
 
-		if (dprintf(client_ptr->clientfd, dtmd_response_started "(%zu " dtmd_command_list_removable_device ", %d%s%s)\n",
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_started "(%s%zu " dtmd_command_list_removable_device ", %d%s%s)\n",
+			client_ptr->request_tag,
 			strlen(dtmd_command_list_removable_device),
-			dt_helper_print_with_all_checks(cmd->args[0])) < 0)
+			dt_helper_print_with_all_checks(cmd->args[0]))))
 		{
 			return result_client_error;
 		}
 
-		if (is_parent_path)
-		{
-			rc = print_all_removable_devices(client_ptr);
-		}
-		else
-		{
-			rc = print_all_removable_devices_recursive(client_ptr, media_ptr);
-		}
+		rc = send_removable_devices(client_ptr, (is_parent_path) ? NULL : media_ptr);
 
 		if (is_result_failure(rc))
 		{
 			return rc;
 		}
 
-		if (dprintf(client_ptr->clientfd, dtmd_response_finished "(%zu " dtmd_command_list_removable_device ", %d%s%s)\n",
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_finished "(%s%zu " dtmd_command_list_removable_device ", %d%s%s)\n",
+			client_ptr->request_tag,
 			strlen(dtmd_command_list_removable_device),
-			dt_helper_print_with_all_checks(cmd->args[0])) < 0)
+			dt_helper_print_with_all_checks(cmd->args[0]))))
 		{
 			return result_client_error;
 		}
@@ -135,57 +134,11 @@ int invoke_command(struct client *client_ptr, dt_command_t *cmd)
 	}
 	else if ((strcmp(cmd->cmd, dtmd_command_mount) == 0) && (cmd->args_count == 2) && (cmd->args[0] != NULL))
 	{
-		rc = invoke_mount(client_ptr, cmd->args[0], cmd->args[1], mount_by_value, &error_code);
-
-		if (is_result_successful(rc))
-		{
-			if (dprintf(client_ptr->clientfd, dtmd_response_succeeded "(%zu " dtmd_command_mount ", %d%s%s, %d%s%s)\n",
-				strlen(dtmd_command_mount),
-				dt_helper_print_with_all_checks(cmd->args[0]),
-				dt_helper_print_with_all_checks(cmd->args[1])) < 0)
-			{
-				return result_client_error;
-			}
-		}
-		else
-		{
-			if (dprintf(client_ptr->clientfd, dtmd_response_failed "(%zu " dtmd_command_mount ", %d%s%s, %d%s%s, %d%s%s)\n",
-				strlen(dtmd_command_mount),
-				dt_helper_print_with_all_checks(cmd->args[0]),
-				dt_helper_print_with_all_checks(cmd->args[1]),
-				dt_helper_print_with_all_checks(dtmd_error_code_to_string(error_code))) < 0)
-			{
-				return result_client_error;
-			}
-		}
-
-		return rc;
+		return invoke_mount(client_ptr, cmd->args[0], cmd->args[1], mount_by_value);
 	}
 	else if ((strcmp(cmd->cmd, dtmd_command_unmount) == 0) && (cmd->args_count == 1) && (cmd->args[0] != NULL))
 	{
-		rc = invoke_unmount(client_ptr, cmd->args[0], &error_code);
-
-		if (is_result_successful(rc))
-		{
-			if (dprintf(client_ptr->clientfd, dtmd_response_succeeded "(%zu " dtmd_command_unmount ", %d%s%s)\n",
-				strlen(dtmd_command_unmount),
-				dt_helper_print_with_all_checks(cmd->args[0])) < 0)
-			{
-				return result_client_error;
-			}
-		}
-		else
-		{
-			if (dprintf(client_ptr->clientfd, dtmd_response_failed "(%zu " dtmd_command_unmount ", %d%s%s, %d%s%s)\n",
-				strlen(dtmd_command_unmount),
-				dt_helper_print_with_all_checks(cmd->args[0]),
-				dt_helper_print_with_all_checks(dtmd_error_code_to_string(error_code))) < 0)
-			{
-				return result_client_error;
-			}
-		}
-
-		return rc;
+		return invoke_unmount(client_ptr, cmd->args[0]);
 	}
 	else if ((strcmp(cmd->cmd, dtmd_command_list_supported_filesystems) == 0) && (cmd->args_count == 0))
 	{
@@ -201,19 +154,21 @@ int invoke_command(struct client *client_ptr, dt_command_t *cmd)
 
 		if (is_result_successful(rc))
 		{
-			if (dprintf(client_ptr->clientfd, dtmd_response_succeeded "(%zu " dtmd_command_poweroff ", %d%s%s)\n",
+			if (is_result_failure(client_printf(client_ptr, dtmd_response_succeeded "(%s%zu " dtmd_command_poweroff ", %d%s%s)\n",
+				client_ptr->request_tag,
 				strlen(dtmd_command_poweroff),
-				dt_helper_print_with_all_checks(cmd->args[0])) < 0)
+				dt_helper_print_with_all_checks(cmd->args[0]))))
 			{
 				return result_client_error;
 			}
 		}
 		else
 		{
-			if (dprintf(client_ptr->clientfd, dtmd_response_failed "(%zu " dtmd_command_poweroff ", %d%s%s, %d%s%s)\n",
+			if (is_result_failure(client_printf(client_ptr, dtmd_response_failed "(%s%zu " dtmd_command_poweroff ", %d%s%s, %d%s%s)\n",
+				client_ptr->request_tag,
 				strlen(dtmd_command_poweroff),
 				dt_helper_print_with_all_checks(cmd->args[0]),
-				dt_helper_print_with_all_checks(dtmd_error_code_to_string(error_code))) < 0)
+				dt_helper_print_with_all_checks(dtmd_error_code_to_string(error_code)))))
 			{
 				return result_client_error;
 			}
@@ -221,12 +176,154 @@ int invoke_command(struct client *client_ptr, dt_command_t *cmd)
 
 		return rc;
 	}
+	else if ((strcmp(cmd->cmd, dtmd_command_request_ids) == 0) && (cmd->args_count == 0))
+	{
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_succeeded "(%s%zu " dtmd_command_request_ids ")\n",
+			client_ptr->request_tag,
+			strlen(dtmd_command_request_ids))))
+		{
+			return result_client_error;
+		}
+
+		return result_success;
+	}
+	else if ((strcmp(cmd->cmd, dtmd_command_tagged_request) == 0)
+		&& (cmd->args_count >= 2)
+		&& (cmd->args[0] != NULL)
+		&& (cmd->args[1] != NULL)
+		&& (client_ptr->request_tag[0] == 0))
+	{
+		return invoke_tagged_command(client_ptr, cmd);
+	}
 	else
 	{
 		return result_fail;
 	}
 }
 
+static int invoke_tagged_command(struct client *client_ptr, dt_command_t *cmd)
+{
+	int rc;
+	size_t id_length;
+	dt_command_t tagged_cmd;
+
+	id_length = strlen(cmd->args[0]);
+	if ((id_length == 0) || (id_length > dtmd_request_id_max_length))
+	{
+		return result_fail;
+	}
+
+	// tagged command only refers to arguments of original command
+	tagged_cmd.cmd        = cmd->args[1];
+	tagged_cmd.args_count = cmd->args_count - 2;
+	tagged_cmd.args       = &(cmd->args[2]);
+
+	snprintf(client_ptr->request_tag, sizeof(client_ptr->request_tag), "%zu %s, ", id_length, cmd->args[0]);
+
+	rc = invoke_command(client_ptr, &tagged_cmd);
+
+	client_ptr->request_tag[0] = 0;
+
+	return rc;
+}
+
+int send_mount_result(struct client *client_ptr, const char *request_tag, const char *path, const char *mount_options, int result, dtmd_error_code_t error_code)
+{
+	if (is_result_successful(result))
+	{
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_succeeded "(%s%zu " dtmd_command_mount ", %d%s%s, %d%s%s)\n",
+			request_tag,
+			strlen(dtmd_command_mount),
+			dt_helper_print_with_all_checks(path),
+			dt_helper_print_with_all_checks(mount_options))))
+		{
+			return result_client_error;
+		}
+	}
+	else
+	{
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_failed "(%s%zu " dtmd_command_mount ", %d%s%s, %d%s%s, %d%s%s)\n",
+			request_tag,
+			strlen(dtmd_command_mount),
+			dt_helper_print_with_all_checks(path),
+			dt_helper_print_with_all_checks(mount_options),
+			dt_helper_print_with_all_checks(dtmd_error_code_to_string(error_code)))))
+		{
+			return result_client_error;
+		}
+	}
+
+	return result_success;
+}
+
+int send_unmount_result(struct client *client_ptr, const char *request_tag, const char *path, int result, dtmd_error_code_t error_code)
+{
+	if (is_result_successful(result))
+	{
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_succeeded "(%s%zu " dtmd_command_unmount ", %d%s%s)\n",
+			request_tag,
+			strlen(dtmd_command_unmount),
+			dt_helper_print_with_all_checks(path))))
+		{
+			return result_client_error;
+		}
+	}
+	else
+	{
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_failed "(%s%zu " dtmd_command_unmount ", %d%s%s, %d%s%s)\n",
+			request_tag,
+			strlen(dtmd_command_unmount),
+			dt_helper_print_with_all_checks(path),
+			dt_helper_print_with_all_checks(dtmd_error_code_to_string(error_code)))))
+		{
+			return result_client_error;
+		}
+	}
+
+	return result_success;
+}
+
+/* sends whole tree if media_ptr is NULL */
+static int send_removable_devices(struct client *client_ptr, dtmd_removable_media_t *media_ptr)
+{
+	int rc;
+	client_message_t *message;
+
+	message = client_message_new();
+	if (message == NULL)
+	{
+		return result_fatal_error;
+	}
+
+	if (media_ptr != NULL)
+	{
+		rc = print_all_removable_devices_recursive(&message, media_ptr);
+	}
+	else
+	{
+		rc = print_all_removable_devices(&message);
+	}
+
+	if (is_result_successful(rc))
+	{
+		rc = client_send(client_ptr, message);
+	}
+
+	client_message_unref(message);
+
+	return rc;
+}
+
+static void notify_all_clients(client_message_t *message)
+{
+	struct client *cur_client;
+
+	for (cur_client = client_root; cur_client != NULL; cur_client = cur_client->next_node)
+	{
+		client_notify(cur_client, message);
+	}
+}
+
 void notify_removable_device_added(const char *parent_path,
 	const char *path,
 	dtmd_removable_media_type_t media_type,
@@ -237,32 +334,54 @@ void notify_removable_device_added(const char *parent_path,
 	const char *mnt_point,
 	const char *mnt_opts)
 {
-	struct client *cur_client;
+	client_message_t *message;
 
-	for (cur_client = client_root; cur_client != NULL; cur_client = cur_client->next_node)
+	if (client_root == NULL)
+	{
+		return;
+	}
+
+	message = client_message_new();
+	if (message == NULL)
+	{
+		return;
+	}
+
+	if (is_result_successful(print_removable_device_common(dtmd_notification_removable_device_added,
+		&message,
+		parent_path,
+		path,
+		media_type,
+		media_subtype,
+		state,
+		fstype,
+		label,
+		mnt_point,
+		mnt_opts)))
 	{
-		print_removable_device_common(dtmd_notification_removable_device_added,
-			cur_client,
-			parent_path,
-			path,
-			media_type,
-			media_subtype,
-			state,
-			fstype,
-			label,
-			mnt_point,
-			mnt_opts);
+		notify_all_clients(message);
 	}
+
+	client_message_unref(message);
 }
 
 void notify_removable_device_removed(const char *path)
 {
-	struct client *cur_client;
+	client_message_t *message;
 
-	for (cur_client = client_root; cur_client != NULL; cur_client = cur_client->next_node)
+	if (client_root == NULL)
+	{
+		return;
+	}
+
+	message = client_message_printf(dtmd_notification_removable_device_removed "(%zu %s)\n", strlen(path), path);
+	if (message == NULL)
 	{
-		dprintf(cur_client->clientfd, dtmd_notification_removable_device_removed "(%zu %s)\n", strlen(path), path);
+		return;
 	}
+
+	notify_all_clients(message);
+	client_message_unref(message);
 }
 
 void notify_removable_device_changed(const char *parent_path,
@@ -275,51 +394,82 @@ void notify_removable_device_changed(const char *parent_path,
 	const char *mnt_point,
 	const char *mnt_opts)
 {
-	struct client *cur_client;
+	client_message_t *message;
 
-	for (cur_client = client_root; cur_client != NULL; cur_client = cur_client->next_node)
+	if (client_root == NULL)
+	{
+		return;
+	}
+
+	message = client_message_new();
+	if (message == NULL)
 	{
-		print_removable_device_common(dtmd_notification_removable_device_changed,
-			cur_client,
-			parent_path,
-			path,
-			media_type,
-			media_subtype,
-			state,
-			fstype,
-			label,
-			mnt_point,
-			mnt_opts);
+		return;
 	}
+
+	if (is_result_successful(print_removable_device_common(dtmd_notification_removable_device_changed,
+		&message,
+		parent_path,
+		path,
+		media_type,
+		media_subtype,
+		state,
+		fstype,
+		label,
+		mnt_point,
+		mnt_opts)))
+	{
+		notify_all_clients(message);
+	}
+
+	client_message_unref(message);
 }
 
 void notify_removable_device_mounted(const char *path, const char *mount_point, const char *mount_options)
 {
-	struct client *cur_client;
+	client_message_t *message;
 
-	for (cur_client = client_root; cur_client != NULL; cur_client = cur_client->next_node)
+	if (client_root == NULL)
+	{
+		return;
+	}
+
+	message = client_message_printf(dtmd_notification_removable_device_mounted "(%zu %s, %zu %s, %d%s%s)\n",
+		strlen(path), path,
+		strlen(mount_point), mount_point,
+		dt_helper_print_with_all_checks(mount_options));
+	if (message == NULL)
 	{
-		dprintf(cur_client->clientfd, dtmd_notification_removable_device_mounted "(%zu %s, %zu %s, %d%s%s)\n",
-			strlen(path), path,
-			strlen(mount_point), mount_point,
-			dt_helper_print_with_all_checks(mount_options));
+		return;
 	}
+
+	notify_all_clients(message);
+	client_message_unref(message);
 }
 
 void notify_removable_device_unmounted(const char *path, const char *mount_point)
 {
-	struct client *cur_client;
+	client_message_t *message;
 
-	for (cur_client = client_root; cur_client != NULL; cur_client = cur_client->next_node)
+	if (client_root == NULL)
 	{
-		dprintf(cur_client->clientfd, dtmd_notification_removable_device_unmounted "(%zu %s, %zu %s)\n",
-			strlen(path), path,
-			strlen(mount_point), mount_point);
+		return;
 	}
+
+	message = client_message_printf(dtmd_notification_removable_device_unmounted "(%zu %s, %zu %s)\n",
+		strlen(path), path,
+		strlen(mount_point), mount_point);
+	if (message == NULL)
+	{
+		return;
+	}
+
+	notify_all_clients(message);
+	client_message_unref(message);
 }
 
 static int print_removable_device_common(const char *action,
-	struct client *client_ptr,
+	client_message_t **message_ptr,
 	const char *parent_path,
 	const char *path,
 	dtmd_removable_media_type_t media_type,
@@ -330,12 +480,10 @@ static int print_removable_device_common(const char *action,
 	const char *mnt_point,
 	const char *mnt_opts)
 {
-	int rc = result_success;
-
 	switch (media_type)
 	{
 	case dtmd_removable_media_type_device_partition:
-		if (dprintf(client_ptr->clientfd, "%s(%d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s)\n",
+		return client_message_append(message_ptr, "%s(%d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s)\n",
 			action,
 			dt_helper_print_with_all_checks(parent_path),
 			dt_helper_print_with_all_checks(path),
@@ -343,26 +491,18 @@ static int print_removable_device_common(const char *action,
 			dt_helper_print_with_all_checks(fstype),
 			dt_helper_print_with_all_checks(label),
 			dt_helper_print_with_all_checks(mnt_point),
-			dt_helper_print_with_all_checks(mnt_opts)) < 0)
-		{
-			rc = result_client_error;
-		}
-		break;
+			dt_helper_print_with_all_checks(mnt_opts));
 
 	case dtmd_removable_media_type_stateless_device:
-		if (dprintf(client_ptr->clientfd, "%s(%d%s%s, %d%s%s, %d%s%s, %d%s%s)\n",
+		return client_message_append(message_ptr, "%s(%d%s%s, %d%s%s, %d%s%s, %d%s%s)\n",
 			action,
 			dt_helper_print_with_all_checks(parent_path),
 			dt_helper_print_with_all_checks(path),
 			dt_helper_print_with_all_checks(dtmd_device_type_to_string(media_type)),
-			dt_helper_print_with_all_checks(dtmd_device_subtype_to_string(media_subtype))) < 0)
-		{
-			rc = result_client_error;
-		}
-		break;
+			dt_helper_print_with_all_checks(dtmd_device_subtype_to_string(media_subtype)));
 
 	case dtmd_removable_media_type_stateful_device:
-		if (dprintf(client_ptr->clientfd, "%s(%d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s)\n",
+		return client_message_append(message_ptr, "%s(%d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s, %d%s%s)\n",
 			action,
 			dt_helper_print_with_all_checks(parent_path),
 			dt_helper_print_with_all_checks(path),
@@ -372,28 +512,21 @@ static int print_removable_device_common(const char *action,
 			dt_helper_print_with_all_checks(fstype),
 			dt_helper_print_with_all_checks(label),
 			dt_helper_print_with_all_checks(mnt_point),
-			dt_helper_print_with_all_checks(mnt_opts)) < 0)
-		{
-			rc = result_client_error;
-		}
-		break;
+			dt_helper_print_with_all_checks(mnt_opts));
 
 	case dtmd_removable_media_type_unknown_or_persistent:
 	default:
-		rc = result_fail;
-		break;
+		return result_fail;
 	}
-
-	return rc;
 }
 
-static int print_all_removable_devices_recursive(struct client *client_ptr, dtmd_removable_media_t *media_ptr)
+static int print_all_removable_devices_recursive(client_message_t **message_ptr, dtmd_removable_media_t *media_ptr)
 {
 	int rc;
 	dtmd_removable_media_t *iter_media_ptr;
 
 	rc = print_removable_device_common(dtmd_response_argument_removable_device,
-		client_ptr,
+		message_ptr,
 		((media_ptr->parent != NULL) ? media_ptr->parent->path : dtmd_root_device_path),
 		media_ptr->path,
 		media_ptr->type,
@@ -411,7 +544,7 @@ static int print_all_removable_devices_recursive(struct client *client_ptr, dtmd
 
 	for (iter_media_ptr = media_ptr->children_list; iter_media_ptr != NULL; iter_media_ptr = iter_media_ptr->next_node)
 	{
-		rc = print_all_removable_devices_recursive(client_ptr, iter_media_ptr);
+		rc = print_all_removable_devices_recursive(message_ptr, iter_media_ptr);
 		if (is_result_failure(rc))
 		{
 			return rc;
@@ -421,14 +554,14 @@ static int print_all_removable_devices_recursive(struct client *client_ptr, dtmd
 	return result_success;
 }
 
-static int print_all_removable_devices(struct client *client_ptr)
+static int print_all_removable_devices(client_message_t **message_ptr)
 {
 	int rc;
 	dtmd_removable_media_t *iter_media_ptr;
 
 	for (iter_media_ptr = removable_media_root; iter_media_ptr != NULL; iter_media_ptr = iter_media_ptr->next_node)
 	{
-		rc = print_all_removable_devices_recursive(client_ptr, iter_media_ptr);
+		rc = print_all_removable_devices_recursive(message_ptr, iter_media_ptr);
 		if (is_result_failure(rc))
 		{
 			return rc;
@@ -33,6 +33,10 @@ extern "C" {
 
 int invoke_command(struct client *client_ptr, dt_command_t *cmd);
 
+/* replies for asynchronously executed commands */
+int send_mount_result(struct client *client_ptr, const char *request_tag, const char *path, const char *mount_options, int result, dtmd_error_code_t error_code);
+int send_unmount_result(struct client *client_ptr, const char *request_tag, const char *path, int result, dtmd_error_code_t error_code);
+
 void notify_removable_device_added(const char *parent_path,
 	const char *path,
 	dtmd_removable_media_type_t media_type,
@@ -0,0 +1,529 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "daemon/client_io.h"
+
+#include "daemon/config_file.h"
+#include "daemon/event_loop.h"
+#include "daemon/log.h"
+#include "daemon/mount_jobs.h"
+#include "daemon/return_codes.h"
+
+#include <dtmd.h>
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define client_message_min_capacity 1024
+#define client_queue_min_capacity 8
+#define client_iov_max 64
+
+static client_message_t* client_message_alloc(size_t capacity)
+{
+	client_message_t *message;
+
+	// one more byte for terminating zero written by vsnprintf
+	message = (client_message_t*) malloc(sizeof(client_message_t) + capacity + 1);
+	if (message == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return NULL;
+	}
+
+	message->refcount = 1;
+	message->size = 0;
+	message->capacity = capacity;
+
+	return message;
+}
+
+static int client_message_vprintf(client_message_t **message_ptr, const char *format, va_list args)
+{
+	client_message_t *message = *message_ptr;
+	va_list args_copy;
+	size_t new_capacity;
+	void *tmp;
+	int len;
+
+	// usually message fits into already allocated buffer and has to be formatted only once
+	va_copy(args_copy, args);
+	len = vsnprintf(&(message->data[message->size]), message->capacity - message->size + 1, format, args_copy);
+	va_end(args_copy);
+
+	if (len < 0)
+	{
+		return result_fail;
+	}
+
+	if ((size_t) len > message->capacity - message->size)
+	{
+		new_capacity = message->capacity * 2;
+		if (new_capacity < message->size + len)
+		{
+			new_capacity = message->size + len;
+		}
+
+		tmp = realloc(message, sizeof(client_message_t) + new_capacity + 1);
+		if (tmp == NULL)
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			return result_fatal_error;
+		}
+
+		message = (client_message_t*) tmp;
+		message->capacity = new_capacity;
+		*message_ptr = message;
+
+		vsnprintf(&(message->data[message->size]), len + 1, format, args);
+	}
+
+	message->size += len;
+
+	return result_success;
+}
+
+client_message_t* client_message_new(void)
+{
+	return client_message_alloc(client_message_min_capacity);
+}
+
+int client_message_append(client_message_t **message_ptr, const char *format, ...)
+{
+	va_list args;
+	int rc;
+
+	va_start(args, format);
+	rc = client_message_vprintf(message_ptr, format, args);
+	va_end(args);
+
+	return rc;
+}
+
+client_message_t* client_message_printf(const char *format, ...)
+{
+	client_message_t *message;
+	va_list args;
+	int rc;
+
+	message = client_message_new();
+	if (message == NULL)
+	{
+		return NULL;
+	}
+
+	va_start(args, format);
+	rc = client_message_vprintf(&message, format, args);
+	va_end(args);
+
+	if (is_result_failure(rc))
+	{
+		free(message);
+		return NULL;
+	}
+
+	return message;
+}
+
+void client_message_unref(client_message_t *message)
+{
+	--(message->refcount);
+
+	if (message->refcount == 0)
+	{
+		free(message);
+	}
+}
+
+static struct client_queue_item* client_queue_tail(struct client *client_ptr)
+{
+	if (client_ptr->outqueue_count == 0)
+	{
+		return NULL;
+	}
+
+	return &(client_ptr->outqueue[(client_ptr->outqueue_head + client_ptr->outqueue_count - 1) % client_ptr->outqueue_capacity]);
+}
+
+static int client_queue_push(struct client *client_ptr, client_message_t *message, size_t offset)
+{
+	struct client_queue_item *new_queue;
+	struct client_queue_item *item;
+	size_t new_capacity;
+	size_t i;
+
+	if (client_ptr->outqueue_count == client_ptr->outqueue_capacity)
+	{
+		new_capacity = (client_ptr->outqueue_capacity > 0) ? (client_ptr->outqueue_capacity * 2) : client_queue_min_capacity;
+
+		new_queue = (struct client_queue_item*) malloc(sizeof(struct client_queue_item) * new_capacity);
+		if (new_queue == NULL)
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			return result_fatal_error;
+		}
+
+		for (i = 0; i < client_ptr->outqueue_count; ++i)
+		{
+			new_queue[i] = client_ptr->outqueue[(client_ptr->outqueue_head + i) % client_ptr->outqueue_capacity];
+		}
+
+		free(client_ptr->outqueue);
+
+		client_ptr->outqueue = new_queue;
+		client_ptr->outqueue_capacity = new_capacity;
+		client_ptr->outqueue_head = 0;
+	}
+
+	item = &(client_ptr->outqueue[(client_ptr->outqueue_head + client_ptr->outqueue_count) % client_ptr->outqueue_capacity]);
+	item->message = message;
+	item->offset = offset;
+
+	++(message->refcount);
+	++(client_ptr->outqueue_count);
+	client_ptr->outqueue_bytes += message->size - offset;
+
+	return result_success;
+}
+
+static int client_handle_overflow(struct client *client_ptr)
+{
+	switch (client_overflow_policy)
+	{
+	case client_overflow_drop:
+		return result_fail;
+
+	case client_overflow_resync:
+		client_ptr->is_overflown = 1;
+		return result_fail;
+
+	case client_overflow_disconnect:
+	default:
+		WRITE_LOG(LOG_WARNING, "Client's queue is full, disconnecting client");
+		schedule_client_removal(client_ptr);
+		return result_client_error;
+	}
+}
+
+int client_printf(struct client *client_ptr, const char *format, ...)
+{
+	struct client_queue_item *item;
+	client_message_t *message;
+	size_t old_size;
+	va_list args;
+	int rc;
+
+	if (client_ptr->is_removal_scheduled)
+	{
+		return result_client_error;
+	}
+
+	// responses are appended to last message in queue if nobody else uses it
+	item = client_queue_tail(client_ptr);
+	if ((item != NULL) && (item->message->refcount == 1))
+	{
+		message = item->message;
+	}
+	else
+	{
+		message = client_message_alloc(client_message_min_capacity);
+		if (message == NULL)
+		{
+			schedule_client_removal(client_ptr);
+			return result_client_error;
+		}
+
+		rc = client_queue_push(client_ptr, message, 0);
+		client_message_unref(message);
+
+		if (is_result_failure(rc))
+		{
+			schedule_client_removal(client_ptr);
+			return result_client_error;
+		}
+
+		item = client_queue_tail(client_ptr);
+	}
+
+	old_size = message->size;
+
+	va_start(args, format);
+	rc = client_message_vprintf(&(item->message), format, args);
+	va_end(args);
+
+	if (is_result_failure(rc))
+	{
+		schedule_client_removal(client_ptr);
+		return result_client_error;
+	}
+
+	client_ptr->outqueue_bytes += item->message->size - old_size;
+
+	if ((!client_ptr->is_corked) && (!client_ptr->is_write_blocked))
+	{
+		return client_flush(client_ptr);
+	}
+
+	return result_success;
+}
+
+static int client_send_common(struct client *client_ptr, client_message_t *message, int is_notification)
+{
+	ssize_t rc;
+	size_t offset = 0;
+
+	if (client_ptr->is_removal_scheduled)
+	{
+		return result_client_error;
+	}
+
+	// client is going to resync anyway, don't bother it with anything else until then
+	if (is_notification && client_ptr->is_overflown)
+	{
+		return result_fail;
+	}
+
+	// responses aren't limited: commands aren't executed while queue is filled by half, so they can't pile up
+	if (is_notification && (client_ptr->outqueue_bytes + message->size > client_queue_size))
+	{
+		return client_handle_overflow(client_ptr);
+	}
+
+	// if nothing is queued, try sending shared buffer directly
+	if ((client_ptr->outqueue_count == 0) && (!client_ptr->is_corked) && (!client_ptr->is_write_blocked))
+	{
+		while (offset < message->size)
+		{
+			rc = write(client_ptr->clientfd, &(message->data[offset]), message->size - offset);
+			if (rc < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				{
+					break;
+				}
+
+				schedule_client_removal(client_ptr);
+				return result_client_error;
+			}
+
+			offset += rc;
+		}
+
+		if (offset == message->size)
+		{
+			return result_success;
+		}
+	}
+
+	if (is_result_failure(client_queue_push(client_ptr, message, offset)))
+	{
+		schedule_client_removal(client_ptr);
+		return result_client_error;
+	}
+
+	if ((!client_ptr->is_corked) && (!client_ptr->is_write_blocked))
+	{
+		return client_flush(client_ptr);
+	}
+
+	return result_success;
+}
+
+int client_send(struct client *client_ptr, client_message_t *message)
+{
+	return client_send_common(client_ptr, message, 0);
+}
+
+int client_notify(struct client *client_ptr, client_message_t *message)
+{
+	return client_send_common(client_ptr, message, 1);
+}
+
+void client_cork(struct client *client_ptr)
+{
+	client_ptr->is_corked = 1;
+}
+
+int client_uncork(struct client *client_ptr)
+{
+	client_ptr->is_corked = 0;
+
+	if (!client_ptr->is_write_blocked)
+	{
+		return client_flush(client_ptr);
+	}
+
+	return result_success;
+}
+
+int client_flush(struct client *client_ptr)
+{
+	struct iovec iov[client_iov_max];
+	struct client_queue_item *item;
+	ssize_t rc;
+	size_t left;
+	size_t i;
+	int iov_count;
+	unsigned char write_blocked = 0;
+
+	if (client_ptr->is_removal_scheduled)
+	{
+		return result_client_error;
+	}
+
+	while (client_ptr->outqueue_count > 0)
+	{
+		for (i = 0, iov_count = 0; (i < client_ptr->outqueue_count) && (iov_count < client_iov_max); ++i, ++iov_count)
+		{
+			item = &(client_ptr->outqueue[(client_ptr->outqueue_head + i) % client_ptr->outqueue_capacity]);
+
+			iov[iov_count].iov_base = &(item->message->data[item->offset]);
+			iov[iov_count].iov_len  = item->message->size - item->offset;
+		}
+
+		rc = writev(client_ptr->clientfd, iov, iov_count);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			{
+				write_blocked = 1;
+				break;
+			}
+
+			schedule_client_removal(client_ptr);
+			return result_client_error;
+		}
+
+		client_ptr->outqueue_bytes -= rc;
+
+		while (client_ptr->outqueue_count > 0)
+		{
+			item = &(client_ptr->outqueue[client_ptr->outqueue_head]);
+			left = item->message->size - item->offset;
+
+			if ((size_t) rc < left)
+			{
+				item->offset += rc;
+				break;
+			}
+
+			rc -= left;
+			client_message_unref(item->message);
+
+			client_ptr->outqueue_head = (client_ptr->outqueue_head + 1) % client_ptr->outqueue_capacity;
+			--(client_ptr->outqueue_count);
+		}
+	}
+
+	if (write_blocked != client_ptr->is_write_blocked)
+	{
+		if (is_result_failure(event_loop_modify(client_ptr->clientfd, (client_ptr->is_throttled ? 0 : event_loop_read) | (write_blocked ? event_loop_write : 0), client_ptr)))
+		{
+			schedule_client_removal(client_ptr);
+			return result_client_error;
+		}
+
+		client_ptr->is_write_blocked = write_blocked;
+	}
+
+	if ((!write_blocked) && (client_ptr->is_overflown))
+	{
+		client_ptr->is_overflown = 0;
+
+		return client_printf(client_ptr, dtmd_notification_resync_required "()\n");
+	}
+
+	return result_success;
+}
+
+int client_throttle(struct client *client_ptr, unsigned char is_throttled)
+{
+	if (is_throttled != client_ptr->is_throttled)
+	{
+		if (is_result_failure(event_loop_modify(client_ptr->clientfd, (is_throttled ? 0 : event_loop_read) | (client_ptr->is_write_blocked ? event_loop_write : 0), client_ptr)))
+		{
+			schedule_client_removal(client_ptr);
+			return result_client_error;
+		}
+
+		client_ptr->is_throttled = is_throttled;
+	}
+
+	return result_success;
+}
+
+void client_free_queue(struct client *client_ptr)
+{
+	while (client_ptr->outqueue_count > 0)
+	{
+		client_message_unref(client_ptr->outqueue[client_ptr->outqueue_head].message);
+
+		client_ptr->outqueue_head = (client_ptr->outqueue_head + 1) % client_ptr->outqueue_capacity;
+		--(client_ptr->outqueue_count);
+	}
+
+	free(client_ptr->outqueue);
+
+	client_ptr->outqueue = NULL;
+	client_ptr->outqueue_capacity = 0;
+	client_ptr->outqueue_head = 0;
+	client_ptr->outqueue_bytes = 0;
+}
+
+void schedule_client_removal(struct client *client_ptr)
+{
+	if (!client_ptr->is_removal_scheduled)
+	{
+		client_ptr->is_removal_scheduled = 1;
+		++clients_scheduled_for_removal;
+	}
+}
+
+void remove_scheduled_clients(void)
+{
+	struct client *cur_client;
+	struct client *next_client;
+
+	for (cur_client = client_root; (cur_client != NULL) && (clients_scheduled_for_removal > 0); cur_client = next_client)
+	{
+		next_client = cur_client->next_node;
+
+		if (cur_client->is_removal_scheduled)
+		{
+			event_loop_remove(cur_client->clientfd);
+			mount_jobs_detach_client(cur_client);
+			remove_client(cur_client);
+		}
+	}
+}
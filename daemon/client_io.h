@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DTMD_CLIENT_IO_H
+#define DTMD_CLIENT_IO_H
+
+#include "daemon/lists.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Client sockets are non-blocking. All output is put into per-client queue
+ * and sent as soon as socket allows it, rest of queue is sent when socket becomes writable.
+ *
+ * Queue consists of references to refcounted messages, this way
+ * each notification is formatted only once and same buffer is shared between all clients.
+ *
+ * Size of queue limits only notifications, those which don't fit into queue are handled according to client_overflow_policy.
+ * Responses are always queued, their amount is limited by executing client's commands only while queue is filled less than by half.
+ */
+
+typedef struct client_message
+{
+	size_t refcount;
+	size_t size;
+	size_t capacity;
+	char data[];
+} client_message_t;
+
+struct client_queue_item
+{
+	client_message_t *message;
+	size_t offset;
+};
+
+client_message_t* client_message_new(void);
+int client_message_append(client_message_t **message_ptr, const char *format, ...);
+client_message_t* client_message_printf(const char *format, ...);
+void client_message_unref(client_message_t *message);
+
+/* send response to client */
+int client_printf(struct client *client_ptr, const char *format, ...);
+int client_send(struct client *client_ptr, client_message_t *message);
+
+/* send notification to client, message isn't modified and may be shared by any number of clients */
+int client_notify(struct client *client_ptr, client_message_t *message);
+
+/* while client is corked, output is only queued */
+void client_cork(struct client *client_ptr);
+int client_uncork(struct client *client_ptr);
+
+int client_flush(struct client *client_ptr);
+
+/* while client is throttled, its socket isn't read */
+int client_throttle(struct client *client_ptr, unsigned char is_throttled);
+
+void client_free_queue(struct client *client_ptr);
+
+/* clients can't be removed while events for them may still be pending, removal is postponed instead */
+void schedule_client_removal(struct client *client_ptr);
+void remove_scheduled_clients(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DTMD_CLIENT_IO_H */
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <dtmd.h>
 
 #ifndef CONFIG_DIR
 #error CONFIG_DIR is not defined
@@ -44,6 +45,14 @@ enum mount_by_value_enum mount_by_value = mount_by_device_name;
 char *mount_dir = NULL;
 int create_mount_dir_on_startup = 0;
 int clear_mount_dir = 1;
+enum client_overflow_policy_enum client_overflow_policy = client_overflow_resync;
+size_t client_queue_size = 64 * 1024;
+int announce_before_probe = 0;
+const char *uevent_record_file = NULL;
+const char *uevent_replay_file = NULL;
+int uevent_replay_fast = 0;
+const char *sysfs_root_dir = NULL;
+const char *devices_root_dir = NULL;
 
 struct config_mount_opts
 {
@@ -74,6 +83,15 @@ static const char *config_create_mount_dir_on_startup = "create_mount_dir";
 
 static const char *config_clear_mount_dir = "clear_mount_dir";
 
+static const char *config_client_overflow_policy = "client_overflow_policy";
+static const char *config_client_overflow_policy_disconnect = "disconnect";
+static const char *config_client_overflow_policy_drop = "drop";
+static const char *config_client_overflow_policy_resync = "resync";
+
+static const char *config_client_queue_size = "client_queue_size";
+
+static const char *config_announce_before_probe = "announce_before_probe";
+
 static const char *config_default_mount_opts = "default_mount_opts_";
 
 static const char *config_mandatory_mount_opts = "mandatory_mount_opts_";
@@ -256,6 +274,8 @@ static int process_config_value(const char *key, const char *value)
 	int result;
 	const struct dtmd_filesystem_options *fsopts_type;
 	dtmd_fsopts_list_t fsopts_list;
+	char *endptr;
+	unsigned long queue_size;
 
 	if (strcmp(key, config_unmount_on_exit) == 0)
 	{
@@ -345,6 +365,48 @@ static int process_config_value(const char *key, const char *value)
 			return result_success;
 		}
 	}
+	else if (strcmp(key, config_client_overflow_policy) == 0)
+	{
+		if (strcmp(value, config_client_overflow_policy_disconnect) == 0)
+		{
+			client_overflow_policy = client_overflow_disconnect;
+			return result_success;
+		}
+		else if (strcmp(value, config_client_overflow_policy_drop) == 0)
+		{
+			client_overflow_policy = client_overflow_drop;
+			return result_success;
+		}
+		else if (strcmp(value, config_client_overflow_policy_resync) == 0)
+		{
+			client_overflow_policy = client_overflow_resync;
+			return result_success;
+		}
+	}
+	else if (strcmp(key, config_client_queue_size) == 0)
+	{
+		queue_size = strtoul(value, &endptr, 10);
+
+		// queue must be able to hold at least one message of maximum length
+		if ((*value != 0) && (*endptr == 0) && (queue_size >= dtmd_command_max_length))
+		{
+			client_queue_size = queue_size;
+			return result_success;
+		}
+	}
+	else if (strcmp(key, config_announce_before_probe) == 0)
+	{
+		if (strcmp(value, config_yes) == 0)
+		{
+			announce_before_probe = 1;
+			return result_success;
+		}
+		else if (strcmp(value, config_no) == 0)
+		{
+			announce_before_probe = 0;
+			return result_success;
+		}
+	}
 	else if (strncmp(key, config_default_mount_opts, strlen(config_default_mount_opts)) == 0)
 	{
 		if (strlen(key) > strlen(config_default_mount_opts))
@@ -21,6 +21,8 @@
 #ifndef CONFIG_FILE_H
 #define CONFIG_FILE_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,6 +33,13 @@ enum mount_by_value_enum
 	mount_by_device_label
 };
 
+enum client_overflow_policy_enum
+{
+	client_overflow_disconnect = 0,
+	client_overflow_drop,
+	client_overflow_resync
+};
+
 extern int daemonize;
 extern int use_syslog;
 extern int unmount_on_exit;
@@ -38,6 +47,16 @@ extern enum mount_by_value_enum mount_by_value;
 extern char *mount_dir;
 extern int create_mount_dir_on_startup;
 extern int clear_mount_dir;
+extern enum client_overflow_policy_enum client_overflow_policy;
+extern size_t client_queue_size;
+extern int announce_before_probe;
+
+/* debugging options, set from command line */
+extern const char *uevent_record_file;
+extern const char *uevent_replay_file;
+extern int uevent_replay_fast;
+extern const char *sysfs_root_dir;
+extern const char *devices_root_dir;
 
 #define read_config_return_ok 0
 #define read_config_return_no_file -1
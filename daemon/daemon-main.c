@@ -27,12 +27,12 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <string.h>
-#include <poll.h>
 #include <errno.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/file.h>
+#include <time.h>
 
 #include <dtmd.h>
 #include "daemon/dtmd-internal.h"
@@ -42,12 +42,23 @@
 #include "daemon/system_module.h"
 #include "daemon/config_file.h"
 #include "daemon/filesystem_mnt.h"
+#include "daemon/event_loop.h"
+#include "daemon/client_io.h"
+#include "daemon/mount_jobs.h"
 #include "daemon/log.h"
 #include "daemon/return_codes.h"
 
 static volatile unsigned char continue_working  = 1;
 static unsigned char check_config_only = 0;
 
+/* markers passed as event data for descriptors which aren't clients */
+static char event_source_device_monitor;
+static char event_source_socket;
+static char event_source_mounts;
+static char event_source_mount_jobs;
+
+#define events_batch_size 64
+
 void print_usage(char *name)
 {
 	fprintf(stderr, "USAGE: %s [options]\n"
@@ -55,10 +66,33 @@ void print_usage(char *name)
 		"\t-n\n"
 		"\t--no-daemon\t- do not daemonize\n"
 		"\t-c\n"
-		"\t--check-config\t- check config file and quit\n",
+		"\t--check-config\t- check config file and quit\n"
+#if (defined OS_Linux)
+		"debugging options, supported by unix-userspace system module, paths must be absolute:\n"
+		"\t--record-uevents file\t- write received uevents into file\n"
+		"\t--replay-uevents file\t- read uevents from file instead of kernel\n"
+		"\t--replay-fast\t- replay uevents without delays between them\n"
+		"\t--sysfs-root dir\t- read device attributes from dir instead of /sys\n"
+		"\t--devices-root dir\t- probe device nodes in dir instead of /dev\n"
+#endif /* (defined OS_Linux) */
+		,
 		name);
 }
 
+#if (defined OS_Linux)
+/* daemon changes working directory to / before these paths are used */
+static int check_absolute_path(const char *option, const char *path)
+{
+	if ((path != NULL) && (path[0] != '/'))
+	{
+		fprintf(stderr, "Error: path given to option %s is not absolute: %s\n", option, path);
+		return 0;
+	}
+
+	return 1;
+}
+#endif /* (defined OS_Linux) */
+
 void signal_handler(int signum)
 {
 	switch (signum)
@@ -287,6 +321,226 @@ int create_mount_dir(const char *directory)
 	return result;
 }
 
+/*
+ * Clients may send many commands without waiting for responses.
+ * Execution stops while output queue is filled more than by half,
+ * otherwise responses to all of them would overflow the queue.
+ */
+static int execute_client_commands(struct client *client_ptr)
+{
+	int rc;
+	char *tmp_str;
+	dt_command_t *cmd;
+
+	for (;;)
+	{
+		// responses to all received commands are sent together
+		client_cork(client_ptr);
+
+		while ((client_ptr->outqueue_bytes < client_queue_size / 2)
+			&& ((tmp_str = strchr(client_ptr->buf, '\n')) != NULL))
+		{
+			rc = dt_validate_command(client_ptr->buf);
+			if (!rc)
+			{
+				return result_client_error;
+			}
+
+			cmd = dt_parse_command(client_ptr->buf);
+			if (cmd == NULL)
+			{
+				WRITE_LOG(LOG_ERR, "Memory allocation failure");
+				return result_fatal_error;
+			}
+
+			rc = invoke_command(client_ptr, cmd);
+			dt_free_command(cmd);
+
+			switch (rc)
+			{
+			case result_bug:
+			case result_fatal_error:
+				return result_fatal_error;
+
+			case result_client_error:
+				return result_client_error;
+
+			case result_fail:
+			case result_success:
+			default:
+				break;
+			}
+
+			client_ptr->buf_used -= (tmp_str + 1 - client_ptr->buf);
+			memmove(client_ptr->buf, tmp_str+1, client_ptr->buf_used + 1);
+		}
+
+		rc = client_uncork(client_ptr);
+		if (is_result_failure(rc))
+		{
+			return rc;
+		}
+
+		// continue only if whole queue is sent already
+		if ((strchr(client_ptr->buf, '\n') == NULL) || (client_ptr->is_write_blocked))
+		{
+			break;
+		}
+	}
+
+	if (strchr(client_ptr->buf, '\n') != NULL)
+	{
+		return client_throttle(client_ptr, 1);
+	}
+
+	if (client_ptr->buf_used == dtmd_command_max_length)
+	{
+		return result_client_error;
+	}
+
+	return client_throttle(client_ptr, 0);
+}
+
+static int process_client_data(struct client *client_ptr)
+{
+	int rc;
+
+	rc = read(client_ptr->clientfd, &(client_ptr->buf[client_ptr->buf_used]), dtmd_command_max_length - client_ptr->buf_used);
+	if (rc <= 0)
+	{
+		if ((rc < 0) && ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)))
+		{
+			return result_success;
+		}
+
+		return result_client_error;
+	}
+
+	client_ptr->buf_used += rc;
+	client_ptr->buf[client_ptr->buf_used] = 0;
+
+	return execute_client_commands(client_ptr);
+}
+
+/*
+ * Adds all devices reported by device system.
+ * On resync known devices are updated and devices which are gone are removed.
+ */
+static int read_all_devices(dtmd_device_system_t *dev_system, int is_resync, unsigned int *devices_count)
+{
+	dtmd_device_enumeration_t *dev_enum;
+	dtmd_info_t *dev_device;
+	dtmd_removable_media_t *media_ptr;
+	int rc;
+
+	dev_enum = device_system_enumerate_devices(dev_system);
+	if (dev_enum == NULL)
+	{
+		return result_fatal_error;
+	}
+
+	while (is_result_successful(rc = device_system_next_enumerated_device(dev_enum, &dev_device)))
+	{
+		if ((dev_device->media_type != dtmd_removable_media_type_unknown_or_persistent)
+			&& (dev_device->media_subtype != dtmd_removable_media_subtype_unknown_or_persistent)
+			&& (dev_device->path != NULL)
+			&& (dev_device->path_parent != NULL))
+		{
+			rc = result_fail;
+
+			if (is_resync && (find_media(dev_device->path) != NULL))
+			{
+				rc = change_media(
+					dev_device->path_parent,
+					dev_device->path,
+#if (defined OS_Linux)
+					dev_device->sysfs_path,
+#endif /* (defined OS_Linux) */
+					dev_device->media_type,
+					dev_device->media_subtype,
+					dev_device->state,
+					dev_device->fstype,
+					dev_device->label,
+					NULL,
+					NULL);
+
+				if (rc == result_bug)
+				{
+					// device was replaced while events were lost
+					remove_media(dev_device->path);
+				}
+			}
+
+			if ((!is_resync) || (find_media(dev_device->path) == NULL))
+			{
+				rc = add_media(
+					dev_device->path_parent,
+					dev_device->path,
+#if (defined OS_Linux)
+					dev_device->sysfs_path,
+#endif /* (defined OS_Linux) */
+					dev_device->media_type,
+					dev_device->media_subtype,
+					dev_device->state,
+					dev_device->fstype,
+					dev_device->label,
+					NULL,
+					NULL);
+			}
+
+#if (defined OS_Linux)
+			if (is_resync && is_result_successful(rc))
+			{
+				rc = check_media_mount(find_media(dev_device->path));
+			}
+#endif /* (defined OS_Linux) */
+
+			if (is_result_fatal_error(rc))
+			{
+				device_system_free_enumerated_device(dev_enum, dev_device);
+				goto read_all_devices_exit_1;
+			}
+
+			media_ptr = find_media(dev_device->path);
+
+			if (is_resync && (media_ptr != NULL))
+			{
+				// enumerated devices are always probed
+				set_media_probing(dev_device->path, 0);
+				set_media_found(media_ptr);
+			}
+
+			++(*devices_count);
+		}
+
+		device_system_free_enumerated_device(dev_enum, dev_device);
+	}
+
+	if (is_result_fatal_error(rc))
+	{
+		goto read_all_devices_exit_1;
+	}
+
+	if (is_resync)
+	{
+		// remove devices which disappeared while events were lost
+		remove_not_found_media();
+
+		rc = mount_jobs_resume_waiting();
+		if (is_result_fatal_error(rc))
+		{
+			goto read_all_devices_exit_1;
+		}
+	}
+
+	rc = result_success;
+
+read_all_devices_exit_1:
+	device_system_finish_enumerate_devices(dev_enum);
+
+	return rc;
+}
+
 int main(int argc, char **argv)
 {
 	int result = 0;
@@ -298,7 +552,7 @@ int main(int argc, char **argv)
 	pid_t child = -1;
 	char buffer[12];
 	const int backlog = 4;
-	size_t i;
+	int i;
 	struct stat st;
 	int daemonpipe[2] = { -1, -1 };
 	unsigned char daemondata;
@@ -306,22 +560,21 @@ int main(int argc, char **argv)
 	int force_mounts_check = 0;
 
 	dtmd_device_system_t *dtmd_dev_system;
-	dtmd_device_enumeration_t *dtmd_dev_enum;
 	dtmd_device_monitor_t *dtmd_dev_mon;
 	dtmd_info_t *dtmd_dev_device;
 	dtmd_device_action_type_t dtmd_dev_action;
+	unsigned int enumerated_count = 0;
+	struct timespec enumeration_start;
+	struct timespec enumeration_end;
 
 	struct client *client_ptr;
 
 	int monfd;
 	int mountfd;
-	void *tmp;
-	char *tmp_str;
-#define pollfds_count_default 3
-	size_t pollfds_count = pollfds_count_default;
-	dt_command_t *cmd;
+	int events_count;
+	int check_mounts;
 
-	struct pollfd *pollfds = NULL;
+	event_loop_event_t events[events_batch_size];
 
 	for (rc = 1; rc < argc; ++rc)
 	{
@@ -333,6 +586,28 @@ int main(int argc, char **argv)
 		{
 			check_config_only = 1;
 		}
+#if (defined OS_Linux)
+		else if ((strcmp(argv[rc],"--record-uevents") == 0) && (rc + 1 < argc))
+		{
+			uevent_record_file = argv[++rc];
+		}
+		else if ((strcmp(argv[rc],"--replay-uevents") == 0) && (rc + 1 < argc))
+		{
+			uevent_replay_file = argv[++rc];
+		}
+		else if (strcmp(argv[rc],"--replay-fast") == 0)
+		{
+			uevent_replay_fast = 1;
+		}
+		else if ((strcmp(argv[rc],"--sysfs-root") == 0) && (rc + 1 < argc))
+		{
+			sysfs_root_dir = argv[++rc];
+		}
+		else if ((strcmp(argv[rc],"--devices-root") == 0) && (rc + 1 < argc))
+		{
+			devices_root_dir = argv[++rc];
+		}
+#endif /* (defined OS_Linux) */
 		else
 		{
 			print_usage(argv[0]);
@@ -340,6 +615,16 @@ int main(int argc, char **argv)
 		}
 	}
 
+#if (defined OS_Linux)
+	if ((!check_absolute_path("--record-uevents", uevent_record_file))
+		|| (!check_absolute_path("--replay-uevents", uevent_replay_file))
+		|| (!check_absolute_path("--sysfs-root", sysfs_root_dir))
+		|| (!check_absolute_path("--devices-root", devices_root_dir)))
+	{
+		return -1;
+	}
+#endif /* (defined OS_Linux) */
+
 	rc = read_config();
 	if (check_config_only == 1)
 	{
@@ -636,52 +921,21 @@ int main(int argc, char **argv)
 		goto exit_6;
 	}
 
-	dtmd_dev_enum = device_system_enumerate_devices(dtmd_dev_system);
-	if (dtmd_dev_enum == NULL)
-	{
-		result = -1;
-		goto exit_6;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &enumeration_start);
 
-	while (is_result_successful(rc = device_system_next_enumerated_device(dtmd_dev_enum, &dtmd_dev_device)))
-	{
-		if ((dtmd_dev_device->media_type != dtmd_removable_media_type_unknown_or_persistent)
-			&& (dtmd_dev_device->media_subtype != dtmd_removable_media_subtype_unknown_or_persistent)
-			&& (dtmd_dev_device->path != NULL)
-			&& (dtmd_dev_device->path_parent != NULL))
-		{
-			if (is_result_fatal_error(add_media(
-				dtmd_dev_device->path_parent,
-				dtmd_dev_device->path,
-#if (defined OS_Linux)
-				dtmd_dev_device->sysfs_path,
-#endif /* (defined OS_Linux) */
-				dtmd_dev_device->media_type,
-				dtmd_dev_device->media_subtype,
-				dtmd_dev_device->state,
-				dtmd_dev_device->fstype,
-				dtmd_dev_device->label,
-				NULL,
-				NULL)))
-			{
-				device_system_free_enumerated_device(dtmd_dev_enum, dtmd_dev_device);
-				device_system_finish_enumerate_devices(dtmd_dev_enum);
-				result = -1;
-				goto exit_7;
-			}
-		}
-
-		device_system_free_enumerated_device(dtmd_dev_enum, dtmd_dev_device);
-	}
-
-	device_system_finish_enumerate_devices(dtmd_dev_enum);
-
-	if (is_result_fatal_error(rc))
+	if (is_result_fatal_error(read_all_devices(dtmd_dev_system, 0, &enumerated_count)))
 	{
 		result = -1;
 		goto exit_7;
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &enumeration_end);
+
+	WRITE_LOG_ARGS(LOG_INFO, "Enumerated %u devices in %ld ms",
+		enumerated_count,
+		(long) ((enumeration_end.tv_sec - enumeration_start.tv_sec) * 1000
+			+ (enumeration_end.tv_nsec - enumeration_start.tv_nsec) / 1000000));
+
 #if (defined OS_Linux)
 	if (is_result_fatal_error(check_mount_changes()))
 #endif /* (defined OS_Linux) */
@@ -693,14 +947,31 @@ int main(int argc, char **argv)
 		goto exit_7;
 	}
 
-	pollfds = (struct pollfd*) malloc(sizeof(struct pollfd)*pollfds_count);
-	if (pollfds == NULL)
+	if (is_result_fatal_error(event_loop_init()))
 	{
-		WRITE_LOG(LOG_ERR, "Memory allocation failure");
 		result = -1;
 		goto exit_7;
 	}
 
+	if (is_result_fatal_error(mount_jobs_init(&event_source_mount_jobs)))
+	{
+		result = -1;
+		goto exit_8;
+	}
+
+	if (is_result_fatal_error(event_loop_add(monfd, event_loop_read, &event_source_device_monitor))
+		|| is_result_fatal_error(event_loop_add(socketfd, event_loop_read, &event_source_socket))
+#if (defined OS_Linux)
+		|| is_result_fatal_error(event_loop_add(mountfd, event_loop_priority, &event_source_mounts)))
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
+		|| is_result_fatal_error(event_loop_add(mountfd, event_loop_read, &event_source_mounts)))
+#endif /* (defined OS_FreeBSD) */
+	{
+		result = -1;
+		goto exit_8;
+	}
+
 	if (daemonpipe[1] != -1)
 	{
 		// successful initialization
@@ -714,42 +985,12 @@ int main(int argc, char **argv)
 
 	while (continue_working)
 	{
-		pollfds[0].fd = monfd;
-		pollfds[0].events = POLLIN;
-		pollfds[0].revents = 0;
-
-		pollfds[1].fd = socketfd;
-		pollfds[1].events = POLLIN;
-		pollfds[1].revents = 0;
-
-		pollfds[2].fd = mountfd;
-#if (defined OS_Linux)
-		pollfds[2].events = POLLERR;
-#endif /* (defined OS_Linux) */
-#if (defined OS_FreeBSD)
-		pollfds[2].events = POLLIN;
-#endif /* (defined OS_FreeBSD) */
-		pollfds[2].revents = 0;
-
-		client_ptr = client_root;
-		i = 0;
-
-		while (client_ptr != NULL)
-		{
-			pollfds[i + pollfds_count_default].fd      = client_ptr->clientfd;
-			pollfds[i + pollfds_count_default].events  = POLLIN;
-			pollfds[i + pollfds_count_default].revents = 0;
-
-			client_ptr = client_ptr->next_node;
-			++i;
-		}
-
-		rc = poll(pollfds, pollfds_count, -1);
-		if (rc == -1)
+		events_count = event_loop_wait(events, events_batch_size, -1);
+		if (events_count == -1)
 		{
 			if (errno != EINTR)
 			{
-				WRITE_LOG_ARGS(LOG_ERR, "Poll failed, errno %d", errno);
+				WRITE_LOG_ARGS(LOG_ERR, "Waiting for events failed, errno %d", errno);
 				result = -1;
 				goto exit_8;
 			}
@@ -757,245 +998,294 @@ int main(int argc, char **argv)
 			continue;
 		}
 
-		if ((pollfds[1].revents & POLLHUP) || (pollfds[1].revents & POLLERR) || (pollfds[1].revents & POLLNVAL))
-		{
-			WRITE_LOG(LOG_ERR, "Invalid poll result on client socket");
-			result = -1;
-			goto exit_8;
-		}
-		else if (pollfds[1].revents & POLLIN)
-		{
-			rc = accept(socketfd, NULL, NULL);
-			if (rc < 0)
-			{
-				WRITE_LOG_ARGS(LOG_ERR, "Accepting client failed, errno %d", errno);
-				result = -1;
-				goto exit_8;
-			}
+		check_mounts = 0;
 
-			rc = add_client(rc);
-			if (is_result_fatal_error(rc))
-			{
-				result = -1;
-				goto exit_8;
-			}
-		}
-
-		if ((pollfds[0].revents & POLLHUP) || (pollfds[0].revents & POLLERR) || (pollfds[0].revents & POLLNVAL))
+		for (i = 0; i < events_count; ++i)
 		{
-			WRITE_LOG(LOG_ERR, "Invalid poll result on device monitoring socket");
-			result = -1;
-			goto exit_8;
-		}
-		else if (pollfds[0].revents & POLLIN)
-		{
-			rc = device_system_monitor_get_device(dtmd_dev_mon, &dtmd_dev_device, &dtmd_dev_action);
-			if (is_result_successful(rc))
+			if (events[i].data == &event_source_socket)
 			{
-				rc = result_fail;
-
-				switch (dtmd_dev_action)
+				if (events[i].events & (event_loop_hangup | event_loop_error))
+				{
+					WRITE_LOG(LOG_ERR, "Invalid poll result on client socket");
+					result = -1;
+					goto exit_8;
+				}
+				else if (events[i].events & event_loop_read)
 				{
-				case dtmd_device_action_add:
-				case dtmd_device_action_online:
-					if ((dtmd_dev_device->media_type != dtmd_removable_media_type_unknown_or_persistent)
-						&& (dtmd_dev_device->media_subtype != dtmd_removable_media_subtype_unknown_or_persistent)
-						&& (dtmd_dev_device->path != NULL)
-						&& (dtmd_dev_device->path_parent != NULL))
+					rc = accept(socketfd, NULL, NULL);
+					if (rc < 0)
 					{
-						rc = add_media(
-							dtmd_dev_device->path_parent,
-							dtmd_dev_device->path,
-#if (defined OS_Linux)
-							dtmd_dev_device->sysfs_path,
-#endif /* (defined OS_Linux) */
-							dtmd_dev_device->media_type,
-							dtmd_dev_device->media_subtype,
-							dtmd_dev_device->state,
-							dtmd_dev_device->fstype,
-							dtmd_dev_device->label,
-							NULL,
-							NULL);
+						WRITE_LOG_ARGS(LOG_ERR, "Accepting client failed, errno %d", errno);
+						result = -1;
+						goto exit_8;
 					}
-					break;
 
-				case dtmd_device_action_remove:
-				case dtmd_device_action_offline:
-					if (dtmd_dev_device->path != NULL)
+					if ((fcntl(rc, F_SETFL, fcntl(rc, F_GETFL) | O_NONBLOCK) < 0)
+						|| (fcntl(rc, F_SETFD, FD_CLOEXEC) < 0))
 					{
-						rc = remove_media(dtmd_dev_device->path);
+						WRITE_LOG_ARGS(LOG_ERR, "Setting up client socket failed, errno %d", errno);
+						close(rc);
+						continue;
 					}
-					break;
 
-				case dtmd_device_action_change:
-					if ((dtmd_dev_device->media_type != dtmd_removable_media_type_unknown_or_persistent)
-						&& (dtmd_dev_device->media_subtype != dtmd_removable_media_subtype_unknown_or_persistent)
-						&& (dtmd_dev_device->path != NULL)
-						&& (dtmd_dev_device->path_parent != NULL))
+					rc = add_client(rc, &client_ptr);
+					if (is_result_fatal_error(rc))
 					{
-						force_mounts_check = 1;
+						result = -1;
+						goto exit_8;
+					}
 
-						rc = change_media(
-							dtmd_dev_device->path_parent,
-							dtmd_dev_device->path,
-#if (defined OS_Linux)
-							dtmd_dev_device->sysfs_path,
-#endif /* (defined OS_Linux) */
-							dtmd_dev_device->media_type,
-							dtmd_dev_device->media_subtype,
-							dtmd_dev_device->state,
-							dtmd_dev_device->fstype,
-							dtmd_dev_device->label,
-							NULL,
-							NULL);
+					if (is_result_fatal_error(event_loop_add(client_ptr->clientfd, event_loop_read, client_ptr)))
+					{
+						remove_client(client_ptr);
+						result = -1;
+						goto exit_8;
 					}
-					break;
 				}
-
-				device_system_monitor_free_device(dtmd_dev_mon, dtmd_dev_device);
 			}
-
-			if (is_result_fatal_error(rc))
+			else if (events[i].data == &event_source_device_monitor)
 			{
-				result = -1;
-				goto exit_8;
-			}
-		}
-
+				if (events[i].events & (event_loop_hangup | event_loop_error))
+				{
+					WRITE_LOG(LOG_ERR, "Invalid poll result on device monitoring socket");
+					result = -1;
+					goto exit_8;
+				}
+				else if (events[i].events & event_loop_read)
+				{
+					// take all devices reported on this wakeup
+					do
+					{
+						rc = device_system_monitor_get_device(dtmd_dev_mon, &dtmd_dev_device, &dtmd_dev_action);
+						if (is_result_successful(rc))
+						{
+							rc = result_fail;
+
+							switch (dtmd_dev_action)
+							{
+							case dtmd_device_action_add:
+							case dtmd_device_action_online:
+							case dtmd_device_action_announce:
+								if ((dtmd_dev_device->media_type != dtmd_removable_media_type_unknown_or_persistent)
+									&& (dtmd_dev_device->media_subtype != dtmd_removable_media_subtype_unknown_or_persistent)
+									&& (dtmd_dev_device->path != NULL)
+									&& (dtmd_dev_device->path_parent != NULL))
+								{
+									rc = add_media(
+										dtmd_dev_device->path_parent,
+										dtmd_dev_device->path,
 #if (defined OS_Linux)
-		if ((pollfds[2].revents & POLLHUP) || (pollfds[2].revents & POLLNVAL))
+										dtmd_dev_device->sysfs_path,
 #endif /* (defined OS_Linux) */
-#if (defined OS_FreeBSD)
-		if ((pollfds[2].revents & POLLHUP) || (pollfds[2].revents & POLLERR) || (pollfds[2].revents & POLLNVAL))
-#endif /* (defined OS_FreeBSD) */
-		{
-			WRITE_LOG(LOG_ERR, "Invalid poll result on mounts monitoring descriptor");
-			result = -1;
-			goto exit_8;
-		}
+										dtmd_dev_device->media_type,
+										dtmd_dev_device->media_subtype,
+										dtmd_dev_device->state,
+										dtmd_dev_device->fstype,
+										dtmd_dev_device->label,
+										NULL,
+										NULL);
+
+									if (is_result_successful(rc) && (dtmd_dev_action == dtmd_device_action_announce))
+									{
+										set_media_probing(dtmd_dev_device->path, 1);
+									}
+
 #if (defined OS_Linux)
-		else if ((pollfds[2].revents & POLLERR)
+									if (is_result_successful(rc))
+									{
+										rc = check_media_mount(find_media(dtmd_dev_device->path));
+									}
 #endif /* (defined OS_Linux) */
+								}
+								break;
+
+							case dtmd_device_action_remove:
+							case dtmd_device_action_offline:
+								if (dtmd_dev_device->path != NULL)
+								{
+									rc = remove_media(dtmd_dev_device->path);
+
+									// mount requests waiting for probing of this device fail now
+									if (is_result_fatal_error(mount_jobs_resume_waiting()))
+									{
+										rc = result_fatal_error;
+									}
+								}
+								break;
+
+							case dtmd_device_action_resync:
+								enumerated_count = 0;
+								rc = read_all_devices(dtmd_dev_system, 1, &enumerated_count);
+								if (is_result_successful(rc))
+								{
+									WRITE_LOG_ARGS(LOG_INFO, "Reread %u devices after lost device events", enumerated_count);
+								}
+								break;
+
+							case dtmd_device_action_change:
+								if ((dtmd_dev_device->media_type != dtmd_removable_media_type_unknown_or_persistent)
+									&& (dtmd_dev_device->media_subtype != dtmd_removable_media_subtype_unknown_or_persistent)
+									&& (dtmd_dev_device->path != NULL)
+									&& (dtmd_dev_device->path_parent != NULL))
+								{
 #if (defined OS_FreeBSD)
-		else if ((pollfds[2].revents & POLLIN)
+									force_mounts_check = 1;
 #endif /* (defined OS_FreeBSD) */
-			|| (force_mounts_check))
-		{
-			force_mounts_check = 0;
 
+									rc = change_media(
+										dtmd_dev_device->path_parent,
+										dtmd_dev_device->path,
 #if (defined OS_Linux)
-			if (is_result_fatal_error(check_mount_changes()))
+										dtmd_dev_device->sysfs_path,
 #endif /* (defined OS_Linux) */
-#if (defined OS_FreeBSD)
-			if (is_result_fatal_error(check_mount_changes(mountfd)))
-#endif /* (defined OS_FreeBSD) */
-			{
-				result = -1;
-				goto exit_8;
-			}
-		}
+										dtmd_dev_device->media_type,
+										dtmd_dev_device->media_subtype,
+										dtmd_dev_device->state,
+										dtmd_dev_device->fstype,
+										dtmd_dev_device->label,
+										NULL,
+										NULL);
 
-		for (i = pollfds_count_default; i < pollfds_count; ++i)
-		{
-			if ((pollfds[i].revents & POLLHUP) || (pollfds[i].revents & POLLERR) || (pollfds[i].revents & POLLNVAL))
-			{
-				remove_client(pollfds[i].fd);
+#if (defined OS_Linux)
+									if (is_result_successful(rc))
+									{
+										rc = check_media_mount(find_media(dtmd_dev_device->path));
+									}
+#endif /* (defined OS_Linux) */
+								}
+
+								// change after announcement reports probed device
+								if ((dtmd_dev_device->path != NULL)
+									&& (!is_result_fatal_error(rc))
+									&& is_media_probing(dtmd_dev_device->path))
+								{
+									set_media_probing(dtmd_dev_device->path, 0);
+
+									if (is_result_fatal_error(mount_jobs_resume_waiting()))
+									{
+										rc = result_fatal_error;
+									}
+								}
+								break;
+							}
+
+							device_system_monitor_free_device(dtmd_dev_mon, dtmd_dev_device);
+						}
+
+						if (is_result_fatal_error(rc))
+						{
+							result = -1;
+							goto exit_8;
+						}
+					} while (device_system_monitor_has_device(dtmd_dev_mon));
+				}
 			}
-			else if (pollfds[i].revents & POLLIN)
+			else if (events[i].data == &event_source_mounts)
 			{
-				for (client_ptr = client_root; client_ptr != NULL; client_ptr = client_ptr->next_node)
+#if (defined OS_Linux)
+				// mounts file reports changes via POLLERR and POLLPRI
+				if (events[i].events & event_loop_hangup)
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
+				if (events[i].events & (event_loop_hangup | event_loop_error))
+#endif /* (defined OS_FreeBSD) */
 				{
-					if (client_ptr->clientfd == pollfds[i].fd)
-					{
-						break;
-					}
+					WRITE_LOG(LOG_ERR, "Invalid poll result on mounts monitoring descriptor");
+					result = -1;
+					goto exit_8;
 				}
 
-				if (client_ptr == NULL)
+				check_mounts = 1;
+			}
+			else if (events[i].data == &event_source_mount_jobs)
+			{
+				if (is_result_fatal_error(mount_jobs_process_completed()))
 				{
-					WRITE_LOG(LOG_ERR, "BUG: could not find non-existent client");
 					result = -1;
 					goto exit_8;
 				}
+			}
+			else
+			{
+				client_ptr = (struct client*) events[i].data;
 
-				rc = read(client_ptr->clientfd, &(client_ptr->buf[client_ptr->buf_used]), dtmd_command_max_length - client_ptr->buf_used);
-				if ((rc <= 0) && (errno != EINTR))
+				if (client_ptr->is_removal_scheduled)
 				{
-					remove_client(pollfds[i].fd);
 					continue;
 				}
 
-				client_ptr->buf_used += rc;
-				client_ptr->buf[client_ptr->buf_used] = 0;
+				rc = result_success;
 
-				while ((tmp_str = strchr(client_ptr->buf, '\n')) != NULL)
+				if (events[i].events & event_loop_write)
 				{
-					rc = dt_validate_command(client_ptr->buf);
-					if (!rc)
+					rc = client_flush(client_ptr);
+
+					if ((is_result_successful(rc)) && (client_ptr->is_throttled) && (!client_ptr->is_write_blocked))
 					{
-						goto exit_remove_client;
+						rc = execute_client_commands(client_ptr);
 					}
+				}
 
-					cmd = dt_parse_command(client_ptr->buf);
-					if (cmd == NULL)
+				if (is_result_successful(rc))
+				{
+					if (events[i].events & event_loop_read)
 					{
-						WRITE_LOG(LOG_ERR, "Memory allocation failure");
-						result = -1;
-						goto exit_8;
+						rc = process_client_data(client_ptr);
 					}
-
-					rc = invoke_command(client_ptr, cmd);
-					dt_free_command(cmd);
-
-					switch (rc)
+					else if (events[i].events & (event_loop_hangup | event_loop_error))
 					{
-					case result_bug:
-					case result_fatal_error:
-						result = -1;
-						goto exit_8;
-
-					case result_client_error:
-						goto exit_remove_client;
-
-					case result_fail:
-					case result_success:
-					default:
-						break;
+						rc = result_client_error;
 					}
-
-					client_ptr->buf_used -= (tmp_str + 1 - client_ptr->buf);
-					memmove(client_ptr->buf, tmp_str+1, client_ptr->buf_used + 1);
 				}
 
-				if (client_ptr->buf_used == dtmd_command_max_length)
+				switch (rc)
 				{
-exit_remove_client:
-					remove_client(pollfds[i].fd);
+				case result_bug:
+				case result_fatal_error:
+					result = -1;
+					goto exit_8;
+
+				case result_client_error:
+					schedule_client_removal(client_ptr);
+					break;
+
+				default:
+					break;
 				}
 			}
 		}
 
-		if (pollfds_count != pollfds_count_default + clients_count)
+		if ((check_mounts) || (force_mounts_check))
 		{
-			pollfds_count = pollfds_count_default + clients_count;
-			tmp = realloc(pollfds, sizeof(struct pollfd)*pollfds_count);
-			if (tmp == NULL)
+			force_mounts_check = 0;
+
+#if (defined OS_Linux)
+			if (is_result_fatal_error(check_mount_changes()))
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
+			if (is_result_fatal_error(check_mount_changes(mountfd)))
+#endif /* (defined OS_FreeBSD) */
 			{
-				WRITE_LOG(LOG_ERR, "Memory allocation failure");
 				result = -1;
 				goto exit_8;
 			}
+		}
 
-			pollfds = (struct pollfd*) tmp;
+		if (clients_scheduled_for_removal > 0)
+		{
+			remove_scheduled_clients();
 		}
 	}
 
 exit_8:
+	// wait for mount operations in progress
+	mount_jobs_deinit();
+
 #if (defined OS_Linux)
 	unlink(dtmd_internal_mtab_temporary);
 #endif /* (defined OS_Linux) */
 
-	free(pollfds);
+	event_loop_deinit();
 
 exit_7:
 	// first remove clients, because remove_all_* produces notifications
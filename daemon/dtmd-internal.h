@@ -25,7 +25,7 @@
 
 #if (defined OS_Linux)
 
-#define dtmd_internal_mounts_file "/proc/self/mounts"
+#define dtmd_internal_mountinfo_file "/proc/self/mountinfo"
 
 #ifndef MTAB_DIR
 #error MTAB_DIR is not defined
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "daemon/event_loop.h"
+
+#include "daemon/log.h"
+#include "daemon/return_codes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if (defined OS_Linux)
+#include <sys/epoll.h>
+#endif /* (defined OS_Linux) */
+
+#if (defined OS_FreeBSD)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif /* (defined OS_FreeBSD) */
+
+#define event_loop_max_batch 64
+
+static int event_loop_fd = -1;
+
+#if (defined OS_Linux)
+int event_loop_init(void)
+{
+	event_loop_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (event_loop_fd < 0)
+	{
+		WRITE_LOG_ARGS(LOG_ERR, "Failed to create epoll descriptor, errno %d", errno);
+		return result_fatal_error;
+	}
+
+	return result_success;
+}
+
+static int event_loop_control(int op, int fd, unsigned int events, void *data)
+{
+	struct epoll_event evt;
+
+	evt.events = 0;
+	evt.data.ptr = data;
+
+	if (events & event_loop_read)
+	{
+		evt.events |= EPOLLIN;
+	}
+
+	if (events & event_loop_write)
+	{
+		evt.events |= EPOLLOUT;
+	}
+
+	if (events & event_loop_priority)
+	{
+		evt.events |= EPOLLPRI;
+	}
+
+	if (epoll_ctl(event_loop_fd, op, fd, &evt) < 0)
+	{
+		WRITE_LOG_ARGS(LOG_ERR, "Failed to update epoll descriptor, errno %d", errno);
+		return result_fatal_error;
+	}
+
+	return result_success;
+}
+
+int event_loop_add(int fd, unsigned int events, void *data)
+{
+	return event_loop_control(EPOLL_CTL_ADD, fd, events, data);
+}
+
+int event_loop_modify(int fd, unsigned int events, void *data)
+{
+	return event_loop_control(EPOLL_CTL_MOD, fd, events, data);
+}
+
+int event_loop_remove(int fd)
+{
+	struct epoll_event evt;
+
+	/* event argument is ignored, but old kernels require it to be non-NULL */
+	if ((epoll_ctl(event_loop_fd, EPOLL_CTL_DEL, fd, &evt) < 0) && (errno != ENOENT))
+	{
+		return result_fail;
+	}
+
+	return result_success;
+}
+
+int event_loop_wait(event_loop_event_t *events, int max_events, int timeout)
+{
+	struct epoll_event evts[event_loop_max_batch];
+	int rc;
+	int i;
+
+	if (max_events > event_loop_max_batch)
+	{
+		max_events = event_loop_max_batch;
+	}
+
+	rc = epoll_wait(event_loop_fd, evts, max_events, timeout);
+	if (rc <= 0)
+	{
+		return rc;
+	}
+
+	for (i = 0; i < rc; ++i)
+	{
+		events[i].data = evts[i].data.ptr;
+		events[i].events = 0;
+
+		if (evts[i].events & EPOLLIN)
+		{
+			events[i].events |= event_loop_read;
+		}
+
+		if (evts[i].events & EPOLLOUT)
+		{
+			events[i].events |= event_loop_write;
+		}
+
+		if (evts[i].events & EPOLLPRI)
+		{
+			events[i].events |= event_loop_priority;
+		}
+
+		if (evts[i].events & EPOLLERR)
+		{
+			events[i].events |= event_loop_error;
+		}
+
+		if (evts[i].events & EPOLLHUP)
+		{
+			events[i].events |= event_loop_hangup;
+		}
+	}
+
+	return rc;
+}
+#endif /* (defined OS_Linux) */
+
+#if (defined OS_FreeBSD)
+int event_loop_init(void)
+{
+	event_loop_fd = kqueue();
+	if (event_loop_fd < 0)
+	{
+		WRITE_LOG_ARGS(LOG_ERR, "Failed to create kqueue, errno %d", errno);
+		return result_fatal_error;
+	}
+
+	fcntl(event_loop_fd, F_SETFD, FD_CLOEXEC);
+
+	return result_success;
+}
+
+int event_loop_add(int fd, unsigned int events, void *data)
+{
+	struct kevent evt[2];
+
+	/* there's no priority data for kqueue, it's reported as readable instead */
+	EV_SET(&(evt[0]), fd, EVFILT_READ, EV_ADD | ((events & (event_loop_read | event_loop_priority)) ? EV_ENABLE : EV_DISABLE), 0, 0, data);
+	EV_SET(&(evt[1]), fd, EVFILT_WRITE, EV_ADD | ((events & event_loop_write) ? EV_ENABLE : EV_DISABLE), 0, 0, data);
+
+	if (kevent(event_loop_fd, evt, 2, NULL, 0, NULL) < 0)
+	{
+		WRITE_LOG_ARGS(LOG_ERR, "Failed to update kqueue, errno %d", errno);
+		return result_fatal_error;
+	}
+
+	return result_success;
+}
+
+int event_loop_modify(int fd, unsigned int events, void *data)
+{
+	return event_loop_add(fd, events, data);
+}
+
+int event_loop_remove(int fd)
+{
+	struct kevent evt;
+	int result = result_success;
+
+	EV_SET(&evt, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+	if ((kevent(event_loop_fd, &evt, 1, NULL, 0, NULL) < 0) && (errno != ENOENT))
+	{
+		result = result_fail;
+	}
+
+	EV_SET(&evt, fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+	if ((kevent(event_loop_fd, &evt, 1, NULL, 0, NULL) < 0) && (errno != ENOENT))
+	{
+		result = result_fail;
+	}
+
+	return result;
+}
+
+int event_loop_wait(event_loop_event_t *events, int max_events, int timeout)
+{
+	struct kevent evts[event_loop_max_batch];
+	struct timespec ts;
+	int rc;
+	int i;
+
+	if (max_events > event_loop_max_batch)
+	{
+		max_events = event_loop_max_batch;
+	}
+
+	if (timeout >= 0)
+	{
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
+	}
+
+	rc = kevent(event_loop_fd, NULL, 0, evts, max_events, (timeout >= 0) ? &ts : NULL);
+	if (rc <= 0)
+	{
+		return rc;
+	}
+
+	for (i = 0; i < rc; ++i)
+	{
+		events[i].data = evts[i].udata;
+		events[i].events = 0;
+
+		if (evts[i].flags & EV_ERROR)
+		{
+			events[i].events |= event_loop_error;
+			continue;
+		}
+
+		if (evts[i].filter == EVFILT_READ)
+		{
+			events[i].events |= event_loop_read;
+		}
+		else if (evts[i].filter == EVFILT_WRITE)
+		{
+			events[i].events |= event_loop_write;
+		}
+
+		if (evts[i].flags & EV_EOF)
+		{
+			events[i].events |= event_loop_hangup;
+		}
+	}
+
+	return rc;
+}
+#endif /* (defined OS_FreeBSD) */
+
+void event_loop_deinit(void)
+{
+	if (event_loop_fd >= 0)
+	{
+		close(event_loop_fd);
+		event_loop_fd = -1;
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DTMD_EVENT_LOOP_H
+#define DTMD_EVENT_LOOP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Thin wrapper around epoll (Linux) and kqueue (FreeBSD).
+ * Each descriptor is registered once together with a user pointer,
+ * which is returned back with every event for that descriptor.
+ */
+
+/* requested and returned events */
+#define event_loop_read     0x01
+#define event_loop_write    0x02
+#define event_loop_priority 0x04
+
+/* returned events only */
+#define event_loop_error    0x08
+#define event_loop_hangup   0x10
+
+typedef struct event_loop_event
+{
+	unsigned int events;
+	void *data;
+} event_loop_event_t;
+
+int event_loop_init(void);
+void event_loop_deinit(void);
+
+int event_loop_add(int fd, unsigned int events, void *data);
+int event_loop_modify(int fd, unsigned int events, void *data);
+int event_loop_remove(int fd);
+
+/* returns number of events, 0 on timeout or -1 on error, errno is set */
+int event_loop_wait(event_loop_event_t *events, int max_events, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DTMD_EVENT_LOOP_H */
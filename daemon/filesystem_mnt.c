@@ -23,6 +23,7 @@
 #include "daemon/dtmd-internal.h"
 #include "daemon/lists.h"
 #include "daemon/mnt_funcs.h"
+#include "daemon/mount_jobs.h"
 #include "daemon/filesystem_opts.h"
 #include "daemon/log.h"
 #include "daemon/return_codes.h"
@@ -137,96 +138,103 @@ static dir_state_t get_dir_state(const char *dirname)
 	}
 }
 
+#if ((defined OS_Linux) && (!defined DISABLE_EXT_MOUNT)) || (defined OS_FreeBSD)
+static int add_command_argument(mount_job_t *job, size_t *arguments_count, const char *argument, size_t argument_len)
+{
+	char **new_command;
+	char *new_argument;
+
+	new_argument = (char*) malloc(argument_len + 1);
+	if (new_argument == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return result_fatal_error;
+	}
+
+	memcpy(new_argument, argument, argument_len);
+	new_argument[argument_len] = 0;
+
+	new_command = (char**) realloc(job->command, sizeof(char*) * (*arguments_count + 2));
+	if (new_command == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		free(new_argument);
+		return result_fatal_error;
+	}
+
+	new_command[*arguments_count] = new_argument;
+	++(*arguments_count);
+	new_command[*arguments_count] = NULL;
+
+	job->command = new_command;
+
+	return result_success;
+}
+
+#define add_command_string(job, count, str) add_command_argument((job), (count), (str), strlen(str))
+#endif /* ((defined OS_Linux) && (!defined DISABLE_EXT_MOUNT)) || (defined OS_FreeBSD) */
+
 #if (defined OS_Linux)
 #if (!defined DISABLE_EXT_MOUNT)
-static int invoke_mount_external(struct client *client_ptr,
-	const char *path,
+static int build_mount_command(mount_job_t *job,
 	const char *mount_path,
 	const char *fstype,
 	dtmd_fsopts_list_t *fsopts_list)
 {
 	int result;
-
-	int total_len;
-	int mount_flags_start;
-	char *mount_cmd;
+	size_t arguments_count = 0;
+	char *mount_opts;
 	size_t string_full_len;
 
 	result = fsopts_generate_string(fsopts_list, &string_full_len, NULL, 0, NULL, NULL, 0, NULL);
 	if (is_result_failure(result))
 	{
-		goto invoke_mount_external_error_1;
+		return result;
 	}
 
-	// calculate total length
-	mount_flags_start = strlen(mount_ext_cmd) + strlen(" -t ") + strlen(fstype) + 1 + strlen(path) + 2 + strlen(mount_path) + 1;
-
-	if (string_full_len > 0)
-	{
-		mount_flags_start += strlen(" -o ");
-	}
-
-	total_len = mount_flags_start + string_full_len;
-
-	mount_cmd = (char*) malloc(total_len + 1);
-	if (mount_cmd == NULL)
+	if (is_result_failure(add_command_string(job, &arguments_count, mount_ext_cmd))
+		|| is_result_failure(add_command_string(job, &arguments_count, "-t"))
+		|| is_result_failure(add_command_string(job, &arguments_count, fstype))
+		|| is_result_failure(add_command_string(job, &arguments_count, job->path))
+		|| is_result_failure(add_command_string(job, &arguments_count, mount_path)))
 	{
-		WRITE_LOG(LOG_ERR, "Memory allocation failure");
-		result = result_fatal_error;
-		goto invoke_mount_external_error_1;
+		return result_fatal_error;
 	}
 
-	strcpy(mount_cmd, mount_ext_cmd);
-	strcat(mount_cmd, " -t ");
-	strcat(mount_cmd, fstype);
-	strcat(mount_cmd, " ");
-	strcat(mount_cmd, path);
-	strcat(mount_cmd, " '");
-	strcat(mount_cmd, mount_path);
-	strcat(mount_cmd, "'");
-
-	// create flags and string
 	if (string_full_len > 0)
 	{
-		strcat(mount_cmd, " -o ");
-
-		result = fsopts_generate_string(fsopts_list, NULL, &(mount_cmd[mount_flags_start]), string_full_len, NULL, NULL, 0, NULL);
-		if (is_result_failure(result))
+		mount_opts = (char*) malloc(string_full_len + 1);
+		if (mount_opts == NULL)
 		{
-			goto invoke_mount_external_error_2;
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			return result_fatal_error;
 		}
-	}
 
-	mount_cmd[total_len] = 0;
-
-	result = system(mount_cmd);
+		result = fsopts_generate_string(fsopts_list, NULL, mount_opts, string_full_len, NULL, NULL, 0, NULL);
+		if (is_result_successful(result))
+		{
+			if (is_result_failure(add_command_string(job, &arguments_count, "-o"))
+				|| is_result_failure(add_command_argument(job, &arguments_count, mount_opts, string_full_len)))
+			{
+				result = result_fatal_error;
+			}
+		}
 
-	free(mount_cmd);
+		free(mount_opts);
 
-	switch (result)
-	{
-	case 16: /* problems writing or locking /etc/mtab */
-		WRITE_LOG(LOG_WARNING, "Failed to modify /etc/mtab");
-		/* NOTE: fallthrough */
-	case 0:  /* success */
-		WRITE_LOG_ARGS(LOG_INFO, "Mounted device '%s' to path '%s'", path, mount_path);
-		return result_success;
-	default:
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s' to path '%s' using external mount: error, code %d", path, mount_path, result);
-		return result_fail;
+		if (is_result_failure(result))
+		{
+			return result;
+		}
 	}
 
-invoke_mount_external_error_2:
-	free(mount_cmd);
+	job->method = mount_job_method_external;
 
-invoke_mount_external_error_1:
-	return result;
+	return result_success;
 }
 #endif /* (!defined DISABLE_EXT_MOUNT) */
 
-static int invoke_mount_internal(struct client *client_ptr,
-	const char *path,
-	const char *mount_path,
+static int build_mount_options(mount_job_t *job,
 	const char *fstype,
 	dtmd_fsopts_list_t *fsopts_list)
 {
@@ -240,7 +248,7 @@ static int invoke_mount_internal(struct client *client_ptr,
 	result = fsopts_generate_string(fsopts_list, &string_full_len, NULL, 0, &string_len, NULL, 0, NULL);
 	if (is_result_failure(result))
 	{
-		goto invoke_mount_internal_error_1;
+		goto build_mount_options_error_1;
 	}
 
 	mount_full_opts = (char*) malloc(string_full_len + 1);
@@ -248,7 +256,7 @@ static int invoke_mount_internal(struct client *client_ptr,
 	{
 		WRITE_LOG(LOG_ERR, "Memory allocation failure");
 		result = result_fatal_error;
-		goto invoke_mount_internal_error_1;
+		goto build_mount_options_error_1;
 	}
 
 	mount_opts = (char*) malloc(string_len + 1);
@@ -256,139 +264,140 @@ static int invoke_mount_internal(struct client *client_ptr,
 	{
 		WRITE_LOG(LOG_ERR, "Memory allocation failure");
 		result = result_fatal_error;
-		goto invoke_mount_internal_error_2;
+		goto build_mount_options_error_2;
 	}
 
 	result = fsopts_generate_string(fsopts_list, NULL, mount_full_opts, string_full_len, NULL, mount_opts, string_len, &mount_flags);
 	if (is_result_failure(result))
 	{
-		goto invoke_mount_internal_error_3;
+		goto build_mount_options_error_3;
 	}
 
 	mount_full_opts[string_full_len] = 0;
 	mount_opts[string_len] = 0;
 
-	result = mount(path, mount_path, fstype, mount_flags, mount_opts);
-
-	if (result == 0)
+	job->fstype = strdup(fstype);
+	if (job->fstype == NULL)
 	{
-		if (is_result_successful(is_mtab_writable()))
-		{
-			result = add_to_mtab(path, mount_path, fstype, mount_full_opts);
-			if (is_result_failure(result))
-			{
-				// NOTE: failing to modify /etc/mtab is non-fatal error
-				WRITE_LOG(LOG_WARNING, "Failed to modify " dtmd_internal_mtab_file );
-			}
-		}
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		result = result_fatal_error;
+		goto build_mount_options_error_3;
+	}
 
-		result = result_success;
+	job->method       = mount_job_method_internal;
+	job->options      = mount_opts;
+	job->full_options = mount_full_opts;
+	job->flags        = mount_flags;
 
-		WRITE_LOG_ARGS(LOG_INFO, "Mounted device '%s' to path '%s'", path, mount_path);
-	}
-	else
-	{
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s' to path '%s'", path, mount_path);
-		result = result_fail;
-	}
+	return result_success;
 
-invoke_mount_internal_error_3:
+build_mount_options_error_3:
 	free(mount_opts);
 
-invoke_mount_internal_error_2:
+build_mount_options_error_2:
 	free(mount_full_opts);
 
-invoke_mount_internal_error_1:
+build_mount_options_error_1:
 	return result;
 }
 #endif /* (defined OS_Linux) */
 
 #if (defined OS_FreeBSD)
-static int invoke_mount_external(struct client *client_ptr,
-	const char *path,
+static int build_mount_command(mount_job_t *job,
 	const char *mount_path,
 	const char *mount_cmd_exe,
 	dtmd_fsopts_list_t *fsopts_list)
 {
-
 	int result;
-
-	int total_len;
-	int mount_flags_start;
-	char *mount_cmd;
+	size_t arguments_count = 0;
+	char *mount_opts;
+	char *word_start;
+	char *word_end;
 	size_t string_full_len;
 
 	result = fsopts_generate_string(fsopts_list, &string_full_len, NULL, 0);
 	if (is_result_failure(result))
 	{
-		goto invoke_mount_external_error_1;
+		return result;
 	}
 
-	// calculate total length
-	mount_flags_start = strlen(mount_cmd_exe) + 1 + strlen(path) + 2 + strlen(mount_path) + 1;
-
-	if (string_full_len > 0)
+	if (is_result_failure(add_command_string(job, &arguments_count, mount_cmd_exe)))
 	{
-		mount_flags_start += strlen(" ");
-	}
-
-	total_len = mount_flags_start + string_full_len;
-
-	mount_cmd = (char*) malloc(total_len + 1);
-	if (mount_cmd == NULL)
-	{
-		WRITE_LOG(LOG_ERR, "Memory allocation failure");
-		result = result_fatal_error;
-		goto invoke_mount_external_error_1;
+		return result_fatal_error;
 	}
 
-	strcpy(mount_cmd, mount_cmd_exe);
-
-	// create flags and string
 	if (string_full_len > 0)
 	{
-		strcat(mount_cmd, " ");
+		mount_opts = (char*) malloc(string_full_len + 1);
+		if (mount_opts == NULL)
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			return result_fatal_error;
+		}
 
-		result = fsopts_generate_string(fsopts_list, NULL, &(mount_cmd[strlen(mount_cmd_exe) + strlen(" ")]), string_full_len);
+		result = fsopts_generate_string(fsopts_list, NULL, mount_opts, string_full_len);
 		if (is_result_failure(result))
 		{
-			goto invoke_mount_external_error_2;
+			free(mount_opts);
+			return result;
 		}
 
-		mount_cmd[strlen(mount_cmd_exe) + strlen(" ") + string_full_len] = 0;
-	}
+		mount_opts[string_full_len] = 0;
+
+		// options string consists of command line arguments separated by spaces
+		for (word_start = mount_opts; *word_start != 0; word_start = word_end)
+		{
+			while (*word_start == ' ')
+			{
+				++word_start;
+			}
 
-	strcat(mount_cmd, " ");
-	strcat(mount_cmd, path);
-	strcat(mount_cmd, " '");
-	strcat(mount_cmd, mount_path);
-	strcat(mount_cmd, "'");
+			for (word_end = word_start; (*word_end != 0) && (*word_end != ' '); ++word_end)
+			{
+			}
 
-	result = system(mount_cmd);
+			if ((word_end != word_start)
+				&& (is_result_failure(add_command_argument(job, &arguments_count, word_start, word_end - word_start))))
+			{
+				free(mount_opts);
+				return result_fatal_error;
+			}
+		}
 
-	free(mount_cmd);
+		free(mount_opts);
+	}
 
-	switch (result)
+	if (is_result_failure(add_command_string(job, &arguments_count, job->path))
+		|| is_result_failure(add_command_string(job, &arguments_count, mount_path)))
 	{
-	case 16: /* problems writing or locking /etc/mtab */
-		WRITE_LOG(LOG_WARNING, "Failed to modify /etc/mtab");
-		/* NOTE: fallthrough */
-	case 0:  /* success */
-		WRITE_LOG_ARGS(LOG_INFO, "Mounted device '%s' to path '%s'", path, mount_path);
-		return result_success;
-	default:
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s' to path '%s' using external mount: error, code %d", path, mount_path, result);
-		return result_fail;
+		return result_fatal_error;
 	}
 
-invoke_mount_external_error_2:
-	free(mount_cmd);
+	job->method = mount_job_method_external;
 
-invoke_mount_external_error_1:
-	return result;
+	return result_success;
 }
 #endif /* (defined OS_FreeBSD) */
 
+#if ((defined OS_Linux) && (!defined DISABLE_EXT_MOUNT)) || (defined OS_FreeBSD)
+static int build_unmount_command(mount_job_t *job, const char *fstype)
+{
+	size_t arguments_count = 0;
+
+	if (is_result_failure(add_command_string(job, &arguments_count, unmount_ext_cmd))
+		|| is_result_failure(add_command_string(job, &arguments_count, "-t"))
+		|| is_result_failure(add_command_string(job, &arguments_count, fstype))
+		|| is_result_failure(add_command_string(job, &arguments_count, job->mount_point)))
+	{
+		return result_fatal_error;
+	}
+
+	job->method = mount_job_method_external;
+
+	return result_success;
+}
+#endif /* ((defined OS_Linux) && (!defined DISABLE_EXT_MOUNT)) || (defined OS_FreeBSD) */
+
 static char* calculate_path(const char *path, const char *label, enum mount_by_value_enum *mount_type)
 {
 	const char *mount_dev_start = NULL;
@@ -465,12 +474,13 @@ static char* calculate_path(const char *path, const char *label, enum mount_by_v
 	return mount_path;
 }
 
-int invoke_mount(struct client *client_ptr, const char *path, const char *mount_options, enum mount_by_value_enum mount_type, dtmd_error_code_t *error_code)
+int prepare_mount(mount_job_t *job)
 {
 	int result;
 	dtmd_removable_media_t *media_ptr;
 
 	char *mount_path;
+	const char *mount_options;
 	const char *mandatory_mount_options;
 
 	const struct dtmd_filesystem_options *fsopts;
@@ -479,70 +489,56 @@ int invoke_mount(struct client *client_ptr, const char *path, const char *mount_
 	uid_t uid;
 	gid_t gid;
 
-	media_ptr = dtmd_find_media(path, removable_media_root);
+	media_ptr = find_media(job->path);
 	if (media_ptr == NULL)
 	{
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s': device does not exist or is not ready", path);
+		WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s': device does not exist or is not ready", job->path);
 		result = result_fail;
-
-		if (error_code != NULL)
-		{
-			*error_code = dtmd_error_code_no_such_removable_device;
-		}
-
-		goto invoke_mount_error_1;
+		job->error_code = dtmd_error_code_no_such_removable_device;
+		goto prepare_mount_error_1;
 	}
 
 	if (media_ptr->fstype == NULL)
 	{
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s': device doesn't have recognized filesystem", path);
+		WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s': device doesn't have recognized filesystem", job->path);
 		result = result_fail;
-
-		if (error_code != NULL)
-		{
-			*error_code = dtmd_error_code_fstype_not_recognized;
-		}
-
-		goto invoke_mount_error_1;
+		job->error_code = dtmd_error_code_fstype_not_recognized;
+		goto prepare_mount_error_1;
 	}
 
 	if (media_ptr->mnt_point != NULL)
 	{
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s': device is already mounted", path);
+		WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s': device is already mounted", job->path);
 		result = result_fail;
+		job->error_code = dtmd_error_code_device_already_mounted;
+		goto prepare_mount_error_1;
+	}
 
-		if (error_code != NULL)
-		{
-			*error_code = dtmd_error_code_device_already_mounted;
-		}
-
-		goto invoke_mount_error_1;
+	// client could disconnect while job was waiting for its turn
+	if (job->client_ptr == NULL)
+	{
+		result = result_fail;
+		job->error_code = dtmd_error_code_generic_error;
+		goto prepare_mount_error_1;
 	}
 
-	result = get_credentials(client_ptr->clientfd, &uid, &gid);
+	result = get_credentials(job->client_ptr->clientfd, &uid, &gid);
 	if (is_result_failure(result))
 	{
-		if (error_code != NULL)
-		{
-			*error_code = dtmd_error_code_generic_error;
-		}
-
-		goto invoke_mount_error_1;
+		job->error_code = dtmd_error_code_generic_error;
+		goto prepare_mount_error_1;
 	}
 
 	fsopts = get_fsopts_for_fs(media_ptr->fstype);
 	if (fsopts == NULL)
 	{
 		result = result_fail;
-
-		if (error_code != NULL)
-		{
-			*error_code = dtmd_error_code_unsupported_fstype;
-		}
-
-		goto invoke_mount_error_1;
+		job->error_code = dtmd_error_code_unsupported_fstype;
+		goto prepare_mount_error_1;
 	}
 
+	mount_options = job->mount_options;
+
 	if (mount_options == NULL)
 	{
 #if (defined OS_Linux) && (!defined DISABLE_EXT_MOUNT)
@@ -569,12 +565,8 @@ int invoke_mount(struct client *client_ptr, const char *path, const char *mount_
 	result = convert_options_to_list(mount_options, fsopts, &uid, &gid, &fsopts_list);
 	if (is_result_failure(result))
 	{
-		if (error_code != NULL)
-		{
-			*error_code = dtmd_error_code_failed_parsing_mount_options;
-		}
-
-		goto invoke_mount_error_2;
+		job->error_code = dtmd_error_code_failed_parsing_mount_options;
+		goto prepare_mount_error_2;
 	}
 
 #if (defined OS_Linux) && (!defined DISABLE_EXT_MOUNT)
@@ -598,62 +590,48 @@ int invoke_mount(struct client *client_ptr, const char *path, const char *mount_
 	result = convert_options_to_list(mandatory_mount_options, fsopts, NULL, NULL, &fsopts_list);
 	if (is_result_failure(result))
 	{
-		if (error_code != NULL)
-		{
-			*error_code = dtmd_error_code_generic_error;
-		}
-
-		goto invoke_mount_error_2;
+		job->error_code = dtmd_error_code_generic_error;
+		goto prepare_mount_error_2;
 	}
 
 	for (;;)
 	{
-		mount_path = calculate_path(path, media_ptr->label, &mount_type);
+		mount_path = calculate_path(job->path, media_ptr->label, &(job->mount_type));
 		if (mount_path == NULL)
 		{
 			result = result_fatal_error;
-
-			if (error_code != NULL)
-			{
-				*error_code = dtmd_error_code_generic_error;
-			}
-
-			goto invoke_mount_error_2;
+			job->error_code = dtmd_error_code_generic_error;
+			goto prepare_mount_error_2;
 		}
 
-		// check mount point
+		// check mount point, it may also be reserved by mount which is being executed right now
 		result = point_mount_count(mount_path, 1);
+		if ((result == 0) && (mount_jobs_is_mount_point_reserved(mount_path)))
+		{
+			result = 1;
+		}
+
 		if (result != 0)
 		{
 			if (result < 0)
 			{
 				result = result_fatal_error;
-
-				if (error_code != NULL)
-				{
-					*error_code = dtmd_error_code_generic_error;
-				}
-
-				goto invoke_mount_error_3;
+				job->error_code = dtmd_error_code_generic_error;
+				goto prepare_mount_error_3;
 			}
 			else
 			{
-				switch (mount_type)
+				switch (job->mount_type)
 				{
 				case mount_by_device_label:
-					mount_type = mount_by_device_name;
+					job->mount_type = mount_by_device_name;
 					break;
 
 				case mount_by_device_name:
-					WRITE_LOG_ARGS(LOG_WARNING, "Could not find suitable mount point for device '%s'", path);
+					WRITE_LOG_ARGS(LOG_WARNING, "Could not find suitable mount point for device '%s'", job->path);
 					result = result_fail;
-
-					if (error_code != NULL)
-					{
-						*error_code = dtmd_error_code_mount_point_busy;
-					}
-
-					goto invoke_mount_error_3;
+					job->error_code = dtmd_error_code_mount_point_busy;
+					goto prepare_mount_error_3;
 				}
 			}
 
@@ -673,13 +651,8 @@ int invoke_mount(struct client *client_ptr, const char *path, const char *mount_
 			// NOTE: failing to create directory is non-fatal error
 			WRITE_LOG_ARGS(LOG_WARNING, "Failed to create directory '%s'", mount_path);
 			result = result_fail;
-
-			if (error_code != NULL)
-			{
-				*error_code = dtmd_error_code_mount_point_busy;
-			}
-
-			goto invoke_mount_error_3;
+			job->error_code = dtmd_error_code_mount_point_busy;
+			goto prepare_mount_error_3;
 		}
 	}
 
@@ -687,18 +660,18 @@ int invoke_mount(struct client *client_ptr, const char *path, const char *mount_
 #if (!defined DISABLE_EXT_MOUNT)
 	if (fsopts->external_fstype != NULL)
 	{
-		result = invoke_mount_external(client_ptr, path, mount_path, fsopts->external_fstype, &fsopts_list);
+		result = build_mount_command(job, mount_path, fsopts->external_fstype, &fsopts_list);
 	}
 	else
 	{
 #endif /* (!defined DISABLE_EXT_MOUNT) */
-		result = invoke_mount_internal(client_ptr, path, mount_path, fsopts->fstype, &fsopts_list);
+		result = build_mount_options(job, fsopts->fstype, &fsopts_list);
 #if (!defined DISABLE_EXT_MOUNT)
 	}
 #endif /* (!defined DISABLE_EXT_MOUNT) */
 #else /* (defined OS_Linux) */
 #if (defined OS_FreeBSD)
-	result = invoke_mount_external(client_ptr, path, mount_path, fsopts->mount_cmd, &fsopts_list);
+	result = build_mount_command(job, mount_path, fsopts->mount_cmd, &fsopts_list);
 #else /* (defined OS_FreeBSD) */
 #error Unsupported OS
 #endif /* (defined OS_FreeBSD) */
@@ -706,237 +679,328 @@ int invoke_mount(struct client *client_ptr, const char *path, const char *mount_
 
 	if (is_result_failure(result))
 	{
-		if (error_code != NULL)
-		{
-			*error_code = dtmd_error_code_generic_error;
-		}
-
+		job->error_code = dtmd_error_code_generic_error;
 		rmdir(mount_path);
+		goto prepare_mount_error_3;
 	}
 
-invoke_mount_error_3:
+	job->mount_point = mount_path;
+
+	free_options_list(&fsopts_list);
+
+	return result_success;
+
+prepare_mount_error_3:
 	free(mount_path);
 
-invoke_mount_error_2:
+prepare_mount_error_2:
 	free_options_list(&fsopts_list);
 
-invoke_mount_error_1:
+prepare_mount_error_1:
 	return result;
 }
 
-#if ((defined OS_Linux) && (!defined DISABLE_EXT_MOUNT)) || (defined OS_FreeBSD)
-static int invoke_unmount_external(struct client *client_ptr, const char *path, const char *mnt_point, const char *fstype, dtmd_error_code_t *error_code)
+void execute_mount(mount_job_t *job)
 {
-	int result;
-	int unmount_cmd_len;
-	char *unmount_cmd;
-
-	unmount_cmd_len = strlen(unmount_ext_cmd) + strlen(" -t ") + strlen(fstype) + 2 + strlen(mnt_point) + 1;
-
-	unmount_cmd = (char*) malloc(unmount_cmd_len + 1);
-	if (unmount_cmd == NULL)
+	switch (job->method)
 	{
-		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+	case mount_job_method_external:
+		mount_job_run_command(job);
+		break;
 
-		if (error_code != NULL)
+#if (defined OS_Linux)
+	case mount_job_method_internal:
+		if (mount(job->path, job->mount_point, job->fstype, job->flags, job->options) == 0)
 		{
-			*error_code = dtmd_error_code_generic_error;
+			job->status = 0;
 		}
-
-		return result_fatal_error;
-	}
-
-	strcpy(unmount_cmd, unmount_ext_cmd);
-	strcat(unmount_cmd, " -t ");
-	strcat(unmount_cmd, fstype);
-	strcat(unmount_cmd, " \"");
-	strcat(unmount_cmd, mnt_point);
-	strcat(unmount_cmd, "\"");
-
-	result = system(unmount_cmd);
-
-	free(unmount_cmd);
-
-	switch (result)
-	{
-	case 0:
-		WRITE_LOG_ARGS(LOG_INFO, "Unmounted device '%s' from path '%s'", path, mnt_point);
-		return result_success;
-
-	default:
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed unmounting device '%s' from path '%s' using external umount: error, code %d", path, mnt_point, result);
-
-		if (error_code != NULL)
+		else
 		{
-			*error_code = dtmd_error_code_generic_error;
+			job->status = errno;
 		}
-
-		return result_fail;
+		break;
+#endif /* (defined OS_Linux) */
 	}
 }
-#endif /* ((defined OS_Linux) && (!defined DISABLE_EXT_MOUNT)) || (defined OS_FreeBSD) */
 
-#if (defined OS_Linux)
-static int invoke_unmount_internal(struct client *client_ptr, const char *path, const char *mnt_point, const char *fstype, dtmd_error_code_t *error_code)
+int finish_mount(mount_job_t *job)
 {
-	int result;
-	int saved_errno;
-
-	result = point_mount_count(mnt_point, 2);
-	if (result != 1)
+	switch (job->method)
 	{
-		if (result < 0)
+	case mount_job_method_external:
+		switch (job->status)
 		{
-			if (error_code != NULL)
-			{
-				*error_code = dtmd_error_code_generic_error;
-			}
+		case 16: /* problems writing or locking /etc/mtab */
+			WRITE_LOG(LOG_WARNING, "Failed to modify /etc/mtab");
+			/* NOTE: fallthrough */
+		case 0:  /* success */
+			WRITE_LOG_ARGS(LOG_INFO, "Mounted device '%s' to path '%s'", job->path, job->mount_point);
+			job->result = result_success;
+			break;
 
-			return result_fatal_error;
+		default:
+			WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s' to path '%s' using external mount: error, code %d", job->path, job->mount_point, job->status);
+			job->result = result_fail;
+			break;
 		}
-		else
+		break;
+
+#if (defined OS_Linux)
+	case mount_job_method_internal:
+		if (job->status == 0)
 		{
-			if (error_code != NULL)
+			if (is_result_successful(is_mtab_writable()))
 			{
-				*error_code = dtmd_error_code_device_not_mounted;
+				if (is_result_failure(add_to_mtab(job->path, job->mount_point, job->fstype, job->full_options)))
+				{
+					// NOTE: failing to modify /etc/mtab is non-fatal error
+					WRITE_LOG(LOG_WARNING, "Failed to modify " dtmd_internal_mtab_file );
+				}
 			}
 
-			return result_fail;
+			WRITE_LOG_ARGS(LOG_INFO, "Mounted device '%s' to path '%s'", job->path, job->mount_point);
+			job->result = result_success;
+
+			// there's no need to wait for kernel to report new mount
+			if (is_result_fatal_error(apply_daemon_mount(job->path, job->mount_point, job->full_options)))
+			{
+				return result_fatal_error;
+			}
+		}
+		else
+		{
+			WRITE_LOG_ARGS(LOG_WARNING, "Failed mounting device '%s' to path '%s'", job->path, job->mount_point);
+			job->result = result_fail;
 		}
+		break;
+#endif /* (defined OS_Linux) */
 	}
 
-	// TODO: check that it's original mounter who requests unmount or root?
-
-	result = umount(mnt_point);
-
-	if (result != 0)
+	if (is_result_failure(job->result))
 	{
-		saved_errno = errno;
+		job->error_code = dtmd_error_code_generic_error;
+		rmdir(job->mount_point);
+	}
 
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed unmounting device '%s' from path '%s'", path, mnt_point);
+	return result_success;
+}
 
-		if (error_code != NULL)
-		{
-			if (saved_errno == EBUSY)
-			{
-				*error_code = dtmd_error_code_mount_point_busy;
-			}
-			else
-			{
-				*error_code = dtmd_error_code_generic_error;
-			}
-		}
+int invoke_mount(struct client *client_ptr, const char *path, const char *mount_options, enum mount_by_value_enum mount_type)
+{
+	mount_job_t *job;
 
-		result = result_fail;
-	}
-	else
+	job = mount_job_new(mount_job_type_mount, client_ptr, path, mount_options, mount_type);
+	if (job == NULL)
 	{
-		if (is_result_successful(is_mtab_writable()))
-		{
-			result = remove_from_mtab(path, mnt_point, fstype);
-			if (is_result_failure(result))
-			{
-				// NOTE: failing to modify /etc/mtab is non-fatal error
-				WRITE_LOG(LOG_WARNING, "Failed to modify " dtmd_internal_mtab_file);
-			}
-		}
-
-		WRITE_LOG_ARGS(LOG_INFO, "Unmounted device '%s' from path '%s'", path, mnt_point);
-		result = result_success;
+		return result_fatal_error;
 	}
 
-	return result;
+	return mount_jobs_submit(job);
 }
-#endif /* (defined OS_Linux) */
 
-static int invoke_unmount_common(struct client *client_ptr, const char *path, const char *mnt_point, const char *fstype, dtmd_error_code_t *error_code)
+int prepare_unmount(mount_job_t *job)
 {
+	dtmd_removable_media_t *media_ptr;
+	const struct dtmd_filesystem_options *fsopts;
+#if (defined OS_Linux)
 	int result;
+#endif /* (defined OS_Linux) */
 
-	const struct dtmd_filesystem_options *fsopts;
+	media_ptr = find_media(job->path);
+	if (media_ptr == NULL)
+	{
+		WRITE_LOG_ARGS(LOG_WARNING, "Failed unmounting device '%s': device does not exist", job->path);
+		job->error_code = dtmd_error_code_no_such_removable_device;
+		return result_fail;
+	}
 
-	fsopts = get_fsopts_for_fs(fstype);
-	if (fsopts == NULL)
+	if (media_ptr->mnt_point == NULL)
 	{
-		result = result_fail;
+		WRITE_LOG_ARGS(LOG_WARNING, "Failed unmounting device '%s': device is not mounted", job->path);
+		job->error_code = dtmd_error_code_device_not_mounted;
+		return result_fail;
+	}
 
-		if (error_code != NULL)
-		{
-			*error_code = dtmd_error_code_unsupported_fstype;
-		}
+	fsopts = get_fsopts_for_fs(media_ptr->fstype);
+	if (fsopts == NULL)
+	{
+		job->error_code = dtmd_error_code_unsupported_fstype;
+		return result_fail;
+	}
 
-		goto invoke_unmount_common_error_1;
+	job->mount_point = strdup(media_ptr->mnt_point);
+	if (job->mount_point == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		job->error_code = dtmd_error_code_generic_error;
+		return result_fatal_error;
 	}
 
 #if (defined OS_Linux)
 #if (!defined DISABLE_EXT_MOUNT)
 	if (fsopts->external_fstype != NULL)
 	{
-		result = invoke_unmount_external(client_ptr, path, mnt_point, fsopts->external_fstype, error_code);
+		if (is_result_failure(build_unmount_command(job, fsopts->external_fstype)))
+		{
+			job->error_code = dtmd_error_code_generic_error;
+			return result_fatal_error;
+		}
+
+		return result_success;
+	}
+#endif /* (!defined DISABLE_EXT_MOUNT) */
+
+	result = point_mount_count(job->mount_point, 2);
+	if (result != 1)
+	{
+		if (result < 0)
+		{
+			job->error_code = dtmd_error_code_generic_error;
+			return result_fatal_error;
+		}
+		else
+		{
+			job->error_code = dtmd_error_code_device_not_mounted;
+			return result_fail;
+		}
 	}
-	else
+
+	// TODO: check that it's original mounter who requests unmount or root?
+
+	job->fstype = strdup(fsopts->fstype);
+	if (job->fstype == NULL)
 	{
-#endif /* (!defined DISABLE_EXT_MOUNT) */
-		result = invoke_unmount_internal(client_ptr, path, mnt_point, fsopts->fstype, error_code);
-#if (!defined DISABLE_EXT_MOUNT)
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		job->error_code = dtmd_error_code_generic_error;
+		return result_fatal_error;
 	}
-#endif /* (!defined DISABLE_EXT_MOUNT) */
+
+	job->method = mount_job_method_internal;
 #else /* (defined OS_Linux) */
 #if (defined OS_FreeBSD)
-	result = invoke_unmount_external(client_ptr, path, mnt_point, fsopts->external_fstype, error_code);
+	if (is_result_failure(build_unmount_command(job, fsopts->external_fstype)))
+	{
+		job->error_code = dtmd_error_code_generic_error;
+		return result_fatal_error;
+	}
 #else /* (defined OS_FreeBSD) */
 #error Unsupported OS
 #endif /* (defined OS_FreeBSD) */
 #endif /* (defined OS_Linux) */
 
-	if (is_result_successful(result))
+	return result_success;
+}
+
+void execute_unmount(mount_job_t *job)
+{
+	switch (job->method)
 	{
-		if (get_dir_state(mnt_point) == dir_state_empty)
+	case mount_job_method_external:
+		mount_job_run_command(job);
+		break;
+
+#if (defined OS_Linux)
+	case mount_job_method_internal:
+		if (umount(job->mount_point) == 0)
 		{
-			rmdir(mnt_point);
+			job->status = 0;
 		}
+		else
+		{
+			job->status = errno;
+		}
+		break;
+#endif /* (defined OS_Linux) */
 	}
-
-invoke_unmount_common_error_1:
-	return result;
 }
 
-int invoke_unmount(struct client *client_ptr, const char *path, dtmd_error_code_t *error_code)
+int finish_unmount(mount_job_t *job)
 {
-	dtmd_removable_media_t *media_ptr;
-
-	media_ptr = dtmd_find_media(path, removable_media_root);
-	if (media_ptr == NULL)
+	switch (job->method)
 	{
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed unmounting device '%s': device does not exist", path);
+	case mount_job_method_external:
+		if (job->status == 0)
+		{
+			WRITE_LOG_ARGS(LOG_INFO, "Unmounted device '%s' from path '%s'", job->path, job->mount_point);
+			job->result = result_success;
+		}
+		else
+		{
+			WRITE_LOG_ARGS(LOG_WARNING, "Failed unmounting device '%s' from path '%s' using external umount: error, code %d", job->path, job->mount_point, job->status);
+			job->error_code = dtmd_error_code_generic_error;
+			job->result = result_fail;
+		}
+		break;
 
-		if (error_code != NULL)
+#if (defined OS_Linux)
+	case mount_job_method_internal:
+		if (job->status == 0)
 		{
-			*error_code = dtmd_error_code_no_such_removable_device;
+			if (is_result_successful(is_mtab_writable()))
+			{
+				if (is_result_failure(remove_from_mtab(job->path, job->mount_point, job->fstype)))
+				{
+					// NOTE: failing to modify /etc/mtab is non-fatal error
+					WRITE_LOG(LOG_WARNING, "Failed to modify " dtmd_internal_mtab_file);
+				}
+			}
+
+			WRITE_LOG_ARGS(LOG_INFO, "Unmounted device '%s' from path '%s'", job->path, job->mount_point);
+			job->result = result_success;
+
+			if (is_result_fatal_error(apply_daemon_unmount(job->path, job->mount_point)))
+			{
+				return result_fatal_error;
+			}
 		}
+		else
+		{
+			WRITE_LOG_ARGS(LOG_WARNING, "Failed unmounting device '%s' from path '%s'", job->path, job->mount_point);
 
-		return result_fail;
+			if (job->status == EBUSY)
+			{
+				job->error_code = dtmd_error_code_mount_point_busy;
+			}
+			else
+			{
+				job->error_code = dtmd_error_code_generic_error;
+			}
+
+			job->result = result_fail;
+		}
+		break;
+#endif /* (defined OS_Linux) */
 	}
 
-	if (media_ptr->mnt_point == NULL)
+	if (is_result_successful(job->result))
 	{
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed unmounting device '%s': device is not mounted", path);
-
-		if (error_code != NULL)
+		if (get_dir_state(job->mount_point) == dir_state_empty)
 		{
-			*error_code = dtmd_error_code_device_not_mounted;
+			rmdir(job->mount_point);
 		}
+	}
 
-		return result_fail;
+	return result_success;
+}
+
+int invoke_unmount(struct client *client_ptr, const char *path)
+{
+	mount_job_t *job;
+
+	job = mount_job_new(mount_job_type_unmount, client_ptr, path, NULL, mount_by_device_name);
+	if (job == NULL)
+	{
+		return result_fatal_error;
 	}
 
-	return invoke_unmount_common(client_ptr, path, media_ptr->mnt_point, media_ptr->fstype, error_code);
+	return mount_jobs_submit(job);
 }
 
 static int invoke_unmount_recursive(struct client *client_ptr, dtmd_removable_media_t *media_ptr)
 {
 	int result;
 	dtmd_removable_media_t *iter_media_ptr;
+	mount_job_t *job;
 
 	for (iter_media_ptr = media_ptr->children_list; iter_media_ptr != NULL; iter_media_ptr = iter_media_ptr->next_node)
 	{
@@ -949,7 +1013,21 @@ static int invoke_unmount_recursive(struct client *client_ptr, dtmd_removable_me
 
 	if (media_ptr->mnt_point != NULL)
 	{
-		result = invoke_unmount_common(client_ptr, media_ptr->path, media_ptr->mnt_point, media_ptr->fstype, NULL);
+		job = mount_job_new(mount_job_type_unmount, client_ptr, media_ptr->path, NULL, mount_by_device_name);
+		if (job == NULL)
+		{
+			return result_fatal_error;
+		}
+
+		result = prepare_unmount(job);
+		if (is_result_successful(result))
+		{
+			execute_unmount(job);
+			result = finish_unmount(job);
+		}
+
+		mount_job_free(job);
+
 		if (is_result_fatal_error(result))
 		{
 			return result;
@@ -24,16 +24,30 @@
 #include <dtmd.h>
 #include "daemon/config_file.h"
 #include "daemon/lists.h"
+#include "daemon/mount_jobs.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* NOTE: invoke_unmount and invoke_unmount_all can take -1 as client number meaning the client is daemon itself */
+/*
+ * Mount and unmount requests of clients are executed asynchronously,
+ * reply is sent to client when operation is completed. See mount_jobs.h
+ */
+
+int invoke_mount(struct client *client_ptr, const char *path, const char *mount_options, enum mount_by_value_enum mount_type);
+int invoke_unmount(struct client *client_ptr, const char *path);
+
+/* finishing step stores result in job, returned value reports only fatal errors */
+int prepare_mount(mount_job_t *job);
+void execute_mount(mount_job_t *job);
+int finish_mount(mount_job_t *job);
 
-int invoke_mount(struct client *client_ptr, const char *path, const char *mount_options, enum mount_by_value_enum mount_type, dtmd_error_code_t *error_code);
-int invoke_unmount(struct client *client_ptr, const char *path, dtmd_error_code_t *error_code);
+int prepare_unmount(mount_job_t *job);
+void execute_unmount(mount_job_t *job);
+int finish_unmount(mount_job_t *job);
 
+/* unmounts everything synchronously, client_ptr may be NULL meaning the client is daemon itself */
 int invoke_unmount_all(struct client *client_ptr);
 
 #ifdef __cplusplus
@@ -18,12 +18,9 @@
  *
  */
 
-#if (defined OS_FreeBSD)
-#define _WITH_DPRINTF
-#endif /* (defined OS_FreeBSD) */
-
 #include "daemon/filesystem_opts.h"
 
+#include "daemon/client_io.h"
 #include "daemon/lists.h"
 #include "daemon/log.h"
 #include "daemon/return_codes.h"
@@ -1388,7 +1385,7 @@ int invoke_list_supported_filesystems(struct client *client_ptr)
 	const struct dtmd_filesystem_options *fsopts = filesystem_mount_options;
 	int first = 1;
 
-	if (dprintf(client_ptr->clientfd, dtmd_response_started "(%zu " dtmd_command_list_supported_filesystems ")\n" dtmd_response_argument_supported_filesystems_lists "(", strlen(dtmd_command_list_supported_filesystems)) < 0)
+	if (is_result_failure(client_printf(client_ptr, dtmd_response_started "(%s%zu " dtmd_command_list_supported_filesystems ")\n" dtmd_response_argument_supported_filesystems_lists "(", client_ptr->request_tag, strlen(dtmd_command_list_supported_filesystems))))
 	{
 		return result_client_error;
 	}
@@ -1413,13 +1410,13 @@ int invoke_list_supported_filesystems(struct client *client_ptr)
 			}
 			else
 			{
-				if (dprintf(client_ptr->clientfd, ", ") < 0)
+				if (is_result_failure(client_printf(client_ptr, ", ")))
 				{
 					return result_client_error;
 				}
 			}
 
-			if (dprintf(client_ptr->clientfd, "%zu %s", strlen(fsopts->fstype), fsopts->fstype) < 0)
+			if (is_result_failure(client_printf(client_ptr, "%zu %s", strlen(fsopts->fstype), fsopts->fstype)))
 			{
 				return result_client_error;
 			}
@@ -1433,7 +1430,7 @@ int invoke_list_supported_filesystems(struct client *client_ptr)
 		++fsopts;
 	}
 
-	if (dprintf(client_ptr->clientfd, ")\n" dtmd_response_finished "(%zu " dtmd_command_list_supported_filesystems ")\n", strlen(dtmd_command_list_supported_filesystems)) < 0)
+	if (is_result_failure(client_printf(client_ptr, ")\n" dtmd_response_finished "(%s%zu " dtmd_command_list_supported_filesystems ")\n", client_ptr->request_tag, strlen(dtmd_command_list_supported_filesystems))))
 	{
 		return result_client_error;
 	}
@@ -1455,10 +1452,10 @@ int invoke_list_supported_filesystem_options(struct client *client_ptr, const ch
 	if (fsopts == NULL)
 #endif /* (defined OS_Linux) && (defined DISABLE_EXT_MOUNT) */
 	{
-		if (dprintf(client_ptr->clientfd, dtmd_response_failed "(%zu " dtmd_command_list_supported_filesystem_options ", %zu %s, %d%s%s)\n",
-			strlen(dtmd_command_list_supported_filesystem_options),
+		if (is_result_failure(client_printf(client_ptr, dtmd_response_failed "(%s%zu " dtmd_command_list_supported_filesystem_options ", %zu %s, %d%s%s)\n",
+			client_ptr->request_tag, strlen(dtmd_command_list_supported_filesystem_options),
 			strlen(filesystem), filesystem,
-			dt_helper_print_with_all_checks(dtmd_error_code_to_string(dtmd_error_code_unsupported_fstype))) < 0)
+			dt_helper_print_with_all_checks(dtmd_error_code_to_string(dtmd_error_code_unsupported_fstype)))))
 		{
 			return result_client_error;
 		}
@@ -1466,9 +1463,9 @@ int invoke_list_supported_filesystem_options(struct client *client_ptr, const ch
 		return result_fail;
 	}
 
-	if (dprintf(client_ptr->clientfd, dtmd_response_started "(%zu " dtmd_command_list_supported_filesystem_options ", %zu %s)\n" dtmd_response_argument_supported_filesystem_options_lists "(",
-		strlen(dtmd_command_list_supported_filesystem_options),
-		strlen(filesystem), filesystem) < 0)
+	if (is_result_failure(client_printf(client_ptr, dtmd_response_started "(%s%zu " dtmd_command_list_supported_filesystem_options ", %zu %s)\n" dtmd_response_argument_supported_filesystem_options_lists "(",
+		client_ptr->request_tag, strlen(dtmd_command_list_supported_filesystem_options),
+		strlen(filesystem), filesystem)))
 	{
 		return result_client_error;
 	}
@@ -1483,22 +1480,22 @@ int invoke_list_supported_filesystem_options(struct client *client_ptr, const ch
 			}
 			else
 			{
-				if (dprintf(client_ptr->clientfd, ", ") < 0)
+				if (is_result_failure(client_printf(client_ptr, ", ")))
 				{
 					return result_client_error;
 				}
 			}
 
-			if (dprintf(client_ptr->clientfd, "%zu %s", strlen(option_list->option), option_list->option) < 0)
+			if (is_result_failure(client_printf(client_ptr, "%zu %s", strlen(option_list->option), option_list->option)))
 			{
 				return result_client_error;
 			}
 		}
 	}
 
-	if (dprintf(client_ptr->clientfd, ")\n" dtmd_response_finished "(%zu " dtmd_command_list_supported_filesystem_options ", %zu %s)\n",
-		strlen(dtmd_command_list_supported_filesystem_options),
-		strlen(filesystem), filesystem) < 0)
+	if (is_result_failure(client_printf(client_ptr, ")\n" dtmd_response_finished "(%s%zu " dtmd_command_list_supported_filesystem_options ", %zu %s)\n",
+		client_ptr->request_tag, strlen(dtmd_command_list_supported_filesystem_options),
+		strlen(filesystem), filesystem)))
 	{
 		return result_client_error;
 	}
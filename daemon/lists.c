@@ -22,6 +22,7 @@
 
 #include "daemon/label.h"
 #include "daemon/actions.h"
+#include "daemon/client_io.h"
 #include "daemon/log.h"
 #include "daemon/return_codes.h"
 
@@ -33,7 +34,152 @@
 dtmd_removable_media_t *removable_media_root = NULL;
 
 struct client *client_root = NULL;
+static struct client *client_last = NULL; /* clients are appended, keeping order of connection */
 size_t clients_count = 0;
+size_t clients_scheduled_for_removal = 0;
+
+#define media_index_initial_size 64
+
+static dtmd_removable_media_private_t **media_index = NULL;
+static size_t media_index_size = 0;
+static size_t media_index_count = 0;
+
+static size_t media_path_hash(const char *path)
+{
+	size_t hash = 2166136261u;
+
+	while (*path != 0)
+	{
+		hash ^= (unsigned char) *path;
+		hash *= 16777619u;
+		++path;
+	}
+
+	return hash;
+}
+
+static int media_index_grow(void)
+{
+	dtmd_removable_media_private_t **new_index;
+	dtmd_removable_media_private_t *cur;
+	dtmd_removable_media_private_t *next;
+	size_t new_size;
+	size_t i;
+
+	new_size = (media_index_size > 0) ? (media_index_size * 2) : media_index_initial_size;
+
+	new_index = (dtmd_removable_media_private_t**) calloc(new_size, sizeof(dtmd_removable_media_private_t*));
+	if (new_index == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return result_fatal_error;
+	}
+
+	for (i = 0; i < media_index_size; ++i)
+	{
+		for (cur = media_index[i]; cur != NULL; cur = next)
+		{
+			next = cur->next_hashed;
+			cur->next_hashed = new_index[cur->path_hash & (new_size - 1)];
+			new_index[cur->path_hash & (new_size - 1)] = cur;
+		}
+	}
+
+	if (media_index != NULL)
+	{
+		free(media_index);
+	}
+
+	media_index = new_index;
+	media_index_size = new_size;
+
+	return result_success;
+}
+
+static int media_index_add(dtmd_removable_media_private_t *media_ptr)
+{
+	size_t bucket;
+
+	if (media_index_count >= media_index_size)
+	{
+		if (is_result_failure(media_index_grow()))
+		{
+			return result_fatal_error;
+		}
+	}
+
+	media_ptr->path_hash = media_path_hash(media_ptr->parent.path);
+
+	bucket = media_ptr->path_hash & (media_index_size - 1);
+	media_ptr->next_hashed = media_index[bucket];
+	media_index[bucket] = media_ptr;
+
+	++media_index_count;
+
+	return result_success;
+}
+
+static void media_index_remove(dtmd_removable_media_private_t *media_ptr)
+{
+	dtmd_removable_media_private_t **iter;
+
+	for (iter = &(media_index[media_ptr->path_hash & (media_index_size - 1)]); *iter != NULL; iter = &((*iter)->next_hashed))
+	{
+		if (*iter == media_ptr)
+		{
+			*iter = media_ptr->next_hashed;
+			--media_index_count;
+			break;
+		}
+	}
+}
+
+dtmd_removable_media_t* find_media(const char *path)
+{
+	dtmd_removable_media_private_t *cur;
+	size_t hash;
+
+	if (media_index_count == 0)
+	{
+		return NULL;
+	}
+
+	hash = media_path_hash(path);
+
+	for (cur = media_index[hash & (media_index_size - 1)]; cur != NULL; cur = cur->next_hashed)
+	{
+		if ((cur->path_hash == hash) && (strcmp(cur->parent.path, path) == 0))
+		{
+			return &(cur->parent);
+		}
+	}
+
+	return NULL;
+}
+
+int is_media_probing(const char *path)
+{
+	dtmd_removable_media_t *media_ptr;
+
+	media_ptr = find_media(path);
+	if (media_ptr == NULL)
+	{
+		return 0;
+	}
+
+	return ((dtmd_removable_media_private_t*) media_ptr->private_data)->is_probing;
+}
+
+void set_media_probing(const char *path, int is_probing)
+{
+	dtmd_removable_media_t *media_ptr;
+
+	media_ptr = find_media(path);
+	if (media_ptr != NULL)
+	{
+		((dtmd_removable_media_private_t*) media_ptr->private_data)->is_probing = is_probing;
+	}
+}
 
 static void remove_media_helper(dtmd_removable_media_t *media_ptr)
 {
@@ -78,6 +224,10 @@ static void remove_media_helper(dtmd_removable_media_t *media_ptr)
 
 	notify_removable_device_removed(media_ptr->path);
 
+	private_data = (dtmd_removable_media_private_t*) (media_ptr->private_data);
+
+	media_index_remove(private_data);
+
 	// and free node itself
 	free(media_ptr->path);
 
@@ -101,8 +251,6 @@ static void remove_media_helper(dtmd_removable_media_t *media_ptr)
 		free(media_ptr->mnt_opts);
 	}
 
-	private_data = (dtmd_removable_media_private_t*) (media_ptr->private_data);
-
 #if (defined OS_Linux)
 	if (private_data->sysfs_path != NULL)
 	{
@@ -140,7 +288,7 @@ int add_media(const char *parent_path,
 
 	if (!is_parent_path)
 	{
-		media_ptr = dtmd_find_media(parent_path, removable_media_root);
+		media_ptr = find_media(parent_path);
 		if (media_ptr == NULL)
 		{
 			return result_fail;
@@ -196,6 +344,13 @@ int add_media(const char *parent_path,
 		constructed_media->label = NULL;
 	}
 
+#if (defined OS_Linux)
+	constructed_media_private->mount_id = -1;
+#endif /* (defined OS_Linux) */
+
+	constructed_media_private->is_probing = 0;
+	constructed_media_private->is_found = 0;
+
 	if (mnt_point != NULL)
 	{
 		constructed_media_private->mount_counter = 1;
@@ -245,6 +400,11 @@ int add_media(const char *parent_path,
 
 	constructed_media->children_list = NULL;
 
+	if (is_result_failure(media_index_add(constructed_media_private)))
+	{
+		goto add_media_error_8;
+	}
+
 	if (is_parent_path)
 	{
 		constructed_media->parent = NULL;
@@ -309,21 +469,19 @@ int add_media(const char *parent_path,
 
 	return result_success;
 
-#if (defined OS_Linux)
-/*
 add_media_error_8:
+#if (defined OS_Linux)
 	if (constructed_media_private->sysfs_path != NULL)
 	{
 		free(constructed_media_private->sysfs_path);
 	}
-*/
 
 add_media_error_7:
+#endif /* (defined OS_Linux) */
 	if (constructed_media->mnt_opts != NULL)
 	{
 		free(constructed_media->mnt_opts);
 	}
-#endif /* (defined OS_Linux) */
 
 add_media_error_6:
 	if (constructed_media->mnt_point != NULL)
@@ -353,11 +511,47 @@ add_media_error_1:
 	return result_fatal_error;
 }
 
+void set_media_found(dtmd_removable_media_t *media_ptr)
+{
+	((dtmd_removable_media_private_t*) media_ptr->private_data)->is_found = 1;
+}
+
+static void remove_not_found_media_helper(dtmd_removable_media_t *media_list)
+{
+	dtmd_removable_media_t *media_ptr;
+	dtmd_removable_media_t *next;
+	dtmd_removable_media_private_t *private_data;
+
+	for (media_ptr = media_list; media_ptr != NULL; media_ptr = next)
+	{
+		next = media_ptr->next_node;
+
+		// children are visited first, so every device is visited once
+		remove_not_found_media_helper(media_ptr->children_list);
+
+		private_data = (dtmd_removable_media_private_t*) (media_ptr->private_data);
+
+		if (private_data->is_found)
+		{
+			private_data->is_found = 0;
+		}
+		else
+		{
+			remove_media(media_ptr->path);
+		}
+	}
+}
+
+void remove_not_found_media(void)
+{
+	remove_not_found_media_helper(removable_media_root);
+}
+
 int remove_media(const char *path)
 {
 	dtmd_removable_media_t *media_ptr;
 
-	media_ptr = dtmd_find_media(path, removable_media_root);
+	media_ptr = find_media(path);
 	if (media_ptr == NULL)
 	{
 		return result_fail;
@@ -390,7 +584,7 @@ int change_media(const char *parent_path,
 	dtmd_removable_media_t *media_ptr;
 	dtmd_removable_media_private_t *private_ptr;
 
-	media_ptr = dtmd_find_media(path, removable_media_root);
+	media_ptr = find_media(path);
 	if (media_ptr == NULL)
 	{
 		WRITE_LOG_ARGS(LOG_ERR, "Caught false event about stateful device change: device name %s", path);
@@ -505,6 +699,10 @@ int change_media(const char *parent_path,
 		free(media_ptr->mnt_point);
 		media_ptr->mnt_point = NULL;
 		private_ptr->mount_counter = 0;
+
+#if (defined OS_Linux)
+		private_ptr->mount_id = -1;
+#endif /* (defined OS_Linux) */
 	}
 
 	if ((media_ptr->mnt_point == NULL) && (mnt_point != NULL))
@@ -570,25 +768,20 @@ void remove_all_media(void)
 	}
 
 	removable_media_root = NULL;
+
+	if (media_index != NULL)
+	{
+		free(media_index);
+		media_index = NULL;
+	}
+
+	media_index_size = 0;
+	media_index_count = 0;
 }
 
-int add_client(int client_fd)
+int add_client(int client_fd, struct client **new_client)
 {
 	struct client *cur_client;
-	struct client *client_iter = NULL;
-
-	cur_client = client_root;
-
-	while (cur_client != NULL)
-	{
-		client_iter = cur_client;
-		cur_client = cur_client->next_node;
-
-		if (client_iter->clientfd == client_fd)
-		{
-			return result_fail;
-		}
-	}
 
 	cur_client = (struct client*) malloc(sizeof(struct client));
 	if (cur_client == NULL)
@@ -599,22 +792,41 @@ int add_client(int client_fd)
 
 	cur_client->clientfd = client_fd;
 	cur_client->buf_used = 0;
+	cur_client->request_tag[0] = 0;
+
+	cur_client->outqueue = NULL;
+	cur_client->outqueue_capacity = 0;
+	cur_client->outqueue_head = 0;
+	cur_client->outqueue_count = 0;
+	cur_client->outqueue_bytes = 0;
+
+	cur_client->is_corked = 0;
+	cur_client->is_write_blocked = 0;
+	cur_client->is_overflown = 0;
+	cur_client->is_throttled = 0;
+	cur_client->is_removal_scheduled = 0;
+
+	cur_client->prev_node = client_last;
+	cur_client->next_node = NULL;
 
-	if (client_iter != NULL)
+	if (client_last != NULL)
 	{
-		client_iter->next_node = cur_client;
-		cur_client->prev_node = client_iter;
+		client_last->next_node = cur_client;
 	}
 	else
 	{
-		cur_client->prev_node = NULL;
 		client_root = cur_client;
 	}
 
-	cur_client->next_node = NULL;
+	client_last = cur_client;
 
 	++clients_count;
 
+	if (new_client != NULL)
+	{
+		*new_client = cur_client;
+	}
+
 	return result_success;
 
 /*
@@ -628,45 +840,39 @@ add_client_error_1:
 	return result_fatal_error;
 }
 
-int remove_client(int client_fd)
+void remove_client(struct client *client_ptr)
 {
-	struct client *cur_client;
-
-	for (cur_client = client_root; cur_client != NULL; cur_client = cur_client->next_node)
+	if (client_ptr->prev_node != NULL)
 	{
-		if (cur_client->clientfd == client_fd)
-		{
-			break;
-		}
+		client_ptr->prev_node->next_node = client_ptr->next_node;
 	}
 
-	if (cur_client == NULL)
+	if (client_ptr->next_node != NULL)
 	{
-		return result_fail;
+		client_ptr->next_node->prev_node = client_ptr->prev_node;
 	}
 
-	if (cur_client->prev_node != NULL)
+	// make sure client_root and client_last stay valid
+	if (client_ptr == client_root)
 	{
-		cur_client->prev_node->next_node = cur_client->next_node;
+		client_root = client_ptr->next_node;
 	}
 
-	if (cur_client->next_node != NULL)
+	if (client_ptr == client_last)
 	{
-		cur_client->next_node->prev_node = cur_client->prev_node;
+		client_last = client_ptr->prev_node;
 	}
 
-	// make sure client_root stays valid
-	if (cur_client == client_root)
+	if (client_ptr->is_removal_scheduled)
 	{
-		client_root = cur_client->next_node;
+		--clients_scheduled_for_removal;
 	}
 
-	shutdown(cur_client->clientfd, SHUT_RDWR);
-	close(cur_client->clientfd);
-	free(cur_client);
+	shutdown(client_ptr->clientfd, SHUT_RDWR);
+	close(client_ptr->clientfd);
+	client_free_queue(client_ptr);
+	free(client_ptr);
 	--clients_count;
-
-	return result_success;
 }
 
 void remove_all_clients(void)
@@ -683,9 +889,12 @@ void remove_all_clients(void)
 
 		shutdown(cur->clientfd, SHUT_RDWR);
 		close(cur->clientfd);
+		client_free_queue(cur);
 		free(cur);
 	}
 
 	client_root = NULL;
+	client_last = NULL;
 	clients_count = 0;
+	clients_scheduled_for_removal = 0;
 }
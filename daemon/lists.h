@@ -29,12 +29,30 @@
 extern "C" {
 #endif
 
+struct client_queue_item;
+
 struct client
 {
 	int clientfd;
 	size_t buf_used;
 	char buf[dtmd_command_max_length + 1];
 
+	/* "length id, " prefix of responses to tagged request being executed now or empty string */
+	char request_tag[dtmd_request_id_max_length + 8];
+
+	/* ring of outgoing messages, outqueue_bytes is amount of data not sent yet */
+	struct client_queue_item *outqueue;
+	size_t outqueue_capacity;
+	size_t outqueue_head;
+	size_t outqueue_count;
+	size_t outqueue_bytes;
+
+	unsigned char is_corked; /* delay sending while processing client's commands */
+	unsigned char is_write_blocked; /* waiting until socket is writable */
+	unsigned char is_overflown; /* notifications were dropped, resync is required */
+	unsigned char is_throttled; /* rest of received commands is executed after output queue is sent */
+	unsigned char is_removal_scheduled;
+
 	struct client *next_node;
 	struct client *prev_node;
 };
@@ -47,12 +65,24 @@ typedef struct dtmd_removable_media_private
 	char *sysfs_path;
 #endif /* (defined OS_Linux) */
 	int mount_counter;
+
+#if (defined OS_Linux)
+	long long mount_id; /* id of mount reported for device or -1 */
+#endif /* (defined OS_Linux) */
+
+	int is_probing; /* device is announced, but its filesystem isn't probed yet */
+	int is_found; /* device is reported again while rereading all devices */
+
+	/* index of devices by path */
+	size_t path_hash;
+	struct dtmd_removable_media_private *next_hashed;
 } dtmd_removable_media_private_t;
 
 extern dtmd_removable_media_t *removable_media_root;
 
 extern struct client *client_root;
 extern size_t clients_count;
+extern size_t clients_scheduled_for_removal;
 
 int add_media(const char *parent_path,
 	const char *path,
@@ -84,8 +114,18 @@ int change_media(const char *parent_path,
 
 void remove_all_media(void);
 
-int add_client(int client_fd);
-int remove_client(int client_fd);
+/* finds device by path using index, unlike dtmd_find_media it doesn't walk whole tree */
+dtmd_removable_media_t* find_media(const char *path);
+
+int is_media_probing(const char *path);
+void set_media_probing(const char *path, int is_probing);
+
+/* devices not marked as found are removed, marks of remaining devices are cleared */
+void set_media_found(dtmd_removable_media_t *media_ptr);
+void remove_not_found_media(void);
+
+int add_client(int client_fd, struct client **new_client);
+void remove_client(struct client *client_ptr);
 
 void remove_all_clients(void);
 
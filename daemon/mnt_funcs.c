@@ -27,6 +27,10 @@
 #include "daemon/log.h"
 #include "daemon/return_codes.h"
 
+#if (defined OS_Linux)
+#include "daemon/mount_table.h"
+#endif /* (defined OS_Linux) */
+
 #if (defined OS_FreeBSD)
 #include "daemon/filesystem_opts.h"
 #endif /* (defined OS_FreeBSD) */
@@ -54,16 +58,29 @@
 #define is_processed     (1<<2)
 
 #if (defined OS_Linux)
+/*
+ * mount monitoring descriptor is also used for reading mount table,
+ * unless kernel is able to report mounts via listmount() and statmount()
+ */
+static mount_table_t mount_table;
+static int mount_table_fd = -1;
+static int use_kernel_mount_table = 0;
+
 int init_mount_monitoring(void)
 {
 	int mountfd;
 
-	mountfd = open(dtmd_internal_mounts_file, O_RDONLY);
+	mountfd = open(dtmd_internal_mountinfo_file, O_RDONLY);
 	if (mountfd < 0)
 	{
 		WRITE_LOG(LOG_ERR, "Failed to open mounts file descriptor");
+		return mountfd;
 	}
 
+	mount_table_init(&mount_table);
+	mount_table_fd = mountfd;
+	use_kernel_mount_table = is_result_successful(mount_table_kernel_supported());
+
 	return mountfd;
 }
 #endif /* (defined OS_Linux) */
@@ -97,9 +114,15 @@ int init_mount_monitoring(void)
 
 int close_mount_monitoring(int monitorfd)
 {
+#if (defined OS_Linux)
+	mount_table_free(&mount_table);
+	mount_table_fd = -1;
+#endif /* (defined OS_Linux) */
+
 	return close(monitorfd);
 }
 
+#if (defined OS_FreeBSD)
 static void mark_each_device_recursive(dtmd_removable_media_t *media_ptr)
 {
 	dtmd_removable_media_t *iter_media_ptr;
@@ -149,127 +172,270 @@ static void process_changes_recursive(dtmd_removable_media_t *media_ptr)
 	}
 }
 
+#endif /* (defined OS_FreeBSD) */
+
 #if (defined OS_Linux)
-int check_mount_changes(void)
+static int set_media_mount(dtmd_removable_media_t *media_ptr, mount_table_entry_t *entry)
 {
-	FILE *mntfile;
-	struct mntent *ent;
-	dtmd_removable_media_t *iter_media_ptr;
 	dtmd_removable_media_private_t *private_ptr;
 
-	mntfile = setmntent(dtmd_internal_mounts_file, "r");
-	if (mntfile == NULL)
+	private_ptr = (dtmd_removable_media_private_t*) (media_ptr->private_data);
+	private_ptr->mount_id = entry->mount_id;
+	entry->is_watched = 1;
+
+	if ((media_ptr->mnt_point == NULL) || (strcmp(media_ptr->mnt_point, entry->mount_point) != 0))
 	{
-		WRITE_LOG_ARGS(LOG_ERR, "Failed opening file '%s'", dtmd_internal_mounts_file);
-		goto check_mount_changes_error_1;
+		if (media_ptr->mnt_point != NULL)
+		{
+			notify_removable_device_unmounted(media_ptr->path, media_ptr->mnt_point);
+			free(media_ptr->mnt_point);
+		}
+
+		media_ptr->mnt_point = strdup(entry->mount_point);
+		if (media_ptr->mnt_point == NULL)
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			return result_fatal_error;
+		}
+
+		notify_removable_device_mounted(media_ptr->path, media_ptr->mnt_point, entry->options);
 	}
 
-	for (iter_media_ptr = removable_media_root; iter_media_ptr != NULL; iter_media_ptr = iter_media_ptr->next_node)
+	if ((media_ptr->mnt_opts == NULL) || (strcmp(media_ptr->mnt_opts, entry->options) != 0))
 	{
-		mark_each_device_recursive(iter_media_ptr);
+		if (media_ptr->mnt_opts != NULL)
+		{
+			free(media_ptr->mnt_opts);
+		}
+
+		media_ptr->mnt_opts = strdup(entry->options);
+		if (media_ptr->mnt_opts == NULL)
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			return result_fatal_error;
+		}
+	}
+
+	return result_success;
+}
+
+static void clear_media_mount(dtmd_removable_media_t *media_ptr)
+{
+	dtmd_removable_media_private_t *private_ptr;
+
+	private_ptr = (dtmd_removable_media_private_t*) (media_ptr->private_data);
+	private_ptr->mount_id = -1;
+
+	if (media_ptr->mnt_point != NULL)
+	{
+		notify_removable_device_unmounted(media_ptr->path, media_ptr->mnt_point);
+
+		free(media_ptr->mnt_point);
+		media_ptr->mnt_point = NULL;
 	}
 
-	while ((ent = getmntent(mntfile)) != NULL)
+	if (media_ptr->mnt_opts != NULL)
 	{
-		iter_media_ptr = dtmd_find_media(ent->mnt_fsname, removable_media_root);
-		if (iter_media_ptr != NULL)
+		free(media_ptr->mnt_opts);
+		media_ptr->mnt_opts = NULL;
+	}
+}
+
+/* device may still be mounted somewhere else */
+static int detach_media_mount(dtmd_removable_media_t *media_ptr)
+{
+	mount_table_entry_t *entry;
+
+	entry = mount_table_find_source(&mount_table, media_ptr->path);
+	if (entry != NULL)
+	{
+		return set_media_mount(media_ptr, entry);
+	}
+
+	clear_media_mount(media_ptr);
+
+	return result_success;
+}
+
+int check_mount_changes(void)
+{
+	mount_table_changes_t changes;
+	mount_table_entry_t *entry;
+	dtmd_removable_media_t *media_ptr;
+	dtmd_removable_media_private_t *private_ptr;
+	int result = result_success;
+
+	if (use_kernel_mount_table)
+	{
+		if (is_result_failure(mount_table_update_kernel(&mount_table, &changes)))
 		{
-			private_ptr = (dtmd_removable_media_private_t*) (iter_media_ptr->private_data);
+			WRITE_LOG(LOG_ERR, "Failed to get list of mounts from kernel");
+			result = result_fatal_error;
+			goto check_mount_changes_exit;
+		}
+	}
+	else
+	{
+		if (is_result_failure(mount_table_read(&mount_table, mount_table_fd)))
+		{
+			WRITE_LOG_ARGS(LOG_ERR, "Failed reading file '%s'", dtmd_internal_mountinfo_file);
+			return result_fatal_error;
+		}
 
-			// skip devices mounted multiple times
-			if (!(private_ptr->mount_counter & is_processed))
-			{
-				private_ptr->mount_counter = private_ptr->mount_counter | is_processed;
+		if (is_result_failure(mount_table_update(&mount_table, mount_table.buffer, mount_table.buffer_used, &changes)))
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			result = result_fatal_error;
+			goto check_mount_changes_exit;
+		}
+	}
 
-				if ((ent->mnt_dir != NULL) && (ent->mnt_opts != NULL))
+	// only changed mounts of known devices need processing
+	for (entry = changes.removed; entry != NULL; entry = entry->next_changed)
+	{
+		media_ptr = find_media(entry->source);
+		if (media_ptr != NULL)
+		{
+			private_ptr = (dtmd_removable_media_private_t*) (media_ptr->private_data);
+
+			if (private_ptr->mount_id == entry->mount_id)
+			{
+				result = detach_media_mount(media_ptr);
+				if (is_result_failure(result))
 				{
-					private_ptr->mount_counter = private_ptr->mount_counter | is_mounted_now;
+					goto check_mount_changes_exit;
+				}
+			}
+		}
+	}
 
-					if ((iter_media_ptr->mnt_point == NULL) || (strcmp(iter_media_ptr->mnt_point, ent->mnt_dir) != 0))
-					{
-						if (iter_media_ptr->mnt_point != NULL)
-						{
-							notify_removable_device_unmounted(iter_media_ptr->path, iter_media_ptr->mnt_point);
-							free(iter_media_ptr->mnt_point);
-						}
-
-						iter_media_ptr->mnt_point = strdup(ent->mnt_dir);
-						if (iter_media_ptr->mnt_point == NULL)
-						{
-							WRITE_LOG(LOG_ERR, "Memory allocation failure");
-							goto check_mount_changes_error_2;
-						}
-
-						notify_removable_device_mounted(iter_media_ptr->path, iter_media_ptr->mnt_point, ent->mnt_opts);
-					}
+	for (entry = changes.modified; entry != NULL; entry = entry->next_changed)
+	{
+		media_ptr = find_media(entry->source);
+		if (media_ptr != NULL)
+		{
+			private_ptr = (dtmd_removable_media_private_t*) (media_ptr->private_data);
 
-					if ((iter_media_ptr->mnt_opts == NULL) || (strcmp(iter_media_ptr->mnt_opts, ent->mnt_opts) != 0))
-					{
-						if (iter_media_ptr->mnt_opts != NULL)
-						{
-							free(iter_media_ptr->mnt_opts);
-						}
-
-						iter_media_ptr->mnt_opts = strdup(ent->mnt_opts);
-						if (iter_media_ptr->mnt_opts == NULL)
-						{
-							WRITE_LOG(LOG_ERR, "Memory allocation failure");
-							goto check_mount_changes_error_2;
-						}
-					}
+			if (private_ptr->mount_id == entry->mount_id)
+			{
+				result = set_media_mount(media_ptr, entry);
+				if (is_result_failure(result))
+				{
+					goto check_mount_changes_exit;
 				}
-				else
+			}
+		}
+	}
+
+	// skip devices mounted multiple times
+	for (entry = changes.added; entry != NULL; entry = entry->next_changed)
+	{
+		media_ptr = find_media(entry->source);
+		if (media_ptr != NULL)
+		{
+			private_ptr = (dtmd_removable_media_private_t*) (media_ptr->private_data);
+
+			if (private_ptr->mount_id == -1)
+			{
+				result = set_media_mount(media_ptr, entry);
+				if (is_result_failure(result))
 				{
-					private_ptr->mount_counter = private_ptr->mount_counter & ~is_mounted_now;
+					goto check_mount_changes_exit;
 				}
 			}
 		}
 	}
 
-	endmntent(mntfile);
+check_mount_changes_exit:
+	mount_table_release_changes(&changes);
 
-	for (iter_media_ptr = removable_media_root; iter_media_ptr != NULL; iter_media_ptr = iter_media_ptr->next_node)
+	return result;
+}
+
+int check_media_mount(dtmd_removable_media_t *media_ptr)
+{
+	dtmd_removable_media_private_t *private_ptr;
+	mount_table_entry_t *entry;
+
+	if (media_ptr == NULL)
 	{
-		process_changes_recursive(iter_media_ptr);
+		return result_success;
 	}
 
-	return result_success;
+	private_ptr = (dtmd_removable_media_private_t*) (media_ptr->private_data);
+	if (private_ptr->mount_id != -1)
+	{
+		return result_success;
+	}
 
-check_mount_changes_error_2:
-	endmntent(mntfile);
+	entry = mount_table_find_source(&mount_table, media_ptr->path);
+	if (entry == NULL)
+	{
+		return result_success;
+	}
 
-check_mount_changes_error_1:
-	return result_fatal_error;
+	return set_media_mount(media_ptr, entry);
 }
 
-int point_mount_count(const char *path, int max)
+int apply_daemon_mount(const char *path, const char *mount_point, const char *mount_options)
 {
-	int result = 0;
-	FILE *mntfile;
-	struct mntent *ent;
+	dtmd_removable_media_t *media_ptr;
+	dtmd_removable_media_private_t *private_ptr;
+	mount_table_entry_t *entry;
 
-	mntfile = setmntent(dtmd_internal_mounts_file, "r");
-	if (mntfile == NULL)
+	// kernel may report the mount before daemon finishes processing it
+	entry = mount_table_find_mount(&mount_table, path, mount_point);
+	if (entry == NULL)
 	{
-		WRITE_LOG_ARGS(LOG_ERR, "Failed opening file '%s'", dtmd_internal_mounts_file);
-		return -1;
+		entry = mount_table_add_provisional(&mount_table, path, mount_point, mount_options);
+		if (entry == NULL)
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			return result_fatal_error;
+		}
 	}
 
-	while ((ent = getmntent(mntfile)) != NULL)
+	media_ptr = find_media(path);
+	if (media_ptr == NULL)
 	{
-		if (strcmp(ent->mnt_dir, path) == 0)
-		{
-			++result;
-			if ((max > 0) && (result == max))
-			{
-				break;
-			}
-		}
+		return result_success;
 	}
 
-	endmntent(mntfile);
+	private_ptr = (dtmd_removable_media_private_t*) (media_ptr->private_data);
+	if (private_ptr->mount_id != -1)
+	{
+		return result_success;
+	}
 
-	return result;
+	return set_media_mount(media_ptr, entry);
+}
+
+int apply_daemon_unmount(const char *path, const char *mount_point)
+{
+	dtmd_removable_media_t *media_ptr;
+	dtmd_removable_media_private_t *private_ptr;
+
+	media_ptr = find_media(path);
+	if ((media_ptr == NULL)
+		|| (media_ptr->mnt_point == NULL)
+		|| (strcmp(media_ptr->mnt_point, mount_point) != 0))
+	{
+		return result_success;
+	}
+
+	private_ptr = (dtmd_removable_media_private_t*) (media_ptr->private_data);
+	if (private_ptr->mount_id != -1)
+	{
+		mount_table_remove(&mount_table, private_ptr->mount_id);
+	}
+
+	return detach_media_mount(media_ptr);
+}
+
+/* mount table is kept up to date by check_mount_changes() */
+int point_mount_count(const char *path, int max)
+{
+	return mount_table_count_mount_point(&mount_table, path, max);
 }
 #endif /* (defined OS_Linux) */
 
@@ -322,7 +488,7 @@ int check_mount_changes(int mountfd)
 
 	for (current = 0; current < count; ++current)
 	{
-		iter_media_ptr = dtmd_find_media(mounts[current].f_mntfromname, removable_media_root);
+		iter_media_ptr = find_media(mounts[current].f_mntfromname);
 		if (iter_media_ptr != NULL)
 		{
 			private_ptr = (dtmd_removable_media_private_t*) (iter_media_ptr->private_data);
@@ -21,6 +21,8 @@
 #ifndef MNT_FUNCS_H
 #define MNT_FUNCS_H
 
+#include <dtmd.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -30,6 +32,16 @@ int close_mount_monitoring(int monitorfd);
 
 #if (defined OS_Linux)
 int check_mount_changes(void);
+
+/* looks up mounts of new or changed device in mount table */
+int check_media_mount(dtmd_removable_media_t *media_ptr);
+
+/*
+ * mounts and unmounts done by daemon itself are applied immediately,
+ * following notification from kernel about them doesn't cause any more changes
+ */
+int apply_daemon_mount(const char *path, const char *mount_point, const char *mount_options);
+int apply_daemon_unmount(const char *path, const char *mount_point);
 #endif /* (defined OS_Linux) */
 
 #if (defined OS_FreeBSD)
@@ -37,6 +49,7 @@ int check_mount_changes(void);
 int check_mount_changes(int mountfd);
 #endif /* (defined OS_FreeBSD) */
 
+/* on Linux mount points are looked up in mount table known to daemon */
 int point_mount_count(const char *path, int max);
 
 #if (defined OS_Linux)
@@ -27,17 +27,191 @@
 #include <libudev.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 
 #define ID_CDROM_MEDIA_STATE_BLANK "blank"
 #define ID_CDROM_MEDIA_STATE_COMPLETE "complete"
 
+#define rejected_devices_initial_size 64
+
+/* kernel names of devices which are never removable media, their events are discarded before reading any property */
+static const char * const excluded_device_names[] =
+{
+	"loop",
+	"ram",
+	"zram",
+	"dm-",
+	"md",
+	"nbd",
+	"nvme",
+	NULL
+};
+
+/*
+ * Device numbers of disks which were found not removable after being initialized by udev.
+ * Their events and events of their partitions are discarded without reading properties,
+ * except change events which may update properties.
+ * It's open addressing hash set, zero device number marks free slot.
+ */
+typedef struct dtmd_rejected_devices
+{
+	dev_t *items;
+	size_t size;
+	size_t count;
+} dtmd_rejected_devices_t;
+
+struct dtmd_device_system
+{
+	struct udev *udev;
+	dtmd_rejected_devices_t rejected;
+};
+
 struct dtmd_device_enumeration
 {
+	dtmd_device_system_t *system;
 	struct udev_enumerate *enumerate;
 	struct udev_list_entry *dev_list_entry;
 };
 
-static dtmd_removable_media_type_t get_device_subtype(struct udev_device *device)
+struct dtmd_device_monitor
+{
+	dtmd_device_system_t *system;
+	struct udev_monitor *monitor;
+};
+
+static size_t rejected_devices_slot(const dtmd_rejected_devices_t *rejected, dev_t devnum)
+{
+	return (size_t) ((devnum * 0x9E3779B97F4A7C15ULL) >> 32) & (rejected->size - 1);
+}
+
+static int rejected_devices_contains(const dtmd_rejected_devices_t *rejected, dev_t devnum)
+{
+	size_t i;
+
+	if (rejected->size == 0)
+	{
+		return 0;
+	}
+
+	for (i = rejected_devices_slot(rejected, devnum); rejected->items[i] != 0; i = (i + 1) & (rejected->size - 1))
+	{
+		if (rejected->items[i] == devnum)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void rejected_devices_put(dtmd_rejected_devices_t *rejected, dev_t devnum)
+{
+	size_t i;
+
+	for (i = rejected_devices_slot(rejected, devnum); rejected->items[i] != 0; i = (i + 1) & (rejected->size - 1))
+	{
+		if (rejected->items[i] == devnum)
+		{
+			return;
+		}
+	}
+
+	rejected->items[i] = devnum;
+	++(rejected->count);
+}
+
+/* cache is only an optimization, device isn't remembered if memory is exhausted */
+static void rejected_devices_insert(dtmd_rejected_devices_t *rejected, dev_t devnum)
+{
+	dtmd_rejected_devices_t resized;
+	size_t i;
+
+	if (devnum == 0)
+	{
+		return;
+	}
+
+	if ((rejected->count + 1) * 2 > rejected->size)
+	{
+		resized.size  = (rejected->size != 0) ? (rejected->size * 2) : rejected_devices_initial_size;
+		resized.count = 0;
+		resized.items = (dev_t*) calloc(resized.size, sizeof(dev_t));
+		if (resized.items == NULL)
+		{
+			return;
+		}
+
+		for (i = 0; i < rejected->size; ++i)
+		{
+			if (rejected->items[i] != 0)
+			{
+				rejected_devices_put(&resized, rejected->items[i]);
+			}
+		}
+
+		if (rejected->items != NULL)
+		{
+			free(rejected->items);
+		}
+
+		*rejected = resized;
+	}
+
+	rejected_devices_put(rejected, devnum);
+}
+
+static void rejected_devices_remove(dtmd_rejected_devices_t *rejected, dev_t devnum)
+{
+	size_t i;
+	size_t j;
+	size_t home;
+
+	if (rejected->size == 0)
+	{
+		return;
+	}
+
+	for (i = rejected_devices_slot(rejected, devnum); rejected->items[i] != devnum; i = (i + 1) & (rejected->size - 1))
+	{
+		if (rejected->items[i] == 0)
+		{
+			return;
+		}
+	}
+
+	// move following items of same probe sequence back, so lookups don't stop at freed slot
+	for (j = (i + 1) & (rejected->size - 1); rejected->items[j] != 0; j = (j + 1) & (rejected->size - 1))
+	{
+		home = rejected_devices_slot(rejected, rejected->items[j]);
+
+		if (((j > i) && ((home <= i) || (home > j)))
+			|| ((j < i) && ((home <= i) && (home > j))))
+		{
+			rejected->items[i] = rejected->items[j];
+			i = j;
+		}
+	}
+
+	rejected->items[i] = 0;
+	--(rejected->count);
+}
+
+static int is_device_name_excluded(const char *name)
+{
+	const char * const *excluded;
+
+	for (excluded = excluded_device_names; *excluded != NULL; ++excluded)
+	{
+		if (strncmp(name, *excluded, strlen(*excluded)) == 0)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static dtmd_removable_media_subtype_t get_device_subtype(struct udev_device *device)
 {
 	const char *removable;
 	const char *id_bus;
@@ -86,7 +260,7 @@ static void device_system_free_device(dtmd_info_t *device)
 	free(device);
 }
 
-static void device_system_fill_device(struct udev_device *dev, const char *path, dtmd_info_t *device_info)
+static void device_system_fill_device(struct udev_device *dev, const char *path, dtmd_removable_media_subtype_t subtype, dtmd_info_t *device_info)
 {
 	const char *state;
 	struct udev_device *parent_device;
@@ -94,7 +268,7 @@ static void device_system_fill_device(struct udev_device *dev, const char *path,
 	parent_device = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
 
 	device_info->path          = path;
-	device_info->media_subtype = get_device_subtype(dev);
+	device_info->media_subtype = subtype;
 	device_info->sysfs_path    = ((parent_device != NULL) ? udev_device_get_syspath(parent_device) : NULL);
 	device_info->private_data  = dev;
 
@@ -138,15 +312,12 @@ static void device_system_fill_device(struct udev_device *dev, const char *path,
 	device_info->path_parent = dtmd_root_device_path;
 }
 
-static void device_system_fill_partition(struct udev_device *dev, const char *path, dtmd_info_t *device_info)
+static void device_system_fill_partition(struct udev_device *dev, struct udev_device *dev_parent, const char *path, dtmd_removable_media_subtype_t subtype, dtmd_info_t *device_info)
 {
-	struct udev_device *dev_parent;
-
-	dev_parent = udev_device_get_parent_with_subsystem_devtype(dev, "block", "disk");
 	if (dev_parent != NULL)
 	{
 		device_info->path_parent   = udev_device_get_devnode(dev_parent);
-		device_info->media_subtype = get_device_subtype(dev_parent);
+		device_info->media_subtype = subtype;
 	}
 	else
 	{
@@ -163,16 +334,150 @@ static void device_system_fill_partition(struct udev_device *dev, const char *pa
 	device_info->private_data = dev;
 }
 
+/*
+ * Fills information of disk or partition, takes ownership of dev.
+ * Returns result_fail if device is discarded.
+ * Persistent devices are discarded as early as possible, before walking parents of device.
+ */
+static int device_system_read_device(dtmd_device_system_t *system, struct udev_device *dev, dtmd_device_action_type_t action, dtmd_info_t **device)
+{
+	const char *name;
+	const char *path;
+	const char *devtype;
+	struct udev_device *dev_parent = NULL;
+	struct udev_device *dev_disk;
+	dtmd_removable_media_subtype_t subtype = dtmd_removable_media_subtype_unknown_or_persistent;
+	dtmd_info_t *device_info;
+	int is_disk;
+
+	name    = udev_device_get_sysname(dev);
+	path    = udev_device_get_devnode(dev);
+	devtype = udev_device_get_devtype(dev);
+
+	if ((name == NULL)
+		|| (path == NULL)
+		|| (devtype == NULL)
+		|| is_device_name_excluded(name))
+	{
+		goto device_system_read_device_discard;
+	}
+
+	if (strcmp(devtype, "disk") == 0)
+	{
+		is_disk  = 1;
+		dev_disk = dev;
+	}
+	else if (strcmp(devtype, "partition") == 0)
+	{
+		is_disk    = 0;
+		dev_parent = udev_device_get_parent_with_subsystem_devtype(dev, "block", "disk");
+		dev_disk   = dev_parent;
+	}
+	else
+	{
+		goto device_system_read_device_discard;
+	}
+
+	if ((dev_disk != NULL)
+		&& rejected_devices_contains(&(system->rejected), udev_device_get_devnum(dev_disk)))
+	{
+		if (action == dtmd_device_action_change)
+		{
+			// properties may be updated, device is checked again
+			rejected_devices_remove(&(system->rejected), udev_device_get_devnum(dev_disk));
+		}
+		else
+		{
+			// device number may be reused by next device
+			if (is_disk && (action == dtmd_device_action_remove))
+			{
+				rejected_devices_remove(&(system->rejected), udev_device_get_devnum(dev_disk));
+			}
+
+			goto device_system_read_device_discard;
+		}
+	}
+
+	if (dev_disk != NULL)
+	{
+		subtype = get_device_subtype(dev_disk);
+	}
+
+	// removals are reported anyway since properties of removed device may be unavailable
+	if ((subtype == dtmd_removable_media_subtype_unknown_or_persistent)
+		&& (action != dtmd_device_action_remove)
+		&& (action != dtmd_device_action_offline))
+	{
+		// properties of device not yet processed by udev may be incomplete
+		if ((dev_disk != NULL) && udev_device_get_is_initialized(dev_disk))
+		{
+			rejected_devices_insert(&(system->rejected), udev_device_get_devnum(dev_disk));
+		}
+
+		goto device_system_read_device_discard;
+	}
+
+	device_info = (dtmd_info_t*) malloc(sizeof(dtmd_info_t));
+	if (device_info == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		udev_device_unref(dev);
+		return result_fatal_error;
+	}
+
+	if (is_disk)
+	{
+		device_system_fill_device(dev, path, subtype, device_info);
+	}
+	else
+	{
+		device_system_fill_partition(dev, dev_parent, path, subtype, device_info);
+	}
+
+	*device = device_info;
+	return result_success;
+
+device_system_read_device_discard:
+	udev_device_unref(dev);
+	return result_fail;
+}
+
 dtmd_device_system_t* device_system_init(void)
 {
-	return (dtmd_device_system_t*) udev_new();
+	dtmd_device_system_t *system;
+
+	system = (dtmd_device_system_t*) malloc(sizeof(dtmd_device_system_t));
+	if (system == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return NULL;
+	}
+
+	system->udev = udev_new();
+	if (system->udev == NULL)
+	{
+		free(system);
+		return NULL;
+	}
+
+	system->rejected.items = NULL;
+	system->rejected.size  = 0;
+	system->rejected.count = 0;
+
+	return system;
 }
 
 void device_system_deinit(dtmd_device_system_t *system)
 {
 	if (system != NULL)
 	{
-		udev_unref((struct udev*) system);
+		if (system->rejected.items != NULL)
+		{
+			free(system->rejected.items);
+		}
+
+		udev_unref(system->udev);
+		free(system);
 	}
 }
 
@@ -192,14 +497,19 @@ dtmd_device_enumeration_t* device_system_enumerate_devices(dtmd_device_system_t
 		goto device_system_enumerate_devices_error_1;
 	}
 
-	enumeration->enumerate = udev_enumerate_new((struct udev*) system);
+	enumeration->system = system;
+
+	enumeration->enumerate = udev_enumerate_new(system->udev);
 	if (enumeration->enumerate == NULL)
 	{
 		WRITE_LOG(LOG_ERR, "Udev failure");
 		goto device_system_enumerate_devices_error_2;
 	}
 
-	if (udev_enumerate_add_match_subsystem(enumeration->enumerate, "block") < 0)
+	// property matches are alternatives, subsystem match is required in addition to them
+	if ((udev_enumerate_add_match_subsystem(enumeration->enumerate, "block") < 0)
+		|| (udev_enumerate_add_match_property(enumeration->enumerate, "DEVTYPE", "disk") < 0)
+		|| (udev_enumerate_add_match_property(enumeration->enumerate, "DEVTYPE", "partition") < 0))
 	{
 		WRITE_LOG(LOG_ERR, "Udev failure");
 		goto device_system_enumerate_devices_error_3;
@@ -237,13 +547,13 @@ void device_system_finish_enumerate_devices(dtmd_device_enumeration_t *enumerati
 int device_system_next_enumerated_device(dtmd_device_enumeration_t *enumeration, dtmd_info_t **device)
 {
 	const char *path;
-	const char *devtype;
+	const char *name;
 
 	struct udev_list_entry *dev_list_entry;
 
 	struct udev_device *dev;
 
-	dtmd_info_t *device_info;
+	int rc;
 
 #ifndef NDEBUG
 	if ((enumeration == NULL)
@@ -261,55 +571,26 @@ int device_system_next_enumerated_device(dtmd_device_enumeration_t *enumeration,
 		}
 
 		path = udev_list_entry_get_name(dev_list_entry);
-		dev = udev_device_new_from_syspath(udev_enumerate_get_udev(enumeration->enumerate), path);
-		if (dev == NULL)
+
+		// last component of syspath is kernel name, excluded devices aren't even opened
+		name = strrchr(path, '/');
+		if ((name != NULL) && is_device_name_excluded(name + 1))
 		{
-			WRITE_LOG(LOG_ERR, "Udev failure");
-			return result_fatal_error;
+			continue;
 		}
 
-		path = udev_device_get_devnode(dev);
-		if (path == NULL)
+		dev = udev_device_new_from_syspath(udev_enumerate_get_udev(enumeration->enumerate), path);
+		if (dev == NULL)
 		{
 			WRITE_LOG(LOG_ERR, "Udev failure");
-			udev_device_unref(dev);
 			return result_fatal_error;
 		}
 
-		devtype = udev_device_get_devtype(dev);
-
-		if (strcmp(devtype, "disk") == 0)
-		{
-			device_info = (dtmd_info_t*) malloc(sizeof(dtmd_info_t));
-			if (device_info == NULL)
-			{
-				WRITE_LOG(LOG_ERR, "Memory allocation failure");
-				udev_device_unref(dev);
-				return result_fatal_error;
-			}
-
-			device_system_fill_device(dev, path, device_info);
-
-			*device = device_info;
-			return result_success;
-		}
-		else if (strcmp(devtype, "partition") == 0)
+		rc = device_system_read_device(enumeration->system, dev, dtmd_device_action_unknown, device);
+		if (rc != result_fail)
 		{
-			device_info = (dtmd_info_t*) malloc(sizeof(dtmd_info_t));
-			if (device_info == NULL)
-			{
-				WRITE_LOG(LOG_ERR, "Memory allocation failure");
-				udev_device_unref(dev);
-				return result_fatal_error;
-			}
-
-			device_system_fill_partition(dev, path, device_info);
-
-			*device = device_info;
-			return result_success;
+			return rc;
 		}
-
-		udev_device_unref(dev);
 	}
 
 	*device = NULL;
@@ -327,36 +608,50 @@ void device_system_free_enumerated_device(dtmd_device_enumeration_t *enumeration
 
 dtmd_device_monitor_t* device_system_start_monitoring(dtmd_device_system_t *system)
 {
-	struct udev_monitor *mon;
+	dtmd_device_monitor_t *monitor;
 
 	if (system == NULL)
 	{
 		goto device_system_start_monitoring_error_1;
 	}
 
-	mon = udev_monitor_new_from_netlink((struct udev*) system, "udev");
-	if (mon == NULL)
+	monitor = (dtmd_device_monitor_t*) malloc(sizeof(dtmd_device_monitor_t));
+	if (monitor == NULL)
 	{
-		WRITE_LOG(LOG_ERR, "Udev failure");
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
 		goto device_system_start_monitoring_error_1;
 	}
 
-	if (udev_monitor_filter_add_match_subsystem_devtype(mon, "block", NULL) < 0)
+	monitor->system = system;
+
+	monitor->monitor = udev_monitor_new_from_netlink(system->udev, "udev");
+	if (monitor->monitor == NULL)
 	{
 		WRITE_LOG(LOG_ERR, "Udev failure");
 		goto device_system_start_monitoring_error_2;
 	}
 
-	if (udev_monitor_enable_receiving(mon) < 0)
+	// filters are applied by socket filter in kernel, other block devices like scsi hosts aren't even received
+	if ((udev_monitor_filter_add_match_subsystem_devtype(monitor->monitor, "block", "disk") < 0)
+		|| (udev_monitor_filter_add_match_subsystem_devtype(monitor->monitor, "block", "partition") < 0))
 	{
 		WRITE_LOG(LOG_ERR, "Udev failure");
-		goto device_system_start_monitoring_error_2;
+		goto device_system_start_monitoring_error_3;
+	}
+
+	if (udev_monitor_enable_receiving(monitor->monitor) < 0)
+	{
+		WRITE_LOG(LOG_ERR, "Udev failure");
+		goto device_system_start_monitoring_error_3;
 	}
 
-	return (dtmd_device_monitor_t*) mon;
+	return monitor;
+
+device_system_start_monitoring_error_3:
+	udev_monitor_unref(monitor->monitor);
 
 device_system_start_monitoring_error_2:
-	udev_monitor_unref(mon);
+	free(monitor);
 
 device_system_start_monitoring_error_1:
 	return NULL;
@@ -366,7 +661,8 @@ void device_system_stop_monitoring(dtmd_device_monitor_t *monitor)
 {
 	if (monitor != NULL)
 	{
-		udev_monitor_unref((struct udev_monitor*) monitor);
+		udev_monitor_unref(monitor->monitor);
+		free(monitor);
 	}
 }
 
@@ -374,7 +670,7 @@ int device_system_get_monitor_fd(dtmd_device_monitor_t *monitor)
 {
 	if (monitor != NULL)
 	{
-		return udev_monitor_get_fd((struct udev_monitor*) monitor);
+		return udev_monitor_get_fd(monitor->monitor);
 	}
 	else
 	{
@@ -384,24 +680,20 @@ int device_system_get_monitor_fd(dtmd_device_monitor_t *monitor)
 
 int device_system_monitor_get_device(dtmd_device_monitor_t *monitor, dtmd_info_t **device, dtmd_device_action_type_t *action)
 {
-	const char *path;
-	const char *devtype;
 	const char *action_str;
 
 	dtmd_device_action_type_t act;
 
 	struct udev_device *dev;
 
-	dtmd_info_t *device_info;
+	int rc;
 
-	dev = udev_monitor_receive_device((struct udev_monitor*) monitor);
+	dev = udev_monitor_receive_device(monitor->monitor);
 	if (dev != NULL)
 	{
-		path       = udev_device_get_devnode(dev);
 		action_str = udev_device_get_action(dev);
-		devtype    = udev_device_get_devtype(dev);
 
-		if ((action_str != NULL) && (path != NULL))
+		if (action_str != NULL)
 		{
 			if (strcmp(action_str, "add") == 0)
 			{
@@ -429,38 +721,14 @@ int device_system_monitor_get_device(dtmd_device_monitor_t *monitor, dtmd_info_t
 				goto device_system_monitor_get_device_exit;
 			}
 
-			if (strcmp(devtype, "disk") == 0)
+			rc = device_system_read_device(monitor->system, dev, act, device);
+			if (rc != result_fail)
 			{
-				device_info = (dtmd_info_t*) malloc(sizeof(dtmd_info_t));
-				if (device_info == NULL)
-				{
-					WRITE_LOG(LOG_ERR, "Memory allocation failure");
-					udev_device_unref(dev);
-					return result_fatal_error;
-				}
-
-				device_system_fill_device(dev, path, device_info);
-
-				*device = device_info;
 				*action = act;
-				return result_success;
+				return rc;
 			}
-			else if (strcmp(devtype, "partition") == 0)
-			{
-				device_info = (dtmd_info_t*) malloc(sizeof(dtmd_info_t));
-				if (device_info == NULL)
-				{
-					WRITE_LOG(LOG_ERR, "Memory allocation failure");
-					udev_device_unref(dev);
-					return result_fatal_error;
-				}
 
-				device_system_fill_partition(dev, path, device_info);
-
-				*device = device_info;
-				*action = act;
-				return result_success;
-			}
+			goto device_system_monitor_get_device_exit;
 		}
 
 		udev_device_unref(dev);
@@ -477,6 +745,12 @@ device_system_monitor_get_device_exit:
 	return result_fail;
 }
 
+int device_system_monitor_has_device(dtmd_device_monitor_t *monitor)
+{
+	// udev reports one device per wakeup
+	return 0;
+}
+
 void device_system_monitor_free_device(dtmd_device_monitor_t *monitor, dtmd_info_t *device)
 {
 	if ((monitor != NULL)
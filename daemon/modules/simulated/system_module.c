@@ -0,0 +1,1405 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Simulated devices for load testing.
+ *
+ * Devices exist only in memory and are controlled via stream socket.
+ * Each line received from control socket is a command, reply is "ok" or "error: <reason>":
+ *
+ *   add_disk <name>                                  - add removable disk
+ *   add_partition <disk> <name> [<fstype> [<label>]] - add partition to disk
+ *   add_cdrom <name> [<fstype> [<label>]]            - add cdrom, without fstype it's empty
+ *   change <name> [<fstype> [<label>]]               - change filesystem of partition or cdrom
+ *   remove <name>                                    - remove device with its partitions
+ *   populate <disks> <partitions> [<fstype>]         - add many disks with given count of partitions
+ *   churn <events per second> [<seed>]               - randomly remove, add back and change devices, 0 stops it
+ *   clear                                            - remove all devices
+ *
+ * Names are relative to /dev/dtmd-simulated and may not contain '/' or be "." or "..",
+ * so simulated devices don't refer to real device nodes.
+ * Absolute names are used as is, so simulated devices may refer to real loop devices for mounting,
+ * but they are rejected unless SIMULATED_ABSOLUTE_NAMES is defined.
+ * Label "-" means no label.
+ *
+ * Control socket is accessible only by owner of daemon.
+ *
+ * Monitor descriptor is epoll descriptor watching control socket, its clients and churn timer,
+ * commands are executed when events are taken from monitor.
+ */
+
+#define _GNU_SOURCE
+
+#include "daemon/system_module.h"
+#include "daemon/log.h"
+#include "daemon/return_codes.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#ifndef SIMULATED_SOCKET_PATH
+#error SIMULATED_SOCKET_PATH is not defined
+#endif /* SIMULATED_SOCKET_PATH */
+
+#define simulated_devices_dir "/dev/dtmd-simulated/"
+#define simulated_clients_max 8
+#define simulated_line_size 1024
+#define simulated_max_args 4
+
+/* churn timer runs with fixed frequency, events are distributed between ticks */
+#define simulated_churn_ticks_per_second 100
+
+#define simulated_epoll_listen ((uint64_t) -1)
+#define simulated_epoll_timer ((uint64_t) -2)
+
+typedef enum simulated_device_type
+{
+	simulated_device_disk = 0,
+	simulated_device_partition,
+	simulated_device_cdrom
+} simulated_device_type_t;
+
+typedef struct simulated_device
+{
+	char *path;
+	char *fstype;
+	char *label;
+
+	simulated_device_type_t type;
+	size_t parent; /* index of disk, for partitions only */
+
+	int is_deleted; /* slot is unused */
+	int is_present; /* device is removed by churn, it'll be added back later */
+} simulated_device_t;
+
+/* device information is copied into event, so devices may change while events are queued */
+typedef struct simulated_event
+{
+	dtmd_info_t info;
+	dtmd_device_action_type_t action;
+
+	struct simulated_event *next;
+} simulated_event_t;
+
+typedef struct simulated_client
+{
+	int fd;
+	size_t buffer_used;
+	char buffer[simulated_line_size];
+} simulated_client_t;
+
+struct dtmd_device_system
+{
+	simulated_device_t *devices;
+	size_t devices_count;
+	size_t devices_size;
+	unsigned int populated_count;
+
+	int epoll_fd;
+	int listen_fd;
+	int timer_fd;
+	simulated_client_t clients[simulated_clients_max];
+
+	unsigned int churn_rate;
+	unsigned int churn_budget; /* in events per tick multiplied by ticks per second */
+	unsigned int churn_seed;
+	unsigned int churn_counter;
+
+	simulated_event_t *events_first;
+	simulated_event_t *events_last;
+
+	dtmd_device_monitor_t *monitor;
+};
+
+struct dtmd_device_enumeration
+{
+	dtmd_device_system_t *system;
+	size_t current;
+};
+
+struct dtmd_device_monitor
+{
+	dtmd_device_system_t *system;
+};
+
+static void device_system_free_device(dtmd_info_t *device)
+{
+	// info is first member of event
+	free((simulated_event_t*) device);
+}
+
+/* copies device and all strings it refers to into single allocation */
+static simulated_event_t* simulated_create_event(dtmd_device_system_t *system, size_t index, dtmd_device_action_type_t action)
+{
+	simulated_device_t *device;
+	simulated_event_t *event;
+	const char *parent_path;
+	char *strings;
+	size_t path_len;
+	size_t parent_len;
+	size_t fstype_len;
+	size_t label_len;
+
+	device = &(system->devices[index]);
+	parent_path = (device->type == simulated_device_partition) ? system->devices[device->parent].path : dtmd_root_device_path;
+
+	path_len   = strlen(device->path) + 1;
+	parent_len = strlen(parent_path) + 1;
+	fstype_len = (device->fstype != NULL) ? strlen(device->fstype) + 1 : 0;
+	label_len  = (device->label != NULL) ? strlen(device->label) + 1 : 0;
+
+	event = (simulated_event_t*) malloc(sizeof(simulated_event_t) + path_len + parent_len + fstype_len + label_len);
+	if (event == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return NULL;
+	}
+
+	strings = (char*) (event + 1);
+
+	memcpy(strings, device->path, path_len);
+	event->info.path = strings;
+	strings += path_len;
+
+	memcpy(strings, parent_path, parent_len);
+	event->info.path_parent = strings;
+	strings += parent_len;
+
+	event->info.fstype = NULL;
+	if (device->fstype != NULL)
+	{
+		memcpy(strings, device->fstype, fstype_len);
+		event->info.fstype = strings;
+		strings += fstype_len;
+	}
+
+	event->info.label = NULL;
+	if (device->label != NULL)
+	{
+		memcpy(strings, device->label, label_len);
+		event->info.label = strings;
+	}
+
+	switch (device->type)
+	{
+	case simulated_device_disk:
+		event->info.media_type    = dtmd_removable_media_type_stateless_device;
+		event->info.media_subtype = dtmd_removable_media_subtype_removable_disk;
+		event->info.state         = dtmd_removable_media_state_unknown;
+		break;
+
+	case simulated_device_partition:
+		event->info.media_type    = dtmd_removable_media_type_device_partition;
+		event->info.media_subtype = dtmd_removable_media_subtype_removable_disk;
+		event->info.state         = dtmd_removable_media_state_unknown;
+		break;
+
+	case simulated_device_cdrom:
+		event->info.media_type    = dtmd_removable_media_type_stateful_device;
+		event->info.media_subtype = dtmd_removable_media_subtype_cdrom;
+		event->info.state         = (device->fstype != NULL) ? dtmd_removable_media_state_ok : dtmd_removable_media_state_empty;
+		break;
+	}
+
+#if (defined OS_Linux)
+	event->info.sysfs_path = NULL;
+#endif /* (defined OS_Linux) */
+	event->info.private_data = NULL;
+
+	event->action = action;
+	event->next   = NULL;
+
+	return event;
+}
+
+/* events are generated only while monitor exists, enumeration reports current state */
+static int simulated_queue_event(dtmd_device_system_t *system, size_t index, dtmd_device_action_type_t action)
+{
+	simulated_event_t *event;
+
+	if (system->monitor == NULL)
+	{
+		return result_success;
+	}
+
+	event = simulated_create_event(system, index, action);
+	if (event == NULL)
+	{
+		return result_fatal_error;
+	}
+
+	if (system->events_last != NULL)
+	{
+		system->events_last->next = event;
+	}
+	else
+	{
+		system->events_first = event;
+	}
+
+	system->events_last = event;
+
+	return result_success;
+}
+
+static void simulated_free_events(dtmd_device_system_t *system)
+{
+	simulated_event_t *event;
+
+	while (system->events_first != NULL)
+	{
+		event = system->events_first;
+		system->events_first = event->next;
+		free(event);
+	}
+
+	system->events_last = NULL;
+}
+
+static void simulated_free_device_data(simulated_device_t *device)
+{
+	free(device->path);
+	device->path = NULL;
+
+	if (device->fstype != NULL)
+	{
+		free(device->fstype);
+		device->fstype = NULL;
+	}
+
+	if (device->label != NULL)
+	{
+		free(device->label);
+		device->label = NULL;
+	}
+}
+
+static int simulated_find_device(dtmd_device_system_t *system, const char *path, size_t *index)
+{
+	size_t i;
+
+	for (i = 0; i < system->devices_count; ++i)
+	{
+		if ((!system->devices[i].is_deleted) && (strcmp(system->devices[i].path, path) == 0))
+		{
+			*index = i;
+			return result_success;
+		}
+	}
+
+	return result_fail;
+}
+
+/* returns path of device with given name, it has to be freed */
+static int simulated_make_path(const char *name, char **path)
+{
+	if (name[0] == '/')
+	{
+#ifdef SIMULATED_ABSOLUTE_NAMES
+		*path = strdup(name);
+#else /* SIMULATED_ABSOLUTE_NAMES */
+		return result_fail;
+#endif /* SIMULATED_ABSOLUTE_NAMES */
+	}
+	else if ((strchr(name, '/') != NULL)
+		|| (strcmp(name, ".") == 0)
+		|| (strcmp(name, "..") == 0))
+	{
+		return result_fail;
+	}
+	else
+	{
+		*path = (char*) malloc(strlen(simulated_devices_dir) + strlen(name) + 1);
+		if (*path != NULL)
+		{
+			strcpy(*path, simulated_devices_dir);
+			strcat(*path, name);
+		}
+	}
+
+	if (*path == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return result_fatal_error;
+	}
+
+	return result_success;
+}
+
+static int simulated_set_filesystem(simulated_device_t *device, const char *fstype, const char *label)
+{
+	char *new_fstype = NULL;
+	char *new_label = NULL;
+
+	if ((fstype != NULL) && (strcmp(fstype, "-") != 0))
+	{
+		new_fstype = strdup(fstype);
+		if (new_fstype == NULL)
+		{
+			goto simulated_set_filesystem_error_1;
+		}
+	}
+
+	if ((label != NULL) && (strcmp(label, "-") != 0))
+	{
+		new_label = strdup(label);
+		if (new_label == NULL)
+		{
+			goto simulated_set_filesystem_error_2;
+		}
+	}
+
+	if (device->fstype != NULL)
+	{
+		free(device->fstype);
+	}
+
+	if (device->label != NULL)
+	{
+		free(device->label);
+	}
+
+	device->fstype = new_fstype;
+	device->label  = new_label;
+
+	return result_success;
+
+simulated_set_filesystem_error_2:
+	if (new_fstype != NULL)
+	{
+		free(new_fstype);
+	}
+
+simulated_set_filesystem_error_1:
+	WRITE_LOG(LOG_ERR, "Memory allocation failure");
+	return result_fatal_error;
+}
+
+/* takes ownership of path */
+static int simulated_add_device(dtmd_device_system_t *system, char *path, simulated_device_type_t type, size_t parent, const char *fstype, const char *label)
+{
+	simulated_device_t *device;
+	size_t index;
+	void *tmp;
+
+	if (is_result_successful(simulated_find_device(system, path, &index)))
+	{
+		free(path);
+		return result_fail;
+	}
+
+	if (system->devices_count == system->devices_size)
+	{
+		tmp = realloc(system->devices, ((system->devices_size != 0) ? (system->devices_size * 2) : 64) * sizeof(simulated_device_t));
+		if (tmp == NULL)
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			free(path);
+			return result_fatal_error;
+		}
+
+		system->devices = (simulated_device_t*) tmp;
+		system->devices_size = (system->devices_size != 0) ? (system->devices_size * 2) : 64;
+	}
+
+	index  = system->devices_count;
+	device = &(system->devices[index]);
+
+	device->path       = path;
+	device->fstype     = NULL;
+	device->label      = NULL;
+	device->type       = type;
+	device->parent     = parent;
+	device->is_deleted = 0;
+	device->is_present = 1;
+
+	if (is_result_fatal_error(simulated_set_filesystem(device, fstype, label)))
+	{
+		free(path);
+		return result_fatal_error;
+	}
+
+	++(system->devices_count);
+
+	return simulated_queue_event(system, index, dtmd_device_action_add);
+}
+
+/* reports removal of present disk and its partitions, partitions first like kernel does */
+static int simulated_report_removal(dtmd_device_system_t *system, size_t index)
+{
+	size_t i;
+
+	if (system->devices[index].type == simulated_device_disk)
+	{
+		for (i = 0; i < system->devices_count; ++i)
+		{
+			if ((!system->devices[i].is_deleted)
+				&& (system->devices[i].type == simulated_device_partition)
+				&& (system->devices[i].parent == index)
+				&& is_result_fatal_error(simulated_queue_event(system, i, dtmd_device_action_remove)))
+			{
+				return result_fatal_error;
+			}
+		}
+	}
+
+	return simulated_queue_event(system, index, dtmd_device_action_remove);
+}
+
+static int simulated_report_addition(dtmd_device_system_t *system, size_t index)
+{
+	size_t i;
+
+	if (is_result_fatal_error(simulated_queue_event(system, index, dtmd_device_action_add)))
+	{
+		return result_fatal_error;
+	}
+
+	if (system->devices[index].type == simulated_device_disk)
+	{
+		for (i = 0; i < system->devices_count; ++i)
+		{
+			if ((!system->devices[i].is_deleted)
+				&& (system->devices[i].type == simulated_device_partition)
+				&& (system->devices[i].parent == index)
+				&& is_result_fatal_error(simulated_queue_event(system, i, dtmd_device_action_add)))
+			{
+				return result_fatal_error;
+			}
+		}
+	}
+
+	return result_success;
+}
+
+static void simulated_delete_device(dtmd_device_system_t *system, size_t index)
+{
+	size_t i;
+
+	if (system->devices[index].type == simulated_device_disk)
+	{
+		for (i = 0; i < system->devices_count; ++i)
+		{
+			if ((!system->devices[i].is_deleted)
+				&& (system->devices[i].type == simulated_device_partition)
+				&& (system->devices[i].parent == index))
+			{
+				simulated_free_device_data(&(system->devices[i]));
+				system->devices[i].is_deleted = 1;
+			}
+		}
+	}
+
+	simulated_free_device_data(&(system->devices[index]));
+	system->devices[index].is_deleted = 1;
+}
+
+static void simulated_clear_devices(dtmd_device_system_t *system)
+{
+	size_t i;
+
+	for (i = 0; i < system->devices_count; ++i)
+	{
+		if (!system->devices[i].is_deleted)
+		{
+			simulated_free_device_data(&(system->devices[i]));
+		}
+	}
+
+	if (system->devices != NULL)
+	{
+		free(system->devices);
+		system->devices = NULL;
+	}
+
+	system->devices_count = 0;
+	system->devices_size  = 0;
+}
+
+static int simulated_set_churn(dtmd_device_system_t *system, unsigned int rate, unsigned int seed)
+{
+	struct itimerspec timer;
+
+	memset(&timer, 0, sizeof(timer));
+
+	if (rate > 0)
+	{
+		timer.it_interval.tv_nsec = 1000000000L / simulated_churn_ticks_per_second;
+		timer.it_value.tv_nsec    = timer.it_interval.tv_nsec;
+	}
+
+	if (timerfd_settime(system->timer_fd, 0, &timer, NULL) != 0)
+	{
+		WRITE_LOG(LOG_ERR, "Timerfd_settime() failed");
+		return result_fatal_error;
+	}
+
+	system->churn_rate   = rate;
+	system->churn_budget = 0;
+	system->churn_seed   = seed;
+
+	return result_success;
+}
+
+/* removes present disk, adds back removed one or changes filesystem label */
+static int simulated_churn_step(dtmd_device_system_t *system)
+{
+	simulated_device_t *device;
+	size_t start;
+	size_t index;
+	size_t i;
+	char label[32];
+
+	if (system->devices_count == 0)
+	{
+		return result_success;
+	}
+
+	start = rand_r(&(system->churn_seed)) % system->devices_count;
+
+	for (i = 0; i < system->devices_count; ++i)
+	{
+		index  = (start + i) % system->devices_count;
+		device = &(system->devices[index]);
+
+		if ((device->is_deleted)
+			|| ((device->type == simulated_device_partition) && (!system->devices[device->parent].is_present)))
+		{
+			continue;
+		}
+
+		if ((device->type == simulated_device_partition) || (device->type == simulated_device_cdrom))
+		{
+			if ((!device->is_present) || (rand_r(&(system->churn_seed)) % 2 == 0))
+			{
+				continue;
+			}
+
+			++(system->churn_counter);
+			snprintf(label, sizeof(label), "churn%u", system->churn_counter);
+
+			if (is_result_fatal_error(simulated_set_filesystem(device, (device->fstype != NULL) ? device->fstype : "-", label)))
+			{
+				return result_fatal_error;
+			}
+
+			return simulated_queue_event(system, index, dtmd_device_action_change);
+		}
+
+		device->is_present = !device->is_present;
+
+		if (device->is_present)
+		{
+			return simulated_report_addition(system, index);
+		}
+		else
+		{
+			return simulated_report_removal(system, index);
+		}
+	}
+
+	return result_success;
+}
+
+static int simulated_command_add(dtmd_device_system_t *system, simulated_device_type_t type, char **args, int args_count)
+{
+	char *path;
+	size_t parent = 0;
+	int arg = 1;
+	int rc;
+
+	if (type == simulated_device_partition)
+	{
+		if (args_count < 3)
+		{
+			return result_fail;
+		}
+
+		rc = simulated_make_path(args[arg], &path);
+		if (is_result_failure(rc))
+		{
+			return rc;
+		}
+
+		if (is_result_failure(simulated_find_device(system, path, &parent))
+			|| (system->devices[parent].type != simulated_device_disk)
+			|| (!system->devices[parent].is_present))
+		{
+			free(path);
+			return result_fail;
+		}
+
+		free(path);
+		++arg;
+	}
+	else if (args_count < 2)
+	{
+		return result_fail;
+	}
+
+	if ((type == simulated_device_disk) && (args_count > 2))
+	{
+		return result_fail;
+	}
+
+	rc = simulated_make_path(args[arg], &path);
+	if (is_result_failure(rc))
+	{
+		return rc;
+	}
+
+	return simulated_add_device(system,
+		path,
+		type,
+		parent,
+		(args_count > arg + 1) ? args[arg + 1] : NULL,
+		(args_count > arg + 2) ? args[arg + 2] : NULL);
+}
+
+static int simulated_command_change(dtmd_device_system_t *system, char **args, int args_count)
+{
+	char *path;
+	size_t index;
+	int rc;
+
+	if (args_count < 2)
+	{
+		return result_fail;
+	}
+
+	rc = simulated_make_path(args[1], &path);
+	if (is_result_failure(rc))
+	{
+		return rc;
+	}
+
+	rc = simulated_find_device(system, path, &index);
+	free(path);
+
+	if (is_result_failure(rc)
+		|| (system->devices[index].type == simulated_device_disk))
+	{
+		return result_fail;
+	}
+
+	if (is_result_fatal_error(simulated_set_filesystem(&(system->devices[index]),
+		(args_count > 2) ? args[2] : NULL,
+		(args_count > 3) ? args[3] : NULL)))
+	{
+		return result_fatal_error;
+	}
+
+	if ((!system->devices[index].is_present)
+		|| ((system->devices[index].type == simulated_device_partition) && (!system->devices[system->devices[index].parent].is_present)))
+	{
+		return result_success;
+	}
+
+	return simulated_queue_event(system, index, dtmd_device_action_change);
+}
+
+static int simulated_command_remove(dtmd_device_system_t *system, char **args, int args_count)
+{
+	char *path;
+	size_t index;
+	int rc;
+
+	if (args_count != 2)
+	{
+		return result_fail;
+	}
+
+	rc = simulated_make_path(args[1], &path);
+	if (is_result_failure(rc))
+	{
+		return rc;
+	}
+
+	rc = simulated_find_device(system, path, &index);
+	free(path);
+
+	if (is_result_failure(rc))
+	{
+		return result_fail;
+	}
+
+	if (system->devices[index].is_present
+		&& ((system->devices[index].type != simulated_device_partition) || system->devices[system->devices[index].parent].is_present))
+	{
+		if (is_result_fatal_error(simulated_report_removal(system, index)))
+		{
+			return result_fatal_error;
+		}
+	}
+
+	simulated_delete_device(system, index);
+
+	return result_success;
+}
+
+static int simulated_command_populate(dtmd_device_system_t *system, char **args, int args_count)
+{
+	unsigned long disks;
+	unsigned long partitions;
+	unsigned long i;
+	unsigned long j;
+	size_t parent;
+	char name[64];
+	char *path;
+	int rc;
+
+	if ((args_count < 3) || (args_count > 4))
+	{
+		return result_fail;
+	}
+
+	disks      = strtoul(args[1], NULL, 10);
+	partitions = strtoul(args[2], NULL, 10);
+
+	for (i = 0; i < disks; ++i)
+	{
+		snprintf(name, sizeof(name), "sim%u", system->populated_count);
+		++(system->populated_count);
+
+		rc = simulated_make_path(name, &path);
+		if (is_result_failure(rc))
+		{
+			return rc;
+		}
+
+		parent = system->devices_count;
+
+		rc = simulated_add_device(system, path, simulated_device_disk, 0, NULL, NULL);
+		if (is_result_failure(rc))
+		{
+			return rc;
+		}
+
+		for (j = 0; j < partitions; ++j)
+		{
+			snprintf(name, sizeof(name), "sim%up%lu", system->populated_count - 1, j + 1);
+
+			rc = simulated_make_path(name, &path);
+			if (is_result_failure(rc))
+			{
+				return rc;
+			}
+
+			rc = simulated_add_device(system, path, simulated_device_partition, parent, (args_count > 3) ? args[3] : NULL, name);
+			if (is_result_failure(rc))
+			{
+				return rc;
+			}
+		}
+	}
+
+	return result_success;
+}
+
+static int simulated_command_clear(dtmd_device_system_t *system)
+{
+	size_t i;
+
+	for (i = 0; i < system->devices_count; ++i)
+	{
+		if ((!system->devices[i].is_deleted)
+			&& system->devices[i].is_present
+			&& (system->devices[i].type != simulated_device_partition)
+			&& is_result_fatal_error(simulated_report_removal(system, i)))
+		{
+			return result_fatal_error;
+		}
+	}
+
+	simulated_clear_devices(system);
+
+	return result_success;
+}
+
+/* returns result_fail for incorrect command */
+static int simulated_execute_command(dtmd_device_system_t *system, const char *line)
+{
+	char buffer[simulated_line_size];
+	char *args[simulated_max_args + 1];
+	int args_count = 0;
+	char *saveptr = NULL;
+	char *token;
+
+	// line is split in copy, original is logged on failure
+	strcpy(buffer, line);
+
+	for (token = strtok_r(buffer, " \t", &saveptr); token != NULL; token = strtok_r(NULL, " \t", &saveptr))
+	{
+		if (args_count > simulated_max_args)
+		{
+			return result_fail;
+		}
+
+		args[args_count] = token;
+		++args_count;
+	}
+
+	if (args_count == 0)
+	{
+		return result_fail;
+	}
+
+	if (strcmp(args[0], "add_disk") == 0)
+	{
+		return simulated_command_add(system, simulated_device_disk, args, args_count);
+	}
+	else if (strcmp(args[0], "add_partition") == 0)
+	{
+		return simulated_command_add(system, simulated_device_partition, args, args_count);
+	}
+	else if (strcmp(args[0], "add_cdrom") == 0)
+	{
+		return simulated_command_add(system, simulated_device_cdrom, args, args_count);
+	}
+	else if (strcmp(args[0], "change") == 0)
+	{
+		return simulated_command_change(system, args, args_count);
+	}
+	else if (strcmp(args[0], "remove") == 0)
+	{
+		return simulated_command_remove(system, args, args_count);
+	}
+	else if (strcmp(args[0], "populate") == 0)
+	{
+		return simulated_command_populate(system, args, args_count);
+	}
+	else if ((strcmp(args[0], "churn") == 0) && (args_count >= 2) && (args_count <= 3))
+	{
+		return simulated_set_churn(system, strtoul(args[1], NULL, 10), (args_count > 2) ? strtoul(args[2], NULL, 10) : 1);
+	}
+	else if ((strcmp(args[0], "clear") == 0) && (args_count == 1))
+	{
+		return simulated_command_clear(system);
+	}
+
+	return result_fail;
+}
+
+static void simulated_close_client(dtmd_device_system_t *system, simulated_client_t *client)
+{
+	epoll_ctl(system->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+	client->fd = -1;
+}
+
+static void simulated_reply(simulated_client_t *client, const char *reply)
+{
+	// replies are informational, client which doesn't read them loses them
+	send(client->fd, reply, strlen(reply), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static int simulated_read_client(dtmd_device_system_t *system, simulated_client_t *client)
+{
+	ssize_t rc;
+	char *line;
+	char *line_end;
+	int result;
+
+	for (;;)
+	{
+		rc = recv(client->fd, client->buffer + client->buffer_used, simulated_line_size - client->buffer_used, MSG_DONTWAIT);
+		if (rc < 0)
+		{
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+			{
+				return result_success;
+			}
+
+			simulated_close_client(system, client);
+			return result_success;
+		}
+
+		if (rc == 0)
+		{
+			simulated_close_client(system, client);
+			return result_success;
+		}
+
+		client->buffer_used += rc;
+		line = client->buffer;
+
+		while ((line_end = memchr(line, '\n', client->buffer_used - (line - client->buffer))) != NULL)
+		{
+			*line_end = 0;
+
+			result = simulated_execute_command(system, line);
+			if (is_result_fatal_error(result))
+			{
+				return result;
+			}
+
+			if (is_result_successful(result))
+			{
+				simulated_reply(client, "ok\n");
+			}
+			else
+			{
+				WRITE_LOG_ARGS(LOG_WARNING, "Simulated devices: failed command '%s'", line);
+				simulated_reply(client, "error: failed command\n");
+			}
+
+			line = line_end + 1;
+		}
+
+		client->buffer_used -= line - client->buffer;
+		memmove(client->buffer, line, client->buffer_used);
+
+		if (client->buffer_used == simulated_line_size)
+		{
+			simulated_reply(client, "error: line is too long\n");
+			client->buffer_used = 0;
+		}
+	}
+}
+
+static void simulated_accept_clients(dtmd_device_system_t *system)
+{
+	struct epoll_event event;
+	int fd;
+	size_t i;
+
+	while ((fd = accept4(system->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		for (i = 0; i < simulated_clients_max; ++i)
+		{
+			if (system->clients[i].fd < 0)
+			{
+				break;
+			}
+		}
+
+		if (i == simulated_clients_max)
+		{
+			WRITE_LOG(LOG_WARNING, "Simulated devices: too many control clients");
+			close(fd);
+			continue;
+		}
+
+		event.events   = EPOLLIN;
+		event.data.u64 = i;
+
+		if (epoll_ctl(system->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+		{
+			close(fd);
+			continue;
+		}
+
+		system->clients[i].fd          = fd;
+		system->clients[i].buffer_used = 0;
+	}
+}
+
+static int simulated_run_churn(dtmd_device_system_t *system)
+{
+	uint64_t expirations;
+	unsigned long long count;
+
+	if (read(system->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+	{
+		return result_success;
+	}
+
+	// after long stall at most one second worth of events is generated
+	if (expirations > simulated_churn_ticks_per_second)
+	{
+		expirations = simulated_churn_ticks_per_second;
+	}
+
+	system->churn_budget += system->churn_rate * expirations;
+	count = system->churn_budget / simulated_churn_ticks_per_second;
+	system->churn_budget %= simulated_churn_ticks_per_second;
+
+	for ( ; count > 0; --count)
+	{
+		if (is_result_fatal_error(simulated_churn_step(system)))
+		{
+			return result_fatal_error;
+		}
+	}
+
+	return result_success;
+}
+
+/* executes commands and churn which are due */
+static int simulated_process_control(dtmd_device_system_t *system)
+{
+	size_t i;
+
+	simulated_accept_clients(system);
+
+	for (i = 0; i < simulated_clients_max; ++i)
+	{
+		if ((system->clients[i].fd >= 0)
+			&& is_result_fatal_error(simulated_read_client(system, &(system->clients[i]))))
+		{
+			return result_fatal_error;
+		}
+	}
+
+	return simulated_run_churn(system);
+}
+
+static int simulated_open_control_socket(void)
+{
+	struct sockaddr_un sockaddr;
+	mode_t old_umask;
+	int fd;
+	int rc;
+
+	fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	memset(&sockaddr, 0, sizeof(sockaddr));
+	sockaddr.sun_family = AF_LOCAL;
+	strncat(sockaddr.sun_path, SIMULATED_SOCKET_PATH, sizeof(sockaddr.sun_path) - 1);
+
+	unlink(sockaddr.sun_path);
+
+	// daemon runs with umask 0, socket has to be created accessible only by owner
+	old_umask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+	rc = bind(fd, (struct sockaddr*) &sockaddr, sizeof(sockaddr));
+	umask(old_umask);
+
+	if ((rc != 0)
+		|| (listen(fd, simulated_clients_max) != 0))
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+dtmd_device_system_t* device_system_init(void)
+{
+	dtmd_device_system_t *system;
+	struct epoll_event event;
+	size_t i;
+
+	system = (dtmd_device_system_t*) malloc(sizeof(dtmd_device_system_t));
+	if (system == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		goto device_system_init_error_1;
+	}
+
+	system->devices         = NULL;
+	system->devices_count   = 0;
+	system->devices_size    = 0;
+	system->populated_count = 0;
+	system->churn_rate      = 0;
+	system->churn_budget    = 0;
+	system->churn_seed      = 1;
+	system->churn_counter   = 0;
+	system->events_first    = NULL;
+	system->events_last     = NULL;
+	system->monitor         = NULL;
+
+	for (i = 0; i < simulated_clients_max; ++i)
+	{
+		system->clients[i].fd = -1;
+	}
+
+	system->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (system->epoll_fd < 0)
+	{
+		WRITE_LOG(LOG_ERR, "Epoll_create1() failed");
+		goto device_system_init_error_2;
+	}
+
+	system->listen_fd = simulated_open_control_socket();
+	if (system->listen_fd < 0)
+	{
+		WRITE_LOG_ARGS(LOG_ERR, "Failed to open control socket '%s'", SIMULATED_SOCKET_PATH);
+		goto device_system_init_error_3;
+	}
+
+	system->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (system->timer_fd < 0)
+	{
+		WRITE_LOG(LOG_ERR, "Timerfd_create() failed");
+		goto device_system_init_error_4;
+	}
+
+	event.events   = EPOLLIN;
+	event.data.u64 = simulated_epoll_listen;
+
+	if (epoll_ctl(system->epoll_fd, EPOLL_CTL_ADD, system->listen_fd, &event) != 0)
+	{
+		WRITE_LOG(LOG_ERR, "Epoll_ctl() failed");
+		goto device_system_init_error_5;
+	}
+
+	event.events   = EPOLLIN;
+	event.data.u64 = simulated_epoll_timer;
+
+	if (epoll_ctl(system->epoll_fd, EPOLL_CTL_ADD, system->timer_fd, &event) != 0)
+	{
+		WRITE_LOG(LOG_ERR, "Epoll_ctl() failed");
+		goto device_system_init_error_5;
+	}
+
+	WRITE_LOG_ARGS(LOG_INFO, "Simulated devices are controlled via socket '%s'", SIMULATED_SOCKET_PATH);
+
+	return system;
+
+device_system_init_error_5:
+	close(system->timer_fd);
+
+device_system_init_error_4:
+	close(system->listen_fd);
+	unlink(SIMULATED_SOCKET_PATH);
+
+device_system_init_error_3:
+	close(system->epoll_fd);
+
+device_system_init_error_2:
+	free(system);
+
+device_system_init_error_1:
+	return NULL;
+}
+
+void device_system_deinit(dtmd_device_system_t *system)
+{
+	size_t i;
+
+	if (system != NULL)
+	{
+		for (i = 0; i < simulated_clients_max; ++i)
+		{
+			if (system->clients[i].fd >= 0)
+			{
+				close(system->clients[i].fd);
+			}
+		}
+
+		close(system->timer_fd);
+		close(system->listen_fd);
+		unlink(SIMULATED_SOCKET_PATH);
+		close(system->epoll_fd);
+
+		simulated_free_events(system);
+		simulated_clear_devices(system);
+
+		if (system->monitor != NULL)
+		{
+			free(system->monitor);
+		}
+
+		free(system);
+	}
+}
+
+dtmd_device_enumeration_t* device_system_enumerate_devices(dtmd_device_system_t *system)
+{
+	dtmd_device_enumeration_t *enumeration;
+
+	if (system == NULL)
+	{
+		return NULL;
+	}
+
+	enumeration = (dtmd_device_enumeration_t*) malloc(sizeof(dtmd_device_enumeration_t));
+	if (enumeration == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return NULL;
+	}
+
+	enumeration->system  = system;
+	enumeration->current = 0;
+
+	return enumeration;
+}
+
+void device_system_finish_enumerate_devices(dtmd_device_enumeration_t *enumeration)
+{
+	if (enumeration != NULL)
+	{
+		free(enumeration);
+	}
+}
+
+int device_system_next_enumerated_device(dtmd_device_enumeration_t *enumeration, dtmd_info_t **device)
+{
+	dtmd_device_system_t *system;
+	simulated_event_t *event;
+	simulated_device_t *current;
+
+#ifndef NDEBUG
+	if ((enumeration == NULL)
+		|| (device == NULL))
+	{
+		return result_bug;
+	}
+#endif /* NDEBUG */
+
+	system = enumeration->system;
+
+	// disks precede their partitions in array
+	for ( ; enumeration->current < system->devices_count; ++(enumeration->current))
+	{
+		current = &(system->devices[enumeration->current]);
+
+		if ((current->is_deleted)
+			|| (!current->is_present)
+			|| ((current->type == simulated_device_partition) && (!system->devices[current->parent].is_present)))
+		{
+			continue;
+		}
+
+		event = simulated_create_event(system, enumeration->current, dtmd_device_action_unknown);
+		if (event == NULL)
+		{
+			return result_fatal_error;
+		}
+
+		++(enumeration->current);
+
+		*device = &(event->info);
+		return result_success;
+	}
+
+	*device = NULL;
+	return result_fail;
+}
+
+void device_system_free_enumerated_device(dtmd_device_enumeration_t *enumeration, dtmd_info_t *device)
+{
+	if ((enumeration != NULL)
+		&& (device != NULL))
+	{
+		device_system_free_device(device);
+	}
+}
+
+dtmd_device_monitor_t* device_system_start_monitoring(dtmd_device_system_t *system)
+{
+	dtmd_device_monitor_t *monitor;
+
+	// only one monitor is supported, it's owned by daemon
+	if ((system == NULL) || (system->monitor != NULL))
+	{
+		return NULL;
+	}
+
+	monitor = (dtmd_device_monitor_t*) malloc(sizeof(dtmd_device_monitor_t));
+	if (monitor == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return NULL;
+	}
+
+	monitor->system = system;
+	system->monitor = monitor;
+
+	return monitor;
+}
+
+void device_system_stop_monitoring(dtmd_device_monitor_t *monitor)
+{
+	if (monitor != NULL)
+	{
+		simulated_free_events(monitor->system);
+		monitor->system->monitor = NULL;
+		free(monitor);
+	}
+}
+
+int device_system_get_monitor_fd(dtmd_device_monitor_t *monitor)
+{
+	if (monitor != NULL)
+	{
+		return monitor->system->epoll_fd;
+	}
+	else
+	{
+		return -1;
+	}
+}
+
+int device_system_monitor_get_device(dtmd_device_monitor_t *monitor, dtmd_info_t **device, dtmd_device_action_type_t *action)
+{
+	dtmd_device_system_t *system;
+	simulated_event_t *event;
+
+	system = monitor->system;
+
+	if (system->events_first == NULL)
+	{
+		if (is_result_fatal_error(simulated_process_control(system)))
+		{
+			return result_fatal_error;
+		}
+	}
+
+	event = system->events_first;
+	if (event == NULL)
+	{
+		*device = NULL;
+		*action = dtmd_device_action_unknown;
+		return result_fail;
+	}
+
+	system->events_first = event->next;
+	if (system->events_first == NULL)
+	{
+		system->events_last = NULL;
+	}
+
+	*device = &(event->info);
+	*action = event->action;
+
+	return result_success;
+}
+
+int device_system_monitor_has_device(dtmd_device_monitor_t *monitor)
+{
+	return (monitor->system->events_first != NULL);
+}
+
+void device_system_monitor_free_device(dtmd_device_monitor_t *monitor, dtmd_info_t *device)
+{
+	if ((monitor != NULL)
+		&& (device != NULL))
+	{
+		device_system_free_device(device);
+	}
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "daemon/modules/unix-userspace/probe_cache.h"
+
+#include "daemon/return_codes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int probe_cache_same_time(const struct timespec *first, const struct timespec *second)
+{
+	return (first->tv_sec == second->tv_sec) && (first->tv_nsec == second->tv_nsec);
+}
+
+static int probe_cache_same_identity(const probe_cache_identity_t *first, const probe_cache_identity_t *second)
+{
+	return (first->device == second->device)
+		&& (first->diskseq == second->diskseq)
+		&& (first->size == second->size)
+		&& probe_cache_same_time(&(first->mtime), &(second->mtime))
+		&& probe_cache_same_time(&(first->ctime), &(second->ctime))
+		&& probe_cache_same_time(&(first->parent_mtime), &(second->parent_mtime))
+		&& probe_cache_same_time(&(first->parent_ctime), &(second->parent_ctime));
+}
+
+static int probe_cache_copy_string(const char *source, char **destination)
+{
+	if (source == NULL)
+	{
+		*destination = NULL;
+		return result_success;
+	}
+
+	*destination = strdup(source);
+	if (*destination == NULL)
+	{
+		return result_fatal_error;
+	}
+
+	return result_success;
+}
+
+static void probe_cache_free_entry(probe_cache_entry_t *entry)
+{
+	if (entry->fstype != NULL)
+	{
+		free(entry->fstype);
+	}
+
+	if (entry->label != NULL)
+	{
+		free(entry->label);
+	}
+
+	free(entry->path);
+	free(entry);
+}
+
+/* must be called with mutex locked, returns entry unlinked from list */
+static probe_cache_entry_t* probe_cache_unlink(probe_cache_t *cache, const char *path)
+{
+	probe_cache_entry_t *entry;
+	probe_cache_entry_t *prev = NULL;
+
+	for (entry = cache->first; entry != NULL; prev = entry, entry = entry->next)
+	{
+		if (strcmp(entry->path, path) == 0)
+		{
+			if (prev != NULL)
+			{
+				prev->next = entry->next;
+			}
+			else
+			{
+				cache->first = entry->next;
+			}
+
+			entry->next = NULL;
+			--(cache->count);
+
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* must be called with mutex locked */
+static void probe_cache_push_front(probe_cache_t *cache, probe_cache_entry_t *entry)
+{
+	probe_cache_entry_t *iter;
+	probe_cache_entry_t *prev = NULL;
+
+	entry->next = cache->first;
+	cache->first = entry;
+	++(cache->count);
+
+	if (cache->count > probe_cache_max_entries)
+	{
+		for (iter = cache->first; iter->next != NULL; prev = iter, iter = iter->next)
+		{
+		}
+
+		prev->next = NULL;
+		--(cache->count);
+
+		probe_cache_free_entry(iter);
+	}
+}
+
+int probe_cache_init(probe_cache_t *cache)
+{
+	cache->first  = NULL;
+	cache->count  = 0;
+	cache->hits   = 0;
+	cache->misses = 0;
+
+	if (pthread_mutex_init(&(cache->mutex), NULL) != 0)
+	{
+		return result_fatal_error;
+	}
+
+	return result_success;
+}
+
+void probe_cache_free(probe_cache_t *cache)
+{
+	probe_cache_entry_t *entry;
+
+	while (cache->first != NULL)
+	{
+		entry = cache->first;
+		cache->first = entry->next;
+
+		probe_cache_free_entry(entry);
+	}
+
+	cache->count = 0;
+
+	pthread_mutex_destroy(&(cache->mutex));
+}
+
+int probe_cache_lookup(probe_cache_t *cache, const char *path, const probe_cache_identity_t *identity, const char **fstype, const char **label)
+{
+	probe_cache_entry_t *entry;
+	char *local_fstype;
+	char *local_label;
+	int result;
+
+	pthread_mutex_lock(&(cache->mutex));
+
+	entry = probe_cache_unlink(cache, path);
+	if (entry == NULL)
+	{
+		++(cache->misses);
+		result = result_fail;
+		goto probe_cache_lookup_exit_1;
+	}
+
+	if (!probe_cache_same_identity(&(entry->identity), identity))
+	{
+		probe_cache_free_entry(entry);
+		++(cache->misses);
+		result = result_fail;
+		goto probe_cache_lookup_exit_1;
+	}
+
+	probe_cache_push_front(cache, entry);
+
+	result = probe_cache_copy_string(entry->fstype, &local_fstype);
+	if (is_result_failure(result))
+	{
+		goto probe_cache_lookup_exit_1;
+	}
+
+	result = probe_cache_copy_string(entry->label, &local_label);
+	if (is_result_failure(result))
+	{
+		goto probe_cache_lookup_exit_2;
+	}
+
+	++(cache->hits);
+
+	pthread_mutex_unlock(&(cache->mutex));
+
+	*fstype = local_fstype;
+	*label  = local_label;
+
+	return result_success;
+
+probe_cache_lookup_exit_2:
+	if (local_fstype != NULL)
+	{
+		free(local_fstype);
+	}
+
+probe_cache_lookup_exit_1:
+	pthread_mutex_unlock(&(cache->mutex));
+
+	return result;
+}
+
+int probe_cache_store(probe_cache_t *cache, const char *path, const probe_cache_identity_t *identity, const char *fstype, const char *label)
+{
+	probe_cache_entry_t *entry;
+	probe_cache_entry_t *old_entry;
+
+	entry = (probe_cache_entry_t*) malloc(sizeof(probe_cache_entry_t));
+	if (entry == NULL)
+	{
+		goto probe_cache_store_error_1;
+	}
+
+	entry->path = strdup(path);
+	if (entry->path == NULL)
+	{
+		goto probe_cache_store_error_2;
+	}
+
+	if (is_result_failure(probe_cache_copy_string(fstype, &(entry->fstype))))
+	{
+		goto probe_cache_store_error_3;
+	}
+
+	if (is_result_failure(probe_cache_copy_string(label, &(entry->label))))
+	{
+		goto probe_cache_store_error_4;
+	}
+
+	entry->identity = *identity;
+	entry->next = NULL;
+
+	pthread_mutex_lock(&(cache->mutex));
+
+	old_entry = probe_cache_unlink(cache, path);
+	if (old_entry != NULL)
+	{
+		probe_cache_free_entry(old_entry);
+	}
+
+	probe_cache_push_front(cache, entry);
+
+	pthread_mutex_unlock(&(cache->mutex));
+
+	return result_success;
+
+probe_cache_store_error_4:
+	if (entry->fstype != NULL)
+	{
+		free(entry->fstype);
+	}
+
+probe_cache_store_error_3:
+	free(entry->path);
+
+probe_cache_store_error_2:
+	free(entry);
+
+probe_cache_store_error_1:
+	return result_fatal_error;
+}
+
+void probe_cache_remove(probe_cache_t *cache, const char *path)
+{
+	probe_cache_entry_t *entry;
+
+	pthread_mutex_lock(&(cache->mutex));
+
+	entry = probe_cache_unlink(cache, path);
+
+	pthread_mutex_unlock(&(cache->mutex));
+
+	if (entry != NULL)
+	{
+		probe_cache_free_entry(entry);
+	}
+}
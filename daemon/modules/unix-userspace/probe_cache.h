@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DTMD_PROBE_CACHE_H
+#define DTMD_PROBE_CACHE_H
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Results of reading filesystem type and label of devices.
+ *
+ * Kernel often reports change of device when media didn't change,
+ * in that case, as well as on resync or when device goes online,
+ * results are taken from cache instead of probing device again.
+ * Device is considered same while its number, disk sequence number and size
+ * and modification and status change times of its device node don't change.
+ * For partitions times of disk device node are compared too.
+ * mkfs or relabeling writes through device node and updates its times,
+ * but changes not made through these device nodes, e.g. relabeling of mounted filesystem
+ * with ioctl, aren't noticed until device identity changes.
+ */
+
+#define probe_cache_max_entries 256
+
+typedef struct probe_cache_identity
+{
+	dev_t device;
+	unsigned long long diskseq;   /* 0 if not available */
+	unsigned long long size;
+	struct timespec mtime;
+	struct timespec ctime;
+	struct timespec parent_mtime; /* zero if device isn't a partition */
+	struct timespec parent_ctime;
+} probe_cache_identity_t;
+
+typedef struct probe_cache_entry
+{
+	char *path;
+	probe_cache_identity_t identity;
+
+	char *fstype;
+	char *label;
+
+	struct probe_cache_entry *next;
+} probe_cache_entry_t;
+
+typedef struct probe_cache
+{
+	pthread_mutex_t mutex;
+
+	/* most recently used entries first */
+	probe_cache_entry_t *first;
+	size_t count;
+
+	unsigned long hits;
+	unsigned long misses;
+} probe_cache_t;
+
+int probe_cache_init(probe_cache_t *cache);
+void probe_cache_free(probe_cache_t *cache);
+
+/*
+ * returns result_success and copies of cached data if device on path has same identity,
+ * result_fail if there's no such data and result_fatal_error on allocation failure
+ */
+int probe_cache_lookup(probe_cache_t *cache, const char *path, const probe_cache_identity_t *identity, const char **fstype, const char **label);
+
+/* replaces data of device on path */
+int probe_cache_store(probe_cache_t *cache, const char *path, const probe_cache_identity_t *identity, const char *fstype, const char *label);
+
+void probe_cache_remove(probe_cache_t *cache, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DTMD_PROBE_CACHE_H */
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "daemon/modules/unix-userspace/sysfs.h"
+
+#include "daemon/return_codes.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define sysfs_class_block_dir "class/block"
+#define sysfs_usb_subsystem "/usb"
+#define sysfs_usb_device_line "DEVTYPE=usb_device"
+
+int sysfs_root_init(sysfs_root_t *root, const char *path)
+{
+	root->path = strdup(path);
+	if (root->path == NULL)
+	{
+		return result_fatal_error;
+	}
+
+	root->sys_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (root->sys_fd < 0)
+	{
+		goto sysfs_root_init_error_1;
+	}
+
+	root->class_block_fd = openat(root->sys_fd, sysfs_class_block_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (root->class_block_fd < 0)
+	{
+		goto sysfs_root_init_error_2;
+	}
+
+	return result_success;
+
+sysfs_root_init_error_2:
+	close(root->sys_fd);
+
+sysfs_root_init_error_1:
+	free(root->path);
+	root->path = NULL;
+
+	return result_fail;
+}
+
+void sysfs_root_free(sysfs_root_t *root)
+{
+	close(root->class_block_fd);
+	close(root->sys_fd);
+	free(root->path);
+}
+
+void sysfs_accessor_init(sysfs_accessor_t *accessor, const sysfs_root_t *root)
+{
+	accessor->root = root;
+	accessor->buffer[0] = 0;
+}
+
+DIR* sysfs_open_directory(int dir_fd, const char *name)
+{
+	DIR *dir_pointer;
+	int fd;
+
+	fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	dir_pointer = fdopendir(fd);
+	if (dir_pointer == NULL)
+	{
+		close(fd);
+	}
+
+	return dir_pointer;
+}
+
+int sysfs_file_exists(int dir_fd, const char *name)
+{
+	struct stat stat_entry;
+
+	if (fstatat(dir_fd, name, &stat_entry, 0) != 0)
+	{
+		return result_fail;
+	}
+
+	return result_success;
+}
+
+static int sysfs_read_file(sysfs_accessor_t *accessor, int dir_fd, const char *name, size_t *size)
+{
+	ssize_t read_size;
+	int fd;
+
+	fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return result_fail;
+	}
+
+	// sysfs attributes are returned completely by first read
+	read_size = read(fd, accessor->buffer, sysfs_read_buffer_size);
+	close(fd);
+
+	if (read_size < 0)
+	{
+		return result_fail;
+	}
+
+	accessor->buffer[read_size] = 0;
+	*size = read_size;
+
+	return result_success;
+}
+
+int sysfs_read_string(sysfs_accessor_t *accessor, int dir_fd, const char *name, const char **value)
+{
+	size_t size;
+	size_t i;
+
+	if (is_result_failure(sysfs_read_file(accessor, dir_fd, name, &size)))
+	{
+		return result_fail;
+	}
+
+	for (i = 0; (i < size) && isprint((unsigned char) accessor->buffer[i]); ++i)
+	{
+	}
+
+	accessor->buffer[i] = 0;
+	*value = accessor->buffer;
+
+	return result_success;
+}
+
+int sysfs_read_int(sysfs_accessor_t *accessor, int dir_fd, const char *name, int *value)
+{
+	size_t size;
+	size_t i;
+	int result = 0;
+
+	if (is_result_failure(sysfs_read_file(accessor, dir_fd, name, &size)))
+	{
+		return result_fail;
+	}
+
+	if ((size == 0) || (!isdigit((unsigned char) accessor->buffer[0])))
+	{
+		return result_fail;
+	}
+
+	for (i = 0; (i < size) && isdigit((unsigned char) accessor->buffer[i]); ++i)
+	{
+		result = (result * 10) + (accessor->buffer[i] - '0');
+	}
+
+	*value = result;
+
+	return result_success;
+}
+
+int sysfs_read_unsigned(sysfs_accessor_t *accessor, int dir_fd, const char *name, unsigned long long *value)
+{
+	size_t size;
+
+	if (is_result_failure(sysfs_read_file(accessor, dir_fd, name, &size)))
+	{
+		return result_fail;
+	}
+
+	if ((size == 0) || (!isdigit((unsigned char) accessor->buffer[0])))
+	{
+		return result_fail;
+	}
+
+	*value = strtoull(accessor->buffer, NULL, 10);
+
+	return result_success;
+}
+
+int sysfs_file_has_line(sysfs_accessor_t *accessor, int dir_fd, const char *name, const char *line)
+{
+	size_t size;
+	size_t line_len;
+	char *line_start;
+	char *line_end;
+
+	if (is_result_failure(sysfs_read_file(accessor, dir_fd, name, &size)))
+	{
+		return result_fail;
+	}
+
+	line_len = strlen(line);
+
+	for (line_start = accessor->buffer; line_start < accessor->buffer + size; line_start = line_end + 1)
+	{
+		line_end = strchr(line_start, '\n');
+		if (line_end == NULL)
+		{
+			// last line without line end may be cut off
+			break;
+		}
+
+		if (((size_t) (line_end - line_start) == line_len) && (strncmp(line_start, line, line_len) == 0))
+		{
+			return result_success;
+		}
+	}
+
+	return result_fail;
+}
+
+int sysfs_get_block_devpath(sysfs_accessor_t *accessor, const char *name, const char **devpath)
+{
+	ssize_t link_size;
+	char *start;
+
+	link_size = readlinkat(accessor->root->class_block_fd, name, accessor->buffer, sysfs_read_buffer_size);
+	if ((link_size <= 0) || (link_size == sysfs_read_buffer_size))
+	{
+		return result_fail;
+	}
+
+	accessor->buffer[link_size] = 0;
+
+	// link is relative to class/block directory
+	if (strncmp(accessor->buffer, "../../", strlen("../../")) != 0)
+	{
+		return result_fail;
+	}
+
+	start = accessor->buffer + strlen("../../");
+	memmove(accessor->buffer, start, strlen(start) + 1);
+
+	*devpath = accessor->buffer;
+
+	return result_success;
+}
+
+char* sysfs_get_usb_parent_syspath(sysfs_accessor_t *accessor, const char *devpath)
+{
+	char path[PATH_MAX + 1];
+	char link_buffer[PATH_MAX + 1];
+	size_t curlen;
+	ssize_t link_size;
+	char *result;
+
+	while (devpath[0] == '/')
+	{
+		++devpath;
+	}
+
+	curlen = strlen(devpath);
+	if (curlen + strlen("/subsystem") > PATH_MAX)
+	{
+		return NULL;
+	}
+
+	strcpy(path, devpath);
+
+	while ((curlen > 0) && (path[curlen - 1] == '/'))
+	{
+		--curlen;
+		path[curlen] = 0;
+	}
+
+	while (curlen > 0)
+	{
+		strcpy(path + curlen, "/subsystem");
+
+		link_size = readlinkat(accessor->root->sys_fd, path, link_buffer, sizeof(link_buffer) - 1);
+		if ((link_size > 0)
+			&& ((size_t) link_size > strlen(sysfs_usb_subsystem))
+			&& (strncmp(&link_buffer[link_size - strlen(sysfs_usb_subsystem)], sysfs_usb_subsystem, strlen(sysfs_usb_subsystem)) == 0))
+		{
+			strcpy(path + curlen, "/uevent");
+
+			if (is_result_successful(sysfs_file_has_line(accessor, accessor->root->sys_fd, path, sysfs_usb_device_line)))
+			{
+				path[curlen] = 0;
+
+				result = (char*) malloc(strlen(accessor->root->path) + curlen + 2);
+				if (result != NULL)
+				{
+					strcpy(result, accessor->root->path);
+					strcat(result, "/");
+					strcat(result, path);
+				}
+
+				return result;
+			}
+		}
+
+		path[curlen] = 0;
+
+		result = strrchr(path, '/');
+		if (result == NULL)
+		{
+			break;
+		}
+
+		*result = 0;
+		curlen = result - path;
+	}
+
+	return NULL;
+}
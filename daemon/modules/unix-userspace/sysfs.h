@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DTMD_SYSFS_H
+#define DTMD_SYSFS_H
+
+#include <dirent.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Access to sysfs attributes relative to cached directory descriptors.
+ *
+ * Root descriptors are opened once and may be shared between threads.
+ * Each thread reads attributes through its own accessor,
+ * which contains buffer reused for all reads.
+ */
+
+#define sysfs_read_buffer_size 4096
+
+typedef struct sysfs_root
+{
+	char *path;
+	int sys_fd;           /* root of sysfs */
+	int class_block_fd;   /* class/block directory */
+} sysfs_root_t;
+
+typedef struct sysfs_accessor
+{
+	const sysfs_root_t *root;
+	char buffer[sysfs_read_buffer_size + 1];
+} sysfs_accessor_t;
+
+int sysfs_root_init(sysfs_root_t *root, const char *path);
+void sysfs_root_free(sysfs_root_t *root);
+
+void sysfs_accessor_init(sysfs_accessor_t *accessor, const sysfs_root_t *root);
+
+/* returns directory stream for directory name relative to dir_fd or NULL */
+DIR* sysfs_open_directory(int dir_fd, const char *name);
+
+/* returns result_success if file exists, result_fail otherwise */
+int sysfs_file_exists(int dir_fd, const char *name);
+
+/*
+ * Reads printable beginning of file into accessor buffer.
+ * On success value points to accessor buffer and stays valid until next read.
+ */
+int sysfs_read_string(sysfs_accessor_t *accessor, int dir_fd, const char *name, const char **value);
+
+int sysfs_read_int(sysfs_accessor_t *accessor, int dir_fd, const char *name, int *value);
+int sysfs_read_unsigned(sysfs_accessor_t *accessor, int dir_fd, const char *name, unsigned long long *value);
+
+/* returns result_success if one of lines of file is equal to line */
+int sysfs_file_has_line(sysfs_accessor_t *accessor, int dir_fd, const char *name, const char *line);
+
+/*
+ * Resolves link class/block/name into device path relative to sysfs root.
+ * Resulting path is written into accessor buffer.
+ */
+int sysfs_get_block_devpath(sysfs_accessor_t *accessor, const char *name, const char **devpath);
+
+/*
+ * Returns absolute sysfs path of usb device which device with given path relative to sysfs root belongs to,
+ * NULL if device isn't on usb or on error.
+ * Result has to be freed.
+ */
+char* sysfs_get_usb_parent_syspath(sysfs_accessor_t *accessor, const char *devpath);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DTMD_SYSFS_H */
@@ -19,11 +19,16 @@
  */
 
 #include "daemon/system_module.h"
+#include "daemon/config_file.h"
 #include "daemon/lists.h"
 #include "daemon/log.h"
 #include "daemon/return_codes.h"
 
 #if (defined OS_Linux)
+#include "daemon/modules/unix-userspace/probe_cache.h"
+#include "daemon/modules/unix-userspace/sysfs.h"
+#include "daemon/modules/unix-userspace/uevent_record.h"
+
 #include <blkid.h>
 #endif /* (defined OS_Linux) */
 
@@ -46,17 +51,23 @@
 #include <limits.h>
 #include <poll.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <stdatomic.h>
 
 #if (defined OS_Linux)
 #include <linux/netlink.h>
+#include <linux/filter.h>
+#include <sys/eventfd.h>
+#include <time.h>
 
-#define block_devices_dir "/sys/class/block"
-#define block_mmc_devices_dir "/sys/bus/mmc/devices"
-#define block_usb_devices_dir "/sys/bus/usb/devices"
+#define block_mmc_devices_dir "bus/mmc/devices"
+#define block_usb_devices_dir "bus/usb/devices"
 
 #define filename_dev "dev"
 #define filename_removable "removable"
 #define filename_device_type "device/type"
+#define filename_diskseq "diskseq"
+#define filename_size "size"
 #define removable_correct_value 1
 #define block_sys_dir "/sys"
 #define block_dir_name "block"
@@ -65,8 +76,6 @@
 #define scsi_type_cd_dvd "5"
 #define scsi_type_sd_card "SD"
 
-#define file_read_buffer 4096
-
 #define NETLINK_STRING_ACTION "ACTION="
 #define NETLINK_STRING_SUBSYSTEM "SUBSYSTEM="
 #define NETLINK_STRING_DEVNAME "DEVNAME="
@@ -83,6 +92,15 @@
 #define NETLINK_STRING_DEVTYPE_PARTITION "partition"
 
 #define NETLINK_GROUP_KERNEL 1
+
+#define netlink_receive_buffer_size (4 * 1024 * 1024)
+#define netlink_batch_size 32
+#define netlink_filter_max_header 512
+
+#define probe_workers_count 4
+
+/* milliseconds between checks whether replay of uevents may start */
+#define replay_wait_interval 100
 #endif /* (defined OS_Linux) */
 
 #if (defined OS_FreeBSD)
@@ -126,6 +144,12 @@
 
 #define devices_dir "/dev"
 
+#define monitor_queue_size 256
+
+#define monitor_status_ok 0
+#define monitor_status_exit 1
+#define monitor_status_error 2
+
 #define IFLIST_REPLY_BUFFER 8192
 
 typedef struct dtmd_enumeration_item
@@ -147,6 +171,29 @@ struct dtmd_device_enumeration
 	struct dtmd_device_enumeration *prev;
 };
 
+#if (defined OS_Linux)
+/*
+ * Events waiting for delivery in order of arrival.
+ * Events which need probing with blkid are probed by probe workers in parallel,
+ * but events of same disk and its partitions are delivered in order of arrival.
+ * Resync request has no device and no order key: it waits for all earlier events
+ * and all later events wait for it, while its enumeration is read by probe worker.
+ */
+typedef struct dtmd_probe_item
+{
+	dtmd_info_t *item;
+	dtmd_device_action_type_t action;
+
+	const char *order_key;
+	int is_probed;
+
+	struct dtmd_device_enumeration *enumeration; /* read for resync request */
+
+	struct dtmd_probe_item *next;
+	struct dtmd_probe_item *next_queued;
+} dtmd_probe_item_t;
+#endif /* (defined OS_Linux) */
+
 typedef struct dtmd_monitor_item
 {
 	dtmd_info_t *item;
@@ -155,19 +202,58 @@ typedef struct dtmd_monitor_item
 	struct dtmd_monitor_item *next;
 } dtmd_monitor_item_t;
 
+/*
+ * Events are passed to monitor via ring of preallocated slots.
+ * Only one thread adds events at a time since it's done with control_mutex locked,
+ * and only owner of monitor takes them, so ring itself needs no locking.
+ * If ring is full, events are put into overflow list protected by control_mutex
+ * until owner of monitor takes all events from ring.
+ */
+typedef struct dtmd_monitor_slot
+{
+	dtmd_info_t *item;
+	dtmd_device_action_type_t action;
+} dtmd_monitor_slot_t;
+
 struct dtmd_device_monitor
 {
 	dtmd_device_system_t *system;
 
+#if (defined OS_Linux)
+	int event_fd;
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
 	int data_pipe[2];
+#endif /* (defined OS_FreeBSD) */
 
-	dtmd_monitor_item_t *first;
-	dtmd_monitor_item_t *last;
+	atomic_size_t head; /* changed only by thread adding events */
+	atomic_size_t tail; /* changed only by owner of monitor */
+	dtmd_monitor_slot_t slots[monitor_queue_size];
+
+	dtmd_monitor_item_t *overflow_first;
+	dtmd_monitor_item_t *overflow_last;
+	atomic_int has_overflow;
+
+	atomic_int status;
 
 	struct dtmd_device_monitor *next;
 	struct dtmd_device_monitor *prev;
 };
 
+#if (defined OS_Linux)
+typedef struct dtmd_netlink_batch
+{
+	struct mmsghdr messages[netlink_batch_size];
+	struct iovec io[netlink_batch_size];
+	struct sockaddr_nl addresses[netlink_batch_size];
+	char cred_msg[netlink_batch_size][CMSG_SPACE(sizeof(struct ucred))];
+	char buffers[netlink_batch_size][IFLIST_REPLY_BUFFER];
+
+	/* used for reading attributes of reported devices */
+	sysfs_accessor_t sysfs;
+} dtmd_netlink_batch_t;
+#endif /* (defined OS_Linux) */
+
 struct dtmd_device_system
 {
 	int events_fd;
@@ -180,119 +266,51 @@ struct dtmd_device_system
 
 	dtmd_device_monitor_t *first_monitor;
 	dtmd_device_monitor_t *last_monitor;
-};
-
-typedef struct dtmd_info_private
-{
-	dtmd_device_system_t *system;
-	uint32_t counter;
-} dtmd_info_private_t;
 
 #if (defined OS_Linux)
-static int read_int_from_file(const char *filename)
-{
-	FILE *file;
-	int value = 0;
-	int read_val;
-	int not_first = 0;
-
-	file = fopen(filename, "r");
-	if (file == NULL)
-	{
-		goto read_int_from_file_error_1;
-	}
-
-	while ((read_val = fgetc(file)) != EOF)
-	{
-		if ((read_val < '0')
-			|| (read_val > '9'))
-		{
-			if (not_first)
-			{
-				break;
-			}
-			else
-			{
-				WRITE_LOG_ARGS(LOG_ERR, "File '%s' does not contain valid number", filename);
-				goto read_int_from_file_error_2;
-			}
-		}
-
-		not_first = 1;
-		value = (value * 10) + (read_val - '0');
-	}
-
-	fclose(file);
-
-	return value;
-
-read_int_from_file_error_2:
-	fclose(file);
-
-read_int_from_file_error_1:
-	return -1;
-}
-
-static int read_string_from_file(char **resultstr, const char *filename)
-{
-	FILE *file;
-	int result_len = 0;
-	int read_val;
-	void *tmp;
-
-#ifndef NDEBUG
-	if (resultstr == NULL)
-	{
-		return result_bug;
-	}
-#endif /* NDEBUG */
-
-	file = fopen(filename, "r");
-	if (file == NULL)
-	{
-		return result_fail;
-	}
+	sysfs_root_t sysfs;
 
-	*resultstr = (char*) malloc((result_len+1) * sizeof(char));
-	if (*resultstr == NULL)
-	{
-		WRITE_LOG(LOG_ERR, "Memory allocation failure");
-		goto read_string_from_file_error_1;
-	}
+	dtmd_netlink_batch_t *netlink_batch;
 
-	while ((read_val = fgetc(file)) != EOF)
-	{
-		if (!isprint(read_val))
-		{
-			break;
-		}
+	/* received uevents are written into recorder */
+	int is_recording;
+	uevent_recorder_t recorder;
 
-		tmp = realloc(*resultstr, result_len + 2);
-		if (tmp == NULL)
-		{
-			WRITE_LOG(LOG_ERR, "Memory allocation failure");
-			goto read_string_from_file_error_2;
-		}
+	/* uevents are read from player instead of netlink socket */
+	int is_replaying;
+	int is_replay_started;
+	int is_enumerated; /* protected by control_mutex */
+	uevent_player_t player;
+	struct timespec replay_start;
+	unsigned long long replay_timestamp; /* of record waiting in first buffer of netlink batch */
+	size_t replay_length;
 
-		*resultstr = (char*) tmp;
-		(*resultstr)[result_len++] = read_val;
-	}
+	probe_cache_t probe_cache;
 
-	fclose(file);
-	(*resultstr)[result_len] = 0;
+	/* read and probed by probe worker, taken by next enumeration; protected by control_mutex */
+	dtmd_device_enumeration_t *resync_enumeration;
 
-	return result_success;
+	pthread_mutex_t probe_mutex;
+	pthread_cond_t probe_cond;
+	pthread_t probe_threads[probe_workers_count];
+	size_t probe_threads_started;
+	int probe_stop;
 
-read_string_from_file_error_2:
-	free(*resultstr);
-	*resultstr = NULL;
+	dtmd_probe_item_t *pending_first;
+	dtmd_probe_item_t *pending_last;
 
-read_string_from_file_error_1:
-	fclose(file);
+	dtmd_probe_item_t *probe_queue_first;
+	dtmd_probe_item_t *probe_queue_last;
+#endif /* (defined OS_Linux) */
+};
 
-	return result_fatal_error;
-}
+typedef struct dtmd_info_private
+{
+	dtmd_device_system_t *system;
+	atomic_uint counter;
+} dtmd_info_private_t;
 
+#if (defined OS_Linux)
 static dtmd_removable_media_type_t device_subtype_from_string(const char *string)
 {
 	if (strcmp(string, scsi_type_direct_access) == 0)
@@ -378,19 +396,186 @@ helper_blkid_read_data_from_partition_error_1:
 
 	return result_fatal_error;
 }
+
+/* returns name of device node which is probed for device path, it's different only if devices root is set */
+static const char* helper_get_device_node(const char *path, char *buffer, size_t buffer_size)
+{
+	int length;
+
+	if (devices_root_dir == NULL)
+	{
+		return path;
+	}
+
+	length = snprintf(buffer, buffer_size, "%s%s", devices_root_dir, path + strlen(devices_dir));
+	if ((length < 0) || ((size_t) length >= buffer_size))
+	{
+		return NULL;
+	}
+
+	return buffer;
+}
+
+static int helper_read_probe_identity(sysfs_accessor_t *sysfs, const dtmd_info_t *device_info, const char *node, probe_cache_identity_t *identity)
+{
+	struct stat stat_entry;
+	char file_name[PATH_MAX + 1];
+	char parent_node_buffer[PATH_MAX + 1];
+	const char *parent_node;
+	const char *name;
+
+	memset(identity, 0, sizeof(probe_cache_identity_t));
+
+	// filesystem of partition may be rewritten through disk device node too
+	if ((device_info->media_type == dtmd_removable_media_type_device_partition)
+		&& (device_info->path_parent != NULL))
+	{
+		parent_node = helper_get_device_node(device_info->path_parent, parent_node_buffer, sizeof(parent_node_buffer));
+		if ((parent_node == NULL)
+			|| (stat(parent_node, &stat_entry) != 0)
+			|| (!S_ISBLK(stat_entry.st_mode)))
+		{
+			return result_fail;
+		}
+
+		identity->parent_mtime = stat_entry.st_mtim;
+		identity->parent_ctime = stat_entry.st_ctim;
+	}
+
+	if ((stat(node, &stat_entry) != 0) || (!S_ISBLK(stat_entry.st_mode)))
+	{
+		return result_fail;
+	}
+
+	name = device_info->path + strlen(devices_dir "/");
+
+	if (strlen(name) + strlen("/../" filename_diskseq) > PATH_MAX)
+	{
+		return result_fail;
+	}
+
+	identity->device = stat_entry.st_rdev;
+	identity->mtime  = stat_entry.st_mtim;
+	identity->ctime  = stat_entry.st_ctim;
+
+	strcpy(file_name, name);
+	strcat(file_name, "/" filename_size);
+
+	if (is_result_failure(sysfs_read_unsigned(sysfs, sysfs->root->class_block_fd, file_name, &(identity->size))))
+	{
+		return result_fail;
+	}
+
+	// partitions share disk sequence number of their disk
+	strcpy(&(file_name[strlen(name)]), "/" filename_diskseq);
+
+	if (is_result_failure(sysfs_read_unsigned(sysfs, sysfs->root->class_block_fd, file_name, &(identity->diskseq))))
+	{
+		strcpy(&(file_name[strlen(name)]), "/../" filename_diskseq);
+
+		if (is_result_failure(sysfs_read_unsigned(sysfs, sysfs->root->class_block_fd, file_name, &(identity->diskseq))))
+		{
+			identity->diskseq = 0;
+		}
+	}
+
+	return result_success;
+}
+
+static int helper_probe_device(probe_cache_t *cache, sysfs_accessor_t *sysfs, dtmd_info_t *device_info)
+{
+	int result;
+	int has_identity;
+	probe_cache_identity_t identity;
+	char node_buffer[PATH_MAX + 1];
+	const char *node;
+
+	switch (device_info->media_type)
+	{
+	case dtmd_removable_media_type_device_partition:
+	case dtmd_removable_media_type_stateful_device:
+		break;
+
+	default:
+		return result_success;
+	}
+
+	node = helper_get_device_node(device_info->path, node_buffer, sizeof(node_buffer));
+	if (node == NULL)
+	{
+		WRITE_LOG(LOG_WARNING, "Error: got too long file name");
+		return result_fail;
+	}
+
+	has_identity = is_result_successful(helper_read_probe_identity(sysfs, device_info, node, &identity));
+
+	result = result_fail;
+
+	if (has_identity)
+	{
+		result = probe_cache_lookup(cache, device_info->path, &identity, &(device_info->fstype), &(device_info->label));
+		if (is_result_fatal_error(result))
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			return result;
+		}
+	}
+
+	if (is_result_failure(result))
+	{
+		result = helper_blkid_read_data_from_partition(node, &(device_info->fstype), &(device_info->label));
+		if (is_result_fatal_error(result))
+		{
+			return result;
+		}
+
+		// empty drives aren't cached, next media may have same identity
+		if (has_identity && is_result_successful(result))
+		{
+			if (is_result_fatal_error(probe_cache_store(cache, device_info->path, &identity, device_info->fstype, device_info->label)))
+			{
+				WRITE_LOG(LOG_ERR, "Memory allocation failure");
+				return result_fatal_error;
+			}
+		}
+	}
+
+	switch (device_info->media_type)
+	{
+	case dtmd_removable_media_type_device_partition:
+		device_info->state = dtmd_removable_media_state_unknown;
+		break;
+
+	case dtmd_removable_media_type_stateful_device:
+		if (is_result_failure(result))
+		{
+			device_info->state = dtmd_removable_media_state_empty;
+		}
+		else if (device_info->fstype == NULL)
+		{
+			device_info->state = dtmd_removable_media_state_clear;
+		}
+		else
+		{
+			device_info->state = dtmd_removable_media_state_ok;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return result_success;
+}
 #endif /* (defined OS_Linux) */
 
 static void device_system_free_device(dtmd_info_t *device)
 {
-	uint32_t counter = 0;
+	unsigned int counter = 0;
 
 	if (device->private_data != NULL)
 	{
-		pthread_mutex_lock(&(((dtmd_info_private_t*)device->private_data)->system->control_mutex));
-
-		counter = --(((dtmd_info_private_t*)device->private_data)->counter);
-
-		pthread_mutex_unlock(&(((dtmd_info_private_t*)device->private_data)->system->control_mutex));
+		counter = atomic_fetch_sub(&(((dtmd_info_private_t*)device->private_data)->counter), 1) - 1;
 	}
 
 	if (counter == 0)
@@ -432,10 +617,67 @@ static void device_system_free_device(dtmd_info_t *device)
 }
 
 #if (defined OS_Linux)
+/*
+ * Kernel sends events in form "action@devpath\0ACTION=action\0DEVPATH=devpath\0SUBSYSTEM=subsystem\0...",
+ * i.e. subsystem always starts at offset 2 * L + 17, where L is length of header "action@devpath".
+ * Filter finds end of header and drops events of all subsystems except block devices,
+ * so that daemon doesn't wake up for them at all.
+ */
+static int attach_netlink_filter(int fd)
+{
+	struct sock_filter *code;
+	struct sock_fprog program;
+	unsigned int check;
+	unsigned int i;
+	int result;
+
+	check = netlink_filter_max_header * 4 + 1;
+
+	code = (struct sock_filter*) malloc((check + 10) * sizeof(struct sock_filter));
+	if (code == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return result_fatal_error;
+	}
+
+	for (i = 0; i < netlink_filter_max_header; ++i)
+	{
+		code[i * 4 + 0] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_B | BPF_ABS, i);
+		code[i * 4 + 1] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 2);
+		code[i * 4 + 2] = (struct sock_filter) BPF_STMT(BPF_LDX | BPF_IMM, 2 * i + 17);
+		code[i * 4 + 3] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JA, check - (i * 4 + 4), 0, 0);
+	}
+
+	// header is too long, let it be checked later
+	code[check - 1] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+
+	// "SUBSYSTEM=block\0"
+	code[check + 0] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_IND, 0);
+	code[check + 1] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ('S' << 24) | ('U' << 16) | ('B' << 8) | 'S', 0, 7);
+	code[check + 2] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_IND, 4);
+	code[check + 3] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ('Y' << 24) | ('S' << 16) | ('T' << 8) | 'E', 0, 5);
+	code[check + 4] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_IND, 8);
+	code[check + 5] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ('M' << 24) | ('=' << 16) | ('b' << 8) | 'l', 0, 3);
+	code[check + 6] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_IND, 12);
+	code[check + 7] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ('o' << 24) | ('c' << 16) | ('k' << 8), 0, 1);
+	code[check + 8] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	code[check + 9] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+
+	program.len    = check + 10;
+	program.filter = code;
+
+	result = (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) == 0) ? result_success : result_fail;
+
+	free(code);
+
+	return result;
+}
+
 static int open_netlink_socket(void)
 {
 	int fd;
 	int on = 1;
+	int receive_buffer_size = netlink_receive_buffer_size;
 	pid_t pid;
 	struct sockaddr_nl local;
 
@@ -453,12 +695,24 @@ static int open_netlink_socket(void)
 		return -1;
 	}
 
+	// events may come in bursts, e.g. when hub with card readers is plugged in
+	if ((setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &receive_buffer_size, sizeof(receive_buffer_size)) != 0)
+		&& (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size)) != 0))
+	{
+		WRITE_LOG(LOG_WARNING, "Failed setting receive buffer size for netlink socket");
+	}
+
+	if (is_result_failure(attach_netlink_filter(fd)))
+	{
+		WRITE_LOG(LOG_WARNING, "Failed attaching filter to netlink socket");
+	}
+
 	pid = (pthread_self() << 16) | getpid();
 
 	memset(&local, 0, sizeof(local));	/* fill-in local address information */
 	local.nl_family = AF_NETLINK;
 	local.nl_pid    = pid;
-	local.nl_groups = NETLINK_KOBJECT_UEVENT;
+	local.nl_groups = NETLINK_GROUP_KERNEL;
 
 	if (bind(fd, (struct sockaddr*) &local, sizeof(local)) < 0)
 	{
@@ -470,183 +724,43 @@ static int open_netlink_socket(void)
 	return fd;
 }
 
-static int file_check_line(const char *path, const char *line)
+/*
+ * Reads device from its sysfs directory opened as device_fd.
+ */
+static int helper_read_device(sysfs_accessor_t *sysfs, int device_fd, const char *device_name, int check_removable, dtmd_info_t **device)
 {
-	char buffer[file_read_buffer + 1];
-	size_t buffer_used = 0;
-	int line_start = 1;
-	ssize_t read_size;
-	char *char_ptr;
-	int fd;
-	int result = result_fail;
+	const char *device_type;
+	const char *devpath;
+	int removable;
+	int result;
+
+	dtmd_info_t *device_info;
+	dtmd_removable_media_subtype_t media_subtype;
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0)
+	if (is_result_failure(sysfs_file_exists(device_fd, filename_dev)))
 	{
-		return result_fail;
+		result = result_fail;
+		goto helper_read_device_error_1;
 	}
 
-	read_size = read(fd, buffer + buffer_used, file_read_buffer - buffer_used);
-	while (read_size > 0)
+	if (check_removable)
 	{
-		buffer_used += read_size;
-		buffer[buffer_used] = 0;
-
-		while ((char_ptr = strchr(buffer, '\n')) != NULL)
-		{
-			if (line_start)
-			{
-				if ((char_ptr - buffer == strlen(line)) && (strncmp(buffer, line, strlen(line)) == 0))
-				{
-					result = result_success;
-					goto file_check_line_exit;
-				}
-			}
-
-			buffer_used -= (char_ptr + 1 - buffer);
-			memmove(buffer, char_ptr + 1, buffer_used + 1);
-			line_start = 1;
-		}
-
-		if (buffer_used == file_read_buffer)
+		if (is_result_failure(sysfs_read_int(sysfs, device_fd, filename_removable, &removable))
+			|| (removable != removable_correct_value))
 		{
-			line_start = 0;
-			buffer_used = 0;
+			result = result_fail;
+			goto helper_read_device_error_1;
 		}
+	}
 
-		read_size = read(fd, buffer + buffer_used, file_read_buffer - buffer_used);
+	result = sysfs_read_string(sysfs, device_fd, filename_device_type, &device_type);
+	if (is_result_failure(result))
+	{
+		WRITE_LOG_ARGS(LOG_ERR, "Failed to get device type of device '%s'", device_name);
+		goto helper_read_device_error_1;
 	}
 
-file_check_line_exit:
-	close(fd);
-	return result;
-}
-
-static char*  helper_get_usb_parent_syspath(const char *path)
-{
-	char file_name[PATH_MAX + 1];
-	char link_buffer[PATH_MAX + 1];
-	char *result;
-	size_t curlen = 0;
-	ssize_t link_buffer_size;
-	struct stat stat_entry;
-	int intresult;
-
-	result = realpath(path, file_name);
-	if (result == NULL)
-	{
-		WRITE_LOG_ARGS(LOG_ERR, "Failed to resolve real path: %s", path);
-		return NULL;
-	}
-
-	curlen = strlen(file_name);
-
-	if (file_name[curlen - 1] != '/')
-	{
-		if (curlen + strlen("/") > PATH_MAX)
-		{
-			WRITE_LOG_ARGS(LOG_ERR, "Path is too long: %s", file_name);
-			return NULL;
-		}
-
-		strcat(file_name, "/");
-		++curlen;
-	}
-
-	if (curlen + strlen("subsystem") > PATH_MAX)
-	{
-		WRITE_LOG_ARGS(LOG_ERR, "Path is too long: %s", file_name);
-		return NULL;
-	}
-
-	while ((curlen > strlen(block_sys_dir "/")) && (strncmp(file_name, block_sys_dir "/", strlen(block_sys_dir "/")) == 0))
-	{
-		strcpy(file_name + curlen, "subsystem");
-
-		intresult = lstat(file_name, &stat_entry);
-		if (intresult == 0)
-		{
-			link_buffer_size = readlink(file_name, link_buffer, sizeof(link_buffer) - 1);
-			if ((link_buffer_size > strlen("/usb")) && (strncmp(&link_buffer[link_buffer_size - strlen("/usb")], "/usb", strlen("/usb")) == 0))
-			{
-				strcpy(file_name + curlen, "uevent");
-
-				intresult = file_check_line(file_name, "DEVTYPE=usb_device");
-				if (is_result_successful(intresult))
-				{
-					file_name[curlen - 1] = 0;
-
-					result = strdup(file_name);
-					if (result == NULL)
-					{
-						WRITE_LOG(LOG_ERR, "Memory allocation failure");
-					}
-
-					return result;
-				}
-				else if (is_result_fatal_error(intresult))
-				{
-					return NULL;
-				}
-			}
-		}
-
-		file_name[curlen - 1] = 0;
-		result = strrchr(file_name, '/');
-
-		if (result == NULL)
-		{
-			break;
-		}
-
-		result[1] = 0;
-		curlen = strlen(file_name);
-	}
-
-	return NULL;
-}
-
-static int helper_read_device(char *name, const char *device_name, int check_removable, dtmd_info_t **device)
-{
-	char *device_type;
-	struct stat stat_entry;
-	char *start_string;
-	int result;
-
-	dtmd_info_t *device_info;
-	dtmd_removable_media_subtype_t media_subtype;
-
-	start_string = name + strlen(name);
-
-	strcpy(start_string, filename_dev);
-
-	if (stat(name, &stat_entry) != 0)
-	{
-		result = result_fail;
-		goto helper_read_device_error_1;
-	}
-
-	if (check_removable)
-	{
-		strcpy(start_string, filename_removable);
-
-		if (read_int_from_file(name) != removable_correct_value)
-		{
-			result = result_fail;
-			goto helper_read_device_error_1;
-		}
-	}
-
-	strcpy(start_string, filename_device_type);
-	result = read_string_from_file(&device_type, name);
-	if (is_result_failure(result))
-	{
-		WRITE_LOG_ARGS(LOG_ERR, "Failed to get device type from file '%s'", name);
-		goto helper_read_device_error_1;
-	}
-
-	media_subtype = device_subtype_from_string(device_type);
-	free(device_type);
+	media_subtype = device_subtype_from_string(device_type);
 
 	if (media_subtype == dtmd_removable_media_subtype_unknown_or_persistent)
 	{
@@ -688,8 +802,12 @@ static int helper_read_device(char *name, const char *device_name, int check_rem
 	{
 	case dtmd_removable_media_subtype_removable_disk:
 	case dtmd_removable_media_subtype_sd_card:
-		start_string[0] = 0;
-		device_info->sysfs_path	= helper_get_usb_parent_syspath(name);
+		device_info->sysfs_path = NULL;
+
+		if (is_result_successful(sysfs_get_block_devpath(sysfs, device_name, &devpath)))
+		{
+			device_info->sysfs_path = sysfs_get_usb_parent_syspath(sysfs, devpath);
+		}
 
 		device_info->media_type = dtmd_removable_media_type_stateless_device;
 		device_info->fstype     = NULL;
@@ -699,32 +817,13 @@ static int helper_read_device(char *name, const char *device_name, int check_rem
 		return 1;
 
 	case dtmd_removable_media_subtype_cdrom:
+		// state is read later by helper_probe_enumerated_devices
 		device_info->media_type = dtmd_removable_media_type_stateful_device;
 		device_info->sysfs_path = NULL;
-
-		result = helper_blkid_read_data_from_partition(device_info->path, &(device_info->fstype), &(device_info->label));
-		switch (result)
-		{
-		case result_fail:
-			device_info->state = dtmd_removable_media_state_empty;
-			break;
-
-		case result_success:
-			if (device_info->fstype == NULL)
-			{
-				device_info->state = dtmd_removable_media_state_clear;
-			}
-			else
-			{
-				device_info->state = dtmd_removable_media_state_ok;
-			}
-			break;
-
-		default:
-			goto helper_read_device_error_4;
-		}
-
-		*device = device_info;
+		device_info->fstype     = NULL;
+		device_info->label      = NULL;
+		device_info->state      = dtmd_removable_media_state_unknown;
+		*device                 = device_info;
 		return 2;
 
 	default:
@@ -732,7 +831,6 @@ static int helper_read_device(char *name, const char *device_name, int check_rem
 		break;
 	}
 
-helper_read_device_error_4:
 	free((char*) device_info->path_parent);
 
 helper_read_device_error_3:
@@ -803,8 +901,18 @@ static int helper_read_device_partitions(dtmd_device_enumeration_t *enumeration,
 	struct stat stat_entry;
 	dtmd_info_t *device_info;
 	int result;
+	char node_buffer[PATH_MAX + 1];
+	const char *node;
+
+	node = helper_get_device_node(device->path, node_buffer, sizeof(node_buffer));
+	if (node == NULL)
+	{
+		WRITE_LOG(LOG_WARNING, "Error: got too long file name");
+		result = result_fail;
+		goto helper_read_device_partitions_error_1;
+	}
 
-	pr = blkid_new_probe_from_filename(device->path);
+	pr = blkid_new_probe_from_filename(node);
 	if (pr == NULL)
 	{
 		result = result_fail;
@@ -840,7 +948,8 @@ static int helper_read_device_partitions(dtmd_device_enumeration_t *enumeration,
 			goto helper_read_device_partitions_error_3;
 		}
 
-		if (stat(string, &stat_entry) != 0)
+		node = helper_get_device_node(string, node_buffer, sizeof(node_buffer));
+		if ((node == NULL) || (stat(node, &stat_entry) != 0))
 		{
 			result = result_fail;
 			goto helper_read_device_partitions_error_3;
@@ -869,12 +978,8 @@ static int helper_read_device_partitions(dtmd_device_enumeration_t *enumeration,
 		device_info->media_type    = dtmd_removable_media_type_device_partition;
 		device_info->media_subtype = device->media_subtype;
 		device_info->state         = dtmd_removable_media_state_unknown;
-
-		result = helper_blkid_read_data_from_partition(device_info->path, &(device_info->fstype), &(device_info->label));
-		if (is_result_fatal_error(result))
-		{
-			goto helper_read_device_partitions_error_5;
-		}
+		device_info->fstype        = NULL;
+		device_info->label         = NULL;
 
 		result = enumeration_add_device(enumeration, device_info);
 		if (is_result_fatal_error(result))
@@ -887,19 +992,6 @@ static int helper_read_device_partitions(dtmd_device_enumeration_t *enumeration,
 
 	return result_success;
 
-helper_read_device_partitions_error_5:
-	if (device_info->fstype != NULL)
-	{
-		free((char*) device_info->fstype);
-	}
-
-	if (device_info->label != NULL)
-	{
-		free((char*) device_info->label);
-	}
-
-	free((char*) device_info->path_parent);
-
 helper_read_device_partitions_error_4:
 	free(device_info);
 
@@ -913,6 +1005,164 @@ helper_read_device_partitions_error_1:
 	return result;
 }
 
+typedef struct dtmd_enumeration_probe
+{
+	pthread_mutex_t mutex;
+	probe_cache_t *cache;
+	const sysfs_root_t *sysfs_root;
+	dtmd_enumeration_item_t *next;
+	int result;
+} dtmd_enumeration_probe_t;
+
+static void* helper_enumeration_probe_function(void *arg)
+{
+	dtmd_enumeration_probe_t *probe;
+	dtmd_enumeration_item_t *item;
+	sysfs_accessor_t sysfs;
+	int result;
+
+	probe = (dtmd_enumeration_probe_t*) arg;
+
+	sysfs_accessor_init(&sysfs, probe->sysfs_root);
+
+	for (;;)
+	{
+		pthread_mutex_lock(&(probe->mutex));
+
+		while ((probe->next != NULL)
+			&& (probe->next->item->media_type != dtmd_removable_media_type_device_partition)
+			&& (probe->next->item->media_type != dtmd_removable_media_type_stateful_device))
+		{
+			probe->next = probe->next->next;
+		}
+
+		item = probe->next;
+		if ((item == NULL) || is_result_fatal_error(probe->result))
+		{
+			pthread_mutex_unlock(&(probe->mutex));
+			break;
+		}
+
+		probe->next = item->next;
+
+		pthread_mutex_unlock(&(probe->mutex));
+
+		result = helper_probe_device(probe->cache, &sysfs, item->item);
+		if (is_result_fatal_error(result))
+		{
+			pthread_mutex_lock(&(probe->mutex));
+			probe->result = result;
+			pthread_mutex_unlock(&(probe->mutex));
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Reads filesystems of all enumerated partitions and stateful devices in parallel.
+ * Results are stored into devices in place, so order of enumeration is kept.
+ */
+static int helper_probe_enumerated_devices(dtmd_device_enumeration_t *enumeration)
+{
+	dtmd_enumeration_probe_t probe;
+	pthread_t threads[probe_workers_count - 1];
+	size_t threads_started;
+
+	probe.cache      = &(enumeration->system->probe_cache);
+	probe.sysfs_root = &(enumeration->system->sysfs);
+	probe.next       = enumeration->first;
+	probe.result     = result_success;
+
+	if (pthread_mutex_init(&(probe.mutex), NULL) != 0)
+	{
+		WRITE_LOG(LOG_ERR, "Pthread initialization failure");
+		return result_fatal_error;
+	}
+
+	for (threads_started = 0; threads_started < probe_workers_count - 1; ++threads_started)
+	{
+		if (pthread_create(&(threads[threads_started]), NULL, &helper_enumeration_probe_function, &probe) != 0)
+		{
+			// remaining work is done by available threads
+			break;
+		}
+	}
+
+	helper_enumeration_probe_function(&probe);
+
+	while (threads_started > 0)
+	{
+		--threads_started;
+		pthread_join(threads[threads_started], NULL);
+	}
+
+	pthread_mutex_destroy(&(probe.mutex));
+
+	return probe.result;
+}
+
+/*
+ * Opens subdirectory of directory stream, not directories are silently skipped.
+ */
+static DIR* helper_open_subdirectory(DIR *parent, const char *name)
+{
+	DIR *dir_pointer;
+
+	dir_pointer = sysfs_open_directory(dirfd(parent), name);
+	if ((dir_pointer == NULL) && (errno != ENOTDIR) && (errno != ENOENT))
+	{
+		WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s'", name);
+	}
+
+	return dir_pointer;
+}
+
+/*
+ * Reads device from subdirectory name of directory stream parent and adds it and its partitions to enumeration.
+ */
+static int helper_enumerate_device(dtmd_device_enumeration_t *enumeration, sysfs_accessor_t *sysfs, DIR *parent, const char *name, int check_removable)
+{
+	dtmd_info_t *device;
+	int device_fd;
+	int result;
+
+	device_fd = openat(dirfd(parent), name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (device_fd < 0)
+	{
+		return result_fail;
+	}
+
+	result = helper_read_device(sysfs, device_fd, name, check_removable, &device);
+	close(device_fd);
+
+	switch (result)
+	{
+	case 1: // device
+		result = enumeration_add_device(enumeration, device);
+		if (is_result_successful(result))
+		{
+			result = helper_read_device_partitions(enumeration, device, name);
+		}
+		break;
+
+	case 2: // stateful_device
+		result = enumeration_add_device(enumeration, device);
+		break;
+
+	default:
+		break;
+	}
+
+	if (is_result_fatal_error(result))
+	{
+		return result;
+	}
+
+	return result_success;
+}
+
 static int device_system_run_device_enumeration(dtmd_device_enumeration_t *enumeration)
 {
 	DIR *dir_pointer = NULL;
@@ -936,35 +1186,17 @@ static int device_system_run_device_enumeration(dtmd_device_enumeration_t *enume
 	struct dirent *dirent_mmc = NULL;
 	struct dirent *dirent_mmc_device = NULL;
 
-	dtmd_info_t *device;
+	sysfs_accessor_t sysfs;
 
 	int result;
 
 	char file_name[PATH_MAX + 1];
-	size_t len_core;
-	size_t len_base;
-	size_t len_ext;
-	struct stat statbuf;
-
-	len_ext       = strlen(filename_dev);
-
-	len_base      = strlen(filename_removable);
-	if (len_base > len_ext)
-	{
-		len_ext = len_base;
-	}
 
-	len_base      = strlen(filename_device_type);
-	if (len_base > len_ext)
-	{
-		len_ext = len_base;
-	}
+	sysfs_accessor_init(&sysfs, &(enumeration->system->sysfs));
 
-	dir_pointer = opendir(block_devices_dir);
+	dir_pointer = sysfs_open_directory(sysfs.root->class_block_fd, ".");
 	if (dir_pointer != NULL)
 	{
-		len_base = strlen(block_devices_dir);
-
 		while ((dirent_device = readdir(dir_pointer)) != NULL)
 		{
 			if ((strcmp(dirent_device->d_name, ".") == 0)
@@ -973,353 +1205,115 @@ static int device_system_run_device_enumeration(dtmd_device_enumeration_t *enume
 				continue;
 			}
 
-			len_core = strlen(dirent_device->d_name) + 2;
-
-			if (len_core + len_base + len_ext > PATH_MAX)
+			result = helper_enumerate_device(enumeration, &sysfs, dir_pointer, dirent_device->d_name, 1);
+			if (is_result_fatal_error(result))
 			{
-				//WRITE_LOG(LOG_WARNING, "Error: got too long file name");
-				continue;
+				goto device_system_run_device_enumeration_error_plain_1;
 			}
+		}
 
-			strcpy(file_name, block_devices_dir "/");
-			strcat(file_name, dirent_device->d_name);
+		closedir(dir_pointer);
+		dir_pointer = NULL;
+	}
+	else
+	{
+		WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s/class/block'", sysfs.root->path);
+	}
 
-			if ((stat(file_name, &statbuf) != 0) || (!S_ISDIR(statbuf.st_mode)))
+	dir_pointer_usb = sysfs_open_directory(sysfs.root->sys_fd, block_usb_devices_dir);
+	if (dir_pointer_usb != NULL)
+	{
+		while ((dirent_usb = readdir(dir_pointer_usb)) != NULL)
+		{
+			if ((strcmp(dirent_usb->d_name, ".") == 0)
+				|| (strcmp(dirent_usb->d_name, "..") == 0))
 			{
 				continue;
 			}
 
-			strcat(file_name, "/");
+			dir_pointer_usb_device = helper_open_subdirectory(dir_pointer_usb, dirent_usb->d_name);
+			if (dir_pointer_usb_device == NULL)
+			{
+				continue;
+			}
 
-			result = helper_read_device(file_name, dirent_device->d_name, 1, &device);
-			switch (result)
+			while ((dirent_usb_device = readdir(dir_pointer_usb_device)) != NULL)
 			{
-			case 1: // device
-				result = enumeration_add_device(enumeration, device);
-				switch (result)
+				if (strncmp(dirent_usb_device->d_name, "host", strlen("host")) != 0)
 				{
-				case result_success: // ok
-					result = helper_read_device_partitions(enumeration, device, dirent_device->d_name);
-					switch (result)
-					{
-					case result_success: // ok
-						break;
+					continue;
+				}
 
-					case result_fail: // ok
-						break;
-
-					default: // error
-						goto device_system_run_device_enumeration_error_plain_1;
-						//break;
-					}
-					break;
-
-				case result_fail: // ok
-					break;
-
-				default: // error
-					goto device_system_run_device_enumeration_error_plain_1;
-					//break;
-				}
-				break;
-
-			case 2: // stateful_device
-				result = enumeration_add_device(enumeration, device);
-				switch (result)
+				dir_pointer_usb_host = helper_open_subdirectory(dir_pointer_usb_device, dirent_usb_device->d_name);
+				if (dir_pointer_usb_host == NULL)
 				{
-				case result_success: // ok
-					break;
-
-				case result_fail: //ok
-					break;
-
-				default: // error
-					goto device_system_run_device_enumeration_error_plain_1;
-					//break;
+					continue;
 				}
-				break;
-
-			case result_fail:
-				break;
-
-			default:
-				goto device_system_run_device_enumeration_error_plain_1;
-				//break;
-			}
-		}
-
-		closedir(dir_pointer);
-		dir_pointer = NULL;
-	}
-	else
-	{
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s'", block_devices_dir);
-	}
-
-	dir_pointer_usb = opendir(block_usb_devices_dir);
-	if (dir_pointer_usb != NULL)
-	{
-		len_base = strlen(block_usb_devices_dir);
-
-		while ((dirent_usb = readdir(dir_pointer_usb)) != NULL)
-		{
-			if ((strcmp(dirent_usb->d_name, ".") == 0)
-				|| (strcmp(dirent_usb->d_name, "..") == 0))
-			{
-				continue;
-			}
-
-			len_core = strlen(dirent_usb->d_name) + 2;
-
-			if (len_core + len_base + len_ext > PATH_MAX)
-			{
-				//WRITE_LOG(LOG_WARNING, "Error: got too long file name");
-				continue;
-			}
-
-			strcpy(file_name, block_usb_devices_dir "/");
-			strcat(file_name, dirent_usb->d_name);
-
-			if ((stat(file_name, &statbuf) != 0) || (!S_ISDIR(statbuf.st_mode)))
-			{
-				continue;
-			}
 
-			dir_pointer_usb_device = opendir(file_name);
-			if (dir_pointer_usb_device != NULL)
-			{
-				while ((dirent_usb_device = readdir(dir_pointer_usb_device)) != NULL)
+				while ((dirent_usb_host = readdir(dir_pointer_usb_host)) != NULL)
 				{
-					if ((strcmp(dirent_usb_device->d_name, ".") == 0)
-						|| (strcmp(dirent_usb_device->d_name, "..") == 0))
-					{
-						continue;
-					}
-
-					if (strncmp(dirent_usb_device->d_name, "host", strlen("host")) != 0)
-					{
-						continue;
-					}
-
-					len_core = strlen(dirent_usb_device->d_name) + strlen(dirent_usb->d_name) + 3;
-
-					if (len_core + len_base + len_ext > PATH_MAX)
+					if (strncmp(dirent_usb_host->d_name, "target", strlen("target")) != 0)
 					{
-						//WRITE_LOG(LOG_WARNING, "Error: got too long file name");
 						continue;
 					}
 
-					strcpy(file_name, block_usb_devices_dir "/");
-					strcat(file_name, dirent_usb->d_name);
-					strcat(file_name, "/");
-					strcat(file_name, dirent_usb_device->d_name);
-
-					if ((stat(file_name, &statbuf) != 0) || (!S_ISDIR(statbuf.st_mode)))
+					dir_pointer_usb_target = helper_open_subdirectory(dir_pointer_usb_host, dirent_usb_host->d_name);
+					if (dir_pointer_usb_target == NULL)
 					{
 						continue;
 					}
 
-					dir_pointer_usb_host = opendir(file_name);
-					if (dir_pointer_usb_host != NULL)
+					while ((dirent_usb_target = readdir(dir_pointer_usb_target)) != NULL)
 					{
-						while ((dirent_usb_host = readdir(dir_pointer_usb_host)) != NULL)
+						if ((strcmp(dirent_usb_target->d_name, ".") == 0)
+							|| (strcmp(dirent_usb_target->d_name, "..") == 0))
 						{
-							if ((strcmp(dirent_usb_host->d_name, ".") == 0)
-								|| (strcmp(dirent_usb_host->d_name, "..") == 0))
-							{
-								continue;
-							}
-
-							if (strncmp(dirent_usb_host->d_name, "target", strlen("target")) != 0)
-							{
-								continue;
-							}
+							continue;
+						}
 
-							len_core = strlen(dirent_usb_host->d_name) + strlen(dirent_usb_device->d_name) + strlen(dirent_usb->d_name) + 4;
+						if (strlen(dirent_usb_target->d_name) + strlen("/" block_dir_name) > PATH_MAX)
+						{
+							continue;
+						}
 
-							if (len_core + len_base + len_ext > PATH_MAX)
-							{
-								//WRITE_LOG(LOG_WARNING, "Error: got too long file name");
-								continue;
-							}
+						strcpy(file_name, dirent_usb_target->d_name);
+						strcat(file_name, "/" block_dir_name);
 
-							strcpy(file_name, block_usb_devices_dir "/");
-							strcat(file_name, dirent_usb->d_name);
-							strcat(file_name, "/");
-							strcat(file_name, dirent_usb_device->d_name);
-							strcat(file_name, "/");
-							strcat(file_name, dirent_usb_host->d_name);
+						dir_pointer_usb_target_device = helper_open_subdirectory(dir_pointer_usb_target, file_name);
+						if (dir_pointer_usb_target_device == NULL)
+						{
+							continue;
+						}
 
-							if ((stat(file_name, &statbuf) != 0) || (!S_ISDIR(statbuf.st_mode)))
+						while ((dirent_usb_target_device = readdir(dir_pointer_usb_target_device)) != NULL)
+						{
+							if ((strcmp(dirent_usb_target_device->d_name, ".") == 0)
+								|| (strcmp(dirent_usb_target_device->d_name, "..") == 0))
 							{
 								continue;
 							}
 
-							dir_pointer_usb_target = opendir(file_name);
-							if (dir_pointer_usb_target != NULL)
-							{
-								while ((dirent_usb_target = readdir(dir_pointer_usb_target)) != NULL)
-								{
-									if ((strcmp(dirent_usb_target->d_name, ".") == 0)
-										|| (strcmp(dirent_usb_target->d_name, "..") == 0))
-									{
-										continue;
-									}
-
-									len_core = strlen(block_dir_name) + strlen(dirent_usb_target->d_name) + strlen(dirent_usb_host->d_name)
-										+ strlen(dirent_usb_device->d_name) + strlen(dirent_usb->d_name) + 6;
-
-									if (len_core + len_base + len_ext > PATH_MAX)
-									{
-										//WRITE_LOG(LOG_WARNING, "Error: got too long file name");
-										continue;
-									}
-
-									strcpy(file_name, block_usb_devices_dir "/");
-									strcat(file_name, dirent_usb->d_name);
-									strcat(file_name, "/");
-									strcat(file_name, dirent_usb_device->d_name);
-									strcat(file_name, "/");
-									strcat(file_name, dirent_usb_host->d_name);
-									strcat(file_name, "/");
-									strcat(file_name, dirent_usb_target->d_name);
-									strcat(file_name, "/" block_dir_name);
-
-									if ((stat(file_name, &statbuf) != 0) || (!S_ISDIR(statbuf.st_mode)))
-									{
-										continue;
-									}
-
-									dir_pointer_usb_target_device = opendir(file_name);
-									if (dir_pointer_usb_target_device != NULL)
-									{
-										while ((dirent_usb_target_device = readdir(dir_pointer_usb_target_device)) != NULL)
-										{
-											if ((strcmp(dirent_usb_target_device->d_name, ".") == 0)
-												|| (strcmp(dirent_usb_target_device->d_name, "..") == 0))
-											{
-												continue;
-											}
-
-											len_core = strlen(dirent_usb_target_device->d_name) + strlen(block_dir_name)
-												+ strlen(dirent_usb_target->d_name) + strlen(dirent_usb_host->d_name)
-												+ strlen(dirent_usb_device->d_name) + strlen(dirent_usb->d_name) + 8;
-
-											if (len_core + len_base + len_ext > PATH_MAX)
-											{
-												//WRITE_LOG(LOG_WARNING, "Error: got too long file name");
-												continue;
-											}
-
-											strcpy(file_name, block_usb_devices_dir "/");
-											strcat(file_name, dirent_usb->d_name);
-											strcat(file_name, "/");
-											strcat(file_name, dirent_usb_device->d_name);
-											strcat(file_name, "/");
-											strcat(file_name, dirent_usb_host->d_name);
-											strcat(file_name, "/");
-											strcat(file_name, dirent_usb_target->d_name);
-											strcat(file_name, "/" block_dir_name "/");
-											strcat(file_name, dirent_usb_target_device->d_name);
-
-											if ((stat(file_name, &statbuf) != 0) || (!S_ISDIR(statbuf.st_mode)))
-											{
-												continue;
-											}
-
-											strcat(file_name, "/");
-
-											result = helper_read_device(file_name, dirent_usb_target_device->d_name, 0, &device);
-											switch (result)
-											{
-											case 1: // device
-												result = enumeration_add_device(enumeration, device);
-												switch (result)
-												{
-												case result_success: // ok
-													result = helper_read_device_partitions(enumeration, device, dirent_usb_target_device->d_name);
-													switch (result)
-													{
-													case result_success: // ok
-														break;
-
-													case result_fail: // ok
-														break;
-
-													default: // error
-														goto device_system_run_device_enumeration_error_usb_2;
-														//break;
-													}
-													break;
-
-												case result_fail: // ok
-													break;
-
-												default: // error
-													goto device_system_run_device_enumeration_error_usb_2;
-													//break;
-												}
-												break;
-
-											case 2: // stateful_device
-												result = enumeration_add_device(enumeration, device);
-												switch (result)
-												{
-												case result_success: // ok
-													break;
-
-												case result_fail: //ok
-													break;
-
-												default: // error
-													goto device_system_run_device_enumeration_error_usb_2;
-													//break;
-												}
-												break;
-
-											case result_fail:
-												break;
-
-											default:
-												goto device_system_run_device_enumeration_error_plain_1;
-												//break;
-											}
-										}
-
-										closedir(dir_pointer_usb_target_device);
-										dir_pointer_usb_target_device = NULL;
-									}
-									else
-									{
-										WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s'", file_name);
-									}
-								}
-
-								closedir(dir_pointer_usb_target);
-								dir_pointer_usb_target = NULL;
-							}
-							else
+							result = helper_enumerate_device(enumeration, &sysfs, dir_pointer_usb_target_device, dirent_usb_target_device->d_name, 0);
+							if (is_result_fatal_error(result))
 							{
-								WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s'", file_name);
+								goto device_system_run_device_enumeration_error_usb_2;
 							}
 						}
 
-						closedir(dir_pointer_usb_host);
-						dir_pointer_usb_host = NULL;
-					}
-					else
-					{
-						WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s'", file_name);
+						closedir(dir_pointer_usb_target_device);
+						dir_pointer_usb_target_device = NULL;
 					}
+
+					closedir(dir_pointer_usb_target);
+					dir_pointer_usb_target = NULL;
 				}
 
-				closedir(dir_pointer_usb_device);
-				dir_pointer_usb_device = NULL;
-			}
-			else
-			{
-				WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s'", file_name);
+				closedir(dir_pointer_usb_host);
+				dir_pointer_usb_host = NULL;
 			}
+
+			closedir(dir_pointer_usb_device);
+			dir_pointer_usb_device = NULL;
 		}
 
 		closedir(dir_pointer_usb);
@@ -1327,14 +1321,12 @@ static int device_system_run_device_enumeration(dtmd_device_enumeration_t *enume
 	}
 	else
 	{
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s'", block_usb_devices_dir);
+		WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s/%s'", sysfs.root->path, block_usb_devices_dir);
 	}
 
-	dir_pointer_mmc = opendir(block_mmc_devices_dir);
+	dir_pointer_mmc = sysfs_open_directory(sysfs.root->sys_fd, block_mmc_devices_dir);
 	if (dir_pointer_mmc != NULL)
 	{
-		len_base = strlen(block_mmc_devices_dir);
-
 		while ((dirent_mmc = readdir(dir_pointer_mmc)) != NULL)
 		{
 			if ((strcmp(dirent_mmc->d_name, ".") == 0)
@@ -1343,120 +1335,37 @@ static int device_system_run_device_enumeration(dtmd_device_enumeration_t *enume
 				continue;
 			}
 
-			len_core = strlen(block_dir_name) + strlen(dirent_mmc->d_name) + 3;
-
-			if (len_core + len_base + len_ext > PATH_MAX)
+			if (strlen(dirent_mmc->d_name) + strlen("/" block_dir_name) > PATH_MAX)
 			{
-				//WRITE_LOG(LOG_WARNING, "Error: got too long file name");
 				continue;
 			}
 
-			strcpy(file_name, block_mmc_devices_dir "/");
-			strcat(file_name, dirent_mmc->d_name);
+			strcpy(file_name, dirent_mmc->d_name);
 			strcat(file_name, "/" block_dir_name);
 
-			if ((stat(file_name, &statbuf) != 0) || (!S_ISDIR(statbuf.st_mode)))
+			dir_pointer_mmc_device = helper_open_subdirectory(dir_pointer_mmc, file_name);
+			if (dir_pointer_mmc_device == NULL)
 			{
 				continue;
 			}
 
-			dir_pointer_mmc_device = opendir(file_name);
-			if (dir_pointer_mmc_device != NULL)
+			while ((dirent_mmc_device = readdir(dir_pointer_mmc_device)) != NULL)
 			{
-				while ((dirent_mmc_device = readdir(dir_pointer_mmc_device)) != NULL)
+				if ((strcmp(dirent_mmc_device->d_name, ".") == 0)
+					|| (strcmp(dirent_mmc_device->d_name, "..") == 0))
 				{
-					if ((strcmp(dirent_mmc_device->d_name, ".") == 0)
-						|| (strcmp(dirent_mmc_device->d_name, "..") == 0))
-					{
-						continue;
-					}
-
-					len_core = strlen(dirent_mmc_device->d_name)
-						+ strlen(block_dir_name) + strlen(dirent_mmc->d_name) + 5;
-
-					if (len_core + len_base + len_ext > PATH_MAX)
-					{
-						//WRITE_LOG(LOG_WARNING, "Error: got too long file name");
-						continue;
-					}
-
-					strcpy(file_name, block_mmc_devices_dir);
-					strcat(file_name, "/");
-					strcat(file_name, dirent_mmc->d_name);
-					strcat(file_name, "/" block_dir_name "/");
-					strcat(file_name, dirent_mmc_device->d_name);
-
-					if ((stat(file_name, &statbuf) != 0) || (!S_ISDIR(statbuf.st_mode)))
-					{
-						continue;
-					}
-
-					strcat(file_name, "/");
-
-					result = helper_read_device(file_name, dirent_mmc_device->d_name, 0, &device);
-					switch (result)
-					{
-					case 1: // device
-						result = enumeration_add_device(enumeration, device);
-						switch (result)
-						{
-						case result_success: // ok
-							result = helper_read_device_partitions(enumeration, device, dirent_mmc_device->d_name);
-							switch (result)
-							{
-							case result_success: // ok
-								break;
-
-							case result_fail: // ok
-								break;
-
-							default: // error
-								goto device_system_run_device_enumeration_error_mmc_2;
-								//break;
-							}
-							break;
-
-						case result_fail: // ok
-							break;
-
-						default: // error
-							goto device_system_run_device_enumeration_error_mmc_2;
-							//break;
-						}
-						break;
-
-					case 2: // stateful_device
-						result = enumeration_add_device(enumeration, device);
-						switch (result)
-						{
-						case result_success: // ok
-							break;
-
-						case result_fail: //ok
-							break;
-
-						default: // error
-							goto device_system_run_device_enumeration_error_mmc_2;
-							//break;
-						}
-						break;
-
-					case result_fail:
-						break;
-
-					default:
-						goto device_system_run_device_enumeration_error_mmc_2;
-						//break;
-					}
+					continue;
 				}
 
-				closedir(dir_pointer_mmc_device);
-				dir_pointer_mmc_device = NULL;
-			}
-			else
-			{
-				WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s'", file_name);
+				result = helper_enumerate_device(enumeration, &sysfs, dir_pointer_mmc_device, dirent_mmc_device->d_name, 0);
+				if (is_result_fatal_error(result))
+				{
+					goto device_system_run_device_enumeration_error_mmc_2;
+				}
 			}
+
+			closedir(dir_pointer_mmc_device);
+			dir_pointer_mmc_device = NULL;
 		}
 
 		closedir(dir_pointer_mmc);
@@ -1464,7 +1373,7 @@ static int device_system_run_device_enumeration(dtmd_device_enumeration_t *enume
 	}
 	else
 	{
-		WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s'", block_mmc_devices_dir);
+		WRITE_LOG_ARGS(LOG_WARNING, "Failed to open directory '%s/%s'", sysfs.root->path, block_mmc_devices_dir);
 	}
 
 	return result_success;
@@ -2025,36 +1934,102 @@ device_system_run_device_enumeration_error_1:
 }
 #endif /* (defined OS_FreeBSD) */
 
-static dtmd_info_t* device_system_copy_device(dtmd_info_t *device)
+static void helper_free_enumeration(dtmd_device_enumeration_t *enumeration)
 {
-	pthread_mutex_lock(&(((dtmd_info_private_t*)device->private_data)->system->control_mutex));
+	dtmd_enumeration_item_t *cur;
+	dtmd_enumeration_item_t *next;
+
+	pthread_mutex_lock(&(enumeration->system->control_mutex));
+
+	if (enumeration->next)
+	{
+		enumeration->next->prev = enumeration->prev;
+	}
 
-	++(((dtmd_info_private_t*)device->private_data)->counter);
+	if (enumeration->prev)
+	{
+		enumeration->prev->next = enumeration->next;
+	}
 
-	pthread_mutex_unlock(&(((dtmd_info_private_t*)device->private_data)->system->control_mutex));
+	if (enumeration->system->first_enumeration == enumeration)
+	{
+		enumeration->system->first_enumeration = enumeration->next;
+	}
 
-	return device;
+	if (enumeration->system->last_enumeration == enumeration)
+	{
+		enumeration->system->last_enumeration = enumeration->prev;
+	}
+
+	pthread_mutex_unlock(&(enumeration->system->control_mutex));
+
+	next = enumeration->first;
+
+	while (next)
+	{
+		cur = next;
+		next = cur->next;
+
+		device_system_free_device(cur->item);
+		free(cur);
+	}
+
+	free(enumeration);
 }
 
-static void device_system_free_monitor_item(dtmd_monitor_item_t *item)
+static dtmd_device_enumeration_t* helper_create_enumeration(dtmd_device_system_t *system)
 {
-	if (item->item != NULL)
+	dtmd_device_enumeration_t *enumeration;
+
+	enumeration = (dtmd_device_enumeration_t*) malloc(sizeof(dtmd_device_enumeration_t));
+	if (enumeration == NULL)
 	{
-		device_system_free_device(item->item);
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		goto helper_create_enumeration_error_1;
 	}
 
-	free(item);
+	enumeration->system  = system;
+	enumeration->first   = NULL;
+	enumeration->last    = NULL;
+	enumeration->current = NULL;
+	enumeration->next    = NULL;
+	enumeration->prev    = NULL;
+
+	if (is_result_failure(device_system_run_device_enumeration(enumeration)))
+	{
+		goto helper_create_enumeration_error_2;
+	}
+
+#if (defined OS_Linux)
+	if (is_result_failure(helper_probe_enumerated_devices(enumeration)))
+	{
+		goto helper_create_enumeration_error_2;
+	}
+#endif /* (defined OS_Linux) */
+
+	return enumeration;
+
+helper_create_enumeration_error_2:
+	helper_free_enumeration(enumeration);
+
+helper_create_enumeration_error_1:
+	return NULL;
+}
+
+static dtmd_info_t* device_system_copy_device(dtmd_info_t *device)
+{
+	atomic_fetch_add(&(((dtmd_info_private_t*)device->private_data)->counter), 1);
+
+	return device;
 }
 
+
 #if (defined OS_Linux)
-static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dtmd_device_action_type_t *action)
+/* parses message received into buffer with at least one spare byte */
+static int device_system_monitor_parse_device(sysfs_accessor_t *sysfs, struct msghdr *rtnl_reply, ssize_t len, dtmd_info_t **device, dtmd_device_action_type_t *action, int *needs_probe)
 {
-	struct sockaddr_nl kernel;
-	struct iovec io;
-	char cred_msg[CMSG_SPACE(sizeof(struct ucred))];
-	char reply[IFLIST_REPLY_BUFFER];
-	ssize_t len;
-	struct msghdr rtnl_reply;
+	struct sockaddr_nl *kernel;
+	char *reply;
 
 	ssize_t pos;
 	struct ucred *cred;
@@ -2067,40 +2042,31 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 	char *devpath = NULL;
 	dtmd_info_t *device_info;
 	char file_name[PATH_MAX + 1];
-	char *device_type;
+	const char *device_type;
 
 	char *last_delim;
 	int result;
 
-	memset(&kernel, 0, sizeof(kernel));
-	memset(&rtnl_reply, 0, sizeof(rtnl_reply));
+	kernel = (struct sockaddr_nl*) rtnl_reply->msg_name;
+	reply = (char*) rtnl_reply->msg_iov->iov_base;
 
-	kernel.nl_family = AF_NETLINK;
-	io.iov_base = reply;
-	io.iov_len = IFLIST_REPLY_BUFFER - 1;
-	rtnl_reply.msg_iov = &io;
-	rtnl_reply.msg_iovlen = 1;
-	rtnl_reply.msg_name = &kernel;
-	rtnl_reply.msg_namelen = sizeof(kernel);
-	rtnl_reply.msg_control = &cred_msg;
-	rtnl_reply.msg_controllen = sizeof(cred_msg);
-
-	len = recvmsg(fd, &rtnl_reply, 0);
 	if (len > 0)
 	{
-		if ((kernel.nl_family != AF_NETLINK)
-			|| (kernel.nl_pid != 0)
-			|| (kernel.nl_groups != NETLINK_GROUP_KERNEL))
+		if ((kernel->nl_family != AF_NETLINK)
+			|| (kernel->nl_pid != 0)
+			|| (kernel->nl_groups != NETLINK_GROUP_KERNEL))
 		{
 			result = result_fail;
-			goto device_system_monitor_receive_device_exit_1;
+			goto device_system_monitor_parse_device_exit_1;
 		}
 
-		cmsg = CMSG_FIRSTHDR(&rtnl_reply);
+		reply[len] = 0;
+
+		cmsg = CMSG_FIRSTHDR(rtnl_reply);
 		if ((cmsg == NULL)|| (cmsg->cmsg_type != SCM_CREDENTIALS))
 		{
 			result = result_fail;
-			goto device_system_monitor_receive_device_exit_1;
+			goto device_system_monitor_parse_device_exit_1;
 		}
 
 		cred = (struct ucred*) CMSG_DATA(cmsg);
@@ -2110,7 +2076,7 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 			|| (cred->gid != 0))
 		{
 			result = result_fail;
-			goto device_system_monitor_receive_device_exit_1;
+			goto device_system_monitor_parse_device_exit_1;
 		}
 
 		for (pos = 0; pos < len; pos += strlen(&(reply[pos])) + 1)
@@ -2166,7 +2132,7 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 				&& (strcmp(devtype, NETLINK_STRING_DEVTYPE_PARTITION) != 0)))
 		{
 			result = result_fail;
-			goto device_system_monitor_receive_device_exit_1;
+			goto device_system_monitor_parse_device_exit_1;
 		}
 
 		device_info = (dtmd_info_t*) malloc(sizeof(dtmd_info_t));
@@ -2174,7 +2140,7 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 		{
 			WRITE_LOG(LOG_ERR, "Memory allocation failure");
 			result = result_fatal_error;
-			goto device_system_monitor_receive_device_exit_1;
+			goto device_system_monitor_parse_device_exit_1;
 		}
 
 		switch (action_type)
@@ -2182,28 +2148,27 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 		case dtmd_device_action_add:
 		case dtmd_device_action_online:
 		case dtmd_device_action_change:
-			if (strlen(block_sys_dir) + strlen(devpath) + strlen(filename_device_type) + 4 > PATH_MAX)
+			// devpath starts with slash, attributes are read relative to sysfs root
+			if (strlen(devpath) + strlen(filename_device_type) + 4 > PATH_MAX)
 			{
 				WRITE_LOG(LOG_WARNING, "Error: got too long file name");
 				result = result_fail;
-				goto device_system_monitor_receive_device_exit_2;
+				goto device_system_monitor_parse_device_exit_2;
 			}
 
-			strcpy(file_name, block_sys_dir);
-			strcat(file_name, devpath);
+			strcpy(file_name, devpath + 1);
 			strcat(file_name, "/" filename_device_type);
 
-			result = read_string_from_file(&device_type, file_name);
+			result = sysfs_read_string(sysfs, sysfs->root->sys_fd, file_name, &device_type);
 			if (is_result_failure(result))
 			{
-				strcpy(&(file_name[strlen(block_sys_dir) + strlen(devpath)]), "/../" filename_device_type);
-				result = read_string_from_file(&device_type, file_name);
+				strcpy(&(file_name[strlen(devpath) - 1]), "/../" filename_device_type);
+				result = sysfs_read_string(sysfs, sysfs->root->sys_fd, file_name, &device_type);
 			}
 
 			if (is_result_successful(result))
 			{
 				device_info->media_subtype = device_subtype_from_string(device_type);
-				free(device_type);
 
 				if (strcmp(devtype, NETLINK_STRING_DEVTYPE_DISK) == 0)
 				{
@@ -2223,9 +2188,7 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 						break;
 					}
 
-					strcpy(file_name, block_sys_dir);
-					strcat(file_name, devpath);
-					device_info->sysfs_path = helper_get_usb_parent_syspath(file_name);
+					device_info->sysfs_path = sysfs_get_usb_parent_syspath(sysfs, devpath);
 				}
 				else
 				{
@@ -2247,7 +2210,7 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 					WRITE_LOG_ARGS(LOG_WARNING, "Failed to get device type from file '%s'", file_name);
 					*/
 					result = result_fail;
-					goto device_system_monitor_receive_device_exit_2;
+					goto device_system_monitor_parse_device_exit_2;
 				}
 			}
 			break;
@@ -2266,72 +2229,38 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 			device_info->media_subtype = dtmd_removable_media_subtype_unknown_or_persistent;
 			device_info->sysfs_path = NULL;
 			break;
-		}
 
-		device_info->path = (char*) malloc(strlen(devices_dir) + strlen(devname) + 2);
+		default:
+			break;
+		}
+
+		device_info->path = (char*) malloc(strlen(devices_dir) + strlen(devname) + 2);
 		if (device_info->path == NULL)
 		{
 			WRITE_LOG(LOG_ERR, "Memory allocation failure");
 			result = result_fatal_error;
-			goto device_system_monitor_receive_device_exit_2;
+			goto device_system_monitor_parse_device_exit_2;
 		}
 
 		strcpy((char*) device_info->path, devices_dir "/");
 		strcat((char*) device_info->path, devname);
 
+		device_info->fstype = NULL;
+		device_info->label  = NULL;
+		device_info->state  = dtmd_removable_media_state_unknown;
+
+		// reading filesystem may take a while, it's done by probe workers
 		switch (action_type)
 		{
 		case dtmd_device_action_add:
 		case dtmd_device_action_online:
 		case dtmd_device_action_change:
-			switch (device_info->media_type)
-			{
-			case dtmd_removable_media_type_device_partition:
-				device_info->state = dtmd_removable_media_state_unknown;
-
-				result = helper_blkid_read_data_from_partition(device_info->path, &(device_info->fstype), &(device_info->label));
-				if (is_result_fatal_error(result))
-				{
-					goto device_system_monitor_receive_device_exit_3;
-				}
-				break;
-
-			case dtmd_removable_media_type_stateful_device:
-				result = helper_blkid_read_data_from_partition(device_info->path, &(device_info->fstype), &(device_info->label));
-				switch (result)
-				{
-				case result_fail:
-					device_info->state = dtmd_removable_media_state_empty;
-					break;
-
-				case result_success:
-					if (device_info->fstype == NULL)
-					{
-						device_info->state = dtmd_removable_media_state_clear;
-					}
-					else
-					{
-						device_info->state = dtmd_removable_media_state_ok;
-					}
-					break;
-
-				default:
-					goto device_system_monitor_receive_device_exit_3;
-				}
-				break;
-
-			default:
-				device_info->fstype = NULL;
-				device_info->label  = NULL;
-				device_info->state  = dtmd_removable_media_state_unknown;
-				break;
-			}
+			*needs_probe = ((device_info->media_type == dtmd_removable_media_type_device_partition)
+				|| (device_info->media_type == dtmd_removable_media_type_stateful_device));
 			break;
 
 		default:
-			device_info->fstype = NULL;
-			device_info->label  = NULL;
-			device_info->state  = dtmd_removable_media_state_unknown;
+			*needs_probe = 0;
 			break;
 		}
 
@@ -2343,7 +2272,7 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 			{
 				WRITE_LOG(LOG_ERR, "Invalid device path");
 				result = result_fail;
-				goto device_system_monitor_receive_device_exit_3;
+				goto device_system_monitor_parse_device_exit_3;
 			}
 
 			*last_delim = 0;
@@ -2352,7 +2281,7 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 			{
 				WRITE_LOG(LOG_ERR, "Invalid device path");
 				result = result_fail;
-				goto device_system_monitor_receive_device_exit_3;
+				goto device_system_monitor_parse_device_exit_3;
 			}
 
 			device_info->path_parent = (char*) malloc(strlen(devices_dir) + strlen(last_delim) + 1);
@@ -2360,7 +2289,7 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 			{
 				WRITE_LOG(LOG_ERR, "Memory allocation failure");
 				result = result_fatal_error;
-				goto device_system_monitor_receive_device_exit_3;
+				goto device_system_monitor_parse_device_exit_3;
 			}
 
 			strcpy((char*) device_info->path_parent, devices_dir);
@@ -2373,7 +2302,7 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 			{
 				WRITE_LOG(LOG_ERR, "Memory allocation failure");
 				result = result_fatal_error;
-				goto device_system_monitor_receive_device_exit_3;
+				goto device_system_monitor_parse_device_exit_3;
 			}
 			break;
 		}
@@ -2384,24 +2313,18 @@ static int device_system_monitor_receive_device(int fd, dtmd_info_t **device, dt
 		*action = action_type;
 		return result_success;
 	}
-	else if (len < 0)
-	{
-		WRITE_LOG(LOG_ERR, "Failed to receive data from netlink socket");
-		result = result_fatal_error;
-		goto device_system_monitor_receive_device_exit_1;
-	}
 
 	return result_fail;
 
 /*
-device_system_monitor_receive_device_exit_4:
+device_system_monitor_parse_device_exit_4:
 	if (device_info->path_parent != NULL)
 	{
 		free((char*) device_info->path_parent);
 	}
 */
 
-device_system_monitor_receive_device_exit_3:
+device_system_monitor_parse_device_exit_3:
 	if (device_info->fstype != NULL)
 	{
 		free((char*) device_info->fstype);
@@ -2414,10 +2337,10 @@ device_system_monitor_receive_device_exit_3:
 
 	free((char*) device_info->path);
 
-device_system_monitor_receive_device_exit_2:
+device_system_monitor_parse_device_exit_2:
 	free(device_info);
 
-device_system_monitor_receive_device_exit_1:
+device_system_monitor_parse_device_exit_1:
 	return result;
 }
 #endif /* (defined OS_Linux) */
@@ -2836,48 +2759,945 @@ device_system_monitor_receive_device_exit_1:
 }
 #endif /* (defined OS_FreeBSD) */
 
-static int device_system_monitor_add_item(dtmd_device_monitor_t *monitor, dtmd_info_t *device, dtmd_device_action_type_t action)
+static void device_system_monitor_signal(dtmd_device_monitor_t *monitor)
 {
+#if (defined OS_Linux)
+	uint64_t value = 1;
+
+	write(monitor->event_fd, &value, sizeof(value));
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
 	char data = 1;
+
+	write(monitor->data_pipe[1], &data, 1);
+#endif /* (defined OS_FreeBSD) */
+}
+
+static void device_system_monitor_clear_signal(dtmd_device_monitor_t *monitor)
+{
+#if (defined OS_Linux)
+	uint64_t value;
+
+	read(monitor->event_fd, &value, sizeof(value));
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
+	char data[64];
+
+	while (read(monitor->data_pipe[0], data, sizeof(data)) == sizeof(data))
+	{
+	}
+#endif /* (defined OS_FreeBSD) */
+}
+
+/* must be called with control_mutex locked */
+static int device_system_monitor_add_item(dtmd_device_monitor_t *monitor, dtmd_info_t *device, dtmd_device_action_type_t action)
+{
 	dtmd_monitor_item_t *monitor_item;
+	size_t head;
 
-	monitor_item = (dtmd_monitor_item_t*) malloc(sizeof(dtmd_monitor_item_t));
-	if (monitor_item == NULL)
+	if (monitor->overflow_first == NULL)
 	{
-		WRITE_LOG(LOG_ERR, "Memory allocation failure");
-		goto device_system_monitor_add_item_error_1;
+		head = atomic_load_explicit(&(monitor->head), memory_order_relaxed);
+
+		if (head - atomic_load_explicit(&(monitor->tail), memory_order_acquire) < monitor_queue_size)
+		{
+			monitor->slots[head % monitor_queue_size].item   = (device != NULL) ? device_system_copy_device(device) : NULL;
+			monitor->slots[head % monitor_queue_size].action = action;
+
+			atomic_store_explicit(&(monitor->head), head + 1, memory_order_release);
+
+			device_system_monitor_signal(monitor);
+
+			return result_success;
+		}
 	}
 
-	monitor_item->item = device_system_copy_device(device);
-	if (monitor_item->item == NULL)
+	monitor_item = (dtmd_monitor_item_t*) malloc(sizeof(dtmd_monitor_item_t));
+	if (monitor_item == NULL)
 	{
-		goto device_system_monitor_add_item_error_2;
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return result_fatal_error;
 	}
 
+	monitor_item->item   = (device != NULL) ? device_system_copy_device(device) : NULL;
 	monitor_item->action = action;
 	monitor_item->next   = NULL;
 
-	if (monitor->last != NULL)
+	if (monitor->overflow_last != NULL)
 	{
-		monitor->last->next = monitor_item;
-		monitor->last = monitor->last->next;
+		monitor->overflow_last->next = monitor_item;
 	}
 	else
 	{
-		monitor->first = monitor_item;
-		monitor->last = monitor->first;
+		monitor->overflow_first = monitor_item;
 	}
 
-	write(monitor->data_pipe[1], &data, 1);
+	monitor->overflow_last = monitor_item;
+
+	atomic_store(&(monitor->has_overflow), 1);
+
+	device_system_monitor_signal(monitor);
+
+	return result_success;
+}
+
+static void device_system_notify_monitors(dtmd_device_system_t *device_system, int status)
+{
+	dtmd_device_monitor_t *monitor_iter;
+
+	pthread_mutex_lock(&(device_system->control_mutex));
+
+	for (monitor_iter = device_system->first_monitor; monitor_iter != NULL; monitor_iter = monitor_iter->next)
+	{
+		atomic_store(&(monitor_iter->status), status);
+		device_system_monitor_signal(monitor_iter);
+	}
+
+	pthread_mutex_unlock(&(device_system->control_mutex));
+}
+
+#if (defined OS_Linux)
+static void helper_free_probe_item(dtmd_probe_item_t *item)
+{
+	if (item->item != NULL)
+	{
+		device_system_free_device(item->item);
+	}
+
+	if (item->enumeration != NULL)
+	{
+		helper_free_enumeration(item->enumeration);
+	}
+
+	free(item);
+}
+
+/*
+ * Passes to monitors all probed events which don't have to wait for earlier events of same disk.
+ * Must be called with probe_mutex locked.
+ */
+static int device_system_deliver_probed(dtmd_device_system_t *device_system)
+{
+	dtmd_probe_item_t *item;
+	dtmd_probe_item_t *prev;
+	dtmd_probe_item_t *iter;
+	dtmd_device_monitor_t *monitor_iter;
+	dtmd_device_enumeration_t *enumeration;
+	int blocked;
+
+	prev = NULL;
+	item = device_system->pending_first;
+
+	while (item != NULL)
+	{
+		blocked = !(item->is_probed);
+
+		for (iter = device_system->pending_first; (!blocked) && (iter != item); iter = iter->next)
+		{
+			if ((iter->order_key == NULL)
+				|| (item->order_key == NULL)
+				|| (strcmp(iter->order_key, item->order_key) == 0))
+			{
+				blocked = 1;
+			}
+		}
+
+		if (blocked)
+		{
+			prev = item;
+			item = item->next;
+			continue;
+		}
+
+		if (pthread_mutex_lock(&(device_system->control_mutex)) != 0)
+		{
+			return result_fatal_error;
+		}
+
+		if (item->action == dtmd_device_action_resync)
+		{
+			// older unused enumeration is replaced by newer one
+			enumeration = device_system->resync_enumeration;
+			device_system->resync_enumeration = item->enumeration;
+			item->enumeration = enumeration;
+		}
+
+		for (monitor_iter = device_system->first_monitor; monitor_iter != NULL; monitor_iter = monitor_iter->next)
+		{
+			if (device_system_monitor_add_item(monitor_iter, item->item, item->action) < 0)
+			{
+				pthread_mutex_unlock(&(device_system->control_mutex));
+				return result_fatal_error;
+			}
+		}
+
+		pthread_mutex_unlock(&(device_system->control_mutex));
+
+		if (prev != NULL)
+		{
+			prev->next = item->next;
+		}
+		else
+		{
+			device_system->pending_first = item->next;
+		}
+
+		if (device_system->pending_last == item)
+		{
+			device_system->pending_last = prev;
+		}
+
+		iter = item;
+		item = item->next;
+
+		helper_free_probe_item(iter);
+	}
 
 	return result_success;
+}
+
+/* returns copy of device without data which is read by probing */
+static dtmd_info_t* device_system_copy_unprobed_device(dtmd_device_system_t *device_system, dtmd_info_t *device)
+{
+	dtmd_info_t *result;
+
+	result = (dtmd_info_t*) malloc(sizeof(dtmd_info_t));
+	if (result == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return NULL;
+	}
+
+	result->path_parent   = (device->path_parent != NULL) ? strdup(device->path_parent) : NULL;
+	result->path          = strdup(device->path);
+	result->sysfs_path    = (device->sysfs_path != NULL) ? strdup(device->sysfs_path) : NULL;
+	result->media_type    = device->media_type;
+	result->media_subtype = device->media_subtype;
+	result->fstype        = NULL;
+	result->label         = NULL;
+	result->state         = dtmd_removable_media_state_unknown;
+	result->private_data  = malloc(sizeof(dtmd_info_private_t));
+
+	if ((result->private_data == NULL)
+		|| (result->path == NULL)
+		|| ((result->path_parent == NULL) && (device->path_parent != NULL))
+		|| ((result->sysfs_path == NULL) && (device->sysfs_path != NULL)))
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+
+		if (result->private_data != NULL)
+		{
+			free(result->private_data);
+			result->private_data = NULL;
+		}
+
+		device_system_free_device(result);
+		return NULL;
+	}
+
+	((dtmd_info_private_t*) result->private_data)->system = device_system;
+	atomic_init(&(((dtmd_info_private_t*) result->private_data)->counter), 1);
+
+	return result;
+}
+
+/* takes ownership of device */
+static int device_system_submit_event(dtmd_device_system_t *device_system, dtmd_info_t *device, dtmd_device_action_type_t action, int needs_probe)
+{
+	dtmd_probe_item_t *item;
+	dtmd_info_t *announced_device;
+	int result;
+
+	// device is reported right away and once more after it's probed
+	if (needs_probe
+		&& announce_before_probe
+		&& ((action == dtmd_device_action_add) || (action == dtmd_device_action_online)))
+	{
+		announced_device = device_system_copy_unprobed_device(device_system, device);
+		if (announced_device == NULL)
+		{
+			device_system_free_device(device);
+			return result_fatal_error;
+		}
+
+		result = device_system_submit_event(device_system, announced_device, dtmd_device_action_announce, 0);
+		if (is_result_fatal_error(result))
+		{
+			device_system_free_device(device);
+			return result;
+		}
+
+		action = dtmd_device_action_change;
+	}
+
+	item = (dtmd_probe_item_t*) malloc(sizeof(dtmd_probe_item_t));
+	if (item == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		device_system_free_device(device);
+		return result_fatal_error;
+	}
+
+	switch (action)
+	{
+	case dtmd_device_action_remove:
+	case dtmd_device_action_offline:
+		probe_cache_remove(&(device_system->probe_cache), device->path);
+		break;
+
+	default:
+		break;
+	}
+
+	item->item        = device;
+	item->action      = action;
+	item->is_probed   = !needs_probe;
+	item->enumeration = NULL;
+	item->next        = NULL;
+	item->next_queued = NULL;
+
+	if (device->media_type == dtmd_removable_media_type_device_partition)
+	{
+		item->order_key = device->path_parent;
+	}
+	else
+	{
+		item->order_key = device->path;
+	}
+
+	if (pthread_mutex_lock(&(device_system->probe_mutex)) != 0)
+	{
+		free(item);
+		device_system_free_device(device);
+		return result_fatal_error;
+	}
+
+	if (device_system->pending_last != NULL)
+	{
+		device_system->pending_last->next = item;
+	}
+	else
+	{
+		device_system->pending_first = item;
+	}
+
+	device_system->pending_last = item;
+
+	if (needs_probe)
+	{
+		if (device_system->probe_queue_last != NULL)
+		{
+			device_system->probe_queue_last->next_queued = item;
+		}
+		else
+		{
+			device_system->probe_queue_first = item;
+		}
+
+		device_system->probe_queue_last = item;
+
+		pthread_cond_signal(&(device_system->probe_cond));
+		result = result_success;
+	}
+	else
+	{
+		result = device_system_deliver_probed(device_system);
+	}
+
+	pthread_mutex_unlock(&(device_system->probe_mutex));
+
+	return result;
+}
+
+/* takes ownership of device */
+static int device_system_dispatch_device(dtmd_device_system_t *device_system, dtmd_info_t *device, dtmd_device_action_type_t action, int needs_probe)
+{
+	switch (action)
+	{
+	case dtmd_device_action_add:
+	case dtmd_device_action_online:
+	case dtmd_device_action_remove:
+	case dtmd_device_action_offline:
+	case dtmd_device_action_change:
+		break;
+
+	case dtmd_device_action_unknown:
+	default:
+		device_system_free_device(device);
+		return result_fail;
+	}
+
+	device->private_data = malloc(sizeof(dtmd_info_private_t));
+	if (device->private_data == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		device_system_free_device(device);
+		return result_fatal_error;
+	}
+
+	((dtmd_info_private_t*) device->private_data)->system = device_system;
+	atomic_init(&(((dtmd_info_private_t*) device->private_data)->counter), 1);
+
+	return device_system_submit_event(device_system, device, action, needs_probe);
+}
+
+/*
+ * Some events were lost, owner of monitor has to read all devices again.
+ * Devices are read by probe worker, and request is delivered after events received earlier.
+ */
+static int device_system_request_resync(dtmd_device_system_t *device_system)
+{
+	dtmd_probe_item_t *probe_item;
+
+	probe_item = (dtmd_probe_item_t*) malloc(sizeof(dtmd_probe_item_t));
+	if (probe_item == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return result_fatal_error;
+	}
+
+	probe_item->item        = NULL;
+	probe_item->action      = dtmd_device_action_resync;
+	probe_item->order_key   = NULL;
+	probe_item->is_probed   = 0;
+	probe_item->enumeration = NULL;
+	probe_item->next        = NULL;
+	probe_item->next_queued = NULL;
+
+	if (pthread_mutex_lock(&(device_system->probe_mutex)) != 0)
+	{
+		free(probe_item);
+		return result_fatal_error;
+	}
+
+	if (device_system->pending_last != NULL)
+	{
+		device_system->pending_last->next = probe_item;
+	}
+	else
+	{
+		device_system->pending_first = probe_item;
+	}
+
+	device_system->pending_last = probe_item;
+
+	if (device_system->probe_queue_last != NULL)
+	{
+		device_system->probe_queue_last->next_queued = probe_item;
+	}
+	else
+	{
+		device_system->probe_queue_first = probe_item;
+	}
+
+	device_system->probe_queue_last = probe_item;
+
+	pthread_cond_signal(&(device_system->probe_cond));
+	pthread_mutex_unlock(&(device_system->probe_mutex));
+
+	return result_success;
+}
+
+static int device_system_monitor_process_message(dtmd_device_system_t *device_system, struct msghdr *message, ssize_t len)
+{
+	dtmd_info_t *device;
+	dtmd_device_action_type_t action;
+	int needs_probe;
+	int rc;
+
+	rc = device_system_monitor_parse_device(&(device_system->netlink_batch->sysfs), message, len, &device, &action, &needs_probe);
+	if (is_result_successful(rc))
+	{
+		rc = device_system_dispatch_device(device_system, device, action, needs_probe);
+	}
+
+	return rc;
+}
+
+static void device_system_stop_recording(dtmd_device_system_t *device_system)
+{
+	WRITE_LOG_ARGS(LOG_ERR, "Failed to write uevents into file '%s', recording is stopped", uevent_record_file);
+
+	uevent_recorder_close(&(device_system->recorder));
+	device_system->is_recording = 0;
+}
+
+static int device_system_monitor_receive_devices(dtmd_device_system_t *device_system)
+{
+	dtmd_netlink_batch_t *batch;
+	int count;
+	int i;
+	int rc;
+
+	batch = device_system->netlink_batch;
+
+	for (i = 0; i < netlink_batch_size; ++i)
+	{
+		batch->messages[i].msg_hdr.msg_namelen    = sizeof(batch->addresses[i]);
+		batch->messages[i].msg_hdr.msg_controllen = sizeof(batch->cred_msg[i]);
+		batch->messages[i].msg_hdr.msg_flags      = 0;
+	}
+
+	count = recvmmsg(device_system->events_fd, batch->messages, netlink_batch_size, MSG_DONTWAIT, NULL);
+	if (count < 0)
+	{
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+		{
+			return result_fail;
+		}
+
+		if (errno == ENOBUFS)
+		{
+			WRITE_LOG(LOG_WARNING, "Netlink socket receive buffer overrun, rereading all devices");
+			return device_system_request_resync(device_system);
+		}
+
+		WRITE_LOG(LOG_ERR, "Failed to receive data from netlink socket");
+		return result_fatal_error;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		if (batch->messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+		{
+			continue;
+		}
+
+		if (device_system->is_recording
+			&& is_result_failure(uevent_recorder_write(&(device_system->recorder), batch->buffers[i], batch->messages[i].msg_len)))
+		{
+			device_system_stop_recording(device_system);
+		}
+
+		rc = device_system_monitor_process_message(device_system, &(batch->messages[i].msg_hdr), batch->messages[i].msg_len);
+		if (is_result_fatal_error(rc))
+		{
+			return rc;
+		}
+	}
+
+	if (device_system->is_recording
+		&& is_result_failure(uevent_recorder_flush(&(device_system->recorder))))
+	{
+		device_system_stop_recording(device_system);
+	}
+
+	return result_success;
+}
+
+/* returns nanoseconds passed since start of replay */
+static unsigned long long device_system_replay_elapsed(dtmd_device_system_t *device_system)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long long) (now.tv_sec - device_system->replay_start.tv_sec) * 1000000000ULL + now.tv_nsec - device_system->replay_start.tv_nsec;
+}
+
+/* reads next record into first buffer of netlink batch */
+static int device_system_replay_read_record(dtmd_device_system_t *device_system)
+{
+	int rc;
+
+	rc = uevent_player_read(&(device_system->player),
+		&(device_system->replay_timestamp),
+		device_system->netlink_batch->buffers[0],
+		IFLIST_REPLY_BUFFER - 1,
+		&(device_system->replay_length));
+
+	switch (rc)
+	{
+	case result_success:
+		break;
+
+	case result_fail:
+		WRITE_LOG_ARGS(LOG_INFO, "Replayed %llu uevents in %llu ms",
+			device_system->player.records,
+			device_system_replay_elapsed(device_system) / 1000000ULL);
+
+		uevent_player_close(&(device_system->player));
+		device_system->is_replaying = 0;
+		break;
+
+	default:
+		WRITE_LOG_ARGS(LOG_ERR, "Uevents file '%s' is damaged", uevent_replay_file);
+		break;
+	}
+
+	return rc;
+}
+
+/*
+ * Returns timeout for poll in milliseconds until next replayed uevent is due.
+ * Replay starts when first monitor is started and devices are enumerated,
+ * otherwise replayed events would be lost or would race with enumeration.
+ */
+static int device_system_replay_timeout(dtmd_device_system_t *device_system)
+{
+	unsigned long long elapsed;
+	int is_ready;
+
+	if (!device_system->is_replaying)
+	{
+		return -1;
+	}
+
+	if (!device_system->is_replay_started)
+	{
+		if (pthread_mutex_lock(&(device_system->control_mutex)) != 0)
+		{
+			return replay_wait_interval;
+		}
+
+		is_ready = (device_system->first_monitor != NULL) && device_system->is_enumerated;
+
+		pthread_mutex_unlock(&(device_system->control_mutex));
+
+		if (!is_ready)
+		{
+			return replay_wait_interval;
+		}
+
+		WRITE_LOG_ARGS(LOG_INFO, "Replaying uevents from file '%s'", uevent_replay_file);
+
+		clock_gettime(CLOCK_MONOTONIC, &(device_system->replay_start));
+		device_system->is_replay_started = 1;
+	}
+
+	if (uevent_replay_fast)
+	{
+		return 0;
+	}
+
+	elapsed = device_system_replay_elapsed(device_system);
+	if (elapsed >= device_system->replay_timestamp)
+	{
+		return 0;
+	}
+
+	// round up, otherwise event would be checked too early
+	return (device_system->replay_timestamp - elapsed + 999999ULL) / 1000000ULL;
+}
+
+/* passes due records through same path as received uevents, at most one batch at a time */
+static int device_system_replay_devices(dtmd_device_system_t *device_system)
+{
+	struct msghdr *message;
+	struct cmsghdr *cmsg;
+	struct ucred *cred;
+	int i;
+	int rc;
+
+	message = &(device_system->netlink_batch->messages[0].msg_hdr);
+
+	for (i = 0; (i < netlink_batch_size) && device_system->is_replaying && device_system->is_replay_started; ++i)
+	{
+		if ((!uevent_replay_fast)
+			&& (device_system_replay_elapsed(device_system) < device_system->replay_timestamp))
+		{
+			break;
+		}
+
+		// message looks like it's sent by kernel
+		memset(&(device_system->netlink_batch->addresses[0]), 0, sizeof(struct sockaddr_nl));
+		device_system->netlink_batch->addresses[0].nl_family = AF_NETLINK;
+		device_system->netlink_batch->addresses[0].nl_groups = NETLINK_GROUP_KERNEL;
+
+		message->msg_namelen    = sizeof(struct sockaddr_nl);
+		message->msg_controllen = CMSG_SPACE(sizeof(struct ucred));
+		message->msg_flags      = 0;
+
+		cmsg = CMSG_FIRSTHDR(message);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type  = SCM_CREDENTIALS;
+		cmsg->cmsg_len   = CMSG_LEN(sizeof(struct ucred));
+
+		cred = (struct ucred*) CMSG_DATA(cmsg);
+		cred->pid = 0;
+		cred->uid = 0;
+		cred->gid = 0;
+
+		rc = device_system_monitor_process_message(device_system, message, device_system->replay_length);
+		if (is_result_fatal_error(rc))
+		{
+			return rc;
+		}
+
+		rc = device_system_replay_read_record(device_system);
+		if (is_result_fatal_error(rc))
+		{
+			return rc;
+		}
+	}
+
+	return result_success;
+}
+
+/* opens netlink socket or file with recorded uevents which replaces it */
+static int device_system_open_events_source(dtmd_device_system_t *device_system)
+{
+	device_system->is_recording      = 0;
+	device_system->is_replaying      = 0;
+	device_system->is_replay_started = 0;
+	device_system->is_enumerated     = 0;
+
+	if (uevent_replay_file != NULL)
+	{
+		device_system->events_fd = -1;
+
+		if (is_result_failure(uevent_player_open(&(device_system->player), uevent_replay_file)))
+		{
+			WRITE_LOG_ARGS(LOG_ERR, "Failed to open uevents file '%s'", uevent_replay_file);
+			return result_fail;
+		}
+
+		device_system->is_replaying = 1;
+		clock_gettime(CLOCK_MONOTONIC, &(device_system->replay_start));
+
+		// first record is read beforehand to know when it's due
+		if (is_result_fatal_error(device_system_replay_read_record(device_system)))
+		{
+			uevent_player_close(&(device_system->player));
+			return result_fail;
+		}
+
+		return result_success;
+	}
+
+	device_system->events_fd = open_netlink_socket();
+	if (device_system->events_fd < 0)
+	{
+		return result_fail;
+	}
+
+	if (uevent_record_file != NULL)
+	{
+		if (is_result_failure(uevent_recorder_open(&(device_system->recorder), uevent_record_file)))
+		{
+			WRITE_LOG_ARGS(LOG_ERR, "Failed to open file '%s' for recording uevents", uevent_record_file);
+			close(device_system->events_fd);
+			return result_fail;
+		}
+
+		device_system->is_recording = 1;
+	}
+
+	return result_success;
+}
+
+static void device_system_close_events_source(dtmd_device_system_t *device_system)
+{
+	if (device_system->events_fd >= 0)
+	{
+		close(device_system->events_fd);
+	}
+
+	if (device_system->is_recording)
+	{
+		uevent_recorder_close(&(device_system->recorder));
+	}
+
+	if (device_system->is_replaying)
+	{
+		uevent_player_close(&(device_system->player));
+	}
+}
+
+static dtmd_netlink_batch_t* device_system_create_netlink_batch(const sysfs_root_t *sysfs_root)
+{
+	dtmd_netlink_batch_t *batch;
+	int i;
+
+	batch = (dtmd_netlink_batch_t*) malloc(sizeof(dtmd_netlink_batch_t));
+	if (batch == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		return NULL;
+	}
+
+	memset(batch->messages, 0, sizeof(batch->messages));
+
+	for (i = 0; i < netlink_batch_size; ++i)
+	{
+		batch->io[i].iov_base = batch->buffers[i];
+		batch->io[i].iov_len  = IFLIST_REPLY_BUFFER - 1;
+
+		batch->messages[i].msg_hdr.msg_iov     = &(batch->io[i]);
+		batch->messages[i].msg_hdr.msg_iovlen  = 1;
+		batch->messages[i].msg_hdr.msg_name    = &(batch->addresses[i]);
+		batch->messages[i].msg_hdr.msg_control = batch->cred_msg[i];
+	}
+
+	sysfs_accessor_init(&(batch->sysfs), sysfs_root);
+
+	return batch;
+}
+
+static void* device_system_probe_worker_function(void *arg)
+{
+	dtmd_device_system_t *device_system;
+	dtmd_probe_item_t *item;
+	sysfs_accessor_t sysfs;
+	int rc;
+
+	device_system = (dtmd_device_system_t*) arg;
+
+	sysfs_accessor_init(&sysfs, &(device_system->sysfs));
+
+	pthread_mutex_lock(&(device_system->probe_mutex));
+
+	for (;;)
+	{
+		while ((!device_system->probe_stop) && (device_system->probe_queue_first == NULL))
+		{
+			pthread_cond_wait(&(device_system->probe_cond), &(device_system->probe_mutex));
+		}
+
+		if (device_system->probe_stop)
+		{
+			break;
+		}
+
+		item = device_system->probe_queue_first;
+		device_system->probe_queue_first = item->next_queued;
+		if (device_system->probe_queue_first == NULL)
+		{
+			device_system->probe_queue_last = NULL;
+		}
+
+		pthread_mutex_unlock(&(device_system->probe_mutex));
+
+		if (item->item != NULL)
+		{
+			rc = helper_probe_device(&(device_system->probe_cache), &sysfs, item->item);
+		}
+		else
+		{
+			// if devices can't be read now, owner of monitor reads them itself
+			item->enumeration = helper_create_enumeration(device_system);
+			rc = result_success;
+		}
+
+		pthread_mutex_lock(&(device_system->probe_mutex));
+
+		item->is_probed = 1;
+
+		if (is_result_fatal_error(rc) || is_result_fatal_error(device_system_deliver_probed(device_system)))
+		{
+			device_system_notify_monitors(device_system, monitor_status_error);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&(device_system->probe_mutex));
+
+	pthread_exit(0);
+}
+
+static int device_system_start_probe_workers(dtmd_device_system_t *device_system)
+{
+	device_system->probe_threads_started = 0;
+	device_system->probe_stop = 0;
+	device_system->pending_first = NULL;
+	device_system->pending_last = NULL;
+	device_system->probe_queue_first = NULL;
+	device_system->probe_queue_last = NULL;
+	device_system->resync_enumeration = NULL;
+
+	if (is_result_failure(probe_cache_init(&(device_system->probe_cache))))
+	{
+		goto device_system_start_probe_workers_error_1;
+	}
+
+	if (pthread_mutex_init(&(device_system->probe_mutex), NULL) != 0)
+	{
+		goto device_system_start_probe_workers_error_2;
+	}
+
+	if (pthread_cond_init(&(device_system->probe_cond), NULL) != 0)
+	{
+		goto device_system_start_probe_workers_error_3;
+	}
+
+	for ( ; device_system->probe_threads_started < probe_workers_count; ++(device_system->probe_threads_started))
+	{
+		if (pthread_create(&(device_system->probe_threads[device_system->probe_threads_started]), NULL, &device_system_probe_worker_function, device_system) != 0)
+		{
+			goto device_system_start_probe_workers_error_4;
+		}
+	}
+
+	return result_success;
+
+device_system_start_probe_workers_error_4:
+	pthread_mutex_lock(&(device_system->probe_mutex));
+	device_system->probe_stop = 1;
+	pthread_cond_broadcast(&(device_system->probe_cond));
+	pthread_mutex_unlock(&(device_system->probe_mutex));
+
+	while (device_system->probe_threads_started > 0)
+	{
+		--(device_system->probe_threads_started);
+		pthread_join(device_system->probe_threads[device_system->probe_threads_started], NULL);
+	}
+
+	pthread_cond_destroy(&(device_system->probe_cond));
+
+device_system_start_probe_workers_error_3:
+	pthread_mutex_destroy(&(device_system->probe_mutex));
+
+device_system_start_probe_workers_error_2:
+	probe_cache_free(&(device_system->probe_cache));
+
+device_system_start_probe_workers_error_1:
+	WRITE_LOG(LOG_ERR, "Pthread initialization failure");
+	return result_fatal_error;
+}
+
+static void device_system_stop_probe_workers(dtmd_device_system_t *device_system)
+{
+	dtmd_probe_item_t *item;
+
+	pthread_mutex_lock(&(device_system->probe_mutex));
+	device_system->probe_stop = 1;
+	pthread_cond_broadcast(&(device_system->probe_cond));
+	pthread_mutex_unlock(&(device_system->probe_mutex));
+
+	while (device_system->probe_threads_started > 0)
+	{
+		--(device_system->probe_threads_started);
+		pthread_join(device_system->probe_threads[device_system->probe_threads_started], NULL);
+	}
+
+	while (device_system->pending_first != NULL)
+	{
+		item = device_system->pending_first;
+		device_system->pending_first = item->next;
+
+		helper_free_probe_item(item);
+	}
+
+	if (device_system->resync_enumeration != NULL)
+	{
+		helper_free_enumeration(device_system->resync_enumeration);
+		device_system->resync_enumeration = NULL;
+	}
+
+	device_system->pending_last = NULL;
+	device_system->probe_queue_first = NULL;
+	device_system->probe_queue_last = NULL;
+
+	pthread_cond_destroy(&(device_system->probe_cond));
+	pthread_mutex_destroy(&(device_system->probe_mutex));
 
-device_system_monitor_add_item_error_2:
-	free(monitor_item);
+	WRITE_LOG_ARGS(LOG_INFO, "Filesystem probe cache: %lu hits, %lu misses",
+		device_system->probe_cache.hits,
+		device_system->probe_cache.misses);
 
-device_system_monitor_add_item_error_1:
-	return result_fatal_error;
+	probe_cache_free(&(device_system->probe_cache));
 }
+#endif /* (defined OS_Linux) */
 
 static void* device_system_worker_function(void *arg)
 {
@@ -2885,9 +3705,11 @@ static void* device_system_worker_function(void *arg)
 	struct pollfd fds[2];
 	char data;
 	int rc;
+#if (defined OS_FreeBSD)
 	dtmd_info_t *device;
 	dtmd_device_action_type_t action;
 	dtmd_device_monitor_t *monitor_iter;
+#endif /* (defined OS_FreeBSD) */
 
 	device_system = (dtmd_device_system_t*) arg;
 
@@ -2901,7 +3723,11 @@ static void* device_system_worker_function(void *arg)
 		fds[1].events  = POLLIN;
 		fds[1].revents = 0;
 
+#if (defined OS_Linux)
+		rc = poll(fds, 2, device_system_replay_timeout(device_system));
+#else /* (defined OS_Linux) */
 		rc = poll(fds, 2, -1);
+#endif /* (defined OS_Linux) */
 
 		if ((rc == -1)
 			|| (fds[0].revents & POLLERR)
@@ -2930,6 +3756,13 @@ static void* device_system_worker_function(void *arg)
 
 		if (fds[1].revents & POLLIN)
 		{
+#if (defined OS_Linux)
+			if (is_result_fatal_error(device_system_monitor_receive_devices(device_system)))
+			{
+				goto device_system_worker_function_error_1;
+			}
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
 			rc = device_system_monitor_receive_device(fds[1].fd, &device, &action);
 			switch (rc)
 			{
@@ -2948,7 +3781,7 @@ static void* device_system_worker_function(void *arg)
 					}
 
 					((dtmd_info_private_t*) device->private_data)->system  = device_system;
-					((dtmd_info_private_t*) device->private_data)->counter = 1;
+					atomic_init(&(((dtmd_info_private_t*) device->private_data)->counter), 1);
 
 					if (pthread_mutex_lock(&(device_system->control_mutex)) != 0)
 					{
@@ -2982,43 +3815,32 @@ static void* device_system_worker_function(void *arg)
 				goto device_system_worker_function_error_1;
 				/* break; */
 			}
+#endif /* (defined OS_FreeBSD) */
 		}
-	}
-
-device_system_worker_function_exit:
-	pthread_mutex_lock(&(device_system->control_mutex));
-
-	data = 2;
 
-	for (monitor_iter = device_system->first_monitor; monitor_iter != NULL; monitor_iter = monitor_iter->next)
-	{
-		write(monitor_iter->data_pipe[1], &data, 1);
+#if (defined OS_Linux)
+		if (is_result_fatal_error(device_system_replay_devices(device_system)))
+		{
+			goto device_system_worker_function_error_1;
+		}
+#endif /* (defined OS_Linux) */
 	}
 
-	pthread_mutex_unlock(&(device_system->control_mutex));
+device_system_worker_function_exit:
+	device_system_notify_monitors(device_system, monitor_status_exit);
 
 	goto device_system_worker_function_terminate;
 
+#if (defined OS_FreeBSD)
 device_system_worker_function_error_3:
-	device_system_free_device(device);
-
-	goto device_system_worker_function_error_1_locked;
+	pthread_mutex_unlock(&(device_system->control_mutex));
 
 device_system_worker_function_error_2:
 	device_system_free_device(device);
+#endif /* (defined OS_FreeBSD) */
 
 device_system_worker_function_error_1:
-	pthread_mutex_lock(&(device_system->control_mutex));
-
-device_system_worker_function_error_1_locked:
-	data = 0;
-
-	for (monitor_iter = device_system->first_monitor; monitor_iter != NULL; monitor_iter = monitor_iter->next)
-	{
-		write(monitor_iter->data_pipe[1], &data, 1);
-	}
-
-	pthread_mutex_unlock(&(device_system->control_mutex));
+	device_system_notify_monitors(device_system, monitor_status_error);
 
 device_system_worker_function_terminate:
 	pthread_exit(0);
@@ -3043,44 +3865,66 @@ dtmd_device_system_t* device_system_init(void)
 	device_system->last_monitor      = NULL;
 
 #if (defined OS_Linux)
-	device_system->events_fd = open_netlink_socket();
+	if (is_result_failure(sysfs_root_init(&(device_system->sysfs), (sysfs_root_dir != NULL) ? sysfs_root_dir : block_sys_dir)))
+	{
+		WRITE_LOG_ARGS(LOG_ERR, "Failed to open sysfs directory '%s'", (sysfs_root_dir != NULL) ? sysfs_root_dir : block_sys_dir);
+		goto device_system_init_error_2;
+	}
+
+	device_system->netlink_batch = device_system_create_netlink_batch(&(device_system->sysfs));
+	if (device_system->netlink_batch == NULL)
+	{
+		goto device_system_init_error_3;
+	}
+
+	if (is_result_failure(device_system_open_events_source(device_system)))
+	{
+		goto device_system_init_error_4;
+	}
 #endif /* (defined OS_Linux) */
 #if (defined OS_FreeBSD)
 	device_system->events_fd = open_devd_socket();
-#endif /* (defined OS_FreeBSD) */
 	if (device_system->events_fd < 0)
 	{
-		goto device_system_init_error_2;
+		goto device_system_init_error_4;
 	}
+#endif /* (defined OS_FreeBSD) */
 
 	if (pthread_mutexattr_init(&mutex_attr) != 0)
 	{
 		WRITE_LOG(LOG_ERR, "Pthread initialization failure");
-		goto device_system_init_error_3;
+		goto device_system_init_error_5;
 	}
 
 	if (pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE) != 0)
 	{
 		WRITE_LOG(LOG_ERR, "Pthread initialization failure");
-		goto device_system_init_error_4;
+		goto device_system_init_error_6;
 	}
 
 	if (pthread_mutex_init(&(device_system->control_mutex), &mutex_attr) != 0)
 	{
 		WRITE_LOG(LOG_ERR, "Pthread initialization failure");
-		goto device_system_init_error_4;
+		goto device_system_init_error_6;
 	}
 
 	if (pipe(device_system->worker_control_pipe) < 0)
 	{
 		WRITE_LOG(LOG_ERR, "Pipe() failed");
-		goto device_system_init_error_5;
+		goto device_system_init_error_7;
+	}
+
+#if (defined OS_Linux)
+	if (is_result_failure(device_system_start_probe_workers(device_system)))
+	{
+		goto device_system_init_error_8;
 	}
+#endif /* (defined OS_Linux) */
 
 	if ((pthread_create(&(device_system->worker_thread), NULL, &device_system_worker_function, device_system)) != 0)
 	{
 		WRITE_LOG(LOG_ERR, "Pthread initialization failure");
-		goto device_system_init_error_6;
+		goto device_system_init_error_9;
 	}
 
 	pthread_mutexattr_destroy(&mutex_attr);
@@ -3088,23 +3932,41 @@ dtmd_device_system_t* device_system_init(void)
 	return device_system;
 
 /*
-device_system_init_error_7:
+device_system_init_error_10:
 	write(device_system->worker_control_pipe[1], &data, sizeof(char));
 	pthread_join(device_system->worker_thread, NULL);
 */
 
-device_system_init_error_6:
+device_system_init_error_9:
+#if (defined OS_Linux)
+	device_system_stop_probe_workers(device_system);
+#endif /* (defined OS_Linux) */
+
+device_system_init_error_8:
 	close(device_system->worker_control_pipe[0]);
 	close(device_system->worker_control_pipe[1]);
 
-device_system_init_error_5:
+device_system_init_error_7:
 	pthread_mutex_destroy(&(device_system->control_mutex));
 
-device_system_init_error_4:
+device_system_init_error_6:
 	pthread_mutexattr_destroy(&mutex_attr);
 
-device_system_init_error_3:
+device_system_init_error_5:
+#if (defined OS_Linux)
+	device_system_close_events_source(device_system);
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
 	close(device_system->events_fd);
+#endif /* (defined OS_FreeBSD) */
+
+device_system_init_error_4:
+#if (defined OS_Linux)
+	free(device_system->netlink_batch);
+
+device_system_init_error_3:
+	sysfs_root_free(&(device_system->sysfs));
+#endif /* (defined OS_Linux) */
 
 device_system_init_error_2:
 	free(device_system);
@@ -3113,52 +3975,10 @@ device_system_init_error_1:
 	return NULL;
 }
 
-static void helper_free_enumeration(dtmd_device_enumeration_t *enumeration)
-{
-	dtmd_enumeration_item_t *cur;
-	dtmd_enumeration_item_t *next;
-
-	pthread_mutex_lock(&(enumeration->system->control_mutex));
-
-	if (enumeration->next)
-	{
-		enumeration->next->prev = enumeration->prev;
-	}
-
-	if (enumeration->prev)
-	{
-		enumeration->prev->next = enumeration->next;
-	}
-
-	if (enumeration->system->first_enumeration == enumeration)
-	{
-		enumeration->system->first_enumeration = enumeration->next;
-	}
-
-	if (enumeration->system->last_enumeration == enumeration)
-	{
-		enumeration->system->last_enumeration = enumeration->prev;
-	}
-
-	pthread_mutex_unlock(&(enumeration->system->control_mutex));
-
-	next = enumeration->first;
-
-	while (next)
-	{
-		cur = next;
-		next = cur->next;
-
-		device_system_free_device(cur->item);
-		free(cur);
-	}
-
-	free(enumeration);
-}
-
 static void helper_free_monitor(dtmd_device_monitor_t *monitor)
 {
 	dtmd_monitor_item_t *item, *delete_item;
+	size_t tail;
 
 	pthread_mutex_lock(&(monitor->system->control_mutex));
 
@@ -3184,18 +4004,36 @@ static void helper_free_monitor(dtmd_device_monitor_t *monitor)
 
 	pthread_mutex_unlock(&(monitor->system->control_mutex));
 
-	item = monitor->first;
+	for (tail = atomic_load(&(monitor->tail)); tail != atomic_load(&(monitor->head)); ++tail)
+	{
+		if (monitor->slots[tail % monitor_queue_size].item != NULL)
+		{
+			device_system_free_device(monitor->slots[tail % monitor_queue_size].item);
+		}
+	}
+
+	item = monitor->overflow_first;
 
 	while (item != NULL)
 	{
 		delete_item = item;
 		item = item->next;
 
-		device_system_free_monitor_item(delete_item);
+		if (delete_item->item != NULL)
+		{
+			device_system_free_device(delete_item->item);
+		}
+
+		free(delete_item);
 	}
 
+#if (defined OS_Linux)
+	close(monitor->event_fd);
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
 	close(monitor->data_pipe[0]);
 	close(monitor->data_pipe[1]);
+#endif /* (defined OS_FreeBSD) */
 
 	free(monitor);
 }
@@ -3208,7 +4046,16 @@ void device_system_deinit(dtmd_device_system_t *system)
 	{
 		write(system->worker_control_pipe[1], &data, sizeof(char));
 		pthread_join(system->worker_thread, NULL);
+#if (defined OS_Linux)
+		device_system_close_events_source(system);
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
 		close(system->events_fd);
+#endif /* (defined OS_FreeBSD) */
+
+#if (defined OS_Linux)
+		device_system_stop_probe_workers(system);
+#endif /* (defined OS_Linux) */
 
 		if (system->first_enumeration != NULL)
 		{
@@ -3225,35 +4072,45 @@ void device_system_deinit(dtmd_device_system_t *system)
 
 		pthread_mutex_destroy(&(system->control_mutex));
 
+#if (defined OS_Linux)
+		free(system->netlink_batch);
+		sysfs_root_free(&(system->sysfs));
+#endif /* (defined OS_Linux) */
+
 		free(system);
 	}
 }
 
 dtmd_device_enumeration_t* device_system_enumerate_devices(dtmd_device_system_t *system)
 {
-	dtmd_device_enumeration_t *enumeration;
+	dtmd_device_enumeration_t *enumeration = NULL;
 
 	if (system == NULL)
 	{
 		goto device_system_enumerate_devices_error_1;
 	}
 
-	enumeration = (dtmd_device_enumeration_t*) malloc(sizeof(dtmd_device_enumeration_t));
-	if (enumeration == NULL)
+#if (defined OS_Linux)
+	// on resync devices are already read and probed by probe worker
+	if (pthread_mutex_lock(&(system->control_mutex)) != 0)
 	{
-		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		WRITE_LOG(LOG_ERR, "Failed to obtain mutex");
 		goto device_system_enumerate_devices_error_1;
 	}
 
-	enumeration->system  = system;
-	enumeration->first   = NULL;
-	enumeration->last    = NULL;
-	enumeration->current = NULL;
-	enumeration->next    = NULL;
+	enumeration = system->resync_enumeration;
+	system->resync_enumeration = NULL;
 
-	if (is_result_failure(device_system_run_device_enumeration(enumeration)))
+	pthread_mutex_unlock(&(system->control_mutex));
+#endif /* (defined OS_Linux) */
+
+	if (enumeration == NULL)
 	{
-		goto device_system_enumerate_devices_error_2;
+		enumeration = helper_create_enumeration(system);
+		if (enumeration == NULL)
+		{
+			goto device_system_enumerate_devices_error_1;
+		}
 	}
 
 	if (pthread_mutex_lock(&(system->control_mutex)) != 0)
@@ -3296,6 +4153,12 @@ void device_system_finish_enumerate_devices(dtmd_device_enumeration_t *enumerati
 {
 	if (enumeration != NULL)
 	{
+#if (defined OS_Linux)
+		pthread_mutex_lock(&(enumeration->system->control_mutex));
+		enumeration->system->is_enumerated = 1;
+		pthread_mutex_unlock(&(enumeration->system->control_mutex));
+#endif /* (defined OS_Linux) */
+
 		helper_free_enumeration(enumeration);
 	}
 }
@@ -3344,17 +4207,38 @@ dtmd_device_monitor_t* device_system_start_monitoring(dtmd_device_system_t *syst
 		goto device_system_start_monitoring_error_1;
 	}
 
-	monitor->system = system;
-	monitor->first  = NULL;
-	monitor->last   = NULL;
-	monitor->next   = NULL;
+	monitor->system         = system;
+	monitor->overflow_first = NULL;
+	monitor->overflow_last  = NULL;
+	monitor->next           = NULL;
 
+	atomic_init(&(monitor->head), 0);
+	atomic_init(&(monitor->tail), 0);
+	atomic_init(&(monitor->has_overflow), 0);
+	atomic_init(&(monitor->status), monitor_status_ok);
+
+#if (defined OS_Linux)
+	monitor->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (monitor->event_fd < 0)
+	{
+		WRITE_LOG(LOG_ERR, "Eventfd() failed");
+		goto device_system_start_monitoring_error_2;
+	}
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
 	if (pipe(monitor->data_pipe) < 0)
 	{
 		WRITE_LOG(LOG_ERR, "Pipe() failed");
 		goto device_system_start_monitoring_error_2;
 	}
 
+	if (fcntl(monitor->data_pipe[0], F_SETFL, fcntl(monitor->data_pipe[0], F_GETFL) | O_NONBLOCK) < 0)
+	{
+		WRITE_LOG(LOG_ERR, "Fcntl() failed");
+		goto device_system_start_monitoring_error_3;
+	}
+#endif /* (defined OS_FreeBSD) */
+
 	if (pthread_mutex_lock(&(system->control_mutex)) != 0)
 	{
 		WRITE_LOG(LOG_ERR, "Failed to obtain mutex");
@@ -3385,8 +4269,13 @@ device_system_start_monitoring_error_4:
 */
 
 device_system_start_monitoring_error_3:
+#if (defined OS_Linux)
+	close(monitor->event_fd);
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
 	close(monitor->data_pipe[0]);
 	close(monitor->data_pipe[1]);
+#endif /* (defined OS_FreeBSD) */
 
 device_system_start_monitoring_error_2:
 	free(monitor);
@@ -3407,7 +4296,12 @@ int device_system_get_monitor_fd(dtmd_device_monitor_t *monitor)
 {
 	if (monitor != NULL)
 	{
+#if (defined OS_Linux)
+		return monitor->event_fd;
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
 		return monitor->data_pipe[0];
+#endif /* (defined OS_FreeBSD) */
 	}
 	else
 	{
@@ -3415,79 +4309,107 @@ int device_system_get_monitor_fd(dtmd_device_monitor_t *monitor)
 	}
 }
 
+/* returns result_fail if there are no events */
+static int device_system_monitor_take_device(dtmd_device_monitor_t *monitor, dtmd_info_t **device, dtmd_device_action_type_t *action)
+{
+	dtmd_monitor_item_t *delete_item;
+	size_t tail;
+
+	tail = atomic_load_explicit(&(monitor->tail), memory_order_relaxed);
+
+	if (tail != atomic_load_explicit(&(monitor->head), memory_order_acquire))
+	{
+		*device = monitor->slots[tail % monitor_queue_size].item;
+		*action = monitor->slots[tail % monitor_queue_size].action;
+
+		atomic_store_explicit(&(monitor->tail), tail + 1, memory_order_release);
+
+		return result_success;
+	}
+
+	// events are put into overflow list only while ring isn't empty, so order is kept
+	if (atomic_load(&(monitor->has_overflow)))
+	{
+		if (pthread_mutex_lock(&(monitor->system->control_mutex)) != 0)
+		{
+			WRITE_LOG(LOG_ERR, "Failed to obtain mutex");
+			return result_fatal_error;
+		}
+
+		delete_item = monitor->overflow_first;
+
+		monitor->overflow_first = delete_item->next;
+		if (monitor->overflow_first == NULL)
+		{
+			monitor->overflow_last = NULL;
+			atomic_store(&(monitor->has_overflow), 0);
+		}
+
+		pthread_mutex_unlock(&(monitor->system->control_mutex));
+
+		*device = delete_item->item;
+		*action = delete_item->action;
+		free(delete_item);
+
+		return result_success;
+	}
+
+	return result_fail;
+}
+
+int device_system_monitor_has_device(dtmd_device_monitor_t *monitor)
+{
+	if (monitor == NULL)
+	{
+		return 0;
+	}
+
+	return ((atomic_load_explicit(&(monitor->tail), memory_order_relaxed) != atomic_load_explicit(&(monitor->head), memory_order_acquire))
+		|| atomic_load(&(monitor->has_overflow)));
+}
+
 int device_system_monitor_get_device(dtmd_device_monitor_t *monitor, dtmd_info_t **device, dtmd_device_action_type_t *action)
 {
-	char data;
 	int rc;
-	dtmd_monitor_item_t *delete_item;
 
 #ifdef NDEBUG
 	if ((monitor == NULL)
 		|| (device == NULL)
 		|| (action == NULL))
 	{
-		rc = result_bug;
-		goto device_system_monitor_get_device_error_1;
+		return result_bug;
 	}
 #endif /* NDEBUG */
 
-	if (pthread_mutex_lock(&(monitor->system->control_mutex)) != 0)
+	rc = device_system_monitor_take_device(monitor, device, action);
+	if (is_result_failure(rc))
 	{
-		WRITE_LOG(LOG_ERR, "Failed to obtain mutex");
-		rc = result_fatal_error;
-		goto device_system_monitor_get_device_error_1;
-	}
+		// signal is cleared before checking for events again, so events added meanwhile are not missed
+		device_system_monitor_clear_signal(monitor);
 
-	rc = read(monitor->data_pipe[0], &data, 1);
-	if (rc != 1)
-	{
-		WRITE_LOG(LOG_ERR, "Failed to read data");
-		rc = result_fatal_error;
-		goto device_system_monitor_get_device_error_2;
+		rc = device_system_monitor_take_device(monitor, device, action);
 	}
 
-	switch (data)
+	if (is_result_successful(rc))
 	{
-	case 1: // data
-		if (monitor->first != NULL)
+		// last event is taken, caller checks device_system_monitor_has_device() after it
+		if (!device_system_monitor_has_device(monitor))
 		{
-			delete_item = monitor->first;
-
-			if (monitor->first != monitor->last)
-			{
-				monitor->first = monitor->first->next;
-			}
-			else
-			{
-				monitor->first = NULL;
-				monitor->last  = NULL;
-			}
-
-			*device = delete_item->item;
-			*action = delete_item->action;
-			free(delete_item);
-
-			rc = result_success;
-			/*goto device_system_monitor_get_device_error_2; */
-			break;
+			device_system_monitor_clear_signal(monitor);
 		}
 
-		// NOTE: passthrough
-
-	case 0: // error
-	case 2: // exit
-		*device = NULL;
-		*action = dtmd_device_action_unknown;
-		rc = ((data == 0) ? (result_fatal_error) : (result_fail));
-		/*goto device_system_monitor_get_device_error_2; */
-		break;
+		return rc;
 	}
 
-device_system_monitor_get_device_error_2:
-	pthread_mutex_unlock(&(monitor->system->control_mutex));
+	*device = NULL;
+	*action = dtmd_device_action_unknown;
 
-device_system_monitor_get_device_error_1:
-	return rc;
+	if (is_result_fatal_error(rc) || (atomic_load(&(monitor->status)) == monitor_status_error))
+	{
+		return result_fatal_error;
+	}
+
+	return result_fail;
 }
 
 void device_system_monitor_free_device(dtmd_device_monitor_t *monitor, dtmd_info_t *device)
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "daemon/modules/unix-userspace/uevent_record.h"
+
+#include "daemon/return_codes.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+int uevent_recorder_open(uevent_recorder_t *recorder, const char *filename)
+{
+	int fd;
+
+	// recorded events may reveal serial numbers of devices
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+	{
+		return result_fail;
+	}
+
+	recorder->file = fdopen(fd, "w");
+	if (recorder->file == NULL)
+	{
+		close(fd);
+		return result_fail;
+	}
+
+	if (fwrite(uevent_record_magic, strlen(uevent_record_magic), 1, recorder->file) != 1)
+	{
+		goto uevent_recorder_open_error_1;
+	}
+
+	if (clock_gettime(CLOCK_MONOTONIC, &(recorder->start)) != 0)
+	{
+		goto uevent_recorder_open_error_1;
+	}
+
+	return result_success;
+
+uevent_recorder_open_error_1:
+	fclose(recorder->file);
+	recorder->file = NULL;
+
+	return result_fail;
+}
+
+int uevent_recorder_write(uevent_recorder_t *recorder, const char *payload, size_t length)
+{
+	uevent_record_header_t header;
+	struct timespec now;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+	{
+		return result_fail;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.timestamp = (unsigned long long) (now.tv_sec - recorder->start.tv_sec) * 1000000000ULL + now.tv_nsec - recorder->start.tv_nsec;
+	header.length    = length;
+
+	if ((fwrite(&header, sizeof(header), 1, recorder->file) != 1)
+		|| ((length > 0) && (fwrite(payload, length, 1, recorder->file) != 1)))
+	{
+		return result_fail;
+	}
+
+	return result_success;
+}
+
+int uevent_recorder_flush(uevent_recorder_t *recorder)
+{
+	if (fflush(recorder->file) != 0)
+	{
+		return result_fail;
+	}
+
+	return result_success;
+}
+
+void uevent_recorder_close(uevent_recorder_t *recorder)
+{
+	fclose(recorder->file);
+	recorder->file = NULL;
+}
+
+int uevent_player_open(uevent_player_t *player, const char *filename)
+{
+	char magic[sizeof(uevent_record_magic)];
+
+	player->file = fopen(filename, "re");
+	if (player->file == NULL)
+	{
+		return result_fail;
+	}
+
+	if ((fread(magic, strlen(uevent_record_magic), 1, player->file) != 1)
+		|| (memcmp(magic, uevent_record_magic, strlen(uevent_record_magic)) != 0))
+	{
+		fclose(player->file);
+		player->file = NULL;
+		return result_fail;
+	}
+
+	player->records = 0;
+
+	return result_success;
+}
+
+int uevent_player_read(uevent_player_t *player, unsigned long long *timestamp, char *buffer, size_t buffer_size, size_t *length)
+{
+	uevent_record_header_t header;
+
+	if (fread(&header, sizeof(header), 1, player->file) != 1)
+	{
+		// partially written header at the end is left by interrupted recording
+		if (feof(player->file))
+		{
+			return result_fail;
+		}
+
+		return result_fatal_error;
+	}
+
+	if (header.length > buffer_size)
+	{
+		return result_fatal_error;
+	}
+
+	if ((header.length > 0) && (fread(buffer, header.length, 1, player->file) != 1))
+	{
+		if (feof(player->file))
+		{
+			return result_fail;
+		}
+
+		return result_fatal_error;
+	}
+
+	*timestamp = header.timestamp;
+	*length    = header.length;
+	++(player->records);
+
+	return result_success;
+}
+
+void uevent_player_close(uevent_player_t *player)
+{
+	fclose(player->file);
+	player->file = NULL;
+}
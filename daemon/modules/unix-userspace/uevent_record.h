@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef DTMD_UEVENT_RECORD_H
+#define DTMD_UEVENT_RECORD_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Files with recorded uevents.
+ *
+ * File starts with magic string, followed by records.
+ * Each record consists of header and raw netlink payload.
+ * Timestamp of record is count of nanoseconds since start of recording.
+ * Numbers are written in native byte order, files aren't meant to be moved between architectures.
+ */
+
+#define uevent_record_magic "DTMDUEV1"
+
+typedef struct uevent_record_header
+{
+	unsigned long long timestamp;
+	unsigned int length;
+	unsigned int reserved;
+} uevent_record_header_t;
+
+typedef struct uevent_recorder
+{
+	FILE *file;
+	struct timespec start;
+} uevent_recorder_t;
+
+typedef struct uevent_player
+{
+	FILE *file;
+	unsigned long long records;
+} uevent_player_t;
+
+int uevent_recorder_open(uevent_recorder_t *recorder, const char *filename);
+int uevent_recorder_write(uevent_recorder_t *recorder, const char *payload, size_t length);
+/* writes recorded data to file */
+int uevent_recorder_flush(uevent_recorder_t *recorder);
+void uevent_recorder_close(uevent_recorder_t *recorder);
+
+int uevent_player_open(uevent_player_t *player, const char *filename);
+
+/*
+ * Reads next record. Payload is written into buffer of buffer_size bytes.
+ * Returns result_success on success, result_fail if no records are left,
+ * result_fatal_error if file is damaged or record doesn't fit into buffer.
+ */
+int uevent_player_read(uevent_player_t *player, unsigned long long *timestamp, char *buffer, size_t buffer_size, size_t *length);
+void uevent_player_close(uevent_player_t *player);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DTMD_UEVENT_RECORD_H */
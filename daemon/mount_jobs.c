@@ -0,0 +1,897 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "daemon/mount_jobs.h"
+
+#include "daemon/actions.h"
+#include "daemon/client_io.h"
+#include "daemon/event_loop.h"
+#include "daemon/filesystem_mnt.h"
+#include "daemon/mnt_funcs.h"
+#include "daemon/log.h"
+#include "daemon/return_codes.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#if (defined OS_Linux)
+#include <sys/syscall.h>
+#endif /* (defined OS_Linux) */
+
+#define mount_workers_count 4
+
+/* used only by main thread */
+static mount_job_t *jobs_first = NULL;
+static mount_job_t *jobs_last  = NULL;
+
+/* protected by jobs_mutex */
+static mount_job_t *queue_first = NULL;
+static mount_job_t *queue_last  = NULL;
+static mount_job_t *completed_first = NULL;
+static mount_job_t *completed_last  = NULL;
+static int workers_stop = 0;
+
+static pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t workers[mount_workers_count];
+static size_t workers_started = 0;
+
+static int completion_pipe[2] = { -1, -1 };
+static void *jobs_event_data = NULL;
+
+extern char **environ;
+
+mount_job_t* mount_job_new(mount_job_type_t type, struct client *client_ptr, const char *path, const char *mount_options, enum mount_by_value_enum mount_type)
+{
+	mount_job_t *job;
+
+	job = (mount_job_t*) calloc(1, sizeof(mount_job_t));
+	if (job == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		goto mount_job_new_error_1;
+	}
+
+	job->type        = type;
+	job->client_ptr  = client_ptr;
+	job->mount_type  = mount_type;
+	job->result      = result_fail;
+	job->error_code  = dtmd_error_code_generic_error;
+	job->pid         = -1;
+	job->pidfd       = -1;
+
+	job->path = strdup(path);
+	if (job->path == NULL)
+	{
+		WRITE_LOG(LOG_ERR, "Memory allocation failure");
+		goto mount_job_new_error_2;
+	}
+
+	if (mount_options != NULL)
+	{
+		job->mount_options = strdup(mount_options);
+		if (job->mount_options == NULL)
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			goto mount_job_new_error_3;
+		}
+	}
+
+	if ((client_ptr != NULL) && (client_ptr->request_tag[0] != 0))
+	{
+		job->request_tag = strdup(client_ptr->request_tag);
+		if (job->request_tag == NULL)
+		{
+			WRITE_LOG(LOG_ERR, "Memory allocation failure");
+			goto mount_job_new_error_4;
+		}
+	}
+
+	return job;
+
+mount_job_new_error_4:
+	if (job->mount_options != NULL)
+	{
+		free(job->mount_options);
+	}
+
+mount_job_new_error_3:
+	free(job->path);
+
+mount_job_new_error_2:
+	free(job);
+
+mount_job_new_error_1:
+	return NULL;
+}
+
+void mount_job_free(mount_job_t *job)
+{
+	size_t i;
+
+	if (job->path != NULL)
+	{
+		free(job->path);
+	}
+
+	if (job->mount_options != NULL)
+	{
+		free(job->mount_options);
+	}
+
+	if (job->request_tag != NULL)
+	{
+		free(job->request_tag);
+	}
+
+	if (job->mount_point != NULL)
+	{
+		free(job->mount_point);
+	}
+
+	if (job->fstype != NULL)
+	{
+		free(job->fstype);
+	}
+
+#if (defined OS_Linux)
+	if (job->options != NULL)
+	{
+		free(job->options);
+	}
+
+	if (job->full_options != NULL)
+	{
+		free(job->full_options);
+	}
+#endif /* (defined OS_Linux) */
+
+	if (job->command != NULL)
+	{
+		for (i = 0; job->command[i] != NULL; ++i)
+		{
+			free(job->command[i]);
+		}
+
+		free(job->command);
+	}
+
+	if (job->pidfd != -1)
+	{
+		close(job->pidfd);
+	}
+
+	free(job);
+}
+
+static int mount_job_spawn(mount_job_t *job)
+{
+	int rc;
+	posix_spawnattr_t attributes;
+	sigset_t signals_mask;
+
+	rc = posix_spawnattr_init(&attributes);
+	if (rc != 0)
+	{
+		WRITE_LOG_ARGS(LOG_ERR, "Failed to execute '%s', error %d", job->command[0], rc);
+		job->pid = -1;
+		return result_fail;
+	}
+
+	// command shouldn't inherit blocked signals of worker thread or ignored SIGPIPE of daemon
+	sigemptyset(&signals_mask);
+	posix_spawnattr_setsigmask(&attributes, &signals_mask);
+
+	sigaddset(&signals_mask, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attributes, &signals_mask);
+
+	posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	rc = posix_spawnp(&(job->pid), job->command[0], NULL, &attributes, job->command, environ);
+
+	posix_spawnattr_destroy(&attributes);
+
+	if (rc != 0)
+	{
+		WRITE_LOG_ARGS(LOG_ERR, "Failed to execute '%s', error %d", job->command[0], rc);
+		job->pid = -1;
+		return result_fail;
+	}
+
+	return result_success;
+}
+
+static void mount_job_set_exit_status(mount_job_t *job, int wait_status)
+{
+	if (WIFEXITED(wait_status))
+	{
+		job->status = WEXITSTATUS(wait_status);
+	}
+	else
+	{
+		job->status = -1;
+	}
+}
+
+void mount_job_run_command(mount_job_t *job)
+{
+	int wait_status;
+	pid_t rc;
+
+	if ((job->pid == -1) && (is_result_failure(mount_job_spawn(job))))
+	{
+		job->status = -1;
+		return;
+	}
+
+	do
+	{
+		rc = waitpid(job->pid, &wait_status, 0);
+	} while ((rc < 0) && (errno == EINTR));
+
+	if (rc < 0)
+	{
+		job->status = -1;
+	}
+	else
+	{
+		mount_job_set_exit_status(job, wait_status);
+	}
+
+	job->pid = -1;
+}
+
+static void* mount_jobs_worker_function(void *arg)
+{
+	mount_job_t *job;
+	unsigned char data = 0;
+
+	pthread_mutex_lock(&jobs_mutex);
+
+	for (;;)
+	{
+		while ((queue_first == NULL) && (!workers_stop))
+		{
+			pthread_cond_wait(&jobs_cond, &jobs_mutex);
+		}
+
+		// queue is drained before stopping
+		if (queue_first == NULL)
+		{
+			break;
+		}
+
+		job = queue_first;
+		queue_first = job->next_queued;
+		if (queue_first == NULL)
+		{
+			queue_last = NULL;
+		}
+
+		pthread_mutex_unlock(&jobs_mutex);
+
+		switch (job->type)
+		{
+		case mount_job_type_mount:
+			execute_mount(job);
+			break;
+
+		case mount_job_type_unmount:
+			execute_unmount(job);
+			break;
+		}
+
+		pthread_mutex_lock(&jobs_mutex);
+
+		job->next_queued = NULL;
+
+		if (completed_last != NULL)
+		{
+			completed_last->next_queued = job;
+		}
+		else
+		{
+			completed_first = job;
+		}
+
+		completed_last = job;
+
+		write(completion_pipe[1], &data, sizeof(unsigned char));
+	}
+
+	pthread_mutex_unlock(&jobs_mutex);
+
+	return NULL;
+}
+
+int mount_jobs_init(void *event_data)
+{
+	sigset_t signals_mask;
+	sigset_t old_signals_mask;
+	size_t i;
+
+	if (pipe(completion_pipe) < 0)
+	{
+		WRITE_LOG(LOG_ERR, "Pipe() failed");
+		goto mount_jobs_init_error_1;
+	}
+
+	if ((fcntl(completion_pipe[0], F_SETFL, fcntl(completion_pipe[0], F_GETFL) | O_NONBLOCK) < 0)
+		|| (fcntl(completion_pipe[0], F_SETFD, FD_CLOEXEC) < 0)
+		|| (fcntl(completion_pipe[1], F_SETFD, FD_CLOEXEC) < 0))
+	{
+		WRITE_LOG(LOG_ERR, "Failed to set up pipe");
+		goto mount_jobs_init_error_2;
+	}
+
+	if (is_result_failure(event_loop_add(completion_pipe[0], event_loop_read, event_data)))
+	{
+		goto mount_jobs_init_error_2;
+	}
+
+	jobs_event_data = event_data;
+
+	// signals should be handled by main thread only, it interrupts waiting for events
+	sigfillset(&signals_mask);
+	pthread_sigmask(SIG_SETMASK, &signals_mask, &old_signals_mask);
+
+	for (i = 0; i < mount_workers_count; ++i)
+	{
+		if (pthread_create(&(workers[i]), NULL, &mount_jobs_worker_function, NULL) != 0)
+		{
+			break;
+		}
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_signals_mask, NULL);
+
+	workers_started = i;
+
+	if (workers_started < mount_workers_count)
+	{
+		WRITE_LOG(LOG_ERR, "Pthread initialization failure");
+		goto mount_jobs_init_error_3;
+	}
+
+	return result_success;
+
+mount_jobs_init_error_3:
+	mount_jobs_deinit();
+	return result_fatal_error;
+
+mount_jobs_init_error_2:
+	close(completion_pipe[0]);
+	close(completion_pipe[1]);
+	completion_pipe[0] = -1;
+	completion_pipe[1] = -1;
+
+mount_jobs_init_error_1:
+	return result_fatal_error;
+}
+
+static int mount_jobs_finish(mount_job_t *job)
+{
+	switch (job->type)
+	{
+	case mount_job_type_mount:
+		return finish_mount(job);
+
+	case mount_job_type_unmount:
+		return finish_unmount(job);
+	}
+
+	return result_bug;
+}
+
+void mount_jobs_deinit(void)
+{
+	mount_job_t *job;
+	size_t i;
+
+	pthread_mutex_lock(&jobs_mutex);
+	workers_stop = 1;
+	pthread_cond_broadcast(&jobs_cond);
+	pthread_mutex_unlock(&jobs_mutex);
+
+	for (i = 0; i < workers_started; ++i)
+	{
+		pthread_join(workers[i], NULL);
+	}
+
+	workers_started = 0;
+	workers_stop = 0;
+
+	// wait for external commands watched by event loop
+	for (job = jobs_first; job != NULL; job = job->next_node)
+	{
+		if (job->pidfd != -1)
+		{
+			mount_job_run_command(job);
+			mount_jobs_finish(job);
+		}
+	}
+
+	// finish executed jobs, nobody waits for results anymore
+	for (job = completed_first; job != NULL; job = job->next_queued)
+	{
+		mount_jobs_finish(job);
+	}
+
+	completed_first = NULL;
+	completed_last  = NULL;
+
+	while (jobs_first != NULL)
+	{
+		job = jobs_first;
+		jobs_first = job->next_node;
+		mount_job_free(job);
+	}
+
+	jobs_last = NULL;
+
+	if (completion_pipe[0] != -1)
+	{
+		close(completion_pipe[0]);
+		close(completion_pipe[1]);
+		completion_pipe[0] = -1;
+		completion_pipe[1] = -1;
+	}
+}
+
+static void mount_jobs_reply(mount_job_t *job)
+{
+	int rc;
+
+	if ((job->client_ptr == NULL) || (job->client_ptr->is_removal_scheduled))
+	{
+		return;
+	}
+
+	switch (job->type)
+	{
+	case mount_job_type_mount:
+		rc = send_mount_result(job->client_ptr, ((job->request_tag != NULL) ? job->request_tag : ""), job->path, job->mount_options, job->result, job->error_code);
+		break;
+
+	case mount_job_type_unmount:
+		rc = send_unmount_result(job->client_ptr, ((job->request_tag != NULL) ? job->request_tag : ""), job->path, job->result, job->error_code);
+		break;
+
+	default:
+		rc = result_success;
+		break;
+	}
+
+	if (is_result_failure(rc))
+	{
+		schedule_client_removal(job->client_ptr);
+	}
+}
+
+/* removes job and returns next job waiting for same device */
+static mount_job_t* mount_jobs_release(mount_job_t *job)
+{
+	mount_job_t *next_job;
+
+	for (next_job = job->next_node; next_job != NULL; next_job = next_job->next_node)
+	{
+		if (strcmp(next_job->path, job->path) == 0)
+		{
+			break;
+		}
+	}
+
+	if (job->prev_node != NULL)
+	{
+		job->prev_node->next_node = job->next_node;
+	}
+	else
+	{
+		jobs_first = job->next_node;
+	}
+
+	if (job->next_node != NULL)
+	{
+		job->next_node->prev_node = job->prev_node;
+	}
+	else
+	{
+		jobs_last = job->prev_node;
+	}
+
+	mount_job_free(job);
+
+	return next_job;
+}
+
+#if (defined OS_Linux) && (defined SYS_pidfd_open)
+/* spawns command and adds its process descriptor to event loop, if it fails worker thread has to wait for command */
+static int mount_jobs_watch_command(mount_job_t *job)
+{
+	int pidfd;
+
+	if (is_result_failure(mount_job_spawn(job)))
+	{
+		return result_fail;
+	}
+
+	pidfd = syscall(SYS_pidfd_open, job->pid, 0);
+	if (pidfd < 0)
+	{
+		return result_fail;
+	}
+
+	if (is_result_failure(event_loop_add(pidfd, event_loop_read, jobs_event_data)))
+	{
+		close(pidfd);
+		return result_fail;
+	}
+
+	job->pidfd = pidfd;
+
+	return result_success;
+}
+
+static void mount_jobs_reap_commands(void)
+{
+	mount_job_t *job;
+	int wait_status;
+	pid_t rc;
+
+	for (job = jobs_first; job != NULL; job = job->next_node)
+	{
+		if (job->pidfd == -1)
+		{
+			continue;
+		}
+
+		rc = waitpid(job->pid, &wait_status, WNOHANG);
+		if (rc == 0)
+		{
+			continue;
+		}
+
+		if (rc < 0)
+		{
+			job->status = -1;
+		}
+		else
+		{
+			mount_job_set_exit_status(job, wait_status);
+		}
+
+		job->pid = -1;
+
+		event_loop_remove(job->pidfd);
+		close(job->pidfd);
+		job->pidfd = -1;
+
+		job->next_queued = NULL;
+
+		if (completed_last != NULL)
+		{
+			completed_last->next_queued = job;
+		}
+		else
+		{
+			completed_first = job;
+		}
+
+		completed_last = job;
+	}
+}
+#endif /* (defined OS_Linux) && (defined SYS_pidfd_open) */
+
+/*
+ * prepares job and passes it to workers. If preparation fails, job is completed and next waiting job for device is started.
+ * Mounting of device which filesystem is still being probed waits until mount_jobs_resume_waiting() is called.
+ */
+static int mount_jobs_start(mount_job_t *job)
+{
+	int rc;
+
+	while (job != NULL)
+	{
+		if ((job->type == mount_job_type_mount) && is_media_probing(job->path))
+		{
+			// started by mount_jobs_resume_waiting()
+			return result_success;
+		}
+
+		switch (job->type)
+		{
+		case mount_job_type_mount:
+			rc = prepare_mount(job);
+			break;
+
+		case mount_job_type_unmount:
+			rc = prepare_unmount(job);
+			break;
+
+		default:
+			rc = result_bug;
+			break;
+		}
+
+		if (is_result_fatal_error(rc))
+		{
+			return rc;
+		}
+
+		if (is_result_successful(rc))
+		{
+			job->is_started = 1;
+
+#if (defined OS_Linux) && (defined SYS_pidfd_open)
+			if ((job->method == mount_job_method_external)
+				&& (is_result_successful(mount_jobs_watch_command(job))))
+			{
+				return result_success;
+			}
+#endif /* (defined OS_Linux) && (defined SYS_pidfd_open) */
+
+			pthread_mutex_lock(&jobs_mutex);
+
+			job->next_queued = NULL;
+
+			if (queue_last != NULL)
+			{
+				queue_last->next_queued = job;
+			}
+			else
+			{
+				queue_first = job;
+			}
+
+			queue_last = job;
+
+			pthread_cond_signal(&jobs_cond);
+			pthread_mutex_unlock(&jobs_mutex);
+
+			return result_success;
+		}
+
+		job->result = rc;
+		mount_jobs_reply(job);
+		job = mount_jobs_release(job);
+	}
+
+	return result_success;
+}
+
+int mount_jobs_process_completed(void)
+{
+	unsigned char data[64];
+	mount_job_t *completed;
+	mount_job_t *job;
+	mount_job_t *next_job;
+	int need_mounts_check = 0;
+	int rc;
+
+	while (read(completion_pipe[0], data, sizeof(data)) > 0)
+	{
+	}
+
+	pthread_mutex_lock(&jobs_mutex);
+
+#if (defined OS_Linux) && (defined SYS_pidfd_open)
+	mount_jobs_reap_commands();
+#endif /* (defined OS_Linux) && (defined SYS_pidfd_open) */
+
+	completed = completed_first;
+	completed_first = NULL;
+	completed_last = NULL;
+	pthread_mutex_unlock(&jobs_mutex);
+
+	if (completed == NULL)
+	{
+		return result_success;
+	}
+
+	for (job = completed; job != NULL; job = job->next_queued)
+	{
+		rc = mount_jobs_finish(job);
+		if (is_result_fatal_error(rc))
+		{
+			return rc;
+		}
+
+		mount_jobs_reply(job);
+
+		// results of internal mounts and unmounts are already applied
+		if (job->method == mount_job_method_external)
+		{
+			need_mounts_check = 1;
+		}
+	}
+
+	// next jobs for these devices must see state after current jobs
+	if (need_mounts_check)
+	{
+#if (defined OS_Linux)
+		rc = check_mount_changes();
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
+		rc = check_mount_changes(-1);
+#endif /* (defined OS_FreeBSD) */
+
+		if (is_result_fatal_error(rc))
+		{
+			return rc;
+		}
+	}
+
+	while (completed != NULL)
+	{
+		job = completed;
+		completed = job->next_queued;
+
+		next_job = mount_jobs_release(job);
+		if ((next_job != NULL) && (!next_job->is_started))
+		{
+			rc = mount_jobs_start(next_job);
+			if (is_result_fatal_error(rc))
+			{
+				return rc;
+			}
+		}
+	}
+
+	return result_success;
+}
+
+int mount_jobs_submit(mount_job_t *job)
+{
+	mount_job_t *iter_job;
+	int is_busy = 0;
+
+	for (iter_job = jobs_first; iter_job != NULL; iter_job = iter_job->next_node)
+	{
+		if (strcmp(iter_job->path, job->path) == 0)
+		{
+			is_busy = 1;
+			break;
+		}
+	}
+
+	job->next_node = NULL;
+	job->prev_node = jobs_last;
+
+	if (jobs_last != NULL)
+	{
+		jobs_last->next_node = job;
+	}
+	else
+	{
+		jobs_first = job;
+	}
+
+	jobs_last = job;
+
+	if (is_busy)
+	{
+		return result_success;
+	}
+
+	return mount_jobs_start(job);
+}
+
+/* returns first job of device which isn't started and may be started now */
+static mount_job_t* mount_jobs_find_waiting(void)
+{
+	mount_job_t *job;
+	mount_job_t *prev_job;
+
+	for (job = jobs_first; job != NULL; job = job->next_node)
+	{
+		if ((job->is_started)
+			|| ((job->type == mount_job_type_mount) && is_media_probing(job->path)))
+		{
+			continue;
+		}
+
+		for (prev_job = job->prev_node; prev_job != NULL; prev_job = prev_job->prev_node)
+		{
+			if (strcmp(prev_job->path, job->path) == 0)
+			{
+				break;
+			}
+		}
+
+		if (prev_job == NULL)
+		{
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+int mount_jobs_resume_waiting(void)
+{
+	mount_job_t *job;
+	int rc;
+
+	// starting job may release it and any following jobs, so search starts over each time
+	while ((job = mount_jobs_find_waiting()) != NULL)
+	{
+		rc = mount_jobs_start(job);
+		if (is_result_fatal_error(rc))
+		{
+			return rc;
+		}
+	}
+
+	return result_success;
+}
+
+void mount_jobs_detach_client(struct client *client_ptr)
+{
+	mount_job_t *job;
+
+	for (job = jobs_first; job != NULL; job = job->next_node)
+	{
+		if (job->client_ptr == client_ptr)
+		{
+			job->client_ptr = NULL;
+		}
+	}
+}
+
+int mount_jobs_is_device_busy(const char *path)
+{
+	mount_job_t *job;
+
+	for (job = jobs_first; job != NULL; job = job->next_node)
+	{
+		if (strcmp(job->path, path) == 0)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int mount_jobs_is_mount_point_reserved(const char *mount_point)
+{
+	mount_job_t *job;
+
+	for (job = jobs_first; job != NULL; job = job->next_node)
+	{
+		if ((job->is_started)
+			&& (job->type == mount_job_type_mount)
+			&& (job->mount_point != NULL)
+			&& (strcmp(job->mount_point, mount_point) == 0))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
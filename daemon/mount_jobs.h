@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DTMD_MOUNT_JOBS_H
+#define DTMD_MOUNT_JOBS_H
+
+#include <dtmd.h>
+#include "daemon/config_file.h"
+#include "daemon/lists.h"
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Mount and unmount operations may take a lot of time,
+ * that's why they are executed by worker threads while main loop keeps serving clients and devices.
+ *
+ * Each operation is a job consisting of three steps:
+ * preparation and finishing are done in main thread, execution is done by worker thread.
+ * Jobs for same device are executed one after another in order of submission,
+ * next job is prepared only after previous one is finished and mount table is rechecked.
+ *
+ * External commands are spawned directly without shell. Where possible their completion
+ * is watched by event loop using process descriptors, otherwise worker thread waits for them.
+ */
+
+typedef enum mount_job_type
+{
+	mount_job_type_mount = 0,
+	mount_job_type_unmount
+} mount_job_type_t;
+
+typedef enum mount_job_method
+{
+	mount_job_method_internal = 0,
+	mount_job_method_external
+} mount_job_method_t;
+
+typedef struct mount_job
+{
+	mount_job_type_t type;
+	struct client *client_ptr; /* NULL if job is done on behalf of daemon or client is gone */
+	char *request_tag; /* prefix of responses if job is requested by tagged request */
+
+	/* request */
+	char *path;
+	char *mount_options;
+	enum mount_by_value_enum mount_type;
+
+	/* filled during preparation */
+	mount_job_method_t method;
+	char *mount_point;
+	char *fstype;
+
+#if (defined OS_Linux)
+	char *options;      /* options for mount() */
+	char *full_options; /* options for mtab */
+	unsigned long flags;
+#endif /* (defined OS_Linux) */
+
+	char **command;     /* arguments of external mount or unmount command */
+	pid_t pid;          /* external command process */
+	int pidfd;          /* descriptor of external command process if it's watched by event loop */
+
+	/* results */
+	int result;
+	int status;         /* errno for internal method, exit code for external method */
+	dtmd_error_code_t error_code;
+
+	int is_started;
+
+	/* list of all jobs, used only by main thread */
+	struct mount_job *next_node;
+	struct mount_job *prev_node;
+
+	/* queue of workers or list of completed jobs */
+	struct mount_job *next_queued;
+} mount_job_t;
+
+mount_job_t* mount_job_new(mount_job_type_t type, struct client *client_ptr, const char *path, const char *mount_options, enum mount_by_value_enum mount_type);
+void mount_job_free(mount_job_t *job);
+
+/* all descriptors of mount jobs are added to event loop with event_data */
+int mount_jobs_init(void *event_data);
+void mount_jobs_deinit(void);
+
+/* should be called when any descriptor of mount jobs becomes readable */
+int mount_jobs_process_completed(void);
+
+/* spawns external command of job unless it's spawned already and waits for it, may be called by any thread */
+void mount_job_run_command(mount_job_t *job);
+
+/* job is owned by mount_jobs after submission */
+int mount_jobs_submit(mount_job_t *job);
+
+/* starts jobs which waited for devices which are probed or removed now */
+int mount_jobs_resume_waiting(void);
+
+/* jobs of removed client are still executed, but results aren't sent */
+void mount_jobs_detach_client(struct client *client_ptr);
+
+int mount_jobs_is_device_busy(const char *path);
+int mount_jobs_is_mount_point_reserved(const char *mount_point);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DTMD_MOUNT_JOBS_H */
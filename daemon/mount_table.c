@@ -0,0 +1,1407 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "daemon/mount_table.h"
+
+#include "daemon/return_codes.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+
+#define mount_table_index_initial_size 256
+#define mount_table_buffer_initial_size 16384
+#define mount_table_buffer_min_free 4096
+
+/*
+ * listmount() and statmount() appeared in Linux 6.8, source of mount is reported since Linux 6.13.
+ * Definitions are provided here since they are missing in older system headers.
+ * New syscalls have same numbers on all architectures except alpha and mips.
+ */
+#if (!defined SYS_statmount) && (!defined __alpha__) && (!defined __mips__)
+#define SYS_statmount 457
+#endif /* (!defined SYS_statmount) && (!defined __alpha__) && (!defined __mips__) */
+
+#if (!defined SYS_listmount) && (!defined __alpha__) && (!defined __mips__)
+#define SYS_listmount 458
+#endif /* (!defined SYS_listmount) && (!defined __alpha__) && (!defined __mips__) */
+
+#if (defined SYS_statmount) && (defined SYS_listmount)
+#define mount_table_listmount_root 0xFFFFFFFFFFFFFFFFULL
+#define mount_table_listmount_batch 512
+#define mount_table_statmount_buffer_initial_size 4096
+
+#define mount_table_statmount_sb_basic   0x00000001
+#define mount_table_statmount_mnt_basic  0x00000002
+#define mount_table_statmount_mnt_point  0x00000010
+#define mount_table_statmount_mnt_opts   0x00000080
+#define mount_table_statmount_sb_source  0x00000200
+
+#define mount_table_statmount_request (mount_table_statmount_sb_basic | mount_table_statmount_mnt_basic | mount_table_statmount_mnt_point | mount_table_statmount_mnt_opts | mount_table_statmount_sb_source)
+
+#define mount_table_attr_rdonly      0x00000001
+#define mount_table_attr_nosuid      0x00000002
+#define mount_table_attr_nodev       0x00000004
+#define mount_table_attr_noexec      0x00000008
+#define mount_table_attr_atime_mask  0x00000070
+#define mount_table_attr_noatime     0x00000010
+#define mount_table_attr_nodiratime  0x00000080
+#define mount_table_attr_nosymfollow 0x00200000
+
+#define mount_table_sb_synchronous 0x00000010
+#define mount_table_sb_mandlock    0x00000040
+#define mount_table_sb_dirsync     0x00000080
+#define mount_table_sb_lazytime    0x02000000
+
+struct mount_table_mnt_id_req
+{
+	uint32_t size;
+	uint32_t spare;
+	uint64_t mnt_id;
+	uint64_t param;
+};
+
+struct mount_table_statmount
+{
+	uint32_t size;
+	uint32_t mnt_opts;
+	uint64_t mask;
+	uint32_t sb_dev_major;
+	uint32_t sb_dev_minor;
+	uint64_t sb_magic;
+	uint32_t sb_flags;
+	uint32_t fs_type;
+	uint64_t mnt_id;
+	uint64_t mnt_parent_id;
+	uint32_t mnt_id_old;
+	uint32_t mnt_parent_id_old;
+	uint64_t mnt_attr;
+	uint64_t mnt_propagation;
+	uint64_t mnt_peer_group;
+	uint64_t mnt_master;
+	uint64_t propagate_from;
+	uint32_t mnt_root;
+	uint32_t mnt_point;
+	uint64_t mnt_ns_id;
+	uint32_t fs_subtype;
+	uint32_t sb_source;
+	uint32_t opt_num;
+	uint32_t opt_array;
+	uint32_t opt_sec_num;
+	uint32_t opt_sec_array;
+	uint64_t spare2[46];
+	char str[];
+};
+#endif /* (defined SYS_statmount) && (defined SYS_listmount) */
+
+typedef struct mount_table_fields
+{
+	const char *mount_point;
+	const char *mount_point_end;
+	const char *options;
+	const char *options_end;
+	const char *source;
+	const char *source_end;
+	const char *super_options;
+	const char *super_options_end;
+} mount_table_fields_t;
+
+void mount_table_init(mount_table_t *table)
+{
+	table->by_id = NULL;
+	table->by_source = NULL;
+	table->by_mount_point = NULL;
+	table->index_size = 0;
+	table->count = 0;
+
+	table->generation = 0;
+	table->last_provisional_id = -1;
+
+	table->buffer = NULL;
+	table->buffer_size = 0;
+	table->buffer_used = 0;
+
+	table->stat_buffer = NULL;
+	table->stat_buffer_size = 0;
+}
+
+static void mount_table_free_entry(mount_table_entry_t *entry)
+{
+	free(entry->source);
+	free(entry->mount_point);
+	free(entry->options);
+	free(entry->line);
+	free(entry);
+}
+
+void mount_table_free(mount_table_t *table)
+{
+	mount_table_entry_t *cur;
+	mount_table_entry_t *next;
+	size_t i;
+
+	for (i = 0; i < table->index_size; ++i)
+	{
+		for (cur = table->by_id[i]; cur != NULL; cur = next)
+		{
+			next = cur->next_by_id;
+			mount_table_free_entry(cur);
+		}
+	}
+
+	if (table->by_id != NULL)
+	{
+		free(table->by_id);
+	}
+
+	if (table->by_source != NULL)
+	{
+		free(table->by_source);
+	}
+
+	if (table->by_mount_point != NULL)
+	{
+		free(table->by_mount_point);
+	}
+
+	if (table->buffer != NULL)
+	{
+		free(table->buffer);
+	}
+
+	if (table->stat_buffer != NULL)
+	{
+		free(table->stat_buffer);
+	}
+
+	mount_table_init(table);
+}
+
+int mount_table_read(mount_table_t *table, int fd)
+{
+	char *new_buffer;
+	size_t new_size;
+	ssize_t rc;
+
+	if (lseek(fd, 0, SEEK_SET) == (off_t) -1)
+	{
+		return result_fatal_error;
+	}
+
+	table->buffer_used = 0;
+
+	for (;;)
+	{
+		if (table->buffer_size - table->buffer_used < mount_table_buffer_min_free)
+		{
+			new_size = (table->buffer_size > 0) ? (table->buffer_size * 2) : mount_table_buffer_initial_size;
+
+			new_buffer = (char*) realloc(table->buffer, new_size);
+			if (new_buffer == NULL)
+			{
+				return result_fatal_error;
+			}
+
+			table->buffer = new_buffer;
+			table->buffer_size = new_size;
+		}
+
+		rc = read(fd, &(table->buffer[table->buffer_used]), table->buffer_size - table->buffer_used);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return result_fatal_error;
+		}
+
+		if (rc == 0)
+		{
+			break;
+		}
+
+		table->buffer_used += rc;
+	}
+
+	return result_success;
+}
+
+static size_t mount_table_string_hash(const char *value)
+{
+	size_t hash = 2166136261u;
+
+	while (*value != 0)
+	{
+		hash ^= (unsigned char) *value;
+		hash *= 16777619u;
+		++value;
+	}
+
+	return hash;
+}
+
+static int mount_table_grow(mount_table_t *table)
+{
+	mount_table_entry_t **new_by_id;
+	mount_table_entry_t **new_by_source;
+	mount_table_entry_t **new_by_mount_point;
+	mount_table_entry_t *cur;
+	mount_table_entry_t *next;
+	size_t new_size;
+	size_t i;
+
+	new_size = (table->index_size > 0) ? (table->index_size * 2) : mount_table_index_initial_size;
+
+	new_by_id = (mount_table_entry_t**) calloc(new_size, sizeof(mount_table_entry_t*));
+	if (new_by_id == NULL)
+	{
+		return result_fatal_error;
+	}
+
+	new_by_source = (mount_table_entry_t**) calloc(new_size, sizeof(mount_table_entry_t*));
+	if (new_by_source == NULL)
+	{
+		free(new_by_id);
+		return result_fatal_error;
+	}
+
+	new_by_mount_point = (mount_table_entry_t**) calloc(new_size, sizeof(mount_table_entry_t*));
+	if (new_by_mount_point == NULL)
+	{
+		free(new_by_source);
+		free(new_by_id);
+		return result_fatal_error;
+	}
+
+	for (i = 0; i < table->index_size; ++i)
+	{
+		for (cur = table->by_id[i]; cur != NULL; cur = next)
+		{
+			next = cur->next_by_id;
+			cur->next_by_id = new_by_id[((size_t) cur->mount_id) & (new_size - 1)];
+			new_by_id[((size_t) cur->mount_id) & (new_size - 1)] = cur;
+		}
+
+		for (cur = table->by_source[i]; cur != NULL; cur = next)
+		{
+			next = cur->next_by_source;
+			cur->next_by_source = new_by_source[cur->source_hash & (new_size - 1)];
+			new_by_source[cur->source_hash & (new_size - 1)] = cur;
+		}
+
+		for (cur = table->by_mount_point[i]; cur != NULL; cur = next)
+		{
+			next = cur->next_by_mount_point;
+			cur->next_by_mount_point = new_by_mount_point[cur->mount_point_hash & (new_size - 1)];
+			new_by_mount_point[cur->mount_point_hash & (new_size - 1)] = cur;
+		}
+	}
+
+	if (table->by_id != NULL)
+	{
+		free(table->by_id);
+	}
+
+	if (table->by_source != NULL)
+	{
+		free(table->by_source);
+	}
+
+	if (table->by_mount_point != NULL)
+	{
+		free(table->by_mount_point);
+	}
+
+	table->by_id = new_by_id;
+	table->by_source = new_by_source;
+	table->by_mount_point = new_by_mount_point;
+	table->index_size = new_size;
+
+	return result_success;
+}
+
+static mount_table_entry_t* mount_table_find_id(const mount_table_t *table, long long mount_id)
+{
+	mount_table_entry_t *cur;
+
+	if (table->index_size == 0)
+	{
+		return NULL;
+	}
+
+	for (cur = table->by_id[((size_t) mount_id) & (table->index_size - 1)]; cur != NULL; cur = cur->next_by_id)
+	{
+		if (cur->mount_id == mount_id)
+		{
+			return cur;
+		}
+	}
+
+	return NULL;
+}
+
+static void mount_table_index_source(mount_table_t *table, mount_table_entry_t *entry)
+{
+	size_t bucket;
+
+	entry->next_by_source = NULL;
+
+	if (entry->source[0] != '/')
+	{
+		return;
+	}
+
+	entry->source_hash = mount_table_string_hash(entry->source);
+
+	bucket = entry->source_hash & (table->index_size - 1);
+	entry->next_by_source = table->by_source[bucket];
+	table->by_source[bucket] = entry;
+}
+
+static void mount_table_unindex_source(mount_table_t *table, mount_table_entry_t *entry)
+{
+	mount_table_entry_t **iter;
+
+	if (entry->source[0] != '/')
+	{
+		return;
+	}
+
+	for (iter = &(table->by_source[entry->source_hash & (table->index_size - 1)]); *iter != NULL; iter = &((*iter)->next_by_source))
+	{
+		if (*iter == entry)
+		{
+			*iter = entry->next_by_source;
+			break;
+		}
+	}
+}
+
+static void mount_table_index_mount_point(mount_table_t *table, mount_table_entry_t *entry)
+{
+	size_t bucket;
+
+	entry->mount_point_hash = mount_table_string_hash(entry->mount_point);
+
+	bucket = entry->mount_point_hash & (table->index_size - 1);
+	entry->next_by_mount_point = table->by_mount_point[bucket];
+	table->by_mount_point[bucket] = entry;
+}
+
+static void mount_table_unindex_mount_point(mount_table_t *table, mount_table_entry_t *entry)
+{
+	mount_table_entry_t **iter;
+
+	for (iter = &(table->by_mount_point[entry->mount_point_hash & (table->index_size - 1)]); *iter != NULL; iter = &((*iter)->next_by_mount_point))
+	{
+		if (*iter == entry)
+		{
+			*iter = entry->next_by_mount_point;
+			break;
+		}
+	}
+}
+
+static int mount_table_insert(mount_table_t *table, mount_table_entry_t *entry)
+{
+	size_t bucket;
+
+	if (table->count >= table->index_size)
+	{
+		if (is_result_failure(mount_table_grow(table)))
+		{
+			return result_fatal_error;
+		}
+	}
+
+	bucket = ((size_t) entry->mount_id) & (table->index_size - 1);
+	entry->next_by_id = table->by_id[bucket];
+	table->by_id[bucket] = entry;
+
+	mount_table_index_source(table, entry);
+	mount_table_index_mount_point(table, entry);
+
+	++(table->count);
+
+	return result_success;
+}
+
+static void mount_table_unlink(mount_table_t *table, mount_table_entry_t *entry)
+{
+	mount_table_entry_t **iter;
+
+	for (iter = &(table->by_id[((size_t) entry->mount_id) & (table->index_size - 1)]); *iter != NULL; iter = &((*iter)->next_by_id))
+	{
+		if (*iter == entry)
+		{
+			*iter = entry->next_by_id;
+			--(table->count);
+			break;
+		}
+	}
+
+	mount_table_unindex_source(table, entry);
+	mount_table_unindex_mount_point(table, entry);
+}
+
+static const char* mount_table_next_field(const char *pos, const char *end, const char **field_end)
+{
+	while ((pos < end) && (*pos == ' '))
+	{
+		++pos;
+	}
+
+	*field_end = pos;
+
+	while ((*field_end < end) && (**field_end != ' '))
+	{
+		++(*field_end);
+	}
+
+	return pos;
+}
+
+static int mount_table_parse_id(const char *pos, const char *end, long long *mount_id)
+{
+	long long result = 0;
+
+	if ((pos == end) || (*pos < '0') || (*pos > '9'))
+	{
+		return result_fail;
+	}
+
+	while ((pos < end) && (*pos >= '0') && (*pos <= '9'))
+	{
+		result = result * 10 + (*pos - '0');
+		++pos;
+	}
+
+	if ((pos < end) && (*pos != ' '))
+	{
+		return result_fail;
+	}
+
+	*mount_id = result;
+
+	return result_success;
+}
+
+/*
+ * Line format:
+ * mount_id parent_id major:minor root mount_point mount_options [optional fields...] - fstype source super_options
+ */
+static int mount_table_parse_fields(const char *line, const char *end, mount_table_fields_t *fields)
+{
+	const char *field;
+	const char *field_end;
+	int i;
+
+	field_end = line;
+
+	/* skip mount id, parent id, device numbers and root */
+	for (i = 0; i < 4; ++i)
+	{
+		field = mount_table_next_field(field_end, end, &field_end);
+		if (field == field_end)
+		{
+			return result_fail;
+		}
+	}
+
+	fields->mount_point = mount_table_next_field(field_end, end, &(fields->mount_point_end));
+	fields->options = mount_table_next_field(fields->mount_point_end, end, &(fields->options_end));
+
+	if ((fields->mount_point == fields->mount_point_end) || (fields->options == fields->options_end))
+	{
+		return result_fail;
+	}
+
+	field_end = fields->options_end;
+
+	/* skip optional fields */
+	do
+	{
+		field = mount_table_next_field(field_end, end, &field_end);
+		if (field == field_end)
+		{
+			return result_fail;
+		}
+	} while ((field_end - field != 1) || (*field != '-'));
+
+	/* skip filesystem type */
+	field = mount_table_next_field(field_end, end, &field_end);
+	if (field == field_end)
+	{
+		return result_fail;
+	}
+
+	fields->source = mount_table_next_field(field_end, end, &(fields->source_end));
+	fields->super_options = mount_table_next_field(fields->source_end, end, &(fields->super_options_end));
+
+	if (fields->source == fields->source_end)
+	{
+		return result_fail;
+	}
+
+	return result_success;
+}
+
+static int is_octal_digit(char c)
+{
+	return ((c >= '0') && (c <= '7'));
+}
+
+/* decodes escape sequences like \040 */
+static char* mount_table_decode(const char *start, const char *end)
+{
+	char *result;
+	char *cur;
+
+	result = (char*) malloc(end - start + 1);
+	if (result == NULL)
+	{
+		return NULL;
+	}
+
+	cur = result;
+
+	while (start < end)
+	{
+		if ((*start == '\\')
+			&& (end - start >= 4)
+			&& is_octal_digit(start[1])
+			&& is_octal_digit(start[2])
+			&& is_octal_digit(start[3]))
+		{
+			*cur = (char) (((start[1] - '0') << 6) | ((start[2] - '0') << 3) | (start[3] - '0'));
+			start += 4;
+		}
+		else
+		{
+			*cur = *start;
+			++start;
+		}
+
+		++cur;
+	}
+
+	*cur = 0;
+
+	return result;
+}
+
+/* superblock options also include read-only flag, but it's already part of mount options */
+static char* mount_table_merge_options(const mount_table_fields_t *fields)
+{
+	const char *super_options = fields->super_options;
+	size_t options_len;
+	size_t super_options_len;
+	char *result;
+
+	if ((fields->super_options_end - super_options >= 2)
+		&& ((strncmp(super_options, "rw", 2) == 0) || (strncmp(super_options, "ro", 2) == 0))
+		&& ((fields->super_options_end - super_options == 2) || (super_options[2] == ',')))
+	{
+		super_options += 2;
+
+		if (super_options != fields->super_options_end)
+		{
+			++super_options;
+		}
+	}
+
+	options_len = fields->options_end - fields->options;
+	super_options_len = fields->super_options_end - super_options;
+
+	result = (char*) malloc(options_len + ((super_options_len > 0) ? (super_options_len + 1) : 0) + 1);
+	if (result == NULL)
+	{
+		return NULL;
+	}
+
+	memcpy(result, fields->options, options_len);
+
+	if (super_options_len > 0)
+	{
+		result[options_len] = ',';
+		memcpy(&(result[options_len + 1]), super_options, super_options_len);
+		options_len += super_options_len + 1;
+	}
+
+	result[options_len] = 0;
+
+	return result;
+}
+
+static mount_table_entry_t* mount_table_new_entry(long long mount_id, const char *line, size_t line_len, const mount_table_fields_t *fields)
+{
+	mount_table_entry_t *entry;
+
+	entry = (mount_table_entry_t*) malloc(sizeof(mount_table_entry_t));
+	if (entry == NULL)
+	{
+		goto mount_table_new_entry_error_1;
+	}
+
+	entry->mount_id = mount_id;
+
+	entry->source = mount_table_decode(fields->source, fields->source_end);
+	if (entry->source == NULL)
+	{
+		goto mount_table_new_entry_error_2;
+	}
+
+	entry->mount_point = mount_table_decode(fields->mount_point, fields->mount_point_end);
+	if (entry->mount_point == NULL)
+	{
+		goto mount_table_new_entry_error_3;
+	}
+
+	entry->options = mount_table_merge_options(fields);
+	if (entry->options == NULL)
+	{
+		goto mount_table_new_entry_error_4;
+	}
+
+	entry->line = (char*) malloc(line_len);
+	if (entry->line == NULL)
+	{
+		goto mount_table_new_entry_error_5;
+	}
+
+	memcpy(entry->line, line, line_len);
+	entry->line_len = line_len;
+
+	entry->generation = 0;
+	entry->is_watched = 0;
+	entry->source_hash = 0;
+	entry->next_by_id = NULL;
+	entry->next_by_source = NULL;
+	entry->mount_point_hash = 0;
+	entry->next_by_mount_point = NULL;
+	entry->next_changed = NULL;
+
+	return entry;
+
+mount_table_new_entry_error_5:
+	free(entry->options);
+
+mount_table_new_entry_error_4:
+	free(entry->mount_point);
+
+mount_table_new_entry_error_3:
+	free(entry->source);
+
+mount_table_new_entry_error_2:
+	free(entry);
+
+mount_table_new_entry_error_1:
+	return NULL;
+}
+
+/* swaps contents of entry in table and new entry with same id and source */
+static void mount_table_swap_contents(mount_table_t *table, mount_table_entry_t *first, mount_table_entry_t *second)
+{
+	char *tmp;
+	size_t tmp_len;
+
+	mount_table_unindex_mount_point(table, first);
+
+	tmp = first->mount_point;
+	first->mount_point = second->mount_point;
+	second->mount_point = tmp;
+
+	tmp = first->options;
+	first->options = second->options;
+	second->options = tmp;
+
+	tmp = first->line;
+	first->line = second->line;
+	second->line = tmp;
+
+	tmp_len = first->line_len;
+	first->line_len = second->line_len;
+	second->line_len = tmp_len;
+
+	mount_table_index_mount_point(table, first);
+}
+
+static void mount_table_append_change(mount_table_entry_t **list, mount_table_entry_t ***tail, mount_table_entry_t *entry)
+{
+	entry->next_changed = NULL;
+
+	if (*tail == NULL)
+	{
+		*tail = list;
+	}
+
+	**tail = entry;
+	*tail = &(entry->next_changed);
+}
+
+int mount_table_update(mount_table_t *table, const char *data, size_t len, mount_table_changes_t *changes)
+{
+	const char *line;
+	const char *line_end;
+	const char *end;
+	mount_table_fields_t fields;
+	mount_table_entry_t *entry;
+	mount_table_entry_t *new_entry;
+	mount_table_entry_t *next;
+	mount_table_entry_t **added_tail = NULL;
+	mount_table_entry_t **modified_tail = NULL;
+	size_t old_count;
+	size_t seen = 0;
+	size_t i;
+	long long mount_id;
+
+	changes->added = NULL;
+	changes->modified = NULL;
+	changes->removed = NULL;
+
+	++(table->generation);
+	old_count = table->count;
+
+	end = data + len;
+
+	for (line = data; line < end; line = line_end + 1)
+	{
+		line_end = (const char*) memchr(line, '\n', end - line);
+		if (line_end == NULL)
+		{
+			line_end = end;
+		}
+
+		if (is_result_failure(mount_table_parse_id(line, line_end, &mount_id)))
+		{
+			continue;
+		}
+
+		entry = mount_table_find_id(table, mount_id);
+		if (entry != NULL)
+		{
+			if (entry->generation == table->generation)
+			{
+				continue;
+			}
+
+			entry->generation = table->generation;
+			++seen;
+
+			/* most of mounts don't change */
+			if ((entry->line_len == (size_t) (line_end - line))
+				&& (memcmp(entry->line, line, entry->line_len) == 0))
+			{
+				continue;
+			}
+		}
+
+		if (is_result_failure(mount_table_parse_fields(line, line_end, &fields)))
+		{
+			continue;
+		}
+
+		new_entry = mount_table_new_entry(mount_id, line, line_end - line, &fields);
+		if (new_entry == NULL)
+		{
+			return result_fatal_error;
+		}
+
+		new_entry->generation = table->generation;
+
+		if ((entry != NULL) && (strcmp(entry->source, new_entry->source) == 0))
+		{
+			mount_table_swap_contents(table, entry, new_entry);
+			mount_table_free_entry(new_entry);
+			mount_table_append_change(&(changes->modified), &modified_tail, entry);
+			continue;
+		}
+
+		if (entry != NULL)
+		{
+			/* mount id got reused for other source, report it as removed and added again */
+			mount_table_unlink(table, entry);
+			entry->next_changed = changes->removed;
+			changes->removed = entry;
+		}
+
+		if (is_result_failure(mount_table_insert(table, new_entry)))
+		{
+			mount_table_free_entry(new_entry);
+			return result_fatal_error;
+		}
+
+		mount_table_append_change(&(changes->added), &added_tail, new_entry);
+	}
+
+	/* there's nothing to look for if all old mounts are still present */
+	if (seen < old_count)
+	{
+		for (i = 0; i < table->index_size; ++i)
+		{
+			for (entry = table->by_id[i]; entry != NULL; entry = next)
+			{
+				next = entry->next_by_id;
+
+				if (entry->generation != table->generation)
+				{
+					mount_table_unlink(table, entry);
+					entry->next_changed = changes->removed;
+					changes->removed = entry;
+				}
+			}
+		}
+	}
+
+	return result_success;
+}
+
+void mount_table_release_changes(mount_table_changes_t *changes)
+{
+	mount_table_entry_t *next;
+
+	while (changes->removed != NULL)
+	{
+		next = changes->removed->next_changed;
+		mount_table_free_entry(changes->removed);
+		changes->removed = next;
+	}
+
+	changes->added = NULL;
+	changes->modified = NULL;
+}
+
+#if (defined SYS_statmount) && (defined SYS_listmount)
+static long mount_table_listmount(uint64_t last_id, uint64_t *ids, size_t count)
+{
+	struct mount_table_mnt_id_req req;
+
+	memset(&req, 0, sizeof(req));
+	req.size   = sizeof(req);
+	req.mnt_id = mount_table_listmount_root;
+	req.param  = last_id;
+
+	return syscall(SYS_listmount, &req, ids, count, 0);
+}
+
+static int mount_table_statmount(mount_table_t *table, uint64_t mount_id, struct mount_table_statmount **result)
+{
+	struct mount_table_mnt_id_req req;
+	void *new_buffer;
+	size_t new_size;
+
+	memset(&req, 0, sizeof(req));
+	req.size   = sizeof(req);
+	req.mnt_id = mount_id;
+	req.param  = mount_table_statmount_request;
+
+	for (;;)
+	{
+		if (table->stat_buffer_size == 0)
+		{
+			table->stat_buffer = malloc(mount_table_statmount_buffer_initial_size);
+			if (table->stat_buffer == NULL)
+			{
+				return result_fatal_error;
+			}
+
+			table->stat_buffer_size = mount_table_statmount_buffer_initial_size;
+		}
+
+		if (syscall(SYS_statmount, &req, table->stat_buffer, table->stat_buffer_size, 0) == 0)
+		{
+			*result = (struct mount_table_statmount*) table->stat_buffer;
+			return result_success;
+		}
+
+		if (errno == EINTR)
+		{
+			continue;
+		}
+
+		if (errno == ENOENT)
+		{
+			// mount is already gone
+			return result_fail;
+		}
+
+		if (errno != EOVERFLOW)
+		{
+			return result_fatal_error;
+		}
+
+		new_size = table->stat_buffer_size * 2;
+
+		new_buffer = realloc(table->stat_buffer, new_size);
+		if (new_buffer == NULL)
+		{
+			return result_fatal_error;
+		}
+
+		table->stat_buffer = new_buffer;
+		table->stat_buffer_size = new_size;
+	}
+}
+
+/* same format as merged options from mountinfo */
+static char* mount_table_kernel_options(const struct mount_table_statmount *sm)
+{
+	char flags[128];
+	const char *fs_options = "";
+	size_t flags_len;
+	size_t fs_options_len;
+	char *result;
+
+	snprintf(flags, sizeof(flags), "%s%s%s%s%s%s%s%s%s%s%s%s",
+		(sm->mnt_attr & mount_table_attr_rdonly) ? "ro" : "rw",
+		(sm->mnt_attr & mount_table_attr_nosuid) ? ",nosuid" : "",
+		(sm->mnt_attr & mount_table_attr_nodev) ? ",nodev" : "",
+		(sm->mnt_attr & mount_table_attr_noexec) ? ",noexec" : "",
+		((sm->mnt_attr & mount_table_attr_atime_mask) == mount_table_attr_noatime) ? ",noatime" : "",
+		(sm->mnt_attr & mount_table_attr_nodiratime) ? ",nodiratime" : "",
+		((sm->mnt_attr & mount_table_attr_atime_mask) == 0) ? ",relatime" : "",
+		(sm->mnt_attr & mount_table_attr_nosymfollow) ? ",nosymfollow" : "",
+		(sm->sb_flags & mount_table_sb_synchronous) ? ",sync" : "",
+		(sm->sb_flags & mount_table_sb_dirsync) ? ",dirsync" : "",
+		(sm->sb_flags & mount_table_sb_mandlock) ? ",mand" : "",
+		(sm->sb_flags & mount_table_sb_lazytime) ? ",lazytime" : "");
+
+	if (sm->mask & mount_table_statmount_mnt_opts)
+	{
+		fs_options = &(sm->str[sm->mnt_opts]);
+	}
+
+	flags_len = strlen(flags);
+	fs_options_len = strlen(fs_options);
+
+	result = (char*) malloc(flags_len + ((fs_options_len > 0) ? (fs_options_len + 1) : 0) + 1);
+	if (result == NULL)
+	{
+		return NULL;
+	}
+
+	memcpy(result, flags, flags_len);
+
+	if (fs_options_len > 0)
+	{
+		result[flags_len] = ',';
+		memcpy(&(result[flags_len + 1]), fs_options, fs_options_len);
+		flags_len += fs_options_len + 1;
+	}
+
+	result[flags_len] = 0;
+
+	return result;
+}
+
+static mount_table_entry_t* mount_table_new_kernel_entry(long long mount_id, const struct mount_table_statmount *sm)
+{
+	mount_table_entry_t *entry;
+
+	entry = (mount_table_entry_t*) malloc(sizeof(mount_table_entry_t));
+	if (entry == NULL)
+	{
+		goto mount_table_new_kernel_entry_error_1;
+	}
+
+	entry->mount_id = mount_id;
+
+	entry->source = strdup((sm->mask & mount_table_statmount_sb_source) ? &(sm->str[sm->sb_source]) : "none");
+	if (entry->source == NULL)
+	{
+		goto mount_table_new_kernel_entry_error_2;
+	}
+
+	entry->mount_point = strdup((sm->mask & mount_table_statmount_mnt_point) ? &(sm->str[sm->mnt_point]) : "");
+	if (entry->mount_point == NULL)
+	{
+		goto mount_table_new_kernel_entry_error_3;
+	}
+
+	entry->options = mount_table_kernel_options(sm);
+	if (entry->options == NULL)
+	{
+		goto mount_table_new_kernel_entry_error_4;
+	}
+
+	entry->line = NULL;
+	entry->line_len = 0;
+
+	entry->generation = 0;
+	entry->is_watched = 0;
+	entry->source_hash = 0;
+	entry->next_by_id = NULL;
+	entry->next_by_source = NULL;
+	entry->mount_point_hash = 0;
+	entry->next_by_mount_point = NULL;
+	entry->next_changed = NULL;
+
+	return entry;
+
+mount_table_new_kernel_entry_error_4:
+	free(entry->mount_point);
+
+mount_table_new_kernel_entry_error_3:
+	free(entry->source);
+
+mount_table_new_kernel_entry_error_2:
+	free(entry);
+
+mount_table_new_kernel_entry_error_1:
+	return NULL;
+}
+
+int mount_table_kernel_supported(void)
+{
+	mount_table_t table;
+	struct mount_table_statmount *sm;
+	uint64_t mount_id;
+	int result = result_fail;
+
+	if (mount_table_listmount(0, &mount_id, 1) != 1)
+	{
+		return result_fail;
+	}
+
+	mount_table_init(&table);
+
+	if (is_result_successful(mount_table_statmount(&table, mount_id, &sm))
+		&& (sm->mask & mount_table_statmount_sb_source))
+	{
+		result = result_success;
+	}
+
+	mount_table_free(&table);
+
+	return result;
+}
+
+int mount_table_update_kernel(mount_table_t *table, mount_table_changes_t *changes)
+{
+	uint64_t ids[mount_table_listmount_batch];
+	uint64_t last_id = 0;
+	struct mount_table_statmount *sm;
+	mount_table_entry_t *entry;
+	mount_table_entry_t *new_entry;
+	mount_table_entry_t *next;
+	mount_table_entry_t **added_tail = NULL;
+	mount_table_entry_t **modified_tail = NULL;
+	size_t old_count;
+	size_t seen = 0;
+	size_t i;
+	long count;
+	int result;
+
+	changes->added = NULL;
+	changes->modified = NULL;
+	changes->removed = NULL;
+
+	++(table->generation);
+	old_count = table->count;
+
+	for (;;)
+	{
+		count = mount_table_listmount(last_id, ids, mount_table_listmount_batch);
+		if (count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return result_fatal_error;
+		}
+
+		for (i = 0; i < (size_t) count; ++i)
+		{
+			entry = mount_table_find_id(table, (long long) ids[i]);
+			if (entry != NULL)
+			{
+				entry->generation = table->generation;
+				++seen;
+
+				// only watched mounts are checked for changes
+				if (!(entry->is_watched))
+				{
+					continue;
+				}
+			}
+
+			result = mount_table_statmount(table, ids[i], &sm);
+			if (is_result_fatal_error(result))
+			{
+				return result;
+			}
+			else if (is_result_failure(result))
+			{
+				if (entry != NULL)
+				{
+					// let it be removed from table
+					--(entry->generation);
+					--seen;
+				}
+
+				continue;
+			}
+
+			new_entry = mount_table_new_kernel_entry((long long) ids[i], sm);
+			if (new_entry == NULL)
+			{
+				return result_fatal_error;
+			}
+
+			new_entry->generation = table->generation;
+
+			if ((entry != NULL) && (strcmp(entry->source, new_entry->source) == 0))
+			{
+				if ((strcmp(entry->mount_point, new_entry->mount_point) != 0)
+					|| (strcmp(entry->options, new_entry->options) != 0))
+				{
+					mount_table_swap_contents(table, entry, new_entry);
+					mount_table_append_change(&(changes->modified), &modified_tail, entry);
+				}
+
+				mount_table_free_entry(new_entry);
+				continue;
+			}
+
+			if (entry != NULL)
+			{
+				mount_table_unlink(table, entry);
+				entry->next_changed = changes->removed;
+				changes->removed = entry;
+			}
+
+			if (is_result_failure(mount_table_insert(table, new_entry)))
+			{
+				mount_table_free_entry(new_entry);
+				return result_fatal_error;
+			}
+
+			mount_table_append_change(&(changes->added), &added_tail, new_entry);
+		}
+
+		if (count < mount_table_listmount_batch)
+		{
+			break;
+		}
+
+		last_id = ids[count - 1];
+	}
+
+	if (seen < old_count)
+	{
+		for (i = 0; i < table->index_size; ++i)
+		{
+			for (entry = table->by_id[i]; entry != NULL; entry = next)
+			{
+				next = entry->next_by_id;
+
+				if (entry->generation != table->generation)
+				{
+					mount_table_unlink(table, entry);
+					entry->next_changed = changes->removed;
+					changes->removed = entry;
+				}
+			}
+		}
+	}
+
+	return result_success;
+}
+#else /* (defined SYS_statmount) && (defined SYS_listmount) */
+int mount_table_kernel_supported(void)
+{
+	return result_fail;
+}
+
+int mount_table_update_kernel(mount_table_t *table, mount_table_changes_t *changes)
+{
+	changes->added = NULL;
+	changes->modified = NULL;
+	changes->removed = NULL;
+
+	return result_fatal_error;
+}
+#endif /* (defined SYS_statmount) && (defined SYS_listmount) */
+
+mount_table_entry_t* mount_table_add_provisional(mount_table_t *table, const char *source, const char *mount_point, const char *options)
+{
+	mount_table_entry_t *entry;
+
+	entry = (mount_table_entry_t*) malloc(sizeof(mount_table_entry_t));
+	if (entry == NULL)
+	{
+		goto mount_table_add_provisional_error_1;
+	}
+
+	entry->source = strdup(source);
+	if (entry->source == NULL)
+	{
+		goto mount_table_add_provisional_error_2;
+	}
+
+	entry->mount_point = strdup(mount_point);
+	if (entry->mount_point == NULL)
+	{
+		goto mount_table_add_provisional_error_3;
+	}
+
+	entry->options = strdup(options);
+	if (entry->options == NULL)
+	{
+		goto mount_table_add_provisional_error_4;
+	}
+
+	entry->mount_id = table->last_provisional_id - 1;
+	entry->line = NULL;
+	entry->line_len = 0;
+
+	/* it's not going to be seen on next update */
+	entry->generation = table->generation;
+	entry->is_watched = 0;
+	entry->source_hash = 0;
+	entry->next_by_id = NULL;
+	entry->next_by_source = NULL;
+	entry->mount_point_hash = 0;
+	entry->next_by_mount_point = NULL;
+	entry->next_changed = NULL;
+
+	if (is_result_failure(mount_table_insert(table, entry)))
+	{
+		goto mount_table_add_provisional_error_5;
+	}
+
+	table->last_provisional_id = entry->mount_id;
+
+	return entry;
+
+mount_table_add_provisional_error_5:
+	free(entry->options);
+
+mount_table_add_provisional_error_4:
+	free(entry->mount_point);
+
+mount_table_add_provisional_error_3:
+	free(entry->source);
+
+mount_table_add_provisional_error_2:
+	free(entry);
+
+mount_table_add_provisional_error_1:
+	return NULL;
+}
+
+void mount_table_remove(mount_table_t *table, long long mount_id)
+{
+	mount_table_entry_t *entry;
+
+	entry = mount_table_find_id(table, mount_id);
+	if (entry != NULL)
+	{
+		mount_table_unlink(table, entry);
+		mount_table_free_entry(entry);
+	}
+}
+
+mount_table_entry_t* mount_table_find_source(const mount_table_t *table, const char *source)
+{
+	mount_table_entry_t *cur;
+	mount_table_entry_t *result = NULL;
+	size_t hash;
+
+	if ((table->index_size == 0) || (source[0] != '/'))
+	{
+		return NULL;
+	}
+
+	hash = mount_table_string_hash(source);
+
+	for (cur = table->by_source[hash & (table->index_size - 1)]; cur != NULL; cur = cur->next_by_source)
+	{
+		if ((cur->source_hash == hash)
+			&& (strcmp(cur->source, source) == 0)
+			&& ((result == NULL) || (cur->mount_id < result->mount_id)))
+		{
+			result = cur;
+		}
+	}
+
+	return result;
+}
+
+mount_table_entry_t* mount_table_find_mount(const mount_table_t *table, const char *source, const char *mount_point)
+{
+	mount_table_entry_t *cur;
+	size_t hash;
+
+	if (table->index_size == 0)
+	{
+		return NULL;
+	}
+
+	hash = mount_table_string_hash(mount_point);
+
+	for (cur = table->by_mount_point[hash & (table->index_size - 1)]; cur != NULL; cur = cur->next_by_mount_point)
+	{
+		if ((cur->mount_point_hash == hash)
+			&& (strcmp(cur->mount_point, mount_point) == 0)
+			&& (strcmp(cur->source, source) == 0))
+		{
+			return cur;
+		}
+	}
+
+	return NULL;
+}
+
+int mount_table_count_mount_point(const mount_table_t *table, const char *mount_point, int max)
+{
+	mount_table_entry_t *cur;
+	size_t hash;
+	int result = 0;
+
+	if (table->index_size == 0)
+	{
+		return 0;
+	}
+
+	hash = mount_table_string_hash(mount_point);
+
+	for (cur = table->by_mount_point[hash & (table->index_size - 1)]; cur != NULL; cur = cur->next_by_mount_point)
+	{
+		if ((cur->mount_point_hash == hash) && (strcmp(cur->mount_point, mount_point) == 0))
+		{
+			++result;
+			if ((max > 0) && (result == max))
+			{
+				break;
+			}
+		}
+	}
+
+	return result;
+}
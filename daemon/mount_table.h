@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DTMD_MOUNT_TABLE_H
+#define DTMD_MOUNT_TABLE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Copy of system mount table keyed by mount id.
+ *
+ * Each update compares new contents of /proc/self/mountinfo with the copy
+ * and reports only mounts which appeared, disappeared or were changed,
+ * so that users of the table don't have to look through all mounts again.
+ *
+ * If kernel supports listmount() and statmount(), table may be updated using them instead.
+ * In that case only list of mount ids is requested from kernel on each update,
+ * and only new mounts and mounts marked as watched are queried for details,
+ * i.e. moving of mount which isn't watched is not noticed.
+ * Mount ids of both sources differ, so table should be updated from one source only.
+ */
+
+typedef struct mount_table_entry
+{
+	long long mount_id;
+
+	char *source;
+	char *mount_point;
+	char *options;      /* mount options followed by superblock options */
+
+	/* original line, used to find out if mount changed */
+	char *line;
+	size_t line_len;
+
+	unsigned int generation;
+
+	/* set by user of table if changes of options or mount point of this mount are needed */
+	int is_watched;
+
+	/* index by mount id */
+	struct mount_table_entry *next_by_id;
+
+	/* index by source, only for sources which are absolute paths */
+	size_t source_hash;
+	struct mount_table_entry *next_by_source;
+
+	/* index by mount point */
+	size_t mount_point_hash;
+	struct mount_table_entry *next_by_mount_point;
+
+	/* list of changes */
+	struct mount_table_entry *next_changed;
+} mount_table_entry_t;
+
+typedef struct mount_table_changes
+{
+	mount_table_entry_t *added;    /* entries which are in table now, in order of appearance */
+	mount_table_entry_t *modified; /* entries which are in table now, mount point or options changed */
+	mount_table_entry_t *removed;  /* entries which are already removed from table */
+} mount_table_changes_t;
+
+typedef struct mount_table
+{
+	mount_table_entry_t **by_id;
+	mount_table_entry_t **by_source;
+	mount_table_entry_t **by_mount_point;
+	size_t index_size;
+	size_t count;
+
+	unsigned int generation;
+
+	/* ids of mounts done by daemon which aren't reported by kernel yet are negative */
+	long long last_provisional_id;
+
+	/* buffer for contents of mountinfo file, reused between reads */
+	char *buffer;
+	size_t buffer_size;
+	size_t buffer_used;
+
+	/* buffer for results of statmount(), reused between calls */
+	void *stat_buffer;
+	size_t stat_buffer_size;
+} mount_table_t;
+
+void mount_table_init(mount_table_t *table);
+void mount_table_free(mount_table_t *table);
+
+/* reads whole file into buffer of table */
+int mount_table_read(mount_table_t *table, int fd);
+
+/* applies contents of mountinfo file to table, changes must be released afterwards */
+int mount_table_update(mount_table_t *table, const char *data, size_t len, mount_table_changes_t *changes);
+void mount_table_release_changes(mount_table_changes_t *changes);
+
+/* returns result_success if listmount() and statmount() provide all needed data */
+int mount_table_kernel_supported(void);
+
+/* applies current mounts reported by listmount() and statmount() to table, changes must be released afterwards */
+int mount_table_update_kernel(mount_table_t *table, mount_table_changes_t *changes);
+
+/*
+ * adds mount done by daemon itself, it's replaced with mount reported by kernel on next update:
+ * provisional entry is reported as removed and real one as added
+ */
+mount_table_entry_t* mount_table_add_provisional(mount_table_t *table, const char *source, const char *mount_point, const char *options);
+
+/* removes mount unmounted by daemon itself */
+void mount_table_remove(mount_table_t *table, long long mount_id);
+
+/* returns mount of source with lowest mount id or NULL */
+mount_table_entry_t* mount_table_find_source(const mount_table_t *table, const char *source);
+
+/* returns mount of source on mount point or NULL */
+mount_table_entry_t* mount_table_find_mount(const mount_table_t *table, const char *source, const char *mount_point);
+
+/* returns number of mounts on mount point, but not more than max if it's positive */
+int mount_table_count_mount_point(const mount_table_t *table, const char *mount_point, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DTMD_MOUNT_TABLE_H */
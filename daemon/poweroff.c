@@ -20,6 +20,7 @@
 
 #include "daemon/poweroff.h"
 
+#include "daemon/mount_jobs.h"
 #include "daemon/return_codes.h"
 #include "daemon/log.h"
 
@@ -241,7 +242,7 @@ static int poweroff_check_if_device_is_not_mounted(dtmd_removable_media_t *media
 {
 	dtmd_removable_media_t *iter_media_ptr;
 
-	if (media_ptr->mnt_point != NULL)
+	if ((media_ptr->mnt_point != NULL) || (mount_jobs_is_device_busy(media_ptr->path)))
 	{
 		return result_fail;
 	}
@@ -263,7 +264,7 @@ int invoke_poweroff(struct client *client_ptr, const char *path, dtmd_error_code
 	dtmd_removable_media_t *media_ptr;
 	dtmd_removable_media_private_t *private_ptr;
 
-	media_ptr = dtmd_find_media(path, removable_media_root);
+	media_ptr = find_media(path);
 	if (media_ptr == NULL)
 	{
 		WRITE_LOG_ARGS(LOG_WARNING, "Failed to poweroff device '%s': device does not exist", path);
@@ -58,7 +58,9 @@ typedef enum dtmd_device_action_type
 	dtmd_device_action_online,
 	dtmd_device_action_remove,
 	dtmd_device_action_offline,
-	dtmd_device_action_change
+	dtmd_device_action_change,
+	dtmd_device_action_resync, /* some events were lost and all devices have to be read again, device is NULL */
+	dtmd_device_action_announce /* device is added, its fstype and label are reported by following change */
 } dtmd_device_action_type_t;
 
 typedef struct dtmd_device_system      dtmd_device_system_t;
@@ -79,7 +81,12 @@ void device_system_stop_monitoring(dtmd_device_monitor_t *monitor);
 
 int device_system_get_monitor_fd(dtmd_device_monitor_t *monitor);
 
+/*
+ * returns result_success and device, result_fail if there's no device and result_fatal_error on failure.
+ * After monitor fd becomes readable, devices should be taken while device_system_monitor_has_device() returns nonzero.
+ */
 int device_system_monitor_get_device(dtmd_device_monitor_t *monitor, dtmd_info_t **device, dtmd_device_action_type_t *action);
+int device_system_monitor_has_device(dtmd_device_monitor_t *monitor);
 void device_system_monitor_free_device(dtmd_device_monitor_t *monitor, dtmd_info_t *device);
 
 #ifdef __cplusplus
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "library/dt-parse-helpers.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+
+#define dt_helper_arena_initial_size 256
+
+void dt_helper_arena_init(dt_helper_arena_t *arena)
+{
+	arena->blocks     = NULL;
+	arena->total_size = 0;
+}
+
+char** dt_helper_arena_alloc(dt_helper_arena_t *arena, size_t count)
+{
+	dt_helper_arena_block_t *block;
+	char **result;
+	size_t size;
+
+	block = arena->blocks;
+
+	if ((block == NULL) || (block->size - block->used < count))
+	{
+		// previous blocks are kept since their contents are still in use
+		size = (arena->total_size > 0) ? arena->total_size : dt_helper_arena_initial_size;
+
+		while (size < count)
+		{
+			size *= 2;
+		}
+
+		block = (dt_helper_arena_block_t*) malloc(sizeof(dt_helper_arena_block_t) + size * sizeof(char*));
+		if (block == NULL)
+		{
+			return NULL;
+		}
+
+		block->next_block = arena->blocks;
+		block->size       = size;
+		block->used       = 0;
+
+		arena->blocks = block;
+		arena->total_size += size;
+	}
+
+	result = &(block->slots[block->used]);
+	block->used += count;
+
+	return result;
+}
+
+void dt_helper_arena_reset(dt_helper_arena_t *arena)
+{
+	dt_helper_arena_block_t *block;
+	size_t total_size;
+
+	if (arena->blocks == NULL)
+	{
+		return;
+	}
+
+	if (arena->blocks->next_block != NULL)
+	{
+		// batch didn't fit into one block, replace all of them with a single block large enough for it
+		total_size = arena->total_size;
+		dt_helper_arena_free(arena);
+
+		block = (dt_helper_arena_block_t*) malloc(sizeof(dt_helper_arena_block_t) + total_size * sizeof(char*));
+		if (block != NULL)
+		{
+			block->next_block = NULL;
+			block->size       = total_size;
+			block->used       = 0;
+
+			arena->blocks     = block;
+			arena->total_size = total_size;
+		}
+
+		return;
+	}
+
+	arena->blocks->used = 0;
+}
+
+void dt_helper_arena_free(dt_helper_arena_t *arena)
+{
+	dt_helper_arena_block_t *block;
+
+	while (arena->blocks != NULL)
+	{
+		block = arena->blocks;
+		arena->blocks = block->next_block;
+		free(block);
+	}
+
+	arena->total_size = 0;
+}
+
+/*
+ * Format of command is: name(length data, length data)
+ * where length is -1 for NULL argument, for empty argument data and space before it are omitted.
+ * If name is NULL, line is only validated and arguments are counted, otherwise it's split in place.
+ */
+static int dt_helper_parse_command_implementation(char *line, char *eol, size_t *count, char **name, char **args)
+{
+	char *cur = line;
+	char *arg;
+	size_t length;
+	size_t args_count = 0;
+	int is_negative;
+	char separator;
+
+	while ((cur < eol) && ((isalnum((unsigned char) *cur)) || (*cur == '_')))
+	{
+		++cur;
+	}
+
+	if ((cur == line) || (*cur != '('))
+	{
+		return 0;
+	}
+
+	if (name != NULL)
+	{
+		*cur = 0;
+		*name = line;
+	}
+
+	++cur;
+
+	if (*cur != ')')
+	{
+		for (;;)
+		{
+			is_negative = (*cur == '-');
+			if (is_negative)
+			{
+				++cur;
+			}
+
+			if (!isdigit((unsigned char) *cur))
+			{
+				return 0;
+			}
+
+			length = 0;
+
+			while (isdigit((unsigned char) *cur))
+			{
+				// no valid argument is longer than line itself
+				if (length > (size_t) (eol - line))
+				{
+					return 0;
+				}
+
+				length = length * 10 + (*cur - '0');
+				++cur;
+			}
+
+			if (is_negative)
+			{
+				if (length != 1)
+				{
+					return 0;
+				}
+
+				arg = NULL;
+			}
+			else if (length == 0)
+			{
+				// last digit is replaced with terminator, thus empty argument still points inside of line
+				arg = cur - 1;
+			}
+			else
+			{
+				if ((*cur != ' ') || (length > (size_t) (eol - cur - 1)))
+				{
+					return 0;
+				}
+
+				arg = cur + 1;
+				cur = arg + length;
+			}
+
+			separator = *cur;
+
+			if ((separator != ')') && ((separator != ',') || (cur[1] != ' ')))
+			{
+				return 0;
+			}
+
+			if (name != NULL)
+			{
+				args[args_count] = arg;
+
+				if (arg != NULL)
+				{
+					arg[length] = 0;
+				}
+			}
+
+			++args_count;
+
+			if (separator == ')')
+			{
+				break;
+			}
+
+			cur += 2;
+		}
+	}
+
+	if (cur + 1 != eol)
+	{
+		return 0;
+	}
+
+	*count = args_count;
+
+	return 1;
+}
+
+int dt_helper_parse_command_in_place(char *line, char *eol, dt_helper_arena_t *arena, dt_command_t *cmd)
+{
+	size_t count;
+	char *name;
+	char **args = NULL;
+
+	if (!dt_helper_parse_command_implementation(line, eol, &count, NULL, NULL))
+	{
+		return 0;
+	}
+
+	if (count > 0)
+	{
+		args = dt_helper_arena_alloc(arena, count);
+		if (args == NULL)
+		{
+			return -1;
+		}
+	}
+
+	dt_helper_parse_command_implementation(line, eol, &count, &name, args);
+
+	cmd->cmd        = name;
+	cmd->args_count = count;
+	cmd->args       = args;
+
+	return 1;
+}
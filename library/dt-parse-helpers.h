@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DTMD_PARSE_HELPERS_H
+#define DTMD_PARSE_HELPERS_H
+
+#include <dt-command.h>
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Commands received by library are parsed in place: command name and arguments
+ * are terminated inside of input buffer and dt_command_t only points to them,
+ * thus it remains valid only until buffer is reused.
+ *
+ * Arrays of arguments are taken from arena, which is reset once all commands
+ * of received batch are processed. Arena grows to fit the largest batch
+ * and doesn't allocate memory after that.
+ */
+
+typedef struct dt_helper_arena_block
+{
+	struct dt_helper_arena_block *next_block;
+	size_t size;
+	size_t used;
+	char *slots[];
+} dt_helper_arena_block_t;
+
+typedef struct dt_helper_arena
+{
+	dt_helper_arena_block_t *blocks; /* block allocations are taken from is first */
+	size_t total_size;
+} dt_helper_arena_t;
+
+void dt_helper_arena_init(dt_helper_arena_t *arena);
+char** dt_helper_arena_alloc(dt_helper_arena_t *arena, size_t count);
+void dt_helper_arena_reset(dt_helper_arena_t *arena);
+void dt_helper_arena_free(dt_helper_arena_t *arena);
+
+/*
+ * Parses line from 'line' up to 'eol', which points to terminating '\n'.
+ * Returns 1 on success and 0 if line isn't valid command, or -1 on memory allocation failure.
+ * On failure line may be partially modified.
+ */
+int dt_helper_parse_command_in_place(char *line, char *eol, dt_helper_arena_t *arena, dt_command_t *cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DTMD_PARSE_HELPERS_H */
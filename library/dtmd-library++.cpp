@@ -266,12 +266,17 @@ dtmd_removable_media_type_t removable_media::getValidType() const
 }
 
 library::library(callback cb, state_callback state_cb, void *arg)
+	: library(cb, state_cb, arg, 0)
+{
+}
+
+library::library(callback cb, state_callback state_cb, void *arg, unsigned int flags)
 	: m_handle(NULL),
 	m_cb(cb),
 	m_state_cb(state_cb),
 	m_arg(arg)
 {
-	m_handle = dtmd_init(&library::local_callback, &library::local_state_callback, this, NULL);
+	m_handle = dtmd_init_with_flags(&library::local_callback, &library::local_state_callback, this, flags, NULL);
 	if (m_handle == NULL)
 	{
 		throw std::runtime_error("Couldn't initialize dtmd library");
@@ -294,23 +299,8 @@ dtmd_result_t library::list_all_removable_devices(int timeout, removable_media_c
 	result = dtmd_list_all_removable_devices(this->m_handle, timeout, &returned_removable_device);
 	if (result == dtmd_ok)
 	{
-		try
-		{
-			removable_devices_list.clear();
-
-			for (dtmd_removable_media_t *removable_devices_iter = returned_removable_device; removable_devices_iter != NULL; removable_devices_iter = removable_devices_iter->next_node)
-			{
-				auto item = removable_media::createFromRemovableMedia(removable_devices_iter);
-				removable_devices_list.insert(item);
-			}
-
-			dtmd_free_removable_devices(this->m_handle, returned_removable_device);
-		}
-		catch (...)
-		{
-			dtmd_free_removable_devices(this->m_handle, returned_removable_device);
-			throw;
-		}
+		removable_devices_list.clear();
+		fill_removable_media_container(this->m_handle, returned_removable_device, removable_devices_list);
 	}
 
 	return result;
@@ -324,23 +314,8 @@ dtmd_result_t library::list_removable_device(int timeout, const std::string &rem
 	result = dtmd_list_removable_device(this->m_handle, timeout, removable_device_path.c_str(), &returned_removable_device);
 	if (result == dtmd_ok)
 	{
-		try
-		{
-			removable_devices_list.clear();
-
-			for (dtmd_removable_media_t *removable_devices_iter = returned_removable_device; removable_devices_iter != NULL; removable_devices_iter = removable_devices_iter->next_node)
-			{
-				auto item = removable_media::createFromRemovableMedia(removable_devices_iter);
-				removable_devices_list.insert(item);
-			}
-
-			dtmd_free_removable_devices(this->m_handle, returned_removable_device);
-		}
-		catch (...)
-		{
-			dtmd_free_removable_devices(this->m_handle, returned_removable_device);
-			throw;
-		}
+		removable_devices_list.clear();
+		fill_removable_media_container(this->m_handle, returned_removable_device, removable_devices_list);
 	}
 
 	return result;
@@ -370,28 +345,7 @@ dtmd_result_t library::list_supported_filesystems(int timeout, std::vector<std::
 	result = dtmd_list_supported_filesystems(this->m_handle, timeout, &supported_filesystems_count, &supported_filesystems_array);
 	if (result == dtmd_ok)
 	{
-		try
-		{
-			if (supported_filesystems_array != NULL)
-			{
-				supported_filesystems_list.reserve(supported_filesystems_count);
-
-				for (size_t i = 0; i < supported_filesystems_count; ++i)
-				{
-					if (supported_filesystems_array[i] != NULL)
-					{
-						supported_filesystems_list.push_back(std::string(supported_filesystems_array[i]));
-					}
-				}
-			}
-
-			dtmd_free_supported_filesystems_list(this->m_handle, supported_filesystems_count, supported_filesystems_array);
-		}
-		catch (...)
-		{
-			dtmd_free_supported_filesystems_list(this->m_handle, supported_filesystems_count, supported_filesystems_array);
-			throw;
-		}
+		fill_string_list(this->m_handle, supported_filesystems_count, supported_filesystems_array, &dtmd_free_supported_filesystems_list, supported_filesystems_list);
 	}
 
 	return result;
@@ -406,28 +360,7 @@ dtmd_result_t library::list_supported_filesystem_options(int timeout, const std:
 	result = dtmd_list_supported_filesystem_options(this->m_handle, timeout, filesystem.c_str(), &supported_filesystem_options_count, &supported_filesystem_options_array);
 	if (result == dtmd_ok)
 	{
-		try
-		{
-			if (supported_filesystem_options_array != NULL)
-			{
-				supported_filesystem_options_list.reserve(supported_filesystem_options_count);
-
-				for (size_t i = 0; i < supported_filesystem_options_count; ++i)
-				{
-					if (supported_filesystem_options_array[i] != NULL)
-					{
-						supported_filesystem_options_list.push_back(std::string(supported_filesystem_options_array[i]));
-					}
-				}
-			}
-
-			dtmd_free_supported_filesystem_options_list(this->m_handle, supported_filesystem_options_count, supported_filesystem_options_array);
-		}
-		catch (...)
-		{
-			dtmd_free_supported_filesystem_options_list(this->m_handle, supported_filesystem_options_count, supported_filesystem_options_array);
-			throw;
-		}
+		fill_string_list(this->m_handle, supported_filesystem_options_count, supported_filesystem_options_array, &dtmd_free_supported_filesystem_options_list, supported_filesystem_options_list);
 	}
 
 	return result;
@@ -440,6 +373,79 @@ dtmd_result_t library::poweroff(int timeout, const std::string &removable_device
 }
 #endif /* (defined OS_Linux) */
 
+std::future<removable_media_result> library::list_all_removable_devices_async(int timeout)
+{
+	return submit_async_request<removable_media_result>([this, timeout](void *arg) {
+		return dtmd_list_all_removable_devices_async(this->m_handle, timeout, &library::local_removable_devices_completion_callback, arg);
+	});
+}
+
+std::future<removable_media_result> library::list_removable_device_async(int timeout, const std::string &removable_device_path)
+{
+	return submit_async_request<removable_media_result>([this, timeout, &removable_device_path](void *arg) {
+		return dtmd_list_removable_device_async(this->m_handle, timeout, removable_device_path.c_str(), &library::local_removable_devices_completion_callback, arg);
+	});
+}
+
+std::future<operation_result> library::mount_async(int timeout, const std::string &path)
+{
+	return submit_async_request<operation_result>([this, timeout, &path](void *arg) {
+		return dtmd_mount_async(this->m_handle, timeout, path.c_str(), NULL, &library::local_completion_callback, arg);
+	});
+}
+
+std::future<operation_result> library::mount_async(int timeout, const std::string &path, const std::string &mount_options)
+{
+	return submit_async_request<operation_result>([this, timeout, &path, &mount_options](void *arg) {
+		return dtmd_mount_async(this->m_handle, timeout, path.c_str(), mount_options.c_str(), &library::local_completion_callback, arg);
+	});
+}
+
+std::future<operation_result> library::unmount_async(int timeout, const std::string &path)
+{
+	return submit_async_request<operation_result>([this, timeout, &path](void *arg) {
+		return dtmd_unmount_async(this->m_handle, timeout, path.c_str(), &library::local_completion_callback, arg);
+	});
+}
+
+std::future<string_list_result> library::list_supported_filesystems_async(int timeout)
+{
+	return submit_async_request<string_list_result>([this, timeout](void *arg) {
+		return dtmd_list_supported_filesystems_async(this->m_handle, timeout, &library::local_supported_filesystems_completion_callback, arg);
+	});
+}
+
+std::future<string_list_result> library::list_supported_filesystem_options_async(int timeout, const std::string &filesystem)
+{
+	return submit_async_request<string_list_result>([this, timeout, &filesystem](void *arg) {
+		return dtmd_list_supported_filesystem_options_async(this->m_handle, timeout, filesystem.c_str(), &library::local_supported_filesystem_options_completion_callback, arg);
+	});
+}
+
+#if (defined OS_Linux)
+std::future<operation_result> library::poweroff_async(int timeout, const std::string &removable_device_path)
+{
+	return submit_async_request<operation_result>([this, timeout, &removable_device_path](void *arg) {
+		return dtmd_poweroff_async(this->m_handle, timeout, removable_device_path.c_str(), &library::local_completion_callback, arg);
+	});
+}
+#endif /* (defined OS_Linux) */
+
+dtmd_result_t library::process_events(int max_events)
+{
+	return dtmd_process_events(this->m_handle, max_events);
+}
+
+int library::getEventFd() const
+{
+	return dtmd_get_event_fd(this->m_handle);
+}
+
+int library::getEventTimeout() const
+{
+	return dtmd_get_event_timeout(this->m_handle);
+}
+
 dtmd_result_t library::fill_removable_device_from_notification(const command &cmd, std::shared_ptr<removable_media> &removable_device) const
 {
 	dtmd_result_t result;
@@ -484,6 +490,11 @@ bool library::isStateInvalid() const
 	return dtmd_is_state_invalid(this->m_handle);
 }
 
+bool library::isDeviceMirrorSynchronized() const
+{
+	return dtmd_is_device_mirror_synchronized(this->m_handle);
+}
+
 bool library::isNotificationValidRemovableDevice(const command &cmd) const
 {
 	dt_command_t reconstructed_command;
@@ -555,6 +566,134 @@ void library::local_state_callback(dtmd_t *library_ptr, void *arg, dtmd_state_t
 	}
 }
 
+template <typename T>
+std::future<T> library::submit_async_request(const std::function<dtmd_result_t (void *arg)> &submit_function)
+{
+	std::unique_ptr<std::promise<T> > promise(new std::promise<T>());
+	std::future<T> future = promise->get_future();
+
+	dtmd_result_t result = submit_function(promise.get());
+	if (result == dtmd_ok)
+	{
+		// completion callback owns promise now
+		promise.release();
+	}
+	else
+	{
+		T value;
+		value.result = result;
+		value.error_code = dtmd_error_code_unknown;
+		promise->set_value(std::move(value));
+	}
+
+	return future;
+}
+
+void library::fill_removable_media_container(dtmd_t *library_ptr, dtmd_removable_media_t *raw_removable_devices, removable_media_container &removable_devices_list)
+{
+	try
+	{
+		for (dtmd_removable_media_t *removable_devices_iter = raw_removable_devices; removable_devices_iter != NULL; removable_devices_iter = removable_devices_iter->next_node)
+		{
+			auto item = removable_media::createFromRemovableMedia(removable_devices_iter);
+			removable_devices_list.insert(item);
+		}
+
+		dtmd_free_removable_devices(library_ptr, raw_removable_devices);
+	}
+	catch (...)
+	{
+		dtmd_free_removable_devices(library_ptr, raw_removable_devices);
+		throw;
+	}
+}
+
+void library::fill_string_list(dtmd_t *library_ptr, size_t raw_list_count, const char **raw_list, void (*free_function)(dtmd_t*, size_t, const char**), std::vector<std::string> &string_list)
+{
+	try
+	{
+		if (raw_list != NULL)
+		{
+			string_list.reserve(raw_list_count);
+
+			for (size_t i = 0; i < raw_list_count; ++i)
+			{
+				if (raw_list[i] != NULL)
+				{
+					string_list.push_back(std::string(raw_list[i]));
+				}
+			}
+		}
+
+		free_function(library_ptr, raw_list_count, raw_list);
+	}
+	catch (...)
+	{
+		free_function(library_ptr, raw_list_count, raw_list);
+		throw;
+	}
+}
+
+void library::local_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code)
+{
+	std::unique_ptr<std::promise<operation_result> > promise((std::promise<operation_result>*) arg);
+	operation_result value;
+
+	value.result = result;
+	value.error_code = error_code;
+	promise->set_value(value);
+}
+
+void library::local_removable_devices_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, dtmd_removable_media_t *result_list)
+{
+	std::unique_ptr<std::promise<removable_media_result> > promise((std::promise<removable_media_result>*) arg);
+
+	try
+	{
+		removable_media_result value;
+
+		value.result = result;
+		value.error_code = error_code;
+		fill_removable_media_container(library_ptr, result_list, value.removable_devices_list);
+
+		promise->set_value(std::move(value));
+	}
+	catch (...)
+	{
+		promise->set_exception(std::current_exception());
+	}
+}
+
+void library::local_supported_filesystems_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, size_t result_count, const char **result_list)
+{
+	local_string_list_completion_callback(library_ptr, arg, result, error_code, result_count, result_list, &dtmd_free_supported_filesystems_list);
+}
+
+void library::local_supported_filesystem_options_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, size_t result_count, const char **result_list)
+{
+	local_string_list_completion_callback(library_ptr, arg, result, error_code, result_count, result_list, &dtmd_free_supported_filesystem_options_list);
+}
+
+void library::local_string_list_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, size_t result_count, const char **result_list, void (*free_function)(dtmd_t*, size_t, const char**))
+{
+	std::unique_ptr<std::promise<string_list_result> > promise((std::promise<string_list_result>*) arg);
+
+	try
+	{
+		string_list_result value;
+
+		value.result = result;
+		value.error_code = error_code;
+		fill_string_list(library_ptr, result_count, result_list, free_function, value.string_list);
+
+		promise->set_value(std::move(value));
+	}
+	catch (...)
+	{
+		promise->set_exception(std::current_exception());
+	}
+}
+
 std::shared_ptr<removable_media> find_removable_media(const std::string &path, const removable_media_container &root)
 {
 	std::shared_ptr<removable_media> result;
@@ -29,6 +29,8 @@
 #include <vector>
 #include <set>
 #include <memory>
+#include <future>
+#include <functional>
 
 namespace dtmd {
 
@@ -135,6 +137,23 @@ private:
 	removable_media& operator=(const removable_media &other) = delete;
 };
 
+// results of asynchronous requests
+struct operation_result
+{
+	dtmd_result_t result;
+	dtmd_error_code_t error_code;
+};
+
+struct removable_media_result: public operation_result
+{
+	removable_media_container removable_devices_list;
+};
+
+struct string_list_result: public operation_result
+{
+	std::vector<std::string> string_list;
+};
+
 class library;
 
 typedef void (*callback)(const library &library_instance, void *arg, const command &cmd);
@@ -144,6 +163,7 @@ class library
 {
 public:
 	library(callback cb, state_callback state_cb, void *arg);
+	library(callback cb, state_callback state_cb, void *arg, unsigned int flags);
 	virtual ~library();
 
 	dtmd_result_t list_all_removable_devices(int timeout, removable_media_container &removable_devices_list);
@@ -158,9 +178,29 @@ public:
 	dtmd_result_t poweroff(int timeout, const std::string &removable_device_path);
 #endif /* (defined OS_Linux) */
 
+	// Asynchronous requests need library to be created with dtmd_init_flag_pipelined.
+	// Futures are fulfilled from library's worker thread or from thread processing events, thus waiting for them from callbacks would block forever
+	std::future<removable_media_result> list_all_removable_devices_async(int timeout);
+	std::future<removable_media_result> list_removable_device_async(int timeout, const std::string &removable_device_path);
+	std::future<operation_result> mount_async(int timeout, const std::string &path);
+	std::future<operation_result> mount_async(int timeout, const std::string &path, const std::string &mount_options);
+	std::future<operation_result> unmount_async(int timeout, const std::string &path);
+	std::future<string_list_result> list_supported_filesystems_async(int timeout);
+	std::future<string_list_result> list_supported_filesystem_options_async(int timeout, const std::string &filesystem);
+
+#if (defined OS_Linux)
+	std::future<operation_result> poweroff_async(int timeout, const std::string &removable_device_path);
+#endif /* (defined OS_Linux) */
+
+	// Event processing needs library to be created with dtmd_init_flag_event_loop
+	dtmd_result_t process_events(int max_events);
+	int getEventFd() const;
+	int getEventTimeout() const;
+
 	dtmd_result_t fill_removable_device_from_notification(const command &cmd, std::shared_ptr<removable_media> &removable_device) const;
 
 	bool isStateInvalid() const;
+	bool isDeviceMirrorSynchronized() const;
 	bool isNotificationValidRemovableDevice(const command &cmd) const;
 	dtmd_error_code_t getCodeOfCommandFail() const;
 
@@ -173,6 +213,18 @@ private:
 	static void local_callback(dtmd_t *library_ptr, void *arg, const dt_command_t *cmd);
 	static void local_state_callback(dtmd_t *library_ptr, void *arg, dtmd_state_t state);
 
+	template <typename T>
+	static std::future<T> submit_async_request(const std::function<dtmd_result_t (void *arg)> &submit_function);
+
+	static void fill_removable_media_container(dtmd_t *library_ptr, dtmd_removable_media_t *raw_removable_devices, removable_media_container &removable_devices_list);
+	static void fill_string_list(dtmd_t *library_ptr, size_t raw_list_count, const char **raw_list, void (*free_function)(dtmd_t*, size_t, const char**), std::vector<std::string> &string_list);
+
+	static void local_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code);
+	static void local_removable_devices_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, dtmd_removable_media_t *result_list);
+	static void local_supported_filesystems_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, size_t result_count, const char **result_list);
+	static void local_supported_filesystem_options_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, size_t result_count, const char **result_list);
+	static void local_string_list_completion_callback(dtmd_t *library_ptr, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, size_t result_count, const char **result_list, void (*free_function)(dtmd_t*, size_t, const char**));
+
 	dtmd_t *m_handle;
 	callback m_cb;
 	state_callback m_state_cb;
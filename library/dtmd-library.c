@@ -25,6 +25,7 @@
 #include <dtmd-library.h>
 
 #include "library/dt-print-helpers.h"
+#include "library/dt-parse-helpers.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -35,10 +36,12 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <limits.h>
 
 #if (defined OS_Linux)
 #include <sys/inotify.h>
-#include <limits.h>
+#include <sys/epoll.h>
 #endif /* (defined OS_Linux) */
 
 #if (defined OS_FreeBSD)
@@ -58,6 +61,8 @@
 
 #define dtmd_removable_media_internal_state_fields_are_linked  (1<<0)
 
+#define dtmd_mirror_index_initial_size 64
+
 typedef enum dtmd_library_state
 {
 	dtmd_state_default,
@@ -67,11 +72,27 @@ typedef enum dtmd_library_state
 	dtmd_state_in_list_supported_filesystem_options
 } dtmd_library_state_t;
 
+typedef enum dtmd_protocol_state
+{
+	dtmd_protocol_disconnected,
+	dtmd_protocol_negotiating,
+	dtmd_protocol_untagged,
+	dtmd_protocol_tagged,
+	dtmd_protocol_failed
+} dtmd_protocol_state_t;
+
+typedef enum dtmd_helper_events_result
+{
+	dtmd_helper_events_processed,
+	dtmd_helper_events_none,
+	dtmd_helper_events_exit,
+	dtmd_helper_events_error
+} dtmd_helper_events_result_t;
+
 typedef enum dtmd_internal_fill_type
 {
 	dtmd_internal_fill_copy = 0,
-	dtmd_internal_fill_link = 1,
-	dtmd_internal_fill_move = 2
+	dtmd_internal_fill_link = 1
 } dtmd_internal_fill_type_t;
 
 struct dtmd_library
@@ -79,6 +100,7 @@ struct dtmd_library
 	dtmd_callback_t callback;
 	dtmd_state_callback_t state_callback;
 	void *callback_arg;
+	unsigned int flags;
 	pthread_t worker;
 	int pipes[2];
 	int feedback[2];
@@ -95,8 +117,61 @@ struct dtmd_library
 
 	sem_t caller_socket;
 
+	/*
+	 * In pipelined mode socket is owned by worker, callers only queue requests for sending.
+	 * Daemon stops reading requests while client doesn't read responses,
+	 * thus nobody ever blocks on writing to socket: whatever isn't sent immediately is sent by worker later.
+	 * Worker passes responses to waiting requests and calls completion callbacks of asynchronous ones.
+	 * Following fields are protected by requests_mutex.
+	 */
+	pthread_mutex_t requests_mutex;
+	pthread_cond_t requests_cond;
+	dtmd_protocol_state_t protocol_state;
+	int is_request_ids_supported;
+	int is_worker_woken;
+	unsigned long long last_request_id;
+	struct dtmd_helper_request *requests;
+	struct dtmd_helper_request *current_request; /* request which list is being received */
+	struct dtmd_helper_request *pending_requests_first; /* requests waiting for being sent */
+	struct dtmd_helper_request *pending_requests_last;
+	struct dtmd_helper_request *completed_requests; /* asynchronous requests waiting for completion callback */
+	char *output_buffer;
+	size_t output_buffer_size;
+	size_t output_buffer_used;
+
+	/*
+	 * Device mirror is seeded by worker with list_all_removable_devices request after connecting
+	 * and then kept current from notifications. Devices are indexed by path.
+	 * Following fields are protected by mirror_mutex, which may be locked while holding requests_mutex, but not the other way around.
+	 */
+	pthread_mutex_t mirror_mutex;
+	int is_mirror_synchronized;
+	dtmd_removable_media_t *mirror_root;
+	dtmd_removable_media_t **mirror_index; /* open addressing with linear probing */
+	size_t mirror_index_size;
+	size_t mirror_index_count;
+	int is_mirror_seed_required; /* used only by worker */
+
+	/*
+	 * In event loop mode there's no worker, instead events are processed by thread which holds events_mutex:
+	 * either by application calling dtmd_process_events or by caller waiting for synchronous request.
+	 * Since application shouldn't block in dtmd_process_events, events_mutex is only tried and never waited for.
+	 * It's tried while holding requests_mutex, and it's released while holding requests_mutex,
+	 * thus callers waiting for requests_cond don't miss the moment when they may process events themselves.
+	 */
+	pthread_mutex_t events_mutex;
+	int event_fd; /* epoll or kqueue watching for pipe, watch_fd and socket, or -1 */
+	int event_socket_fd; /* socket added to event_fd, or -1 */
+	int is_event_socket_writable; /* whether event_fd watches socket for being writable */
+
+	/*
+	 * Received lines are parsed in place and dropped from buffer only before next read,
+	 * so that remainder of data is moved once per read instead of once per line.
+	 */
+	size_t buffer_start; /* start of first unprocessed line */
 	size_t cur_pos;
 	char buffer[dtmd_command_max_length + 1];
+	dt_helper_arena_t arena; /* arguments of parsed commands */
 
 #if (defined OS_Linux)
 	size_t inotify_buffer_used;
@@ -111,6 +186,39 @@ typedef enum dtmd_helper_result
 	dtmd_helper_result_error
 } dtmd_helper_result_t;
 
+typedef struct dtmd_helper_request dtmd_helper_request_t;
+
+typedef int (*dtmd_helper_dprintf_func_t)(dtmd_t *handle, dtmd_helper_request_t *request, void *args);
+typedef dtmd_helper_result_t (*dtmd_helper_process_func_t)(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state);
+typedef int (*dtmd_helper_exit_func_t)(dtmd_t *handle, dtmd_helper_request_t *request, void *state);
+typedef void (*dtmd_helper_exit_clear_func_t)(void *state);
+typedef void (*dtmd_helper_complete_func_t)(dtmd_t *handle, dtmd_helper_request_t *request);
+
+struct dtmd_helper_request
+{
+	dtmd_result_t result_state;
+	dtmd_error_code_t error_code;
+
+	/* following fields are used only in pipelined mode */
+	unsigned long long id; /* zero for untagged request */
+	void *params;
+	void *state;
+	dtmd_helper_dprintf_func_t dprintf_func;
+	dtmd_helper_process_func_t process_func;
+	dtmd_helper_exit_func_t exit_func;
+	dtmd_helper_exit_clear_func_t exit_clear_func;
+	int is_pending;
+	int is_finished;
+
+	/* following fields are used only for asynchronous requests */
+	dtmd_helper_complete_func_t complete_func;
+	int has_timeout;
+	struct timespec time_end;
+
+	struct dtmd_helper_request *next_node;
+	struct dtmd_helper_request *prev_node;
+};
+
 typedef struct dtmd_helper_params_list_removable_device
 {
 	const char *device_path;
@@ -168,6 +276,41 @@ typedef struct dtmd_helper_state_list_supported_filesystem_options
 	const char **result_list;
 } dtmd_helper_state_list_supported_filesystem_options_t;
 
+/* asynchronous request owns its parameters and state */
+typedef struct dtmd_helper_async_request
+{
+	dtmd_helper_request_t request;
+
+	union
+	{
+		dtmd_helper_params_list_removable_device_t list_removable_device;
+		dtmd_helper_params_mount_t mount;
+		dtmd_helper_params_unmount_t unmount;
+		dtmd_helper_params_list_supported_filesystem_options_t list_supported_filesystem_options;
+#if (defined OS_Linux)
+		dtmd_helper_params_poweroff_t poweroff;
+#endif /* (defined OS_Linux) */
+	} params;
+
+	union
+	{
+		dtmd_helper_state_list_all_removable_devices_t list_all_removable_devices;
+		dtmd_helper_state_list_removable_device_t list_removable_device;
+		dtmd_helper_state_list_supported_filesystems_t list_supported_filesystems;
+		dtmd_helper_state_list_supported_filesystem_options_t list_supported_filesystem_options;
+	} state;
+
+	union
+	{
+		dtmd_completion_callback_t generic;
+		dtmd_removable_devices_completion_callback_t removable_devices;
+		dtmd_string_list_completion_callback_t string_list;
+	} callback;
+
+	void *arg;
+	char strings[]; /* storage for string parameters */
+} dtmd_helper_async_request_t;
+
 #if (defined OS_FreeBSD)
 int expected_nanosleep(int microseconds)
 {
@@ -197,6 +340,15 @@ int expected_nanosleep(int microseconds)
 #endif /* (defined OS_FreeBSD) */
 
 static void* dtmd_worker_function(void *arg);
+static int dtmd_helper_prepare_events(dtmd_t *handle, int *is_output_pending);
+static dtmd_helper_events_result_t dtmd_helper_process_commands(dtmd_t *handle);
+static dtmd_helper_events_result_t dtmd_helper_process_next_event(dtmd_t *handle, int timeout);
+static void dtmd_helper_finish_events(dtmd_t *handle);
+static void dtmd_helper_fail_events(dtmd_t *handle);
+static int dtmd_helper_create_event_fd(dtmd_t *handle);
+static int dtmd_helper_update_event_fd(dtmd_t *handle);
+static int dtmd_helper_release_events(dtmd_t *handle);
+static dtmd_result_t dtmd_helper_wait_processing_events(dtmd_t *handle, int timeout, const struct timespec *time_end);
 
 static int dtmd_helper_fill_data(char **where, char **from, dtmd_internal_fill_type_t internal_fill_type);
 static dtmd_result_t dtmd_fill_removable_device_from_notification_implementation(dtmd_t *handle, dt_command_t *cmd, dtmd_internal_fill_type_t internal_fill_type, dtmd_removable_media_t **result);
@@ -255,54 +407,109 @@ static void dtmd_helper_free_supported_filesystem_options(size_t supported_files
 
 static dtmd_result_t dtmd_helper_capture_socket(dtmd_t *handle, int timeout, struct timespec *time_cur, struct timespec *time_end);
 static dtmd_result_t dtmd_helper_read_data(dtmd_t *handle, int timeout, struct timespec *time_cur, struct timespec *time_end);
-
-static int dtmd_helper_dprintf_list_all_removable_devices(dtmd_t *handle, void *args);
-static int dtmd_helper_dprintf_list_removable_device(dtmd_t *handle, void *args);
-static int dtmd_helper_dprintf_mount(dtmd_t *handle, void *args);
-static int dtmd_helper_dprintf_unmount(dtmd_t *handle, void *args);
-static int dtmd_helper_dprintf_list_supported_filesystems(dtmd_t *handle, void *args);
-static int dtmd_helper_dprintf_list_supported_filesystem_options(dtmd_t *handle, void *args);
+static int dtmd_helper_next_command(dtmd_t *handle, dt_command_t *cmd);
+static void dtmd_helper_compact_buffer(dtmd_t *handle);
+
+static int dtmd_helper_dprintf_list_all_removable_devices(dtmd_t *handle, dtmd_helper_request_t *request, void *args);
+static int dtmd_helper_dprintf_list_removable_device(dtmd_t *handle, dtmd_helper_request_t *request, void *args);
+static int dtmd_helper_dprintf_mount(dtmd_t *handle, dtmd_helper_request_t *request, void *args);
+static int dtmd_helper_dprintf_unmount(dtmd_t *handle, dtmd_helper_request_t *request, void *args);
+static int dtmd_helper_dprintf_list_supported_filesystems(dtmd_t *handle, dtmd_helper_request_t *request, void *args);
+static int dtmd_helper_dprintf_list_supported_filesystem_options(dtmd_t *handle, dtmd_helper_request_t *request, void *args);
 #if (defined OS_Linux)
-static int dtmd_helper_dprintf_poweroff(dtmd_t *handle, void *args);
+static int dtmd_helper_dprintf_poweroff(dtmd_t *handle, dtmd_helper_request_t *request, void *args);
 #endif /* (defined OS_Linux) */
 
-typedef int (*dtmd_helper_dprintf_func_t)(dtmd_t *handle, void *args);
-typedef dtmd_helper_result_t (*dtmd_helper_process_func_t)(dtmd_t *handle, dt_command_t *cmd, void *params, void *state);
-typedef int (*dtmd_helper_exit_func_t)(dtmd_t *handle, void *state);
-typedef void (*dtmd_helper_exit_clear_func_t)(void *state);
-
 dtmd_result_t dtmd_helper_generic_process(dtmd_t *handle, int timeout, void *params, void *state, dtmd_helper_dprintf_func_t dprintf_func, dtmd_helper_process_func_t process_func, dtmd_helper_exit_func_t exit_func, dtmd_helper_exit_clear_func_t exit_clear_func);
-
-static dtmd_helper_result_t dtmd_helper_process_list_all_removable_devices(dtmd_t *handle, dt_command_t *cmd, void *params, void *state);
-static dtmd_helper_result_t dtmd_helper_process_list_removable_device(dtmd_t *handle, dt_command_t *cmd, void *params, void *state);
-static dtmd_helper_result_t dtmd_helper_process_mount(dtmd_t *handle, dt_command_t *cmd, void *params, void *state);
-static dtmd_helper_result_t dtmd_helper_process_unmount(dtmd_t *handle, dt_command_t *cmd, void *params, void *state);
-static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystems(dtmd_t *handle, dt_command_t *cmd, void *params, void *state);
-static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystem_options(dtmd_t *handle, dt_command_t *cmd, void *params, void *state);
+static void dtmd_helper_init_request(dtmd_helper_request_t *request, void *params, void *state, dtmd_helper_dprintf_func_t dprintf_func, dtmd_helper_process_func_t process_func, dtmd_helper_exit_func_t exit_func, dtmd_helper_exit_clear_func_t exit_clear_func);
+static int dtmd_helper_calculate_time_end(int timeout, struct timespec *time_end);
+static dtmd_result_t dtmd_helper_pipelined_process(dtmd_t *handle, int timeout, void *params, void *state, dtmd_helper_dprintf_func_t dprintf_func, dtmd_helper_process_func_t process_func, dtmd_helper_exit_func_t exit_func, dtmd_helper_exit_clear_func_t exit_clear_func);
+static dtmd_helper_async_request_t* dtmd_helper_async_request_new(size_t strings_size);
+static dtmd_result_t dtmd_helper_async_process(dtmd_t *handle, int timeout, dtmd_helper_async_request_t *async_request, void *state, dtmd_helper_dprintf_func_t dprintf_func, dtmd_helper_process_func_t process_func, dtmd_helper_exit_func_t exit_func, dtmd_helper_exit_clear_func_t exit_clear_func, dtmd_helper_complete_func_t complete_func);
+
+static dtmd_result_t dtmd_helper_wait_for_requests(dtmd_t *handle, int timeout, const struct timespec *time_end);
+static void dtmd_helper_wake_worker(dtmd_t *handle);
+static dtmd_result_t dtmd_helper_submit_request(dtmd_t *handle, dtmd_helper_request_t *request);
+static void dtmd_helper_send_pending_requests(dtmd_t *handle);
+static int dtmd_helper_queue_output(dtmd_t *handle, const char *data, size_t size);
+static int dtmd_helper_flush_output(dtmd_t *handle);
+static ssize_t dtmd_helper_send_nonblocking(int fd, const char *data, size_t size);
+static void dtmd_helper_unlink_request(dtmd_t *handle, dtmd_helper_request_t *request);
+static dtmd_helper_request_t* dtmd_helper_find_request(dtmd_t *handle, const char *id_string);
+static void dtmd_helper_finish_request(dtmd_t *handle, dtmd_helper_request_t *request);
+static void dtmd_helper_fail_request(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_result_t result);
+static void dtmd_helper_finish_all_requests(dtmd_t *handle, dtmd_result_t result, dtmd_protocol_state_t protocol_state);
+static int dtmd_helper_expire_requests(dtmd_t *handle);
+static void dtmd_helper_run_completions(dtmd_t *handle);
+static int dtmd_helper_start_negotiation(dtmd_t *handle);
+static dtmd_result_t dtmd_helper_negotiate(dtmd_t *handle, dt_command_t *cmd);
+static int dtmd_helper_is_response(dt_command_t *cmd);
+static dtmd_result_t dtmd_helper_dispatch_cmd(dtmd_t *handle, dt_command_t *cmd);
+static void dtmd_helper_disconnect(dtmd_t *handle);
+static int dtmd_helper_write_all(int fd, const char *data, size_t size);
+
+static void dtmd_helper_seed_mirror(dtmd_t *handle);
+static void dtmd_helper_update_mirror(dtmd_t *handle, dt_command_t *cmd);
+static void dtmd_helper_clear_mirror(dtmd_t *handle);
+static int dtmd_helper_list_from_mirror(dtmd_t *handle, const char *device_path, dtmd_result_t *result, dtmd_removable_media_t **result_list);
+static size_t dtmd_helper_mirror_path_hash(const char *path);
+static int dtmd_helper_mirror_index_grow(dtmd_t *handle);
+static int dtmd_helper_mirror_index_add(dtmd_t *handle, dtmd_removable_media_t *device);
+static int dtmd_helper_mirror_index_add_recursive(dtmd_t *handle, dtmd_removable_media_t *devices_list);
+static void dtmd_helper_mirror_index_remove(dtmd_t *handle, dtmd_removable_media_t *device);
+static void dtmd_helper_mirror_index_remove_recursive(dtmd_t *handle, dtmd_removable_media_t *devices_list);
+static dtmd_removable_media_t* dtmd_helper_mirror_find(dtmd_t *handle, const char *path);
+static void dtmd_helper_insert_removable_device(dtmd_removable_media_t **root_ptr, dtmd_removable_media_t *device);
+static int dtmd_helper_copy_removable_device(const dtmd_removable_media_t *device, dtmd_removable_media_t *parent, dtmd_removable_media_t **result);
+static int dtmd_helper_copy_removable_devices_list(const dtmd_removable_media_t *devices_list, dtmd_removable_media_t *parent, dtmd_removable_media_t **result);
+static int dtmd_helper_dprintf_command(dtmd_t *handle, dtmd_helper_request_t *request, const char *command, const char *args_format, ...);
+
+static dtmd_helper_result_t dtmd_helper_process_list_all_removable_devices(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state);
+static dtmd_helper_result_t dtmd_helper_process_list_removable_device(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state);
+static dtmd_helper_result_t dtmd_helper_process_mount(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state);
+static dtmd_helper_result_t dtmd_helper_process_unmount(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state);
+static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystems(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state);
+static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystem_options(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state);
 #if (defined OS_Linux)
-static dtmd_helper_result_t dtmd_helper_process_poweroff(dtmd_t *handle, dt_command_t *cmd, void *params, void *state);
+static dtmd_helper_result_t dtmd_helper_process_poweroff(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state);
 #endif /* (defined OS_Linux) */
 
-static int dtmd_helper_exit_list_all_removable_devices(dtmd_t *handle, void *state);
+static int dtmd_helper_exit_list_all_removable_devices(dtmd_t *handle, dtmd_helper_request_t *request, void *state);
 static void dtmd_helper_exit_clear_list_all_removable_devices(void *state);
 
-static int dtmd_helper_exit_list_removable_device(dtmd_t *handle, void *state);
+static int dtmd_helper_exit_list_removable_device(dtmd_t *handle, dtmd_helper_request_t *request, void *state);
 static void dtmd_helper_exit_clear_list_removable_device(void *state);
 
-static int dtmd_helper_exit_list_supported_filesystems(dtmd_t *handle, void *state);
+static int dtmd_helper_exit_list_supported_filesystems(dtmd_t *handle, dtmd_helper_request_t *request, void *state);
 static void dtmd_helper_exit_clear_list_supported_filesystems(void *state);
 
-static int dtmd_helper_exit_list_supported_filesystem_options(dtmd_t *handle, void *state);
+static int dtmd_helper_exit_list_supported_filesystem_options(dtmd_t *handle, dtmd_helper_request_t *request, void *state);
 static void dtmd_helper_exit_clear_list_supported_filesystem_options(void *state);
 
+static void dtmd_helper_complete_generic(dtmd_t *handle, dtmd_helper_request_t *request);
+static void dtmd_helper_complete_list_all_removable_devices(dtmd_t *handle, dtmd_helper_request_t *request);
+static void dtmd_helper_complete_list_removable_device(dtmd_t *handle, dtmd_helper_request_t *request);
+static void dtmd_helper_complete_list_supported_filesystems(dtmd_t *handle, dtmd_helper_request_t *request);
+static void dtmd_helper_complete_list_supported_filesystem_options(dtmd_t *handle, dtmd_helper_request_t *request);
+
+static int dtmd_helper_exit_mirror_seed(dtmd_t *handle, dtmd_helper_request_t *request, void *state);
+static void dtmd_helper_complete_mirror_seed(dtmd_t *handle, dtmd_helper_request_t *request);
+
 static void dtmd_helper_free_string_array(size_t count, const char **data);
+static int dtmd_helper_copy_string_array(size_t count, char **data, const char ***result);
 static int dtmd_helper_validate_string_array(size_t count, const char **data);
 
 dtmd_t* dtmd_init(dtmd_callback_t callback, dtmd_state_callback_t state_callback, void *arg, dtmd_result_t *result)
+{
+	return dtmd_init_with_flags(callback, state_callback, arg, 0, result);
+}
+
+dtmd_t* dtmd_init_with_flags(dtmd_callback_t callback, dtmd_state_callback_t state_callback, void *arg, unsigned int flags, dtmd_result_t *result)
 {
 	dtmd_t *handle;
 	dtmd_result_t errorcode;
 	int rc;
+	pthread_condattr_t condattr;
 	char *watchdir;
 	char *watchdir_sep_ptr;
 #if (defined OS_FreeBSD)
@@ -316,6 +523,18 @@ dtmd_t* dtmd_init(dtmd_callback_t callback, dtmd_state_callback_t state_callback
 		goto dtmd_init_error_1;
 	}
 
+	if (flags & dtmd_init_flag_device_mirror)
+	{
+		// mirror is kept current by worker, which isn't possible without owning socket
+		flags |= dtmd_init_flag_pipelined;
+	}
+
+	if (flags & dtmd_init_flag_event_loop)
+	{
+		// without worker socket can't be lent to callers, only requests queued by them are sent
+		flags |= dtmd_init_flag_pipelined;
+	}
+
 	handle = (dtmd_t*) malloc(sizeof(dtmd_t));
 	if (handle == NULL)
 	{
@@ -326,12 +545,41 @@ dtmd_t* dtmd_init(dtmd_callback_t callback, dtmd_state_callback_t state_callback
 	handle->callback       = callback;
 	handle->state_callback = state_callback;
 	handle->callback_arg   = arg;
+	handle->flags          = flags;
+
 	handle->result_state   = dtmd_ok;
 	handle->library_state  = dtmd_state_default;
 	handle->buffer[0]      = 0;
+	handle->buffer_start   = 0;
 	handle->cur_pos        = 0;
 	handle->error_code     = dtmd_error_code_unknown;
 
+	handle->protocol_state           = dtmd_protocol_disconnected;
+	handle->is_request_ids_supported = 0;
+	handle->is_worker_woken          = 0;
+	handle->last_request_id          = 0;
+	handle->requests                 = NULL;
+	handle->current_request          = NULL;
+	handle->pending_requests_first   = NULL;
+	handle->pending_requests_last    = NULL;
+	handle->completed_requests       = NULL;
+	handle->output_buffer            = NULL;
+	handle->output_buffer_size       = 0;
+	handle->output_buffer_used       = 0;
+
+	handle->is_mirror_synchronized  = 0;
+	handle->mirror_root             = NULL;
+	handle->mirror_index            = NULL;
+	handle->mirror_index_size       = 0;
+	handle->mirror_index_count      = 0;
+	handle->is_mirror_seed_required = 0;
+
+	handle->event_fd                 = -1;
+	handle->event_socket_fd          = -1;
+	handle->is_event_socket_writable = 0;
+
+	dt_helper_arena_init(&(handle->arena));
+
 #if (defined OS_Linux)
 	handle->inotify_buffer_used = 0;
 #endif /* (defined OS_Linux) */
@@ -401,31 +649,94 @@ dtmd_t* dtmd_init(dtmd_callback_t callback, dtmd_state_callback_t state_callback
 		goto dtmd_init_error_5;
 	}
 
-	if (pipe(handle->feedback) == -1)
+	if (pthread_mutex_init(&(handle->requests_mutex), NULL) != 0)
 	{
 		errorcode = dtmd_internal_initialization_error;
 		goto dtmd_init_error_6;
 	}
 
-	if (pipe(handle->pipes) == -1)
+	if (pthread_condattr_init(&condattr) != 0)
 	{
 		errorcode = dtmd_internal_initialization_error;
 		goto dtmd_init_error_7;
 	}
 
-	rc = dtmd_try_connecting(handle);
-	if (rc < 0)
+	// timeouts are measured using monotonic clock
+	if ((pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC) != 0)
+		|| (pthread_cond_init(&(handle->requests_cond), &condattr) != 0))
+	{
+		pthread_condattr_destroy(&condattr);
+		errorcode = dtmd_internal_initialization_error;
+		goto dtmd_init_error_7;
+	}
+
+	pthread_condattr_destroy(&condattr);
+
+	if (pthread_mutex_init(&(handle->mirror_mutex), NULL) != 0)
 	{
 		errorcode = dtmd_internal_initialization_error;
 		goto dtmd_init_error_8;
 	}
 
-	if ((pthread_create(&(handle->worker), NULL, &dtmd_worker_function, handle)) != 0)
+	if (pthread_mutex_init(&(handle->events_mutex), NULL) != 0)
 	{
 		errorcode = dtmd_internal_initialization_error;
 		goto dtmd_init_error_9;
 	}
 
+	if (pipe(handle->feedback) == -1)
+	{
+		errorcode = dtmd_internal_initialization_error;
+		goto dtmd_init_error_10;
+	}
+
+	if (pipe(handle->pipes) == -1)
+	{
+		errorcode = dtmd_internal_initialization_error;
+		goto dtmd_init_error_11;
+	}
+
+	if ((flags & dtmd_init_flag_event_loop)
+		&& (dtmd_helper_create_event_fd(handle) < 0))
+	{
+		errorcode = dtmd_internal_initialization_error;
+		goto dtmd_init_error_12;
+	}
+
+	rc = dtmd_try_connecting(handle);
+	if (rc < 0)
+	{
+		errorcode = dtmd_internal_initialization_error;
+		goto dtmd_init_error_13;
+	}
+
+	if ((flags & dtmd_init_flag_pipelined) && (rc > 0))
+	{
+		if (dtmd_helper_start_negotiation(handle) < 0)
+		{
+			errorcode = dtmd_internal_initialization_error;
+			goto dtmd_init_error_14;
+		}
+	}
+
+	if (flags & dtmd_init_flag_event_loop)
+	{
+		pthread_mutex_lock(&(handle->requests_mutex));
+		rc = dtmd_helper_update_event_fd(handle);
+		pthread_mutex_unlock(&(handle->requests_mutex));
+
+		if (rc < 0)
+		{
+			errorcode = dtmd_internal_initialization_error;
+			goto dtmd_init_error_14;
+		}
+	}
+	else if ((pthread_create(&(handle->worker), NULL, &dtmd_worker_function, handle)) != 0)
+	{
+		errorcode = dtmd_internal_initialization_error;
+		goto dtmd_init_error_14;
+	}
+
 	if (result != NULL)
 	{
 		*result = dtmd_ok;
@@ -436,22 +747,45 @@ dtmd_t* dtmd_init(dtmd_callback_t callback, dtmd_state_callback_t state_callback
 #endif /* (defined OS_FreeBSD) */
 	return handle;
 /*
-dtmd_init_error_10:
+dtmd_init_error_15:
 	write(handle->pipes[1], &data, sizeof(char));
 	pthread_join(handle->worker, NULL);
 */
-dtmd_init_error_9:
-	shutdown(handle->socket_fd, SHUT_RDWR);
-	close(handle->socket_fd);
+dtmd_init_error_14:
+	if (handle->socket_fd >= 0)
+	{
+		shutdown(handle->socket_fd, SHUT_RDWR);
+		close(handle->socket_fd);
+	}
 
-dtmd_init_error_8:
+	free(handle->output_buffer);
+
+dtmd_init_error_13:
+	if (handle->event_fd >= 0)
+	{
+		close(handle->event_fd);
+	}
+
+dtmd_init_error_12:
 	close(handle->pipes[0]);
 	close(handle->pipes[1]);
 
-dtmd_init_error_7:
+dtmd_init_error_11:
 	close(handle->feedback[0]);
 	close(handle->feedback[1]);
 
+dtmd_init_error_10:
+	pthread_mutex_destroy(&(handle->events_mutex));
+
+dtmd_init_error_9:
+	pthread_mutex_destroy(&(handle->mirror_mutex));
+
+dtmd_init_error_8:
+	pthread_cond_destroy(&(handle->requests_cond));
+
+dtmd_init_error_7:
+	pthread_mutex_destroy(&(handle->requests_mutex));
+
 dtmd_init_error_6:
 	sem_destroy(&(handle->caller_socket));
 
@@ -487,8 +821,16 @@ void dtmd_deinit(dtmd_t *handle)
 
 	if (handle != NULL)
 	{
-		write(handle->pipes[1], &data, sizeof(char));
-		pthread_join(handle->worker, NULL);
+		if (handle->flags & dtmd_init_flag_event_loop)
+		{
+			dtmd_helper_finish_events(handle);
+			close(handle->event_fd);
+		}
+		else
+		{
+			write(handle->pipes[1], &data, sizeof(char));
+			pthread_join(handle->worker, NULL);
+		}
 
 		if (handle->socket_fd >= 0)
 		{
@@ -496,10 +838,17 @@ void dtmd_deinit(dtmd_t *handle)
 			close(handle->socket_fd);
 		}
 
+		free(handle->output_buffer);
+		dtmd_helper_clear_mirror(handle);
+		dt_helper_arena_free(&(handle->arena));
 		close(handle->pipes[0]);
 		close(handle->pipes[1]);
 		close(handle->feedback[0]);
 		close(handle->feedback[1]);
+		pthread_mutex_destroy(&(handle->events_mutex));
+		pthread_mutex_destroy(&(handle->mirror_mutex));
+		pthread_cond_destroy(&(handle->requests_cond));
+		pthread_mutex_destroy(&(handle->requests_mutex));
 		sem_destroy(&(handle->caller_socket));
 
 #if (defined OS_Linux)
@@ -522,250 +871,554 @@ void dtmd_deinit(dtmd_t *handle)
 static void* dtmd_worker_function(void *arg)
 {
 	dtmd_t *handle;
-	struct pollfd fds[3];
-	int rc;
-	dt_command_t *cmd;
 	char data;
-	dtmd_result_t res;
-	char *eol;
-#if (defined OS_Linux)
-	size_t idx;
-	struct inotify_event *event;
-#endif /* (defined OS_Linux) */
-#if (defined OS_FreeBSD)
-	struct kevent notify_event;
-	struct timespec waittime;
-#endif /* (defined OS_FreeBSD) */
 
 	handle = (dtmd_t*) arg;
 
-	fds[0].fd = handle->pipes[0];
-	fds[1].fd = handle->watch_fd;
-	fds[2].fd = handle->socket_fd;
-
 	for (;;)
 	{
-		while ((eol = strchr(handle->buffer, '\n')) != NULL)
+		switch (dtmd_helper_process_next_event(handle, dtmd_library_timeout_infinite))
 		{
-			if (!dt_validate_command(handle->buffer))
-			{
-				goto dtmd_worker_function_error;
-			}
+		case dtmd_helper_events_exit:
+			goto dtmd_worker_function_exit;
 
-			cmd = dt_parse_command(handle->buffer);
+		case dtmd_helper_events_error:
+			goto dtmd_worker_function_error;
 
-			handle->cur_pos -= (eol + 1 - handle->buffer);
-			memmove(handle->buffer, eol+1, handle->cur_pos + 1);
+		default:
+			break;
+		}
+	}
 
-			if (cmd == NULL)
-			{
-				goto dtmd_worker_function_error;
-			}
+dtmd_worker_function_error:
+	// Signal about error
+	handle->state_callback(handle, handle->callback_arg, dtmd_state_failure);
 
-			res = dtmd_helper_handle_cmd(handle, cmd);
-			dt_free_command(cmd);
+dtmd_worker_function_exit:
+	dtmd_helper_finish_events(handle);
 
-			if (res != dtmd_ok)
-			{
-				goto dtmd_worker_function_error;
-			}
-		}
+	// Signal about exit
+	data = 0;
+	write(handle->feedback[1], &data, sizeof(char));
+
+	pthread_exit(0);
+}
 
-		fds[0].events  = POLLIN;
-		fds[0].revents = 0;
-		fds[1].events  = POLLIN;
-		fds[1].revents = 0;
-		fds[2].events  = POLLIN;
-		fds[2].revents = 0;
+/* returns timeout in milliseconds until next asynchronous request expires, or -1 */
+static int dtmd_helper_prepare_events(dtmd_t *handle, int *is_output_pending)
+{
+	int timeout = -1;
+
+	*is_output_pending = 0;
+
+	if (handle->flags & dtmd_init_flag_pipelined)
+	{
+		pthread_mutex_lock(&(handle->requests_mutex));
 
-		rc = poll(fds, ((handle->socket_fd >= 0) ? 3 : 2), -1);
-		if ((rc == -1) && (errno == EINTR))
+		if (handle->is_mirror_seed_required)
 		{
-			continue;
+			dtmd_helper_seed_mirror(handle);
 		}
 
-		if ((rc == -1)
-			|| (fds[0].revents & POLLERR)
-			|| (fds[0].revents & POLLHUP)
-			|| (fds[0].revents & POLLNVAL)
-			|| (fds[1].revents & POLLERR)
-			|| (fds[1].revents & POLLHUP)
-			|| (fds[1].revents & POLLNVAL))
+		timeout = dtmd_helper_expire_requests(handle);
+		*is_output_pending = (handle->output_buffer_used > 0);
+
+		pthread_mutex_unlock(&(handle->requests_mutex));
+
+		dtmd_helper_run_completions(handle);
+	}
+
+	return timeout;
+}
+
+static dtmd_helper_events_result_t dtmd_helper_process_commands(dtmd_t *handle)
+{
+	dt_command_t cmd;
+	dtmd_result_t res;
+	int rc;
+
+	while ((rc = dtmd_helper_next_command(handle, &cmd)) != 0)
+	{
+		if (rc < 0)
 		{
-			goto dtmd_worker_function_error;
+			return dtmd_helper_events_error;
 		}
 
-		if ((handle->socket_fd >= 0)
-			&& ((fds[2].revents & POLLERR)
-				|| (fds[2].revents & POLLHUP)
-				|| (fds[2].revents & POLLNVAL)))
+		if (handle->flags & dtmd_init_flag_pipelined)
 		{
-			handle->state_callback(handle, handle->callback_arg, dtmd_state_disconnected);
-			shutdown(handle->socket_fd, SHUT_RDWR);
-			close(handle->socket_fd);
-			handle->socket_fd = -1;
+			res = dtmd_helper_dispatch_cmd(handle, &cmd);
+		}
+		else
+		{
+			res = dtmd_helper_handle_cmd(handle, &cmd);
 		}
-		else if (fds[0].revents & POLLIN)
+
+		if (res != dtmd_ok)
 		{
-			rc = read(handle->pipes[0], &data, sizeof(char));
+			return dtmd_helper_events_error;
+		}
+	}
+
+	return dtmd_helper_events_processed;
+}
+
+/* Waits for single event for at most timeout milliseconds, negative for infinite, and handles it */
+static dtmd_helper_events_result_t dtmd_helper_process_next_event(dtmd_t *handle, int timeout)
+{
+	struct pollfd fds[3];
+	int rc;
+	int poll_timeout;
+	int is_output_pending;
+	char data;
+#if (defined OS_Linux)
+	size_t idx;
+	struct inotify_event *event;
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
+	struct kevent notify_event;
+	struct timespec waittime;
+#endif /* (defined OS_FreeBSD) */
+
+	// data may be left after socket was released by caller
+	if (dtmd_helper_process_commands(handle) != dtmd_helper_events_processed)
+	{
+		return dtmd_helper_events_error;
+	}
+
+	fds[0].fd      = handle->pipes[0];
+	fds[0].events  = POLLIN;
+	fds[0].revents = 0;
+	fds[1].fd      = handle->watch_fd;
+	fds[1].events  = POLLIN;
+	fds[1].revents = 0;
+	fds[2].fd      = handle->socket_fd;
+	fds[2].events  = POLLIN;
+	fds[2].revents = 0;
+
+	poll_timeout = dtmd_helper_prepare_events(handle, &is_output_pending);
+
+	if ((timeout >= 0) && ((poll_timeout < 0) || (timeout < poll_timeout)))
+	{
+		poll_timeout = timeout;
+	}
+
+	if (is_output_pending)
+	{
+		fds[2].events |= POLLOUT;
+	}
+
+	rc = poll(fds, ((handle->socket_fd >= 0) ? 3 : 2), poll_timeout);
+	if ((rc == 0) || ((rc == -1) && (errno == EINTR)))
+	{
+		return dtmd_helper_events_none;
+	}
+
+	if ((rc == -1)
+		|| (fds[0].revents & POLLERR)
+		|| (fds[0].revents & POLLHUP)
+		|| (fds[0].revents & POLLNVAL)
+		|| (fds[1].revents & POLLERR)
+		|| (fds[1].revents & POLLHUP)
+		|| (fds[1].revents & POLLNVAL))
+	{
+		return dtmd_helper_events_error;
+	}
+
+	if ((handle->socket_fd >= 0)
+		&& ((fds[2].revents & POLLERR)
+			|| (fds[2].revents & POLLHUP)
+			|| (fds[2].revents & POLLNVAL)))
+	{
+		dtmd_helper_disconnect(handle);
+	}
+	else if (fds[0].revents & POLLIN)
+	{
+		rc = read(handle->pipes[0], &data, sizeof(char));
 
-			if (rc == 1)
+		if (rc == 1)
+		{
+			if (data == 1)
 			{
-				if (data == 1)
-				{
-					// release ownership of socket and wait for return
-					data = 1;
-					write(handle->feedback[1], &data, sizeof(char));
+				// release ownership of socket and wait for return
+				data = 1;
+				write(handle->feedback[1], &data, sizeof(char));
 
-					sem_wait(&(handle->caller_socket));
-				}
-				else
-				{
-					goto dtmd_worker_function_exit;
-				}
+				sem_wait(&(handle->caller_socket));
+			}
+			else if (data == 2)
+			{
+				// there are requests to send, to complete, or new timeouts to take into account
+				pthread_mutex_lock(&(handle->requests_mutex));
+				handle->is_worker_woken = 0;
+				pthread_mutex_unlock(&(handle->requests_mutex));
 			}
 			else
 			{
-				goto dtmd_worker_function_error;
+				return dtmd_helper_events_exit;
 			}
 		}
-		else if (fds[1].revents & POLLIN)
+		else
 		{
+			return dtmd_helper_events_error;
+		}
+	}
+	else if (fds[1].revents & POLLIN)
+	{
 #if (defined OS_Linux)
-			if (handle->inotify_buffer_used == dtmd_inotify_buffer_size)
-			{
-				goto dtmd_worker_function_error;
-			}
+		if (handle->inotify_buffer_used == dtmd_inotify_buffer_size)
+		{
+			return dtmd_helper_events_error;
+		}
 
-			rc = read(handle->watch_fd, &(handle->inotify_buffer[handle->inotify_buffer_used]), dtmd_inotify_buffer_size - handle->inotify_buffer_used);
-			if (rc <= 0)
-			{
-				goto dtmd_worker_function_error;
-			}
+		rc = read(handle->watch_fd, &(handle->inotify_buffer[handle->inotify_buffer_used]), dtmd_inotify_buffer_size - handle->inotify_buffer_used);
+		if (rc <= 0)
+		{
+			return dtmd_helper_events_error;
+		}
 
-			handle->inotify_buffer_used += rc;
-			idx = 0;
+		handle->inotify_buffer_used += rc;
+		idx = 0;
 
-			while (idx < handle->inotify_buffer_used)
+		while (idx < handle->inotify_buffer_used)
+		{
+			if (handle->inotify_buffer_used < idx + sizeof(struct inotify_event))
 			{
-				if (handle->inotify_buffer_used < idx + sizeof(struct inotify_event))
-				{
-					break;
-				}
+				break;
+			}
 
-				event = (struct inotify_event*) &(handle->inotify_buffer[idx]);
+			event = (struct inotify_event*) &(handle->inotify_buffer[idx]);
 
-				if (handle->inotify_buffer_used < idx + sizeof(struct inotify_event) + event->len)
-				{
-					break;
-				}
+			if (handle->inotify_buffer_used < idx + sizeof(struct inotify_event) + event->len)
+			{
+				break;
+			}
 
-				if ((event->mask & IN_CREATE)
-					|| (event->mask & IN_MOVED_TO))
+			if ((event->mask & IN_CREATE)
+				|| (event->mask & IN_MOVED_TO))
+			{
+				if (handle->socket_fd < 0)
 				{
-					if (handle->socket_fd < 0)
+					if ((event->len > 0) && (strcmp(event->name, handle->watch_file_name) == 0))
 					{
-						if ((event->len > 0) && (strcmp(event->name, handle->watch_file_name) == 0))
+						rc = dtmd_try_connecting(handle);
+						if (rc < 0)
 						{
-							rc = dtmd_try_connecting(handle);
-							if (rc < 0)
-							{
-								goto dtmd_worker_function_error;
-							}
-							else if (rc > 0)
+							return dtmd_helper_events_error;
+						}
+						else if (rc > 0)
+						{
+							handle->buffer_start = 0;
+							handle->cur_pos = 0;
+							handle->buffer[handle->cur_pos] = 0;
+
+							if ((handle->flags & dtmd_init_flag_pipelined)
+								&& (dtmd_helper_start_negotiation(handle) < 0))
 							{
-								fds[2].fd = handle->socket_fd;
-								handle->cur_pos = 0;
-								handle->buffer[handle->cur_pos] = 0;
-								handle->state_callback(handle, handle->callback_arg, dtmd_state_connected);
+								return dtmd_helper_events_error;
 							}
+
+							handle->state_callback(handle, handle->callback_arg, dtmd_state_connected);
 						}
 					}
 				}
+			}
 
-				if ((event->mask & IN_DELETE_SELF)
-					|| (event->mask & IN_MOVE_SELF))
-				{
-					goto dtmd_worker_function_error;
-				}
-
-				idx += sizeof(struct inotify_event) + event->len;
+			if ((event->mask & IN_DELETE_SELF)
+				|| (event->mask & IN_MOVE_SELF))
+			{
+				return dtmd_helper_events_error;
 			}
 
-			handle->inotify_buffer_used -= idx;
-			memmove(handle->inotify_buffer, &(handle->inotify_buffer[idx]), handle->inotify_buffer_used);
+			idx += sizeof(struct inotify_event) + event->len;
+		}
+
+		handle->inotify_buffer_used -= idx;
+		memmove(handle->inotify_buffer, &(handle->inotify_buffer[idx]), handle->inotify_buffer_used);
 #endif /* (defined OS_Linux) */
 
 #if (defined OS_FreeBSD)
-			waittime.tv_sec = 0;
-			waittime.tv_nsec = 0;
-			rc = kevent(handle->watch_fd, NULL, 0, &notify_event, 1, &waittime);
-			if (rc <= 0)
-			{
-				goto dtmd_worker_function_error;
-			}
+		waittime.tv_sec = 0;
+		waittime.tv_nsec = 0;
+		rc = kevent(handle->watch_fd, NULL, 0, &notify_event, 1, &waittime);
+		if (rc <= 0)
+		{
+			return dtmd_helper_events_error;
+		}
 
-			if (notify_event.fflags & (NOTE_DELETE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_LINK | NOTE_RENAME | NOTE_REVOKE))
-			{
-				goto dtmd_worker_function_error;
-			}
+		if (notify_event.fflags & (NOTE_DELETE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_LINK | NOTE_RENAME | NOTE_REVOKE))
+		{
+			return dtmd_helper_events_error;
+		}
 
-			if (notify_event.fflags & NOTE_WRITE)
+		if (notify_event.fflags & NOTE_WRITE)
+		{
+			if (handle->socket_fd < 0)
 			{
-				if (handle->socket_fd < 0)
+				/* NOTE: event may be received much faster than daemon actually starts to listen on socket. Make a minor delay to workaround that */
+				rc = expected_nanosleep(10);
+				if (rc < 0)
 				{
-					/* NOTE: event may be received much faster than daemon actually starts to listen on socket. Make a minor delay to workaround that */
-					rc = expected_nanosleep(10);
-					if (rc < 0)
-					{
-						goto dtmd_worker_function_error;
-					}
+					return dtmd_helper_events_error;
+				}
 
-					rc = dtmd_try_connecting(handle);
-					if (rc < 0)
-					{
-						goto dtmd_worker_function_error;
-					}
-					else if (rc > 0)
+				rc = dtmd_try_connecting(handle);
+				if (rc < 0)
+				{
+					return dtmd_helper_events_error;
+				}
+				else if (rc > 0)
+				{
+					handle->buffer_start = 0;
+					handle->cur_pos = 0;
+					handle->buffer[handle->cur_pos] = 0;
+
+					if ((handle->flags & dtmd_init_flag_pipelined)
+						&& (dtmd_helper_start_negotiation(handle) < 0))
 					{
-						fds[2].fd = handle->socket_fd;
-						handle->cur_pos = 0;
-						handle->buffer[handle->cur_pos] = 0;
-						handle->state_callback(handle, handle->callback_arg, dtmd_state_connected);
+						return dtmd_helper_events_error;
 					}
+
+					handle->state_callback(handle, handle->callback_arg, dtmd_state_connected);
 				}
 			}
+		}
 #endif /* (defined OS_FreeBSD) */
+	}
+	else if ((handle->socket_fd >= 0)
+		&& (fds[2].revents & POLLOUT)
+		&& (dtmd_helper_flush_output(handle) < 0))
+	{
+		dtmd_helper_disconnect(handle);
+	}
+	else if ((handle->socket_fd >= 0)
+		&& (fds[2].revents & POLLIN))
+	{
+		dtmd_helper_compact_buffer(handle);
+
+		rc = read(handle->socket_fd, &(handle->buffer[handle->cur_pos]), dtmd_command_max_length - handle->cur_pos);
+		if (rc > 0)
+		{
+			handle->cur_pos += rc;
+			handle->buffer[handle->cur_pos] = 0;
+
+			// complete lines are never left in buffer, since no event would tell about them
+			return dtmd_helper_process_commands(handle);
 		}
-		else if ((handle->socket_fd >= 0)
-			&& (fds[2].revents & POLLIN))
+		else
 		{
-			rc = read(handle->socket_fd, &(handle->buffer[handle->cur_pos]), dtmd_command_max_length - handle->cur_pos);
-			if (rc > 0)
-			{
-				handle->cur_pos += rc;
-				handle->buffer[handle->cur_pos] = 0;
-			}
-			else
-			{
-				handle->state_callback(handle, handle->callback_arg, dtmd_state_disconnected);
-				shutdown(handle->socket_fd, SHUT_RDWR);
-				close(handle->socket_fd);
-				handle->socket_fd = -1;
-			}
+			dtmd_helper_disconnect(handle);
 		}
 	}
 
-dtmd_worker_function_error:
-	// Signal about error
-	handle->state_callback(handle, handle->callback_arg, dtmd_state_failure);
+	return dtmd_helper_events_processed;
+}
 
-dtmd_worker_function_exit:
-	// Signal about exit
-	data = 0;
-	write(handle->feedback[1], &data, sizeof(char));
+/* fails all requests which weren't completed yet, is called when events are no longer processed */
+static void dtmd_helper_finish_events(dtmd_t *handle)
+{
+	if (handle->flags & dtmd_init_flag_pipelined)
+	{
+		pthread_mutex_lock(&(handle->requests_mutex));
+		dtmd_helper_finish_all_requests(handle, dtmd_fatal_io_error, dtmd_protocol_failed);
+		pthread_mutex_unlock(&(handle->requests_mutex));
 
-	pthread_exit(0);
+		dtmd_helper_run_completions(handle);
+
+		pthread_mutex_lock(&(handle->mirror_mutex));
+		dtmd_helper_clear_mirror(handle);
+		pthread_mutex_unlock(&(handle->mirror_mutex));
+	}
+}
+
+static void dtmd_helper_fail_events(dtmd_t *handle)
+{
+	int is_failed;
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+
+	is_failed = dtmd_helper_is_state_invalid(handle->result_state);
+	if (!is_failed)
+	{
+		handle->result_state = dtmd_fatal_io_error;
+	}
+
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	if (!is_failed)
+	{
+		// Signal about error
+		handle->state_callback(handle, handle->callback_arg, dtmd_state_failure);
+
+		dtmd_helper_finish_events(handle);
+	}
+}
+
+static int dtmd_helper_create_event_fd(dtmd_t *handle)
+{
+#if (defined OS_Linux)
+	struct epoll_event event;
+	int fds[2];
+	size_t i;
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
+	struct kevent change_events[2];
+#endif /* (defined OS_FreeBSD) */
+
+#if (defined OS_Linux)
+	handle->event_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (handle->event_fd < 0)
+	{
+		return -1;
+	}
+
+	fds[0] = handle->pipes[0];
+	fds[1] = handle->watch_fd;
+
+	for (i = 0; i < sizeof(fds) / sizeof(fds[0]); ++i)
+	{
+		event.events  = EPOLLIN;
+		event.data.fd = fds[i];
+
+		if (epoll_ctl(handle->event_fd, EPOLL_CTL_ADD, fds[i], &event) == -1)
+		{
+			goto dtmd_helper_create_event_fd_error;
+		}
+	}
+#endif /* (defined OS_Linux) */
+
+#if (defined OS_FreeBSD)
+	handle->event_fd = kqueue();
+	if (handle->event_fd < 0)
+	{
+		return -1;
+	}
+
+	EV_SET(&(change_events[0]), handle->pipes[0], EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, NULL);
+	EV_SET(&(change_events[1]), handle->watch_fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, NULL);
+
+	if (kevent(handle->event_fd, change_events, 2, NULL, 0, NULL) < 0)
+	{
+		goto dtmd_helper_create_event_fd_error;
+	}
+#endif /* (defined OS_FreeBSD) */
+
+	return 1;
+
+dtmd_helper_create_event_fd_error:
+	close(handle->event_fd);
+	handle->event_fd = -1;
+
+	return -1;
+}
+
+/* requests_mutex must be locked. Socket is watched for being writable only while there's data to send */
+static int dtmd_helper_update_event_fd(dtmd_t *handle)
+{
+	int is_writable;
+#if (defined OS_Linux)
+	struct epoll_event event;
+#endif /* (defined OS_Linux) */
+#if (defined OS_FreeBSD)
+	struct kevent change_events[2];
+	int count = 0;
+#endif /* (defined OS_FreeBSD) */
+
+	if (handle->socket_fd < 0)
+	{
+		return 1;
+	}
+
+	is_writable = (handle->output_buffer_used > 0);
+
+	if ((handle->event_socket_fd == handle->socket_fd)
+		&& (handle->is_event_socket_writable == is_writable))
+	{
+		return 1;
+	}
+
+#if (defined OS_Linux)
+	event.events  = EPOLLIN | (is_writable ? EPOLLOUT : 0);
+	event.data.fd = handle->socket_fd;
+
+	if (epoll_ctl(handle->event_fd, ((handle->event_socket_fd == handle->socket_fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD), handle->socket_fd, &event) == -1)
+	{
+		return -1;
+	}
+#endif /* (defined OS_Linux) */
+
+#if (defined OS_FreeBSD)
+	if (handle->event_socket_fd != handle->socket_fd)
+	{
+		EV_SET(&(change_events[count]), handle->socket_fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, NULL);
+		++count;
+
+		handle->is_event_socket_writable = 0;
+	}
+
+	if (handle->is_event_socket_writable != is_writable)
+	{
+		EV_SET(&(change_events[count]), handle->socket_fd, EVFILT_WRITE, (is_writable ? (EV_ADD | EV_ENABLE) : EV_DELETE), 0, 0, NULL);
+		++count;
+	}
+
+	if (kevent(handle->event_fd, change_events, count, NULL, 0, NULL) < 0)
+	{
+		return -1;
+	}
+#endif /* (defined OS_FreeBSD) */
+
+	handle->event_socket_fd = handle->socket_fd;
+	handle->is_event_socket_writable = is_writable;
+
+	return 1;
+}
+
+/* requests_mutex must be locked. Called by thread which processed events */
+static int dtmd_helper_release_events(dtmd_t *handle)
+{
+	int rc;
+
+	rc = dtmd_helper_update_event_fd(handle);
+
+	pthread_mutex_unlock(&(handle->events_mutex));
+
+	// let callers of synchronous requests process events if application isn't doing it
+	pthread_cond_broadcast(&(handle->requests_cond));
+
+	return rc;
+}
+
+static void dtmd_helper_disconnect(dtmd_t *handle)
+{
+	handle->state_callback(handle, handle->callback_arg, dtmd_state_disconnected);
+
+	if (handle->flags & dtmd_init_flag_pipelined)
+	{
+		pthread_mutex_lock(&(handle->requests_mutex));
+	}
+
+	shutdown(handle->socket_fd, SHUT_RDWR);
+	close(handle->socket_fd);
+	handle->socket_fd = -1;
+
+	// closed socket is removed from event_fd automatically
+	handle->event_socket_fd = -1;
+	handle->is_event_socket_writable = 0;
+
+	if (handle->flags & dtmd_init_flag_pipelined)
+	{
+		handle->library_state = dtmd_state_default;
+		handle->output_buffer_used = 0;
+		dtmd_helper_finish_all_requests(handle, dtmd_io_error, dtmd_protocol_disconnected);
+		pthread_mutex_unlock(&(handle->requests_mutex));
+
+		dtmd_helper_run_completions(handle);
+
+		// changes made while disconnected are never notified about
+		pthread_mutex_lock(&(handle->mirror_mutex));
+		dtmd_helper_clear_mirror(handle);
+		pthread_mutex_unlock(&(handle->mirror_mutex));
+	}
 }
 
 dtmd_result_t dtmd_list_all_removable_devices(dtmd_t *handle, int timeout, dtmd_removable_media_t **result_list)
@@ -784,6 +1437,12 @@ dtmd_result_t dtmd_list_all_removable_devices(dtmd_t *handle, int timeout, dtmd_
 		return dtmd_input_error;
 	}
 
+	if ((handle->flags & dtmd_init_flag_device_mirror)
+		&& (dtmd_helper_list_from_mirror(handle, dtmd_root_device_path, &res, result_list)))
+	{
+		return res;
+	}
+
 	state.got_started = 0;
 	state.result = NULL;
 
@@ -818,6 +1477,12 @@ dtmd_result_t dtmd_list_removable_device(dtmd_t *handle, int timeout, const char
 		return dtmd_input_error;
 	}
 
+	if ((handle->flags & dtmd_init_flag_device_mirror)
+		&& (dtmd_helper_list_from_mirror(handle, device_path, &res, result_list)))
+	{
+		return res;
+	}
+
 	params.device_path = device_path;
 
 	state.got_started = 0;
@@ -994,116 +1659,403 @@ dtmd_result_t dtmd_poweroff(dtmd_t *handle, int timeout, const char *path)
 }
 #endif /* (defined OS_Linux) */
 
-static int dtmd_helper_fill_data(char **where, char **from, dtmd_internal_fill_type_t internal_fill_type)
+dtmd_result_t dtmd_list_all_removable_devices_async(dtmd_t *handle, int timeout, dtmd_removable_devices_completion_callback_t callback, void *arg)
 {
-	switch (internal_fill_type)
+	dtmd_helper_async_request_t *async_request;
+
+	if (handle == NULL)
 	{
-	case dtmd_internal_fill_copy:
-		if (*from != NULL)
-		{
-			*where = strdup(*from);
-			if (*where == NULL)
-			{
-				return 0;
-			}
-		}
-		else
-		{
-			*where = NULL;
-		}
+		return dtmd_library_not_initialized;
+	}
 
-		return 1;
-		break;
+	if (callback == NULL)
+	{
+		return dtmd_input_error;
+	}
 
-	case dtmd_internal_fill_move:
-		*where = *from;
-		*from = NULL;
-		return 1;
-		break;
+	async_request = dtmd_helper_async_request_new(0);
+	if (async_request == NULL)
+	{
+		return dtmd_memory_error;
+	}
 
-	case dtmd_internal_fill_link:
-		*where = *from;
-		return 1;
-		break;
+	async_request->state.list_all_removable_devices.got_started = 0;
+	async_request->state.list_all_removable_devices.result = NULL;
 
-	default:
-		return dtmd_input_error;
-		break;
-	}
+	async_request->callback.removable_devices = callback;
+	async_request->arg = arg;
 
-	return 0;
+	return dtmd_helper_async_process(handle,
+		timeout,
+		async_request,
+		&(async_request->state.list_all_removable_devices),
+		&dtmd_helper_dprintf_list_all_removable_devices,
+		&dtmd_helper_process_list_all_removable_devices,
+		&dtmd_helper_exit_list_all_removable_devices,
+		&dtmd_helper_exit_clear_list_all_removable_devices,
+		&dtmd_helper_complete_list_all_removable_devices);
 }
 
-static dtmd_result_t dtmd_fill_removable_device_from_notification_implementation(dtmd_t *handle, dt_command_t *cmd, dtmd_internal_fill_type_t internal_fill_type, dtmd_removable_media_t **result)
+dtmd_result_t dtmd_list_removable_device_async(dtmd_t *handle, int timeout, const char *device_path, dtmd_removable_devices_completion_callback_t callback, void *arg)
 {
-	dtmd_removable_media_t *constructed_media = NULL;
+	dtmd_helper_async_request_t *async_request;
+	size_t device_path_size;
 
-	constructed_media = (dtmd_removable_media_t*) malloc(sizeof(dtmd_removable_media_t));
-	if (constructed_media == NULL)
+	if (handle == NULL)
 	{
-		handle->result_state = dtmd_memory_error;
-		goto dtmd_fill_removable_device_from_notification_implementation_error_1;
+		return dtmd_library_not_initialized;
 	}
 
-	constructed_media->private_data = NULL;
-
-	switch (internal_fill_type)
+	if ((device_path == NULL) || (*device_path == 0) || (callback == NULL))
 	{
-	case dtmd_internal_fill_link:
-		constructed_media->private_data = (void*) (dtmd_removable_media_internal_state_fields_are_linked);
-		break;
-
-	case dtmd_internal_fill_copy:
-	case dtmd_internal_fill_move:
-	default:
-		break;
+		return dtmd_input_error;
 	}
 
-	constructed_media->path          = NULL;
-	constructed_media->type          = dtmd_removable_media_type_unknown_or_persistent;
-	constructed_media->subtype       = dtmd_removable_media_subtype_unknown_or_persistent;
-	constructed_media->state         = dtmd_removable_media_state_unknown;
-	constructed_media->fstype        = NULL;
-	constructed_media->label         = NULL;
-	constructed_media->mnt_point     = NULL;
-	constructed_media->mnt_opts      = NULL;
-	constructed_media->parent        = NULL;
-	constructed_media->children_list = NULL;
-	constructed_media->next_node     = NULL;
-	constructed_media->prev_node     = NULL;
+	device_path_size = strlen(device_path) + 1;
 
-	if (!dtmd_helper_fill_data(&(constructed_media->path), &(cmd->args[1]), internal_fill_type))
+	async_request = dtmd_helper_async_request_new(device_path_size);
+	if (async_request == NULL)
 	{
-		handle->result_state = dtmd_memory_error;
-		goto dtmd_fill_removable_device_from_notification_implementation_error_2;
+		return dtmd_memory_error;
 	}
 
-	constructed_media->type         = dtmd_string_to_device_type(cmd->args[2]);
+	memcpy(async_request->strings, device_path, device_path_size);
+	async_request->params.list_removable_device.device_path = async_request->strings;
 
-	switch (constructed_media->type)
-	{
-	case dtmd_removable_media_type_device_partition:
-		if (!dtmd_helper_fill_data(&(constructed_media->fstype), &(cmd->args[3]), internal_fill_type))
-		{
-			handle->result_state = dtmd_memory_error;
-			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
-		}
+	async_request->state.list_removable_device.got_started = 0;
+	async_request->state.list_removable_device.accept_multiple_devices = ((strcmp(device_path, dtmd_root_device_path) == 0) ? 1 : 0);
+	async_request->state.list_removable_device.result = NULL;
 
-		if (!dtmd_helper_fill_data(&(constructed_media->label), &(cmd->args[4]), internal_fill_type))
-		{
-			handle->result_state = dtmd_memory_error;
-			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
-		}
+	async_request->callback.removable_devices = callback;
+	async_request->arg = arg;
 
-		if (!dtmd_helper_fill_data(&(constructed_media->mnt_point), &(cmd->args[5]), internal_fill_type))
-		{
-			handle->result_state = dtmd_memory_error;
+	return dtmd_helper_async_process(handle,
+		timeout,
+		async_request,
+		&(async_request->state.list_removable_device),
+		&dtmd_helper_dprintf_list_removable_device,
+		&dtmd_helper_process_list_removable_device,
+		&dtmd_helper_exit_list_removable_device,
+		&dtmd_helper_exit_clear_list_removable_device,
+		&dtmd_helper_complete_list_removable_device);
+}
+
+dtmd_result_t dtmd_mount_async(dtmd_t *handle, int timeout, const char *path, const char *mount_options, dtmd_completion_callback_t callback, void *arg)
+{
+	dtmd_helper_async_request_t *async_request;
+	size_t path_size;
+	size_t mount_options_size = 0;
+
+	if (handle == NULL)
+	{
+		return dtmd_library_not_initialized;
+	}
+
+	if ((path == NULL) || (*path == 0) || (callback == NULL))
+	{
+		return dtmd_input_error;
+	}
+
+	path_size = strlen(path) + 1;
+
+	if (mount_options != NULL)
+	{
+		mount_options_size = strlen(mount_options) + 1;
+	}
+
+	async_request = dtmd_helper_async_request_new(path_size + mount_options_size);
+	if (async_request == NULL)
+	{
+		return dtmd_memory_error;
+	}
+
+	memcpy(async_request->strings, path, path_size);
+	async_request->params.mount.path = async_request->strings;
+	async_request->params.mount.mount_options = NULL;
+
+	if (mount_options != NULL)
+	{
+		memcpy(&(async_request->strings[path_size]), mount_options, mount_options_size);
+		async_request->params.mount.mount_options = &(async_request->strings[path_size]);
+	}
+
+	async_request->callback.generic = callback;
+	async_request->arg = arg;
+
+	return dtmd_helper_async_process(handle,
+		timeout,
+		async_request,
+		NULL,
+		&dtmd_helper_dprintf_mount,
+		&dtmd_helper_process_mount,
+		NULL,
+		NULL,
+		&dtmd_helper_complete_generic);
+}
+
+dtmd_result_t dtmd_unmount_async(dtmd_t *handle, int timeout, const char *path, dtmd_completion_callback_t callback, void *arg)
+{
+	dtmd_helper_async_request_t *async_request;
+	size_t path_size;
+
+	if (handle == NULL)
+	{
+		return dtmd_library_not_initialized;
+	}
+
+	if ((path == NULL) || (*path == 0) || (callback == NULL))
+	{
+		return dtmd_input_error;
+	}
+
+	path_size = strlen(path) + 1;
+
+	async_request = dtmd_helper_async_request_new(path_size);
+	if (async_request == NULL)
+	{
+		return dtmd_memory_error;
+	}
+
+	memcpy(async_request->strings, path, path_size);
+	async_request->params.unmount.path = async_request->strings;
+
+	async_request->callback.generic = callback;
+	async_request->arg = arg;
+
+	return dtmd_helper_async_process(handle,
+		timeout,
+		async_request,
+		NULL,
+		&dtmd_helper_dprintf_unmount,
+		&dtmd_helper_process_unmount,
+		NULL,
+		NULL,
+		&dtmd_helper_complete_generic);
+}
+
+dtmd_result_t dtmd_list_supported_filesystems_async(dtmd_t *handle, int timeout, dtmd_string_list_completion_callback_t callback, void *arg)
+{
+	dtmd_helper_async_request_t *async_request;
+
+	if (handle == NULL)
+	{
+		return dtmd_library_not_initialized;
+	}
+
+	if (callback == NULL)
+	{
+		return dtmd_input_error;
+	}
+
+	async_request = dtmd_helper_async_request_new(0);
+	if (async_request == NULL)
+	{
+		return dtmd_memory_error;
+	}
+
+	async_request->state.list_supported_filesystems.got_started = 0;
+	async_request->state.list_supported_filesystems.got_result = 0;
+	async_request->state.list_supported_filesystems.result_list = NULL;
+	async_request->state.list_supported_filesystems.result_count = 0;
+
+	async_request->callback.string_list = callback;
+	async_request->arg = arg;
+
+	return dtmd_helper_async_process(handle,
+		timeout,
+		async_request,
+		&(async_request->state.list_supported_filesystems),
+		&dtmd_helper_dprintf_list_supported_filesystems,
+		&dtmd_helper_process_list_supported_filesystems,
+		&dtmd_helper_exit_list_supported_filesystems,
+		&dtmd_helper_exit_clear_list_supported_filesystems,
+		&dtmd_helper_complete_list_supported_filesystems);
+}
+
+dtmd_result_t dtmd_list_supported_filesystem_options_async(dtmd_t *handle, int timeout, const char *filesystem, dtmd_string_list_completion_callback_t callback, void *arg)
+{
+	dtmd_helper_async_request_t *async_request;
+	size_t filesystem_size;
+
+	if (handle == NULL)
+	{
+		return dtmd_library_not_initialized;
+	}
+
+	if ((filesystem == NULL) || (callback == NULL))
+	{
+		return dtmd_input_error;
+	}
+
+	filesystem_size = strlen(filesystem) + 1;
+
+	async_request = dtmd_helper_async_request_new(filesystem_size);
+	if (async_request == NULL)
+	{
+		return dtmd_memory_error;
+	}
+
+	memcpy(async_request->strings, filesystem, filesystem_size);
+	async_request->params.list_supported_filesystem_options.filesystem = async_request->strings;
+
+	async_request->state.list_supported_filesystem_options.got_started = 0;
+	async_request->state.list_supported_filesystem_options.got_result = 0;
+	async_request->state.list_supported_filesystem_options.result_list = NULL;
+	async_request->state.list_supported_filesystem_options.result_count = 0;
+
+	async_request->callback.string_list = callback;
+	async_request->arg = arg;
+
+	return dtmd_helper_async_process(handle,
+		timeout,
+		async_request,
+		&(async_request->state.list_supported_filesystem_options),
+		&dtmd_helper_dprintf_list_supported_filesystem_options,
+		&dtmd_helper_process_list_supported_filesystem_options,
+		&dtmd_helper_exit_list_supported_filesystem_options,
+		&dtmd_helper_exit_clear_list_supported_filesystem_options,
+		&dtmd_helper_complete_list_supported_filesystem_options);
+}
+
+#if (defined OS_Linux)
+dtmd_result_t dtmd_poweroff_async(dtmd_t *handle, int timeout, const char *path, dtmd_completion_callback_t callback, void *arg)
+{
+	dtmd_helper_async_request_t *async_request;
+	size_t path_size;
+
+	if (handle == NULL)
+	{
+		return dtmd_library_not_initialized;
+	}
+
+	if ((path == NULL) || (*path == 0) || (callback == NULL))
+	{
+		return dtmd_input_error;
+	}
+
+	path_size = strlen(path) + 1;
+
+	async_request = dtmd_helper_async_request_new(path_size);
+	if (async_request == NULL)
+	{
+		return dtmd_memory_error;
+	}
+
+	memcpy(async_request->strings, path, path_size);
+	async_request->params.poweroff.device_path = async_request->strings;
+
+	async_request->callback.generic = callback;
+	async_request->arg = arg;
+
+	return dtmd_helper_async_process(handle,
+		timeout,
+		async_request,
+		NULL,
+		&dtmd_helper_dprintf_poweroff,
+		&dtmd_helper_process_poweroff,
+		NULL,
+		NULL,
+		&dtmd_helper_complete_generic);
+}
+#endif /* (defined OS_Linux) */
+
+static int dtmd_helper_fill_data(char **where, char **from, dtmd_internal_fill_type_t internal_fill_type)
+{
+	switch (internal_fill_type)
+	{
+	case dtmd_internal_fill_copy:
+		if (*from != NULL)
+		{
+			*where = strdup(*from);
+			if (*where == NULL)
+			{
+				return 0;
+			}
+		}
+		else
+		{
+			*where = NULL;
+		}
+
+		return 1;
+		break;
+
+	case dtmd_internal_fill_link:
+		*where = *from;
+		return 1;
+		break;
+
+	default:
+		return dtmd_input_error;
+		break;
+	}
+
+	return 0;
+}
+
+static dtmd_result_t dtmd_fill_removable_device_from_notification_implementation(dtmd_t *handle, dt_command_t *cmd, dtmd_internal_fill_type_t internal_fill_type, dtmd_removable_media_t **result)
+{
+	dtmd_removable_media_t *constructed_media = NULL;
+
+	constructed_media = (dtmd_removable_media_t*) malloc(sizeof(dtmd_removable_media_t));
+	if (constructed_media == NULL)
+	{
+		goto dtmd_fill_removable_device_from_notification_implementation_error_1;
+	}
+
+	constructed_media->private_data = NULL;
+
+	switch (internal_fill_type)
+	{
+	case dtmd_internal_fill_link:
+		constructed_media->private_data = (void*) (dtmd_removable_media_internal_state_fields_are_linked);
+		break;
+
+	case dtmd_internal_fill_copy:
+	default:
+		break;
+	}
+
+	constructed_media->path          = NULL;
+	constructed_media->type          = dtmd_removable_media_type_unknown_or_persistent;
+	constructed_media->subtype       = dtmd_removable_media_subtype_unknown_or_persistent;
+	constructed_media->state         = dtmd_removable_media_state_unknown;
+	constructed_media->fstype        = NULL;
+	constructed_media->label         = NULL;
+	constructed_media->mnt_point     = NULL;
+	constructed_media->mnt_opts      = NULL;
+	constructed_media->parent        = NULL;
+	constructed_media->children_list = NULL;
+	constructed_media->next_node     = NULL;
+	constructed_media->prev_node     = NULL;
+
+	if (!dtmd_helper_fill_data(&(constructed_media->path), &(cmd->args[1]), internal_fill_type))
+	{
+		goto dtmd_fill_removable_device_from_notification_implementation_error_2;
+	}
+
+	constructed_media->type         = dtmd_string_to_device_type(cmd->args[2]);
+
+	switch (constructed_media->type)
+	{
+	case dtmd_removable_media_type_device_partition:
+		if (!dtmd_helper_fill_data(&(constructed_media->fstype), &(cmd->args[3]), internal_fill_type))
+		{
+			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
+		}
+
+		if (!dtmd_helper_fill_data(&(constructed_media->label), &(cmd->args[4]), internal_fill_type))
+		{
+			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
+		}
+
+		if (!dtmd_helper_fill_data(&(constructed_media->mnt_point), &(cmd->args[5]), internal_fill_type))
+		{
 			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
 		}
 
 		if (!dtmd_helper_fill_data(&(constructed_media->mnt_opts), &(cmd->args[6]), internal_fill_type))
 		{
-			handle->result_state = dtmd_memory_error;
 			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
 		}
 		break;
@@ -1118,25 +2070,21 @@ static dtmd_result_t dtmd_fill_removable_device_from_notification_implementation
 
 		if (!dtmd_helper_fill_data(&(constructed_media->fstype), &(cmd->args[5]), internal_fill_type))
 		{
-			handle->result_state = dtmd_memory_error;
 			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
 		}
 
 		if (!dtmd_helper_fill_data(&(constructed_media->label), &(cmd->args[6]), internal_fill_type))
 		{
-			handle->result_state = dtmd_memory_error;
 			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
 		}
 
 		if (!dtmd_helper_fill_data(&(constructed_media->mnt_point), &(cmd->args[7]), internal_fill_type))
 		{
-			handle->result_state = dtmd_memory_error;
 			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
 		}
 
 		if (!dtmd_helper_fill_data(&(constructed_media->mnt_opts), &(cmd->args[8]), internal_fill_type))
 		{
-			handle->result_state = dtmd_memory_error;
 			goto dtmd_fill_removable_device_from_notification_implementation_error_2;
 		}
 		break;
@@ -1154,11 +2102,12 @@ dtmd_fill_removable_device_from_notification_implementation_error_2:
 	dtmd_helper_free_removable_device_recursive(constructed_media);
 
 dtmd_fill_removable_device_from_notification_implementation_error_1:
-	return handle->result_state;
+	return dtmd_memory_error;
 }
 
 dtmd_result_t dtmd_fill_removable_device_from_notification(dtmd_t *handle, const dt_command_t *cmd, dtmd_fill_type_t fill_type, dtmd_removable_media_t **result)
 {
+	dtmd_result_t res;
 	dtmd_internal_fill_type_t internal_fill_type;
 
 	if (handle == NULL)
@@ -1192,45 +2141,142 @@ dtmd_result_t dtmd_fill_removable_device_from_notification(dtmd_t *handle, const
 	}
 
 	/* it's safe to do a cast here since allowed fill types a read-only ones */
-	return dtmd_fill_removable_device_from_notification_implementation(handle, (dt_command_t*) cmd, internal_fill_type, result);
-}
-
-int dtmd_is_state_invalid(dtmd_t *handle)
-{
-	if (handle == NULL)
+	res = dtmd_fill_removable_device_from_notification_implementation(handle, (dt_command_t*) cmd, internal_fill_type, result);
+	if (res != dtmd_ok)
 	{
-		return 1;
+		handle->result_state = res;
 	}
 
-	return dtmd_helper_is_state_invalid(handle->result_state);
+	return res;
 }
 
-int dtmd_is_notification_valid_removable_device(dtmd_t *handle, const dt_command_t *cmd)
+int dtmd_get_event_fd(dtmd_t *handle)
 {
-	if (handle == NULL)
+	if ((handle == NULL) || (!(handle->flags & dtmd_init_flag_event_loop)))
 	{
-		return 0;
+		return -1;
 	}
 
-	return ((cmd->cmd != NULL)
-		&& ((strcmp(cmd->cmd, dtmd_notification_removable_device_added) == 0)
-			|| (strcmp(cmd->cmd, dtmd_notification_removable_device_changed) == 0))
-		&& (dtmd_helper_cmd_check_removable_device_common(cmd)));
+	return handle->event_fd;
 }
 
-dtmd_error_code_t dtmd_get_code_of_command_fail(dtmd_t *handle)
+int dtmd_get_event_timeout(dtmd_t *handle)
 {
-	if (handle == NULL)
+	int timeout;
+
+	if ((handle == NULL) || (!(handle->flags & dtmd_init_flag_event_loop)))
 	{
-		return dtmd_error_code_unknown;
+		return -1;
 	}
 
-	return handle->error_code;
+	// expired requests wake up event_fd, thus they are completed by next dtmd_process_events call
+	pthread_mutex_lock(&(handle->requests_mutex));
+	timeout = dtmd_helper_expire_requests(handle);
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	return timeout;
 }
 
-void dtmd_free_removable_devices(dtmd_t *handle, dtmd_removable_media_t *devices_list)
+dtmd_result_t dtmd_process_events(dtmd_t *handle, int max_events)
 {
-	if ((handle == NULL) || (devices_list == NULL))
+	dtmd_helper_events_result_t events_result = dtmd_helper_events_none;
+	int events_count = 0;
+	int rc;
+
+	if ((handle == NULL) || (!(handle->flags & dtmd_init_flag_event_loop)))
+	{
+		return dtmd_input_error;
+	}
+
+	if (dtmd_is_state_invalid(handle))
+	{
+		return dtmd_invalid_state;
+	}
+
+	// events are being processed by caller waiting for synchronous request
+	if (pthread_mutex_trylock(&(handle->events_mutex)) != 0)
+	{
+		return dtmd_ok;
+	}
+
+	while ((max_events <= 0) || (events_count < max_events))
+	{
+		events_result = dtmd_helper_process_next_event(handle, 0);
+		if (events_result != dtmd_helper_events_processed)
+		{
+			break;
+		}
+
+		++events_count;
+	}
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+	rc = dtmd_helper_release_events(handle);
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	if ((events_result == dtmd_helper_events_error)
+		|| (events_result == dtmd_helper_events_exit)
+		|| (rc < 0))
+	{
+		dtmd_helper_fail_events(handle);
+		return dtmd_fatal_io_error;
+	}
+
+	return dtmd_ok;
+}
+
+int dtmd_is_state_invalid(dtmd_t *handle)
+{
+	if (handle == NULL)
+	{
+		return 1;
+	}
+
+	return dtmd_helper_is_state_invalid(handle->result_state);
+}
+
+int dtmd_is_device_mirror_synchronized(dtmd_t *handle)
+{
+	int result;
+
+	if ((handle == NULL) || (!(handle->flags & dtmd_init_flag_device_mirror)))
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock(&(handle->mirror_mutex));
+	result = handle->is_mirror_synchronized;
+	pthread_mutex_unlock(&(handle->mirror_mutex));
+
+	return result;
+}
+
+int dtmd_is_notification_valid_removable_device(dtmd_t *handle, const dt_command_t *cmd)
+{
+	if (handle == NULL)
+	{
+		return 0;
+	}
+
+	return ((cmd->cmd != NULL)
+		&& ((strcmp(cmd->cmd, dtmd_notification_removable_device_added) == 0)
+			|| (strcmp(cmd->cmd, dtmd_notification_removable_device_changed) == 0))
+		&& (dtmd_helper_cmd_check_removable_device_common(cmd)));
+}
+
+dtmd_error_code_t dtmd_get_code_of_command_fail(dtmd_t *handle)
+{
+	if (handle == NULL)
+	{
+		return dtmd_error_code_unknown;
+	}
+
+	return handle->error_code;
+}
+
+void dtmd_free_removable_devices(dtmd_t *handle, dtmd_removable_media_t *devices_list)
+{
+	if ((handle == NULL) || (devices_list == NULL))
 	{
 		return;
 	}
@@ -1377,8 +2423,15 @@ static dtmd_result_t dtmd_helper_handle_callback_cmd(dtmd_t *handle, dt_command_
 		|| ((strcmp(cmd->cmd, dtmd_notification_removable_device_removed) == 0) && (cmd->args_count == 1) && (cmd->args[0] != NULL))
 		|| ((strcmp(cmd->cmd, dtmd_notification_removable_device_changed) == 0) && (dtmd_helper_cmd_check_removable_device_common(cmd)))
 		|| ((strcmp(cmd->cmd, dtmd_notification_removable_device_mounted) == 0) && (cmd->args_count == 3) && (cmd->args[0] != NULL) && (cmd->args[1] != NULL) && (cmd->args[2] != NULL))
-		|| ((strcmp(cmd->cmd, dtmd_notification_removable_device_unmounted) == 0) && (cmd->args_count == 2) && (cmd->args[0] != NULL) && (cmd->args[1] != NULL)))
+		|| ((strcmp(cmd->cmd, dtmd_notification_removable_device_unmounted) == 0) && (cmd->args_count == 2) && (cmd->args[0] != NULL) && (cmd->args[1] != NULL))
+		|| ((strcmp(cmd->cmd, dtmd_notification_resync_required) == 0) && (cmd->args_count == 0)))
 	{
+		if (handle->flags & dtmd_init_flag_device_mirror)
+		{
+			// mirror is updated first so that callback sees it already changed
+			dtmd_helper_update_mirror(handle, cmd);
+		}
+
 		handle->callback(handle, handle->callback_arg, cmd);
 		return dtmd_ok;
 	}
@@ -1805,6 +2858,8 @@ static dtmd_result_t dtmd_helper_read_data(dtmd_t *handle, int timeout, struct t
 	dtmd_result_t res;
 	int rc;
 
+	dtmd_helper_compact_buffer(handle);
+
 	if (handle->cur_pos == dtmd_command_max_length)
 	{
 		return dtmd_invalid_state;
@@ -1843,88 +2898,218 @@ static dtmd_result_t dtmd_helper_read_data(dtmd_t *handle, int timeout, struct t
 	return dtmd_ok;
 }
 
-static int dtmd_helper_dprintf_list_all_removable_devices(dtmd_t *handle, void *args)
+/* parsed command points into buffer and remains valid until buffer is compacted */
+static int dtmd_helper_next_command(dtmd_t *handle, dt_command_t *cmd)
+{
+	char *line;
+	char *eol;
+
+	line = &(handle->buffer[handle->buffer_start]);
+
+	eol = strchr(line, '\n');
+	if (eol == NULL)
+	{
+		return 0;
+	}
+
+	handle->buffer_start = eol + 1 - handle->buffer;
+
+	if (dt_helper_parse_command_in_place(line, eol, &(handle->arena), cmd) <= 0)
+	{
+		return -1;
+	}
+
+	return 1;
+}
+
+/* must be called only when no parsed command is in use */
+static void dtmd_helper_compact_buffer(dtmd_t *handle)
+{
+	if (handle->buffer_start > 0)
+	{
+		handle->cur_pos -= handle->buffer_start;
+		memmove(handle->buffer, &(handle->buffer[handle->buffer_start]), handle->cur_pos + 1);
+		handle->buffer_start = 0;
+	}
+
+	dt_helper_arena_reset(&(handle->arena));
+}
+
+static int dtmd_helper_write_all(int fd, const char *data, size_t size)
+{
+	ssize_t rc;
+
+	while (size > 0)
+	{
+		// don't get killed by SIGPIPE if daemon is gone
+		rc = send(fd, data, size, MSG_NOSIGNAL);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return -1;
+		}
+
+		data += rc;
+		size -= rc;
+	}
+
+	return 1;
+}
+
+/* whole request is written at once, thus requests of different threads are never mixed */
+static int dtmd_helper_dprintf_command(dtmd_t *handle, dtmd_helper_request_t *request, const char *command, const char *args_format, ...)
+{
+	va_list args;
+	char buffer[dtmd_command_max_length + 1];
+	char id_string[dtmd_request_id_max_length + 1];
+	int rc;
+	size_t length;
+
+	if (request->id != 0)
+	{
+		snprintf(id_string, sizeof(id_string), "%llu", request->id);
+
+		rc = snprintf(buffer, sizeof(buffer), dtmd_command_tagged_request "(%zu %s, %zu %s%s",
+			strlen(id_string), id_string,
+			strlen(command), command,
+			((*args_format != 0) ? ", " : ""));
+	}
+	else
+	{
+		rc = snprintf(buffer, sizeof(buffer), "%s(", command);
+	}
+
+	if ((rc < 0) || ((size_t) rc >= sizeof(buffer)))
+	{
+		return -1;
+	}
+
+	length = rc;
+
+	va_start(args, args_format);
+	rc = vsnprintf(&(buffer[length]), sizeof(buffer) - length, args_format, args);
+	va_end(args);
+
+	if ((rc < 0) || ((size_t) rc >= sizeof(buffer) - length))
+	{
+		return -1;
+	}
+
+	length += rc;
+
+	// daemon doesn't accept commands longer than dtmd_command_max_length including newline
+	if (length + 2 > dtmd_command_max_length)
+	{
+		return -1;
+	}
+
+	buffer[length++] = ')';
+	buffer[length++] = '\n';
+
+	if (handle->flags & dtmd_init_flag_pipelined)
+	{
+		return dtmd_helper_queue_output(handle, buffer, length);
+	}
+
+	return dtmd_helper_write_all(handle->socket_fd, buffer, length);
+}
+
+static int dtmd_helper_dprintf_list_all_removable_devices(dtmd_t *handle, dtmd_helper_request_t *request, void *args)
 {
-	return dprintf(handle->socket_fd, dtmd_command_list_all_removable_devices "()\n");
+	return dtmd_helper_dprintf_command(handle, request, dtmd_command_list_all_removable_devices, "");
 }
 
-inline static int dtmd_helper_dprintf_list_removable_device_implementation(dtmd_t *handle, dtmd_helper_params_list_removable_device_t *args)
+inline static int dtmd_helper_dprintf_list_removable_device_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_params_list_removable_device_t *args)
 {
-	return dprintf(handle->socket_fd, dtmd_command_list_removable_device "(%zu %s)\n", strlen(args->device_path), args->device_path);
+	return dtmd_helper_dprintf_command(handle, request, dtmd_command_list_removable_device, "%zu %s", strlen(args->device_path), args->device_path);
 }
 
-static int dtmd_helper_dprintf_list_removable_device(dtmd_t *handle, void *args)
+static int dtmd_helper_dprintf_list_removable_device(dtmd_t *handle, dtmd_helper_request_t *request, void *args)
 {
-	return dtmd_helper_dprintf_list_removable_device_implementation(handle, (dtmd_helper_params_list_removable_device_t*) args);
+	return dtmd_helper_dprintf_list_removable_device_implementation(handle, request, (dtmd_helper_params_list_removable_device_t*) args);
 }
 
-inline static int dtmd_helper_dprintf_mount_implementation(dtmd_t *handle, dtmd_helper_params_mount_t *args)
+inline static int dtmd_helper_dprintf_mount_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_params_mount_t *args)
 {
-	return dprintf(handle->socket_fd, dtmd_command_mount "(%zu %s, %d%s%s)\n",
+	return dtmd_helper_dprintf_command(handle, request, dtmd_command_mount, "%zu %s, %d%s%s",
 		strlen(args->path), args->path,
 		dt_helper_print_with_all_checks(args->mount_options));
 }
 
-static int dtmd_helper_dprintf_mount(dtmd_t *handle, void *args)
+static int dtmd_helper_dprintf_mount(dtmd_t *handle, dtmd_helper_request_t *request, void *args)
 {
-	return dtmd_helper_dprintf_mount_implementation(handle, (dtmd_helper_params_mount_t*) args);
+	return dtmd_helper_dprintf_mount_implementation(handle, request, (dtmd_helper_params_mount_t*) args);
 }
 
-inline static int dtmd_helper_dprintf_unmount_implementation(dtmd_t *handle, dtmd_helper_params_unmount_t *args)
+inline static int dtmd_helper_dprintf_unmount_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_params_unmount_t *args)
 {
-	return dprintf(handle->socket_fd, dtmd_command_unmount "(%zu %s)\n", strlen(args->path), args->path);
+	return dtmd_helper_dprintf_command(handle, request, dtmd_command_unmount, "%zu %s", strlen(args->path), args->path);
 }
 
-static int dtmd_helper_dprintf_unmount(dtmd_t *handle, void *args)
+static int dtmd_helper_dprintf_unmount(dtmd_t *handle, dtmd_helper_request_t *request, void *args)
 {
-	return dtmd_helper_dprintf_unmount_implementation(handle, (dtmd_helper_params_unmount_t*) args);
+	return dtmd_helper_dprintf_unmount_implementation(handle, request, (dtmd_helper_params_unmount_t*) args);
 }
 
-static int dtmd_helper_dprintf_list_supported_filesystems(dtmd_t *handle, void *args)
+static int dtmd_helper_dprintf_list_supported_filesystems(dtmd_t *handle, dtmd_helper_request_t *request, void *args)
 {
-	return dprintf(handle->socket_fd, dtmd_command_list_supported_filesystems "()\n");
+	return dtmd_helper_dprintf_command(handle, request, dtmd_command_list_supported_filesystems, "");
 }
 
-inline static int dtmd_helper_dprintf_list_supported_filesystem_options_implementation(dtmd_t *handle, dtmd_helper_params_list_supported_filesystem_options_t *args)
+inline static int dtmd_helper_dprintf_list_supported_filesystem_options_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_params_list_supported_filesystem_options_t *args)
 {
-	return dprintf(handle->socket_fd, dtmd_command_list_supported_filesystem_options "(%zu %s)\n", strlen(args->filesystem), args->filesystem);
+	return dtmd_helper_dprintf_command(handle, request, dtmd_command_list_supported_filesystem_options, "%zu %s", strlen(args->filesystem), args->filesystem);
 }
 
-static int dtmd_helper_dprintf_list_supported_filesystem_options(dtmd_t *handle, void *args)
+static int dtmd_helper_dprintf_list_supported_filesystem_options(dtmd_t *handle, dtmd_helper_request_t *request, void *args)
 {
-	return dtmd_helper_dprintf_list_supported_filesystem_options_implementation(handle, (dtmd_helper_params_list_supported_filesystem_options_t*) args);
+	return dtmd_helper_dprintf_list_supported_filesystem_options_implementation(handle, request, (dtmd_helper_params_list_supported_filesystem_options_t*) args);
 }
 
 #if (defined OS_Linux)
-inline static int dtmd_helper_dprintf_poweroff_implementation(dtmd_t *handle, dtmd_helper_params_poweroff_t *args)
+inline static int dtmd_helper_dprintf_poweroff_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_params_poweroff_t *args)
 {
-	return dprintf(handle->socket_fd, dtmd_command_poweroff "(%zu %s)\n", strlen(args->device_path), args->device_path);
+	return dtmd_helper_dprintf_command(handle, request, dtmd_command_poweroff, "%zu %s", strlen(args->device_path), args->device_path);
 }
 
-static int dtmd_helper_dprintf_poweroff(dtmd_t *handle, void *args)
+static int dtmd_helper_dprintf_poweroff(dtmd_t *handle, dtmd_helper_request_t *request, void *args)
 {
-	return dtmd_helper_dprintf_poweroff_implementation(handle, (dtmd_helper_params_poweroff_t*) args);
+	return dtmd_helper_dprintf_poweroff_implementation(handle, request, (dtmd_helper_params_poweroff_t*) args);
 }
 #endif /* (defined OS_Linux) */
 
 dtmd_result_t dtmd_helper_generic_process(dtmd_t *handle, int timeout, void *params, void *state, dtmd_helper_dprintf_func_t dprintf_func, dtmd_helper_process_func_t process_func, dtmd_helper_exit_func_t exit_func, dtmd_helper_exit_clear_func_t exit_clear_func)
 {
 	char data = 0;
-	dt_command_t *cmd;
+	dt_command_t cmd;
 	dtmd_result_t res;
+	int rc;
 	struct timespec time_cur, time_end;
-	char *eol;
 	dtmd_helper_result_t result_code;
+	dtmd_helper_request_t request;
 
 	if (dtmd_is_state_invalid(handle))
 	{
 		return dtmd_invalid_state;
 	}
 
+	if (handle->flags & dtmd_init_flag_pipelined)
+	{
+		return dtmd_helper_pipelined_process(handle, timeout, params, state, dprintf_func, process_func, exit_func, exit_clear_func);
+	}
+
+	request.result_state = dtmd_ok;
+	request.error_code   = handle->error_code;
+	request.id           = 0;
+
 	res = dtmd_helper_capture_socket(handle, timeout, &time_cur, &time_end);
 	if (res != dtmd_ok)
 	{
-		handle->result_state = res;
+		request.result_state = res;
 
 		if (dtmd_helper_is_state_invalid(res))
 		{
@@ -1938,38 +3123,27 @@ dtmd_result_t dtmd_helper_generic_process(dtmd_t *handle, int timeout, void *par
 
 	if (handle->socket_fd < 0)
 	{
-		handle->result_state = dtmd_not_connected;
+		request.result_state = dtmd_not_connected;
 		goto dtmd_helper_generic_process_exit;
 	}
 
-	if (dprintf_func(handle, params) < 0)
+	if (dprintf_func(handle, &request, params) < 0)
 	{
-		handle->result_state = dtmd_io_error;
+		request.result_state = dtmd_io_error;
 		goto dtmd_helper_generic_process_error;
 	}
 
 	for (;;)
 	{
-		while ((eol = strchr(handle->buffer, '\n')) != NULL)
+		while ((rc = dtmd_helper_next_command(handle, &cmd)) != 0)
 		{
-			if (!dt_validate_command(handle->buffer))
-			{
-				goto dtmd_helper_generic_process_error;
-			}
-
-			cmd = dt_parse_command(handle->buffer);
-
-			handle->cur_pos -= (eol + 1 - handle->buffer);
-			memmove(handle->buffer, eol+1, handle->cur_pos + 1);
-
-			if (cmd == NULL)
+			if (rc < 0)
 			{
-				handle->result_state = dtmd_invalid_state;
+				request.result_state = dtmd_invalid_state;
 				goto dtmd_helper_generic_process_error;
 			}
 
-			result_code = process_func(handle, cmd, params, state);
-			dt_free_command(cmd);
+			result_code = process_func(handle, &request, &cmd, params, state);
 
 			switch (result_code)
 			{
@@ -1985,7 +3159,7 @@ dtmd_result_t dtmd_helper_generic_process(dtmd_t *handle, int timeout, void *par
 
 		if (res != dtmd_ok)
 		{
-			handle->result_state = res;
+			request.result_state = res;
 
 			if (dtmd_helper_is_state_invalid(res))
 			{
@@ -2001,7 +3175,7 @@ dtmd_result_t dtmd_helper_generic_process(dtmd_t *handle, int timeout, void *par
 dtmd_helper_generic_process_exit:
 	if (state != NULL)
 	{
-		if (!exit_func(handle, state))
+		if (!exit_func(handle, &request, state))
 		{
 			goto dtmd_helper_generic_process_error;
 		}
@@ -2018,91 +3192,1045 @@ dtmd_helper_generic_process_error:
 	write(handle->pipes[1], &data, sizeof(char));
 
 dtmd_helper_generic_process_finish:
+	handle->result_state = request.result_state;
+	handle->error_code   = request.error_code;
+
 	sem_post(&(handle->caller_socket));
 	return handle->result_state;
 }
 
-inline static dtmd_helper_result_t dtmd_helper_process_list_all_removable_devices_implementation(dtmd_t *handle, dt_command_t *cmd, void *params, dtmd_helper_state_list_all_removable_devices_t *state)
+static void dtmd_helper_init_request(dtmd_helper_request_t *request, void *params, void *state, dtmd_helper_dprintf_func_t dprintf_func, dtmd_helper_process_func_t process_func, dtmd_helper_exit_func_t exit_func, dtmd_helper_exit_clear_func_t exit_clear_func)
+{
+	request->result_state    = dtmd_ok;
+	request->error_code      = dtmd_error_code_unknown;
+	request->id              = 0;
+	request->params          = params;
+	request->state           = state;
+	request->dprintf_func    = dprintf_func;
+	request->process_func    = process_func;
+	request->exit_func       = exit_func;
+	request->exit_clear_func = exit_clear_func;
+	request->is_pending      = 0;
+	request->is_finished     = 0;
+	request->complete_func   = NULL;
+	request->has_timeout     = 0;
+	request->next_node       = NULL;
+	request->prev_node       = NULL;
+}
+
+static int dtmd_helper_calculate_time_end(int timeout, struct timespec *time_end)
+{
+	if (clock_gettime(CLOCK_MONOTONIC, time_end) == -1)
+	{
+		return -1;
+	}
+
+	time_end->tv_sec  += timeout / 1000;
+	time_end->tv_nsec += (timeout % 1000) * 1000000;
+
+	if (time_end->tv_nsec >= 1000000000)
+	{
+		time_end->tv_sec  += 1;
+		time_end->tv_nsec -= 1000000000;
+	}
+
+	return 1;
+}
+
+static dtmd_result_t dtmd_helper_pipelined_process(dtmd_t *handle, int timeout, void *params, void *state, dtmd_helper_dprintf_func_t dprintf_func, dtmd_helper_process_func_t process_func, dtmd_helper_exit_func_t exit_func, dtmd_helper_exit_clear_func_t exit_clear_func)
 {
 	dtmd_result_t res;
-	int is_parent_path = 0;
-	dtmd_removable_media_t *media_ptr = NULL;
-	dtmd_removable_media_t *constructed_media = NULL;
-	dtmd_removable_media_t *last_ptr = NULL;
-	dtmd_removable_media_t **root_ptr = NULL;
+	struct timespec time_end;
+	dtmd_helper_request_t request;
 
-	if (state->got_started)
+	dtmd_helper_init_request(&request, params, state, dprintf_func, process_func, exit_func, exit_clear_func);
+
+	if ((timeout >= 0) && (dtmd_helper_calculate_time_end(timeout, &time_end) < 0))
 	{
-		if ((strcmp(cmd->cmd, dtmd_response_finished) == 0)
-			&& (dtmd_helper_is_helper_list_all_removable_devices_generic(cmd)))
-		{
-			handle->result_state = dtmd_ok;
-			handle->library_state = dtmd_state_default;
-			return dtmd_helper_result_exit;
-		}
+		return dtmd_time_error;
+	}
 
-		if (dtmd_helper_cmd_check_removable_device(cmd))
+	pthread_mutex_lock(&(handle->requests_mutex));
+
+	res = dtmd_helper_submit_request(handle, &request);
+	if (res != dtmd_ok)
+	{
+		request.result_state = res;
+		goto dtmd_helper_pipelined_process_finish;
+	}
+
+	while (!request.is_finished)
+	{
+		res = dtmd_helper_wait_for_requests(handle, timeout, &time_end);
+		if ((res != dtmd_ok) && (!request.is_finished))
 		{
-			if (strcmp(cmd->args[0], dtmd_root_device_path) == 0)
-			{
-				is_parent_path = 1;
-			}
+			// response may still arrive, but nobody is waiting for it anymore
+			dtmd_helper_unlink_request(handle, &request);
 
-			if (!is_parent_path)
+			if (state != NULL)
 			{
-				media_ptr = dtmd_find_media(cmd->args[0], state->result);
-				if (media_ptr == NULL)
-				{
-					handle->result_state = dtmd_invalid_state;
-					return dtmd_helper_result_error;
-				}
+				exit_clear_func(state);
 			}
 
-			res = dtmd_fill_removable_device_from_notification_implementation(handle, cmd, dtmd_internal_fill_move, &constructed_media);
-			if (res != dtmd_ok)
-			{
-				handle->result_state = res;
-				return dtmd_helper_result_error;
-			}
+			request.result_state = res;
 
-			if (is_parent_path)
-			{
-				constructed_media->parent = NULL;
-				root_ptr = &(state->result);
-			}
-			else
-			{
-				constructed_media->parent = media_ptr;
-				root_ptr = &(media_ptr->children_list);
-			}
+			dtmd_helper_send_pending_requests(handle);
+			break;
+		}
+	}
 
-			media_ptr = *root_ptr;
+dtmd_helper_pipelined_process_finish:
+	if (!dtmd_helper_is_state_invalid(handle->result_state))
+	{
+		handle->result_state = request.result_state;
+	}
 
-			while (media_ptr != NULL)
-			{
-				if (strcmp(constructed_media->path, media_ptr->path) < 0)
-				{
-					break;
-				}
+	if (request.result_state == dt_command_failed)
+	{
+		handle->error_code = request.error_code;
+	}
 
-				last_ptr = media_ptr;
-				media_ptr = media_ptr->next_node;
-			}
+	pthread_mutex_unlock(&(handle->requests_mutex));
 
-			if (last_ptr != NULL)
-			{
-				constructed_media->prev_node = last_ptr;
-				constructed_media->next_node = last_ptr->next_node;
-				last_ptr->next_node = constructed_media;
+	return request.result_state;
+}
 
-				if (constructed_media->next_node != NULL)
-				{
-					constructed_media->next_node->prev_node = constructed_media;
-				}
-			}
-			else
-			{
-				constructed_media->next_node = *root_ptr;
+static dtmd_helper_async_request_t* dtmd_helper_async_request_new(size_t strings_size)
+{
+	return (dtmd_helper_async_request_t*) malloc(sizeof(dtmd_helper_async_request_t) + strings_size);
+}
+
+/* async_request is either passed to worker or freed */
+static dtmd_result_t dtmd_helper_async_process(dtmd_t *handle, int timeout, dtmd_helper_async_request_t *async_request, void *state, dtmd_helper_dprintf_func_t dprintf_func, dtmd_helper_process_func_t process_func, dtmd_helper_exit_func_t exit_func, dtmd_helper_exit_clear_func_t exit_clear_func, dtmd_helper_complete_func_t complete_func)
+{
+	dtmd_result_t res;
+	dtmd_helper_request_t *request = &(async_request->request);
+
+	if (!(handle->flags & dtmd_init_flag_pipelined))
+	{
+		res = dtmd_input_error;
+		goto dtmd_helper_async_process_error;
+	}
+
+	if (dtmd_is_state_invalid(handle))
+	{
+		res = dtmd_invalid_state;
+		goto dtmd_helper_async_process_error;
+	}
+
+	dtmd_helper_init_request(request, &(async_request->params), state, dprintf_func, process_func, exit_func, exit_clear_func);
+	request->complete_func = complete_func;
+
+	if (timeout >= 0)
+	{
+		if (dtmd_helper_calculate_time_end(timeout, &(request->time_end)) < 0)
+		{
+			res = dtmd_time_error;
+			goto dtmd_helper_async_process_error;
+		}
+
+		request->has_timeout = 1;
+	}
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+
+	res = dtmd_helper_submit_request(handle, request);
+	if (res != dtmd_ok)
+	{
+		pthread_mutex_unlock(&(handle->requests_mutex));
+		goto dtmd_helper_async_process_error;
+	}
+
+	if (request->has_timeout)
+	{
+		// worker has to take new timeout into account
+		dtmd_helper_wake_worker(handle);
+	}
+
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	return dtmd_ok;
+
+dtmd_helper_async_process_error:
+	free(async_request);
+	return res;
+}
+
+static dtmd_result_t dtmd_helper_wait_for_requests(dtmd_t *handle, int timeout, const struct timespec *time_end)
+{
+	int rc;
+
+	if ((handle->flags & dtmd_init_flag_event_loop)
+		&& (pthread_mutex_trylock(&(handle->events_mutex)) == 0))
+	{
+		return dtmd_helper_wait_processing_events(handle, timeout, time_end);
+	}
+
+	if (timeout >= 0)
+	{
+		rc = pthread_cond_timedwait(&(handle->requests_cond), &(handle->requests_mutex), time_end);
+	}
+	else
+	{
+		rc = pthread_cond_wait(&(handle->requests_cond), &(handle->requests_mutex));
+	}
+
+	switch (rc)
+	{
+	case 0:
+		return dtmd_ok;
+
+	case ETIMEDOUT:
+		return dtmd_timeout;
+
+	default:
+		return dtmd_time_error;
+	}
+}
+
+/* requests_mutex must be locked and events_mutex must be acquired, the latter is released before return */
+static dtmd_result_t dtmd_helper_wait_processing_events(dtmd_t *handle, int timeout, const struct timespec *time_end)
+{
+	struct timespec time_cur;
+	long long time_left = -1;
+	dtmd_helper_events_result_t events_result;
+	int rc;
+
+	if (timeout >= 0)
+	{
+		if (clock_gettime(CLOCK_MONOTONIC, &time_cur) == -1)
+		{
+			dtmd_helper_release_events(handle);
+			return dtmd_time_error;
+		}
+
+		time_left = (time_end->tv_sec - time_cur.tv_sec) * 1000LL
+			+ (time_end->tv_nsec - time_cur.tv_nsec + 999999) / 1000000;
+
+		if (time_left <= 0)
+		{
+			dtmd_helper_release_events(handle);
+			return dtmd_timeout;
+		}
+
+		if (time_left > INT_MAX)
+		{
+			time_left = INT_MAX;
+		}
+	}
+
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	events_result = dtmd_helper_process_next_event(handle, (int) time_left);
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+
+	rc = dtmd_helper_release_events(handle);
+
+	if ((events_result == dtmd_helper_events_error)
+		|| (events_result == dtmd_helper_events_exit)
+		|| (rc < 0))
+	{
+		// all requests are failed, including the one being waited for
+		pthread_mutex_unlock(&(handle->requests_mutex));
+		dtmd_helper_fail_events(handle);
+		pthread_mutex_lock(&(handle->requests_mutex));
+	}
+
+	return dtmd_ok;
+}
+
+/* requests_mutex must be locked */
+static void dtmd_helper_wake_worker(dtmd_t *handle)
+{
+	char data = 2;
+
+	// worker consumes wakeup only after locking the mutex, thus pipe never holds more than one of them
+	if (!handle->is_worker_woken)
+	{
+		handle->is_worker_woken = 1;
+		write(handle->pipes[1], &data, sizeof(char));
+	}
+}
+
+/* requests_mutex must be locked */
+static dtmd_result_t dtmd_helper_submit_request(dtmd_t *handle, dtmd_helper_request_t *request)
+{
+	switch (handle->protocol_state)
+	{
+	case dtmd_protocol_disconnected:
+		return dtmd_not_connected;
+
+	case dtmd_protocol_failed:
+		return dtmd_fatal_io_error;
+
+	default:
+		break;
+	}
+
+	request->is_pending = 1;
+	request->next_node  = NULL;
+	request->prev_node  = handle->pending_requests_last;
+
+	if (handle->pending_requests_last != NULL)
+	{
+		handle->pending_requests_last->next_node = request;
+	}
+	else
+	{
+		handle->pending_requests_first = request;
+	}
+
+	handle->pending_requests_last = request;
+
+	dtmd_helper_send_pending_requests(handle);
+
+	return dtmd_ok;
+}
+
+/* requests_mutex must be locked */
+static void dtmd_helper_send_pending_requests(dtmd_t *handle)
+{
+	dtmd_helper_request_t *request;
+
+	// daemons not supporting tagged requests get them one by one
+	while ((handle->pending_requests_first != NULL)
+		&& ((handle->protocol_state == dtmd_protocol_tagged)
+			|| ((handle->protocol_state == dtmd_protocol_untagged) && (handle->requests == NULL))))
+	{
+		request = handle->pending_requests_first;
+		dtmd_helper_unlink_request(handle, request);
+
+		if (handle->protocol_state == dtmd_protocol_tagged)
+		{
+			request->id = ++(handle->last_request_id);
+		}
+
+		request->next_node = handle->requests;
+		if (handle->requests != NULL)
+		{
+			handle->requests->prev_node = request;
+		}
+		handle->requests = request;
+
+		if (request->dprintf_func(handle, request, request->params) < 0)
+		{
+			dtmd_helper_fail_request(handle, request, dtmd_io_error);
+		}
+	}
+}
+
+/* requests_mutex must be locked. Nothing is written to socket unless it's writable, rest is sent by worker */
+static int dtmd_helper_queue_output(dtmd_t *handle, const char *data, size_t size)
+{
+	ssize_t rc;
+	size_t new_size;
+	char *new_buffer;
+
+	if (handle->socket_fd < 0)
+	{
+		return -1;
+	}
+
+	if (handle->output_buffer_used == 0)
+	{
+		rc = dtmd_helper_send_nonblocking(handle->socket_fd, data, size);
+		if (rc < 0)
+		{
+			return -1;
+		}
+
+		data += rc;
+		size -= rc;
+
+		if (size == 0)
+		{
+			return 1;
+		}
+	}
+
+	if (handle->output_buffer_used + size > handle->output_buffer_size)
+	{
+		new_size = handle->output_buffer_size * 2;
+		if (new_size < handle->output_buffer_used + size)
+		{
+			new_size = handle->output_buffer_used + size;
+		}
+
+		if (new_size < dtmd_command_max_length)
+		{
+			new_size = dtmd_command_max_length;
+		}
+
+		new_buffer = (char*) realloc(handle->output_buffer, new_size);
+		if (new_buffer == NULL)
+		{
+			return -1;
+		}
+
+		handle->output_buffer      = new_buffer;
+		handle->output_buffer_size = new_size;
+	}
+
+	memcpy(&(handle->output_buffer[handle->output_buffer_used]), data, size);
+	handle->output_buffer_used += size;
+
+	dtmd_helper_wake_worker(handle);
+
+	return 1;
+}
+
+/* called by worker when socket is writable */
+static int dtmd_helper_flush_output(dtmd_t *handle)
+{
+	ssize_t rc;
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+
+	rc = dtmd_helper_send_nonblocking(handle->socket_fd, handle->output_buffer, handle->output_buffer_used);
+	if (rc > 0)
+	{
+		handle->output_buffer_used -= rc;
+		memmove(handle->output_buffer, &(handle->output_buffer[rc]), handle->output_buffer_used);
+	}
+
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	return ((rc < 0) ? -1 : 1);
+}
+
+static ssize_t dtmd_helper_send_nonblocking(int fd, const char *data, size_t size)
+{
+	ssize_t rc;
+	size_t sent = 0;
+
+	while (sent < size)
+	{
+		rc = send(fd, &(data[sent]), size - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			{
+				break;
+			}
+
+			return -1;
+		}
+
+		sent += rc;
+	}
+
+	return sent;
+}
+
+/* requests_mutex must be locked */
+static void dtmd_helper_unlink_request(dtmd_t *handle, dtmd_helper_request_t *request)
+{
+	if (request->prev_node != NULL)
+	{
+		request->prev_node->next_node = request->next_node;
+	}
+	else if (request->is_pending)
+	{
+		handle->pending_requests_first = request->next_node;
+	}
+	else
+	{
+		handle->requests = request->next_node;
+	}
+
+	if (request->next_node != NULL)
+	{
+		request->next_node->prev_node = request->prev_node;
+	}
+	else if (request->is_pending)
+	{
+		handle->pending_requests_last = request->prev_node;
+	}
+
+	request->next_node  = NULL;
+	request->prev_node  = NULL;
+	request->is_pending = 0;
+
+	if (handle->current_request == request)
+	{
+		handle->current_request = NULL;
+	}
+}
+
+static dtmd_helper_request_t* dtmd_helper_find_request(dtmd_t *handle, const char *id_string)
+{
+	dtmd_helper_request_t *request;
+	unsigned long long id;
+	char *endptr;
+
+	errno = 0;
+	id = strtoull(id_string, &endptr, 10);
+	if ((errno != 0) || (*id_string == 0) || (*endptr != 0))
+	{
+		return NULL;
+	}
+
+	for (request = handle->requests; request != NULL; request = request->next_node)
+	{
+		if (request->id == id)
+		{
+			return request;
+		}
+	}
+
+	return NULL;
+}
+
+/* requests_mutex must be locked */
+static void dtmd_helper_finish_request(dtmd_t *handle, dtmd_helper_request_t *request)
+{
+	dtmd_helper_unlink_request(handle, request);
+	request->is_finished = 1;
+
+	if (request->complete_func != NULL)
+	{
+		if (!dtmd_helper_is_state_invalid(handle->result_state))
+		{
+			handle->result_state = request->result_state;
+		}
+
+		// completion callbacks are called by worker without holding the lock
+		request->next_node = handle->completed_requests;
+		handle->completed_requests = request;
+
+		dtmd_helper_wake_worker(handle);
+	}
+	else
+	{
+		pthread_cond_broadcast(&(handle->requests_cond));
+	}
+}
+
+/* requests_mutex must be locked */
+static void dtmd_helper_fail_request(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_result_t result)
+{
+	request->result_state = result;
+
+	if (request->state != NULL)
+	{
+		request->exit_clear_func(request->state);
+	}
+
+	dtmd_helper_finish_request(handle, request);
+}
+
+/* requests_mutex must be locked */
+static void dtmd_helper_finish_all_requests(dtmd_t *handle, dtmd_result_t result, dtmd_protocol_state_t protocol_state)
+{
+	while (handle->requests != NULL)
+	{
+		dtmd_helper_fail_request(handle, handle->requests, result);
+	}
+
+	while (handle->pending_requests_first != NULL)
+	{
+		dtmd_helper_fail_request(handle, handle->pending_requests_first, result);
+	}
+
+	handle->protocol_state = protocol_state;
+	pthread_cond_broadcast(&(handle->requests_cond));
+}
+
+/* requests_mutex must be locked. Returns timeout in milliseconds until next asynchronous request expires, or -1 */
+static int dtmd_helper_expire_requests(dtmd_t *handle)
+{
+	dtmd_helper_request_t *request;
+	dtmd_helper_request_t *next_request;
+	dtmd_helper_request_t *lists[2];
+	struct timespec time_cur;
+	long long time_left;
+	long long min_time_left = -1;
+	size_t i;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &time_cur) == -1)
+	{
+		return -1;
+	}
+
+	lists[0] = handle->requests;
+	lists[1] = handle->pending_requests_first;
+
+	for (i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i)
+	{
+		for (request = lists[i]; request != NULL; request = next_request)
+		{
+			next_request = request->next_node;
+
+			if ((request->complete_func == NULL) || (!request->has_timeout))
+			{
+				continue;
+			}
+
+			time_left = (request->time_end.tv_sec - time_cur.tv_sec) * 1000LL
+				+ (request->time_end.tv_nsec - time_cur.tv_nsec + 999999) / 1000000;
+
+			if (time_left <= 0)
+			{
+				// response may still arrive, but nobody is waiting for it anymore
+				dtmd_helper_fail_request(handle, request, dtmd_timeout);
+			}
+			else if ((min_time_left < 0) || (time_left < min_time_left))
+			{
+				min_time_left = time_left;
+			}
+		}
+	}
+
+	dtmd_helper_send_pending_requests(handle);
+
+	if (min_time_left > INT_MAX)
+	{
+		min_time_left = INT_MAX;
+	}
+
+	return (int) min_time_left;
+}
+
+/* called by worker without holding requests_mutex */
+static void dtmd_helper_run_completions(dtmd_t *handle)
+{
+	dtmd_helper_request_t *completed;
+	dtmd_helper_request_t *request;
+	dtmd_helper_request_t *next_request;
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+	completed = handle->completed_requests;
+	handle->completed_requests = NULL;
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	// restore order of completion
+	request = NULL;
+
+	while (completed != NULL)
+	{
+		next_request = completed->next_node;
+		completed->next_node = request;
+		request = completed;
+		completed = next_request;
+	}
+
+	for (; request != NULL; request = next_request)
+	{
+		next_request = request->next_node;
+		request->complete_func(handle, request);
+	}
+}
+
+static int dtmd_helper_start_negotiation(dtmd_t *handle)
+{
+	static const char negotiation[] = dtmd_command_request_ids "()\n" dtmd_command_list_supported_filesystems "()\n";
+	int rc;
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+
+	handle->protocol_state = dtmd_protocol_negotiating;
+	handle->is_request_ids_supported = 0;
+	handle->library_state = dtmd_state_default;
+	handle->current_request = NULL;
+	handle->output_buffer_used = 0;
+	handle->is_mirror_seed_required = ((handle->flags & dtmd_init_flag_device_mirror) ? 1 : 0);
+
+	// daemons not supporting tagged requests silently ignore first command, response to second one shows that negotiation is over
+	rc = dtmd_helper_queue_output(handle, negotiation, sizeof(negotiation) - 1);
+
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	return rc;
+}
+
+static dtmd_result_t dtmd_helper_negotiate(dtmd_t *handle, dt_command_t *cmd)
+{
+	dtmd_result_t res;
+
+	if ((handle->library_state == dtmd_state_default)
+		&& (strcmp(cmd->cmd, dtmd_response_succeeded) == 0)
+		&& (cmd->args_count == 1)
+		&& (cmd->args[0] != NULL)
+		&& (strcmp(cmd->args[0], dtmd_command_request_ids) == 0))
+	{
+		handle->is_request_ids_supported = 1;
+		return dtmd_ok;
+	}
+
+	res = dtmd_helper_handle_cmd(handle, cmd);
+	if (res != dtmd_ok)
+	{
+		return res;
+	}
+
+	if ((strcmp(cmd->cmd, dtmd_response_finished) == 0)
+		&& (dtmd_helper_is_helper_list_supported_filesystems_generic(cmd)))
+	{
+		pthread_mutex_lock(&(handle->requests_mutex));
+		handle->protocol_state = ((handle->is_request_ids_supported) ? dtmd_protocol_tagged : dtmd_protocol_untagged);
+		dtmd_helper_send_pending_requests(handle);
+		pthread_mutex_unlock(&(handle->requests_mutex));
+	}
+
+	return dtmd_ok;
+}
+
+static int dtmd_helper_is_response(dt_command_t *cmd)
+{
+	return (strcmp(cmd->cmd, dtmd_response_started) == 0)
+		|| (strcmp(cmd->cmd, dtmd_response_finished) == 0)
+		|| (strcmp(cmd->cmd, dtmd_response_succeeded) == 0)
+		|| (strcmp(cmd->cmd, dtmd_response_failed) == 0);
+}
+
+/* passes commands received by worker in pipelined mode to requests waiting for them */
+static dtmd_result_t dtmd_helper_dispatch_cmd(dtmd_t *handle, dt_command_t *cmd)
+{
+	dtmd_result_t res = dtmd_ok;
+	dtmd_helper_request_t *request = NULL;
+	char *id_string = NULL;
+	int is_response;
+
+	if (handle->protocol_state == dtmd_protocol_negotiating)
+	{
+		return dtmd_helper_negotiate(handle, cmd);
+	}
+
+	is_response = dtmd_helper_is_response(cmd);
+
+	if ((handle->library_state == dtmd_state_default) && (!is_response))
+	{
+		// notification
+		return dtmd_helper_handle_cmd(handle, cmd);
+	}
+
+	if ((handle->protocol_state == dtmd_protocol_tagged) && (is_response))
+	{
+		if ((cmd->args_count == 0) || (cmd->args[0] == NULL))
+		{
+			return dtmd_fatal_io_error;
+		}
+
+		// strip request id, the rest is same as response to untagged request
+		id_string = cmd->args[0];
+		--(cmd->args_count);
+		memmove(cmd->args, &(cmd->args[1]), cmd->args_count * sizeof(char*));
+	}
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+
+	if (handle->library_state == dtmd_state_default)
+	{
+		if (id_string != NULL)
+		{
+			handle->current_request = dtmd_helper_find_request(handle, id_string);
+		}
+		else
+		{
+			// only one untagged request may be sent at once
+			handle->current_request = handle->requests;
+		}
+	}
+
+	request = handle->current_request;
+
+	if (request == NULL)
+	{
+		// response to request which timed out
+		pthread_mutex_unlock(&(handle->requests_mutex));
+		res = dtmd_helper_handle_cmd(handle, cmd);
+		goto dtmd_helper_dispatch_cmd_exit;
+	}
+
+	switch (request->process_func(handle, request, cmd, request->params, request->state))
+	{
+	case dtmd_helper_result_ok:
+		break;
+
+	case dtmd_helper_result_exit:
+		if ((request->state == NULL) || (request->exit_func(handle, request, request->state)))
+		{
+			dtmd_helper_finish_request(handle, request);
+			break;
+		}
+		/* fallthrough */
+
+	case dtmd_helper_result_error:
+		if (request->state != NULL)
+		{
+			request->exit_clear_func(request->state);
+		}
+
+		res = request->result_state;
+		if (!dtmd_helper_is_state_invalid(res))
+		{
+			res = dtmd_invalid_state;
+		}
+
+		dtmd_helper_finish_request(handle, request);
+		break;
+	}
+
+	if (handle->library_state == dtmd_state_default)
+	{
+		handle->current_request = NULL;
+	}
+
+	if (request->is_finished)
+	{
+		dtmd_helper_send_pending_requests(handle);
+	}
+
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+dtmd_helper_dispatch_cmd_exit:
+	if (id_string != NULL)
+	{
+		// put id back so that it's freed with command
+		memmove(&(cmd->args[1]), cmd->args, cmd->args_count * sizeof(char*));
+		cmd->args[0] = id_string;
+		++(cmd->args_count);
+	}
+
+	return res;
+}
+
+inline static dtmd_helper_result_t dtmd_helper_process_list_all_removable_devices_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, dtmd_helper_state_list_all_removable_devices_t *state)
+{
+	dtmd_result_t res;
+	int is_parent_path = 0;
+	dtmd_removable_media_t *media_ptr = NULL;
+	dtmd_removable_media_t *constructed_media = NULL;
+	dtmd_removable_media_t *last_ptr = NULL;
+	dtmd_removable_media_t **root_ptr = NULL;
+
+	if (state->got_started)
+	{
+		if ((strcmp(cmd->cmd, dtmd_response_finished) == 0)
+			&& (dtmd_helper_is_helper_list_all_removable_devices_generic(cmd)))
+		{
+			request->result_state = dtmd_ok;
+			handle->library_state = dtmd_state_default;
+			return dtmd_helper_result_exit;
+		}
+
+		if (dtmd_helper_cmd_check_removable_device(cmd))
+		{
+			if (strcmp(cmd->args[0], dtmd_root_device_path) == 0)
+			{
+				is_parent_path = 1;
+			}
+
+			if (!is_parent_path)
+			{
+				media_ptr = dtmd_find_media(cmd->args[0], state->result);
+				if (media_ptr == NULL)
+				{
+					request->result_state = dtmd_invalid_state;
+					return dtmd_helper_result_error;
+				}
+			}
+
+			// command points into receive buffer, thus data has to be copied
+			res = dtmd_fill_removable_device_from_notification_implementation(handle, cmd, dtmd_internal_fill_copy, &constructed_media);
+			if (res != dtmd_ok)
+			{
+				request->result_state = res;
+				return dtmd_helper_result_error;
+			}
+
+			if (is_parent_path)
+			{
+				constructed_media->parent = NULL;
+				root_ptr = &(state->result);
+			}
+			else
+			{
+				constructed_media->parent = media_ptr;
+				root_ptr = &(media_ptr->children_list);
+			}
+
+			media_ptr = *root_ptr;
+
+			while (media_ptr != NULL)
+			{
+				if (strcmp(constructed_media->path, media_ptr->path) < 0)
+				{
+					break;
+				}
+
+				last_ptr = media_ptr;
+				media_ptr = media_ptr->next_node;
+			}
+
+			if (last_ptr != NULL)
+			{
+				constructed_media->prev_node = last_ptr;
+				constructed_media->next_node = last_ptr->next_node;
+				last_ptr->next_node = constructed_media;
+
+				if (constructed_media->next_node != NULL)
+				{
+					constructed_media->next_node->prev_node = constructed_media;
+				}
+			}
+			else
+			{
+				constructed_media->next_node = *root_ptr;
+
+				if (*root_ptr != NULL)
+				{
+					constructed_media->prev_node = (*root_ptr)->prev_node;
+					(*root_ptr)->prev_node = constructed_media;
+				}
+				else
+				{
+					constructed_media->prev_node = NULL;
+				}
+
+				*root_ptr = constructed_media;
+			}
+		}
+		else
+		{
+			request->result_state = dtmd_invalid_state;
+			return dtmd_helper_result_error;
+		}
+	}
+	else
+	{
+		if (handle->library_state == dtmd_state_default)
+		{
+			if ((strcmp(cmd->cmd, dtmd_response_started) == 0)
+				&& (dtmd_helper_is_helper_list_all_removable_devices_generic(cmd)))
+			{
+				state->got_started = 1;
+				handle->library_state = dtmd_state_in_list_all_removable_devices;
+				return dtmd_helper_result_ok;
+			}
+			else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
+				&& (dtmd_helper_is_helper_list_all_removable_devices_failed(cmd)))
+			{
+				request->result_state = dt_command_failed;
+				request->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
+				handle->library_state = dtmd_state_default;
+				return dtmd_helper_result_exit;
+			}
+		}
+
+		res = dtmd_helper_handle_cmd(handle, cmd);
+		if (res != dtmd_ok)
+		{
+			request->result_state = res;
+
+			if (dtmd_helper_is_state_invalid(res))
+			{
+				return dtmd_helper_result_error;
+			}
+			else
+			{
+				return dtmd_helper_result_exit;
+			}
+		}
+	}
+
+	return dtmd_helper_result_ok;
+}
+
+static dtmd_helper_result_t dtmd_helper_process_list_all_removable_devices(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state)
+{
+	return dtmd_helper_process_list_all_removable_devices_implementation(handle, request, cmd, params, (dtmd_helper_state_list_all_removable_devices_t*) state);
+}
+
+inline static dtmd_helper_result_t dtmd_helper_process_list_removable_device_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, dtmd_helper_params_list_removable_device_t *params, dtmd_helper_state_list_removable_device_t *state)
+{
+	dtmd_result_t res;
+	int is_parent_path = 0;
+	dtmd_removable_media_t *media_ptr = NULL;
+	dtmd_removable_media_t *constructed_media = NULL;
+	dtmd_removable_media_t *last_ptr = NULL;
+	dtmd_removable_media_t **root_ptr = NULL;
+
+	if (state->got_started)
+	{
+		if ((strcmp(cmd->cmd, dtmd_response_finished) == 0)
+			&& (dtmd_helper_is_helper_list_removable_device_generic(cmd))
+			&& (dtmd_helper_is_helper_list_removable_device_parameters_match(cmd, params->device_path)))
+		{
+			request->result_state = dtmd_ok;
+			handle->library_state = dtmd_state_default;
+			return dtmd_helper_result_exit;
+		}
+
+		if (dtmd_helper_cmd_check_removable_device(cmd))
+		{
+			if ((strcmp(cmd->args[0], dtmd_root_device_path) == 0) || (strcmp(cmd->args[1], params->device_path) == 0))
+			{
+				is_parent_path = 1;
+			}
+
+			if (!is_parent_path)
+			{
+				media_ptr = dtmd_find_media(cmd->args[0], state->result);
+				if (media_ptr == NULL)
+				{
+					request->result_state = dtmd_invalid_state;
+					return dtmd_helper_result_error;
+				}
+			}
+
+			// command points into receive buffer, thus data has to be copied
+			res = dtmd_fill_removable_device_from_notification_implementation(handle, cmd, dtmd_internal_fill_copy, &constructed_media);
+			if (res != dtmd_ok)
+			{
+				request->result_state = res;
+				return dtmd_helper_result_error;
+			}
+
+			if (is_parent_path)
+			{
+				constructed_media->parent = NULL;
+				root_ptr = &(state->result);
+			}
+			else
+			{
+				constructed_media->parent = media_ptr;
+				root_ptr = &(media_ptr->children_list);
+			}
+
+			media_ptr = *root_ptr;
+
+			while (media_ptr != NULL)
+			{
+				if (strcmp(constructed_media->path, media_ptr->path) < 0)
+				{
+					break;
+				}
+
+				last_ptr = media_ptr;
+				media_ptr = media_ptr->next_node;
+			}
+
+			if (last_ptr != NULL)
+			{
+				constructed_media->prev_node = last_ptr;
+				constructed_media->next_node = last_ptr->next_node;
+				last_ptr->next_node = constructed_media;
+
+				if (constructed_media->next_node != NULL)
+				{
+					constructed_media->next_node->prev_node = constructed_media;
+				}
+			}
+			else
+			{
+				constructed_media->next_node = *root_ptr;
 
 				if (*root_ptr != NULL)
 				{
@@ -2114,12 +4242,184 @@ inline static dtmd_helper_result_t dtmd_helper_process_list_all_removable_device
 					constructed_media->prev_node = NULL;
 				}
 
-				*root_ptr = constructed_media;
+				*root_ptr = constructed_media;
+			}
+		}
+		else
+		{
+			request->result_state = dtmd_invalid_state;
+			return dtmd_helper_result_error;
+		}
+	}
+	else
+	{
+		if (handle->library_state == dtmd_state_default)
+		{
+			if ((strcmp(cmd->cmd, dtmd_response_started) == 0)
+				&& (dtmd_helper_is_helper_list_removable_device_generic(cmd))
+				&& (dtmd_helper_is_helper_list_removable_device_parameters_match(cmd, params->device_path)))
+			{
+				state->got_started = 1;
+				handle->library_state = dtmd_state_in_list_removable_device;
+				return dtmd_helper_result_ok;
+			}
+			else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
+				&& (dtmd_helper_is_helper_list_removable_device_failed(cmd))
+				&& (dtmd_helper_is_helper_list_removable_device_parameters_match(cmd, params->device_path)))
+			{
+				request->result_state = dt_command_failed;
+				request->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
+				handle->library_state = dtmd_state_default;
+				return dtmd_helper_result_exit;
+			}
+		}
+
+		res = dtmd_helper_handle_cmd(handle, cmd);
+		if (res != dtmd_ok)
+		{
+			request->result_state = res;
+
+			if (dtmd_helper_is_state_invalid(res))
+			{
+				return dtmd_helper_result_error;
+			}
+			else
+			{
+				return dtmd_helper_result_exit;
+			}
+		}
+	}
+
+	return dtmd_helper_result_ok;
+}
+
+static dtmd_helper_result_t dtmd_helper_process_list_removable_device(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state)
+{
+	return dtmd_helper_process_list_removable_device_implementation(handle, request, cmd, (dtmd_helper_params_list_removable_device_t*) params, (dtmd_helper_state_list_removable_device_t*) state);
+}
+
+inline static dtmd_helper_result_t dtmd_helper_process_mount_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, dtmd_helper_params_mount_t *params, void *state)
+{
+	dtmd_result_t res;
+
+	if (handle->library_state == dtmd_state_default)
+	{
+		if ((strcmp(cmd->cmd, dtmd_response_succeeded) == 0)
+			&& (dtmd_helper_is_helper_mount_generic(cmd))
+			&& (dtmd_helper_is_helper_mount_parameters_match(cmd, params->path, params->mount_options)))
+		{
+			request->result_state = dtmd_ok;
+			return dtmd_helper_result_exit;
+		}
+		else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
+			&& (dtmd_helper_is_helper_mount_failed(cmd))
+			&& (dtmd_helper_is_helper_mount_parameters_match(cmd, params->path, params->mount_options)))
+		{
+			request->result_state = dt_command_failed;
+			request->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
+			return dtmd_helper_result_exit;
+		}
+	}
+
+	res = dtmd_helper_handle_cmd(handle, cmd);
+	if (res != dtmd_ok)
+	{
+		request->result_state = res;
+
+		if (dtmd_helper_is_state_invalid(res))
+		{
+			return dtmd_helper_result_error;
+		}
+		else
+		{
+			return dtmd_helper_result_exit;
+		}
+	}
+
+	return dtmd_helper_result_ok;
+}
+
+static dtmd_helper_result_t dtmd_helper_process_mount(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state)
+{
+	return dtmd_helper_process_mount_implementation(handle, request, cmd, (dtmd_helper_params_mount_t*) params, state);
+}
+
+inline static dtmd_helper_result_t dtmd_helper_process_unmount_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, dtmd_helper_params_unmount_t *params, void *state)
+{
+	dtmd_result_t res;
+
+	if (handle->library_state == dtmd_state_default)
+	{
+		if ((strcmp(cmd->cmd, dtmd_response_succeeded) == 0)
+			&& (dtmd_helper_is_helper_unmount_generic(cmd))
+			&& (dtmd_helper_is_helper_unmount_parameters_match(cmd, params->path)))
+		{
+			request->result_state = dtmd_ok;
+			return dtmd_helper_result_exit;
+		}
+		else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
+			&& (dtmd_helper_is_helper_unmount_failed(cmd))
+			&& (dtmd_helper_is_helper_unmount_parameters_match(cmd, params->path)))
+		{
+			request->result_state = dt_command_failed;
+			request->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
+			return dtmd_helper_result_exit;
+		}
+	}
+
+	res = dtmd_helper_handle_cmd(handle, cmd);
+	if (res != dtmd_ok)
+	{
+		request->result_state = res;
+
+		if (dtmd_helper_is_state_invalid(res))
+		{
+			return dtmd_helper_result_error;
+		}
+		else
+		{
+			return dtmd_helper_result_exit;
+		}
+	}
+
+	return dtmd_helper_result_ok;
+}
+
+static dtmd_helper_result_t dtmd_helper_process_unmount(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state)
+{
+	return dtmd_helper_process_unmount_implementation(handle, request, cmd, (dtmd_helper_params_unmount_t*) params, state);
+}
+
+inline static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystems_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, dtmd_helper_state_list_supported_filesystems_t *state)
+{
+	dtmd_result_t res;
+
+	if (state->got_started)
+	{
+		if ((strcmp(cmd->cmd, dtmd_response_finished) == 0)
+			&& (dtmd_helper_is_helper_list_supported_filesystems_generic(cmd)))
+		{
+			request->result_state = dtmd_ok;
+			handle->library_state = dtmd_state_default;
+			return dtmd_helper_result_exit;
+		}
+
+		if ((dtmd_helper_cmd_check_supported_filesystems(cmd))
+			&& (state->got_result == 0))
+		{
+			// command points into receive buffer, thus data has to be copied
+			if (!dtmd_helper_copy_string_array(cmd->args_count, cmd->args, &(state->result_list)))
+			{
+				request->result_state = dtmd_memory_error;
+				return dtmd_helper_result_error;
 			}
+
+			state->got_result = 1;
+			state->result_count = cmd->args_count;
 		}
 		else
 		{
-			handle->result_state = dtmd_invalid_state;
+			request->result_state = dtmd_invalid_state;
 			return dtmd_helper_result_error;
 		}
 	}
@@ -2128,17 +4428,17 @@ inline static dtmd_helper_result_t dtmd_helper_process_list_all_removable_device
 		if (handle->library_state == dtmd_state_default)
 		{
 			if ((strcmp(cmd->cmd, dtmd_response_started) == 0)
-				&& (dtmd_helper_is_helper_list_all_removable_devices_generic(cmd)))
+				&& (dtmd_helper_is_helper_list_supported_filesystems_generic(cmd)))
 			{
 				state->got_started = 1;
-				handle->library_state = dtmd_state_in_list_all_removable_devices;
+				handle->library_state = dtmd_state_in_list_supported_filesystems;
 				return dtmd_helper_result_ok;
 			}
 			else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
-				&& (dtmd_helper_is_helper_list_all_removable_devices_failed(cmd)))
+				&& (dtmd_helper_is_helper_list_supported_filesystems_failed(cmd)))
 			{
-				handle->result_state = dt_command_failed;
-				handle->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
+				request->result_state = dt_command_failed;
+				request->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
 				handle->library_state = dtmd_state_default;
 				return dtmd_helper_result_exit;
 			}
@@ -2147,7 +4447,7 @@ inline static dtmd_helper_result_t dtmd_helper_process_list_all_removable_device
 		res = dtmd_helper_handle_cmd(handle, cmd);
 		if (res != dtmd_ok)
 		{
-			handle->result_state = res;
+			request->result_state = res;
 
 			if (dtmd_helper_is_state_invalid(res))
 			{
@@ -2163,607 +4463,972 @@ inline static dtmd_helper_result_t dtmd_helper_process_list_all_removable_device
 	return dtmd_helper_result_ok;
 }
 
-static dtmd_helper_result_t dtmd_helper_process_list_all_removable_devices(dtmd_t *handle, dt_command_t *cmd, void *params, void *state)
+static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystems(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state)
 {
-	return dtmd_helper_process_list_all_removable_devices_implementation(handle, cmd, params, (dtmd_helper_state_list_all_removable_devices_t*) state);
+	return dtmd_helper_process_list_supported_filesystems_implementation(handle, request, cmd, params, (dtmd_helper_state_list_supported_filesystems_t*) state);
 }
 
-inline static dtmd_helper_result_t dtmd_helper_process_list_removable_device_implementation(dtmd_t *handle, dt_command_t *cmd, dtmd_helper_params_list_removable_device_t *params, dtmd_helper_state_list_removable_device_t *state)
+inline static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystem_options_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, dtmd_helper_params_list_supported_filesystem_options_t *params, dtmd_helper_state_list_supported_filesystem_options_t *state)
 {
 	dtmd_result_t res;
-	int is_parent_path = 0;
-	dtmd_removable_media_t *media_ptr = NULL;
-	dtmd_removable_media_t *constructed_media = NULL;
-	dtmd_removable_media_t *last_ptr = NULL;
-	dtmd_removable_media_t **root_ptr = NULL;
 
 	if (state->got_started)
 	{
 		if ((strcmp(cmd->cmd, dtmd_response_finished) == 0)
-			&& (dtmd_helper_is_helper_list_removable_device_generic(cmd))
-			&& (dtmd_helper_is_helper_list_removable_device_parameters_match(cmd, params->device_path)))
+			&& (dtmd_helper_is_helper_list_supported_filesystem_options_generic(cmd))
+			&& (dtmd_helper_is_helper_list_supported_filesystem_options_parameters_match(cmd, params->filesystem)))
 		{
-			handle->result_state = dtmd_ok;
+			request->result_state = dtmd_ok;
 			handle->library_state = dtmd_state_default;
 			return dtmd_helper_result_exit;
 		}
 
-		if (dtmd_helper_cmd_check_removable_device(cmd))
+		if ((dtmd_helper_cmd_check_supported_filesystem_options(cmd))
+			&& (state->got_result == 0))
 		{
-			if ((strcmp(cmd->args[0], dtmd_root_device_path) == 0) || (strcmp(cmd->args[1], params->device_path) == 0))
+			// command points into receive buffer, thus data has to be copied
+			if (!dtmd_helper_copy_string_array(cmd->args_count, cmd->args, &(state->result_list)))
 			{
-				is_parent_path = 1;
+				request->result_state = dtmd_memory_error;
+				return dtmd_helper_result_error;
 			}
 
-			if (!is_parent_path)
+			state->got_result = 1;
+			state->result_count = cmd->args_count;
+		}
+		else
+		{
+			request->result_state = dtmd_invalid_state;
+			return dtmd_helper_result_error;
+		}
+	}
+	else
+	{
+		if (handle->library_state == dtmd_state_default)
+		{
+			if ((strcmp(cmd->cmd, dtmd_response_started) == 0)
+				&& (dtmd_helper_is_helper_list_supported_filesystem_options_generic(cmd))
+				&& (dtmd_helper_is_helper_list_supported_filesystem_options_parameters_match(cmd, params->filesystem)))
 			{
-				media_ptr = dtmd_find_media(cmd->args[0], state->result);
-				if (media_ptr == NULL)
-				{
-					handle->result_state = dtmd_invalid_state;
-					return dtmd_helper_result_error;
-				}
+				state->got_started = 1;
+				handle->library_state = dtmd_state_in_list_supported_filesystem_options;
+				return dtmd_helper_result_ok;
 			}
-
-			res = dtmd_fill_removable_device_from_notification_implementation(handle, cmd, dtmd_internal_fill_move, &constructed_media);
-			if (res != dtmd_ok)
+			else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
+				&& (dtmd_helper_is_helper_list_supported_filesystem_options_failed(cmd))
+				&& (dtmd_helper_is_helper_list_supported_filesystem_options_parameters_match(cmd, params->filesystem)))
 			{
-				handle->result_state = res;
-				return dtmd_helper_result_error;
+				request->result_state = dt_command_failed;
+				request->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
+				handle->library_state = dtmd_state_default;
+				return dtmd_helper_result_exit;
 			}
+		}
 
-			if (is_parent_path)
+		res = dtmd_helper_handle_cmd(handle, cmd);
+		if (res != dtmd_ok)
+		{
+			request->result_state = res;
+
+			if (dtmd_helper_is_state_invalid(res))
 			{
-				constructed_media->parent = NULL;
-				root_ptr = &(state->result);
+				return dtmd_helper_result_error;
 			}
 			else
 			{
-				constructed_media->parent = media_ptr;
-				root_ptr = &(media_ptr->children_list);
+				return dtmd_helper_result_exit;
 			}
+		}
+	}
 
-			media_ptr = *root_ptr;
-
-			while (media_ptr != NULL)
-			{
-				if (strcmp(constructed_media->path, media_ptr->path) < 0)
-				{
-					break;
-				}
+	return dtmd_helper_result_ok;
+}
 
-				last_ptr = media_ptr;
-				media_ptr = media_ptr->next_node;
-			}
+static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystem_options(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state)
+{
+	return dtmd_helper_process_list_supported_filesystem_options_implementation(handle, request, cmd, (dtmd_helper_params_list_supported_filesystem_options_t*) params, (dtmd_helper_state_list_supported_filesystem_options_t*) state);
+}
 
-			if (last_ptr != NULL)
-			{
-				constructed_media->prev_node = last_ptr;
-				constructed_media->next_node = last_ptr->next_node;
-				last_ptr->next_node = constructed_media;
+#if (defined OS_Linux)
+inline static dtmd_helper_result_t dtmd_helper_process_poweroff_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, dtmd_helper_params_poweroff_t *params, void *state)
+{
+	dtmd_result_t res;
 
-				if (constructed_media->next_node != NULL)
-				{
-					constructed_media->next_node->prev_node = constructed_media;
-				}
-			}
-			else
-			{
-				constructed_media->next_node = *root_ptr;
+	if (handle->library_state == dtmd_state_default)
+	{
+		if ((strcmp(cmd->cmd, dtmd_response_succeeded) == 0)
+			&& (dtmd_helper_is_helper_poweroff_generic(cmd))
+			&& (dtmd_helper_is_helper_poweroff_parameters_match(cmd, params->device_path)))
+		{
+			request->result_state = dtmd_ok;
+			return dtmd_helper_result_exit;
+		}
+		else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
+			&& (dtmd_helper_is_helper_poweroff_failed(cmd))
+			&& (dtmd_helper_is_helper_poweroff_parameters_match(cmd, params->device_path)))
+		{
+			request->result_state = dt_command_failed;
+			request->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
+			return dtmd_helper_result_exit;
+		}
+	}
 
-				if (*root_ptr != NULL)
-				{
-					constructed_media->prev_node = (*root_ptr)->prev_node;
-					(*root_ptr)->prev_node = constructed_media;
-				}
-				else
-				{
-					constructed_media->prev_node = NULL;
-				}
+	res = dtmd_helper_handle_cmd(handle, cmd);
+	if (res != dtmd_ok)
+	{
+		request->result_state = res;
 
-				*root_ptr = constructed_media;
-			}
+		if (dtmd_helper_is_state_invalid(res))
+		{
+			return dtmd_helper_result_error;
 		}
 		else
 		{
-			handle->result_state = dtmd_invalid_state;
-			return dtmd_helper_result_error;
+			return dtmd_helper_result_exit;
+		}
+	}
+
+	return dtmd_helper_result_ok;
+}
+
+static dtmd_helper_result_t dtmd_helper_process_poweroff(dtmd_t *handle, dtmd_helper_request_t *request, dt_command_t *cmd, void *params, void *state)
+{
+	return dtmd_helper_process_poweroff_implementation(handle, request, cmd, (dtmd_helper_params_poweroff_t*) params, state);
+}
+#endif /* (defined OS_Linux) */
+
+inline static int dtmd_helper_exit_list_all_removable_devices_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_state_list_all_removable_devices_t *state)
+{
+	if (request->result_state == dtmd_ok)
+	{
+		if (!state->got_started)
+		{
+			request->result_state = dtmd_invalid_state;
+			return 0;
 		}
 	}
 	else
 	{
-		if (handle->library_state == dtmd_state_default)
+		dtmd_helper_exit_clear_list_all_removable_devices(state);
+	}
+
+	return 1;
+}
+
+static int dtmd_helper_exit_list_all_removable_devices(dtmd_t *handle, dtmd_helper_request_t *request, void *state)
+{
+	return dtmd_helper_exit_list_all_removable_devices_implementation(handle, request, (dtmd_helper_state_list_all_removable_devices_t*) state);
+}
+
+inline static void dtmd_helper_exit_clear_list_all_removable_devices_implementation(dtmd_helper_state_list_all_removable_devices_t *state)
+{
+	if (state->result != NULL)
+	{
+		dtmd_helper_free_removable_device(state->result);
+		state->result = NULL;
+	}
+}
+
+static void dtmd_helper_exit_clear_list_all_removable_devices(void *state)
+{
+	dtmd_helper_exit_clear_list_all_removable_devices_implementation((dtmd_helper_state_list_all_removable_devices_t*) state);
+}
+
+inline static int dtmd_helper_exit_list_removable_device_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_state_list_removable_device_t *state)
+{
+	if (request->result_state == dtmd_ok)
+	{
+		if ((!state->got_started)
+			|| (state->result == NULL)
+			|| ((!state->accept_multiple_devices) && (state->result->next_node != NULL)))
 		{
-			if ((strcmp(cmd->cmd, dtmd_response_started) == 0)
-				&& (dtmd_helper_is_helper_list_removable_device_generic(cmd))
-				&& (dtmd_helper_is_helper_list_removable_device_parameters_match(cmd, params->device_path)))
-			{
-				state->got_started = 1;
-				handle->library_state = dtmd_state_in_list_removable_device;
-				return dtmd_helper_result_ok;
-			}
-			else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
-				&& (dtmd_helper_is_helper_list_removable_device_failed(cmd))
-				&& (dtmd_helper_is_helper_list_removable_device_parameters_match(cmd, params->device_path)))
-			{
-				handle->result_state = dt_command_failed;
-				handle->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
-				handle->library_state = dtmd_state_default;
-				return dtmd_helper_result_exit;
-			}
+			request->result_state = dtmd_invalid_state;
+			return 0;
 		}
+	}
+	else
+	{
+		dtmd_helper_exit_clear_list_removable_device(state);
+	}
+
+	return 1;
+}
+
+static int dtmd_helper_exit_list_removable_device(dtmd_t *handle, dtmd_helper_request_t *request, void *state)
+{
+	return dtmd_helper_exit_list_removable_device_implementation(handle, request, (dtmd_helper_state_list_removable_device_t*) state);
+}
+
+inline static void dtmd_helper_exit_clear_list_removable_device_implementation(dtmd_helper_state_list_removable_device_t *state)
+{
+	if (state->result != NULL)
+	{
+		dtmd_helper_free_removable_device(state->result);
+		state->result = NULL;
+	}
+}
+
+static void dtmd_helper_exit_clear_list_removable_device(void *state)
+{
+	dtmd_helper_exit_clear_list_removable_device_implementation((dtmd_helper_state_list_removable_device_t*) state);
+}
 
-		res = dtmd_helper_handle_cmd(handle, cmd);
-		if (res != dtmd_ok)
+inline static int dtmd_helper_exit_list_supported_filesystems_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_state_list_supported_filesystems_t *state)
+{
+	if (request->result_state == dtmd_ok)
+	{
+		if (!state->got_result)
 		{
-			handle->result_state = res;
-
-			if (dtmd_helper_is_state_invalid(res))
-			{
-				return dtmd_helper_result_error;
-			}
-			else
-			{
-				return dtmd_helper_result_exit;
-			}
+			request->result_state = dtmd_invalid_state;
+			return 0;
 		}
 	}
+	else
+	{
+		dtmd_helper_exit_clear_list_supported_filesystems(state);
+	}
 
-	return dtmd_helper_result_ok;
+	return 1;
 }
 
-static dtmd_helper_result_t dtmd_helper_process_list_removable_device(dtmd_t *handle, dt_command_t *cmd, void *params, void *state)
+static int dtmd_helper_exit_list_supported_filesystems(dtmd_t *handle, dtmd_helper_request_t *request, void *state)
 {
-	return dtmd_helper_process_list_removable_device_implementation(handle, cmd, (dtmd_helper_params_list_removable_device_t*) params, (dtmd_helper_state_list_removable_device_t*) state);
+	return dtmd_helper_exit_list_supported_filesystems_implementation(handle, request, (dtmd_helper_state_list_supported_filesystems_t*) state);
 }
 
-inline static dtmd_helper_result_t dtmd_helper_process_mount_implementation(dtmd_t *handle, dt_command_t *cmd, dtmd_helper_params_mount_t *params, void *state)
+inline static void dtmd_helper_exit_clear_list_supported_filesystems_implementation(dtmd_helper_state_list_supported_filesystems_t *state)
 {
-	dtmd_result_t res;
+	if (state->result_list != NULL)
+	{
+		dtmd_helper_free_supported_filesystems(state->result_count, state->result_list);
+	}
 
-	if (handle->library_state == dtmd_state_default)
+	state->result_list  = NULL;
+	state->result_count = 0;
+}
+
+static void dtmd_helper_exit_clear_list_supported_filesystems(void *state)
+{
+	dtmd_helper_exit_clear_list_supported_filesystems_implementation((dtmd_helper_state_list_supported_filesystems_t*) state);
+}
+
+inline static int dtmd_helper_exit_list_supported_filesystem_options_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_state_list_supported_filesystem_options_t *state)
+{
+	if (request->result_state == dtmd_ok)
 	{
-		if ((strcmp(cmd->cmd, dtmd_response_succeeded) == 0)
-			&& (dtmd_helper_is_helper_mount_generic(cmd))
-			&& (dtmd_helper_is_helper_mount_parameters_match(cmd, params->path, params->mount_options)))
-		{
-			handle->result_state = dtmd_ok;
-			return dtmd_helper_result_exit;
-		}
-		else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
-			&& (dtmd_helper_is_helper_mount_failed(cmd))
-			&& (dtmd_helper_is_helper_mount_parameters_match(cmd, params->path, params->mount_options)))
+		if (!state->got_result)
 		{
-			handle->result_state = dt_command_failed;
-			handle->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
-			return dtmd_helper_result_exit;
+			request->result_state = dtmd_invalid_state;
+			return 0;
 		}
 	}
-
-	res = dtmd_helper_handle_cmd(handle, cmd);
-	if (res != dtmd_ok)
+	else
 	{
-		handle->result_state = res;
+		dtmd_helper_exit_clear_list_supported_filesystem_options(state);
+	}
 
-		if (dtmd_helper_is_state_invalid(res))
-		{
-			return dtmd_helper_result_error;
-		}
-		else
-		{
-			return dtmd_helper_result_exit;
-		}
+	return 1;
+}
+
+static int dtmd_helper_exit_list_supported_filesystem_options(dtmd_t *handle, dtmd_helper_request_t *request, void *state)
+{
+	return dtmd_helper_exit_list_supported_filesystem_options_implementation(handle, request, (dtmd_helper_state_list_supported_filesystem_options_t*) state);
+}
+
+inline static void dtmd_helper_exit_clear_list_supported_filesystem_options_implementation(dtmd_helper_state_list_supported_filesystem_options_t *state)
+{
+	if (state->result_list != NULL)
+	{
+		dtmd_helper_free_supported_filesystem_options(state->result_count, state->result_list);
 	}
 
-	return dtmd_helper_result_ok;
+	state->result_list  = NULL;
+	state->result_count = 0;
 }
 
-static dtmd_helper_result_t dtmd_helper_process_mount(dtmd_t *handle, dt_command_t *cmd, void *params, void *state)
+static void dtmd_helper_exit_clear_list_supported_filesystem_options(void *state)
 {
-	return dtmd_helper_process_mount_implementation(handle, cmd, (dtmd_helper_params_mount_t*) params, state);
+	dtmd_helper_exit_clear_list_supported_filesystem_options_implementation((dtmd_helper_state_list_supported_filesystem_options_t*) state);
 }
 
-inline static dtmd_helper_result_t dtmd_helper_process_unmount_implementation(dtmd_t *handle, dt_command_t *cmd, dtmd_helper_params_unmount_t *params, void *state)
+static void dtmd_helper_complete_generic(dtmd_t *handle, dtmd_helper_request_t *request)
 {
-	dtmd_result_t res;
+	dtmd_helper_async_request_t *async_request = (dtmd_helper_async_request_t*) request;
 
-	if (handle->library_state == dtmd_state_default)
+	async_request->callback.generic(handle, async_request->arg, request->result_state, request->error_code);
+
+	free(async_request);
+}
+
+static void dtmd_helper_complete_list_all_removable_devices(dtmd_t *handle, dtmd_helper_request_t *request)
+{
+	dtmd_helper_async_request_t *async_request = (dtmd_helper_async_request_t*) request;
+
+	async_request->callback.removable_devices(handle, async_request->arg, request->result_state, request->error_code,
+		async_request->state.list_all_removable_devices.result);
+
+	free(async_request);
+}
+
+static void dtmd_helper_complete_list_removable_device(dtmd_t *handle, dtmd_helper_request_t *request)
+{
+	dtmd_helper_async_request_t *async_request = (dtmd_helper_async_request_t*) request;
+
+	async_request->callback.removable_devices(handle, async_request->arg, request->result_state, request->error_code,
+		async_request->state.list_removable_device.result);
+
+	free(async_request);
+}
+
+static void dtmd_helper_complete_list_supported_filesystems(dtmd_t *handle, dtmd_helper_request_t *request)
+{
+	dtmd_helper_async_request_t *async_request = (dtmd_helper_async_request_t*) request;
+
+	async_request->callback.string_list(handle, async_request->arg, request->result_state, request->error_code,
+		async_request->state.list_supported_filesystems.result_count,
+		async_request->state.list_supported_filesystems.result_list);
+
+	free(async_request);
+}
+
+static void dtmd_helper_complete_list_supported_filesystem_options(dtmd_t *handle, dtmd_helper_request_t *request)
+{
+	dtmd_helper_async_request_t *async_request = (dtmd_helper_async_request_t*) request;
+
+	async_request->callback.string_list(handle, async_request->arg, request->result_state, request->error_code,
+		async_request->state.list_supported_filesystem_options.result_count,
+		async_request->state.list_supported_filesystem_options.result_list);
+
+	free(async_request);
+}
+
+inline static int dtmd_helper_exit_mirror_seed_implementation(dtmd_t *handle, dtmd_helper_request_t *request, dtmd_helper_state_list_all_removable_devices_t *state)
+{
+	if (!dtmd_helper_exit_list_all_removable_devices_implementation(handle, request, state))
 	{
-		if ((strcmp(cmd->cmd, dtmd_response_succeeded) == 0)
-			&& (dtmd_helper_is_helper_unmount_generic(cmd))
-			&& (dtmd_helper_is_helper_unmount_parameters_match(cmd, params->path)))
-		{
-			handle->result_state = dtmd_ok;
-			return dtmd_helper_result_exit;
-		}
-		else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
-			&& (dtmd_helper_is_helper_unmount_failed(cmd))
-			&& (dtmd_helper_is_helper_unmount_parameters_match(cmd, params->path)))
-		{
-			handle->result_state = dt_command_failed;
-			handle->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
-			return dtmd_helper_result_exit;
-		}
+		return 0;
 	}
 
-	res = dtmd_helper_handle_cmd(handle, cmd);
-	if (res != dtmd_ok)
+	if (request->result_state == dtmd_ok)
 	{
-		handle->result_state = res;
+		// mirror is replaced while dispatching response, thus notifications following it are applied to new mirror
+		pthread_mutex_lock(&(handle->mirror_mutex));
 
-		if (dtmd_helper_is_state_invalid(res))
+		dtmd_helper_clear_mirror(handle);
+
+		handle->mirror_root = state->result;
+		state->result = NULL;
+
+		if (dtmd_helper_mirror_index_add_recursive(handle, handle->mirror_root) >= 0)
 		{
-			return dtmd_helper_result_error;
+			handle->is_mirror_synchronized = 1;
 		}
 		else
 		{
-			return dtmd_helper_result_exit;
+			dtmd_helper_clear_mirror(handle);
 		}
+
+		pthread_mutex_unlock(&(handle->mirror_mutex));
 	}
 
-	return dtmd_helper_result_ok;
+	return 1;
 }
 
-static dtmd_helper_result_t dtmd_helper_process_unmount(dtmd_t *handle, dt_command_t *cmd, void *params, void *state)
+static int dtmd_helper_exit_mirror_seed(dtmd_t *handle, dtmd_helper_request_t *request, void *state)
 {
-	return dtmd_helper_process_unmount_implementation(handle, cmd, (dtmd_helper_params_unmount_t*) params, state);
+	return dtmd_helper_exit_mirror_seed_implementation(handle, request, (dtmd_helper_state_list_all_removable_devices_t*) state);
 }
 
-inline static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystems_implementation(dtmd_t *handle, dt_command_t *cmd, void *params, dtmd_helper_state_list_supported_filesystems_t *state)
+static void dtmd_helper_complete_mirror_seed(dtmd_t *handle, dtmd_helper_request_t *request)
 {
-	dtmd_result_t res;
+	dtmd_helper_async_request_t *async_request = (dtmd_helper_async_request_t*) request;
 
-	if (state->got_started)
-	{
-		if ((strcmp(cmd->cmd, dtmd_response_finished) == 0)
-			&& (dtmd_helper_is_helper_list_supported_filesystems_generic(cmd)))
-		{
-			handle->result_state = dtmd_ok;
-			handle->library_state = dtmd_state_default;
-			return dtmd_helper_result_exit;
-		}
+	// on success result is already moved to mirror, otherwise it's cleared
+	free(async_request);
+}
 
-		if ((dtmd_helper_cmd_check_supported_filesystems(cmd))
-			&& (state->got_result == 0))
-		{
-			state->got_result = 1;
+/* requests_mutex must be locked, called only by worker */
+static void dtmd_helper_seed_mirror(dtmd_t *handle)
+{
+	dtmd_helper_async_request_t *async_request;
 
-			state->result_count = cmd->args_count;
-			state->result_list  = (const char**) cmd->args;
+	switch (handle->protocol_state)
+	{
+	case dtmd_protocol_disconnected:
+	case dtmd_protocol_failed:
+		// mirror is seeded again on reconnection
+		handle->is_mirror_seed_required = 0;
+		return;
 
-			cmd->args_count = 0;
-			cmd->args       = NULL;
-		}
-		else
-		{
-			handle->result_state = dtmd_invalid_state;
-			return dtmd_helper_result_error;
-		}
+	default:
+		break;
 	}
-	else
+
+	async_request = dtmd_helper_async_request_new(0);
+	if (async_request == NULL)
 	{
-		if (handle->library_state == dtmd_state_default)
-		{
-			if ((strcmp(cmd->cmd, dtmd_response_started) == 0)
-				&& (dtmd_helper_is_helper_list_supported_filesystems_generic(cmd)))
-			{
-				state->got_started = 1;
-				handle->library_state = dtmd_state_in_list_supported_filesystems;
-				return dtmd_helper_result_ok;
-			}
-			else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
-				&& (dtmd_helper_is_helper_list_supported_filesystems_failed(cmd)))
-			{
-				handle->result_state = dt_command_failed;
-				handle->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
-				handle->library_state = dtmd_state_default;
-				return dtmd_helper_result_exit;
-			}
-		}
+		// retried on next iteration of worker
+		return;
+	}
 
-		res = dtmd_helper_handle_cmd(handle, cmd);
-		if (res != dtmd_ok)
-		{
-			handle->result_state = res;
+	dtmd_helper_init_request(&(async_request->request),
+		NULL,
+		&(async_request->state.list_all_removable_devices),
+		&dtmd_helper_dprintf_list_all_removable_devices,
+		&dtmd_helper_process_list_all_removable_devices,
+		&dtmd_helper_exit_mirror_seed,
+		&dtmd_helper_exit_clear_list_all_removable_devices);
 
-			if (dtmd_helper_is_state_invalid(res))
-			{
-				return dtmd_helper_result_error;
-			}
-			else
-			{
-				return dtmd_helper_result_exit;
-			}
-		}
+	async_request->request.complete_func = &dtmd_helper_complete_mirror_seed;
+	async_request->state.list_all_removable_devices.got_started = 0;
+	async_request->state.list_all_removable_devices.result = NULL;
+
+	if (dtmd_helper_submit_request(handle, &(async_request->request)) != dtmd_ok)
+	{
+		free(async_request);
 	}
 
-	return dtmd_helper_result_ok;
+	handle->is_mirror_seed_required = 0;
 }
 
-static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystems(dtmd_t *handle, dt_command_t *cmd, void *params, void *state)
+/* called only by worker, cmd is a validated notification */
+static void dtmd_helper_update_mirror(dtmd_t *handle, dt_command_t *cmd)
 {
-	return dtmd_helper_process_list_supported_filesystems_implementation(handle, cmd, params, (dtmd_helper_state_list_supported_filesystems_t*) state);
-}
+	dtmd_removable_media_t *media_ptr;
+	dtmd_removable_media_t *constructed_media = NULL;
+	dtmd_removable_media_t **root_ptr;
+	dtmd_removable_media_t tmp_media;
+	char *mnt_point;
+	char *mnt_opts;
 
-inline static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystem_options_implementation(dtmd_t *handle, dt_command_t *cmd, dtmd_helper_params_list_supported_filesystem_options_t *params, dtmd_helper_state_list_supported_filesystem_options_t *state)
-{
-	dtmd_result_t res;
+	pthread_mutex_lock(&(handle->mirror_mutex));
 
-	if (state->got_started)
+	if (strcmp(cmd->cmd, dtmd_notification_resync_required) == 0)
 	{
-		if ((strcmp(cmd->cmd, dtmd_response_finished) == 0)
-			&& (dtmd_helper_is_helper_list_supported_filesystem_options_generic(cmd))
-			&& (dtmd_helper_is_helper_list_supported_filesystem_options_parameters_match(cmd, params->filesystem)))
+		goto dtmd_helper_update_mirror_invalidate;
+	}
+
+	if (!handle->is_mirror_synchronized)
+	{
+		// changes notified about before seeding response are already present in it
+		goto dtmd_helper_update_mirror_exit;
+	}
+
+	if (strcmp(cmd->cmd, dtmd_notification_removable_device_added) == 0)
+	{
+		if (strcmp(cmd->args[0], dtmd_root_device_path) == 0)
 		{
-			handle->result_state = dtmd_ok;
-			handle->library_state = dtmd_state_default;
-			return dtmd_helper_result_exit;
+			media_ptr = NULL;
+			root_ptr = &(handle->mirror_root);
 		}
-
-		if ((dtmd_helper_cmd_check_supported_filesystem_options(cmd))
-			&& (state->got_result == 0))
+		else
 		{
-			state->got_result = 1;
+			media_ptr = dtmd_helper_mirror_find(handle, cmd->args[0]);
+			if (media_ptr == NULL)
+			{
+				goto dtmd_helper_update_mirror_invalidate;
+			}
 
-			state->result_count = cmd->args_count;
-			state->result_list  = (const char**) cmd->args;
+			root_ptr = &(media_ptr->children_list);
+		}
 
-			cmd->args_count = 0;
-			cmd->args       = NULL;
+		if (dtmd_fill_removable_device_from_notification_implementation(handle, cmd, dtmd_internal_fill_copy, &constructed_media) != dtmd_ok)
+		{
+			goto dtmd_helper_update_mirror_invalidate;
 		}
-		else
+
+		// fails if device is already present
+		if (dtmd_helper_mirror_index_add(handle, constructed_media) < 0)
 		{
-			handle->result_state = dtmd_invalid_state;
-			return dtmd_helper_result_error;
+			dtmd_helper_free_removable_device_recursive(constructed_media);
+			goto dtmd_helper_update_mirror_invalidate;
 		}
+
+		constructed_media->parent = media_ptr;
+		dtmd_helper_insert_removable_device(root_ptr, constructed_media);
 	}
-	else
+	else if (strcmp(cmd->cmd, dtmd_notification_removable_device_removed) == 0)
 	{
-		if (handle->library_state == dtmd_state_default)
+		media_ptr = dtmd_helper_mirror_find(handle, cmd->args[0]);
+		if (media_ptr == NULL)
 		{
-			if ((strcmp(cmd->cmd, dtmd_response_started) == 0)
-				&& (dtmd_helper_is_helper_list_supported_filesystem_options_generic(cmd))
-				&& (dtmd_helper_is_helper_list_supported_filesystem_options_parameters_match(cmd, params->filesystem)))
+			goto dtmd_helper_update_mirror_invalidate;
+		}
+
+		dtmd_helper_mirror_index_remove(handle, media_ptr);
+		dtmd_helper_mirror_index_remove_recursive(handle, media_ptr->children_list);
+
+		if (media_ptr->prev_node == NULL)
+		{
+			if (media_ptr->parent != NULL)
 			{
-				state->got_started = 1;
-				handle->library_state = dtmd_state_in_list_supported_filesystem_options;
-				return dtmd_helper_result_ok;
+				media_ptr->parent->children_list = media_ptr->next_node;
 			}
-			else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
-				&& (dtmd_helper_is_helper_list_supported_filesystem_options_failed(cmd))
-				&& (dtmd_helper_is_helper_list_supported_filesystem_options_parameters_match(cmd, params->filesystem)))
+			else
 			{
-				handle->result_state = dt_command_failed;
-				handle->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
-				handle->library_state = dtmd_state_default;
-				return dtmd_helper_result_exit;
+				handle->mirror_root = media_ptr->next_node;
 			}
 		}
 
-		res = dtmd_helper_handle_cmd(handle, cmd);
-		if (res != dtmd_ok)
+		dtmd_helper_free_removable_device_recursive(media_ptr);
+	}
+	else if (strcmp(cmd->cmd, dtmd_notification_removable_device_changed) == 0)
+	{
+		media_ptr = dtmd_helper_mirror_find(handle, cmd->args[1]);
+		if (media_ptr == NULL)
+		{
+			goto dtmd_helper_update_mirror_invalidate;
+		}
+
+		if (dtmd_fill_removable_device_from_notification_implementation(handle, cmd, dtmd_internal_fill_copy, &constructed_media) != dtmd_ok)
+		{
+			goto dtmd_helper_update_mirror_invalidate;
+		}
+
+		// swap data, old one is freed together with constructed device
+		tmp_media = *media_ptr;
+
+		media_ptr->type      = constructed_media->type;
+		media_ptr->subtype   = constructed_media->subtype;
+		media_ptr->state     = constructed_media->state;
+		media_ptr->fstype    = constructed_media->fstype;
+		media_ptr->label     = constructed_media->label;
+		media_ptr->mnt_point = constructed_media->mnt_point;
+		media_ptr->mnt_opts  = constructed_media->mnt_opts;
+
+		constructed_media->fstype    = tmp_media.fstype;
+		constructed_media->label     = tmp_media.label;
+		constructed_media->mnt_point = tmp_media.mnt_point;
+		constructed_media->mnt_opts  = tmp_media.mnt_opts;
+
+		dtmd_helper_free_removable_device_recursive(constructed_media);
+	}
+	else if (strcmp(cmd->cmd, dtmd_notification_removable_device_mounted) == 0)
+	{
+		media_ptr = dtmd_helper_mirror_find(handle, cmd->args[0]);
+		if (media_ptr == NULL)
 		{
-			handle->result_state = res;
+			goto dtmd_helper_update_mirror_invalidate;
+		}
 
-			if (dtmd_helper_is_state_invalid(res))
-			{
-				return dtmd_helper_result_error;
-			}
-			else
-			{
-				return dtmd_helper_result_exit;
-			}
+		mnt_point = strdup(cmd->args[1]);
+		mnt_opts  = strdup(cmd->args[2]);
+
+		if ((mnt_point == NULL) || (mnt_opts == NULL))
+		{
+			free(mnt_point);
+			free(mnt_opts);
+			goto dtmd_helper_update_mirror_invalidate;
 		}
+
+		free(media_ptr->mnt_point);
+		free(media_ptr->mnt_opts);
+
+		media_ptr->mnt_point = mnt_point;
+		media_ptr->mnt_opts  = mnt_opts;
 	}
+	else if (strcmp(cmd->cmd, dtmd_notification_removable_device_unmounted) == 0)
+	{
+		media_ptr = dtmd_helper_mirror_find(handle, cmd->args[0]);
+		if (media_ptr == NULL)
+		{
+			goto dtmd_helper_update_mirror_invalidate;
+		}
 
-	return dtmd_helper_result_ok;
+		free(media_ptr->mnt_point);
+		free(media_ptr->mnt_opts);
+
+		media_ptr->mnt_point = NULL;
+		media_ptr->mnt_opts  = NULL;
+	}
+
+dtmd_helper_update_mirror_exit:
+	pthread_mutex_unlock(&(handle->mirror_mutex));
+	return;
+
+dtmd_helper_update_mirror_invalidate:
+	// mirror can't be trusted anymore, get new one from daemon
+	dtmd_helper_clear_mirror(handle);
+	handle->is_mirror_seed_required = 1;
+	pthread_mutex_unlock(&(handle->mirror_mutex));
 }
 
-static dtmd_helper_result_t dtmd_helper_process_list_supported_filesystem_options(dtmd_t *handle, dt_command_t *cmd, void *params, void *state)
+/* mirror_mutex must be locked */
+static void dtmd_helper_clear_mirror(dtmd_t *handle)
 {
-	return dtmd_helper_process_list_supported_filesystem_options_implementation(handle, cmd, (dtmd_helper_params_list_supported_filesystem_options_t*) params, (dtmd_helper_state_list_supported_filesystem_options_t*) state);
+	if (handle->mirror_root != NULL)
+	{
+		dtmd_helper_free_removable_device(handle->mirror_root);
+		handle->mirror_root = NULL;
+	}
+
+	if (handle->mirror_index != NULL)
+	{
+		free(handle->mirror_index);
+		handle->mirror_index = NULL;
+	}
+
+	handle->mirror_index_size  = 0;
+	handle->mirror_index_count = 0;
+	handle->is_mirror_synchronized = 0;
 }
 
-#if (defined OS_Linux)
-inline static dtmd_helper_result_t dtmd_helper_process_poweroff_implementation(dtmd_t *handle, dt_command_t *cmd, dtmd_helper_params_poweroff_t *params, void *state)
+/* returns 0 if mirror isn't synchronized and daemon has to be queried instead */
+static int dtmd_helper_list_from_mirror(dtmd_t *handle, const char *device_path, dtmd_result_t *result, dtmd_removable_media_t **result_list)
 {
+	dtmd_removable_media_t *media_ptr;
 	dtmd_result_t res;
 
-	if (handle->library_state == dtmd_state_default)
+	if (dtmd_is_state_invalid(handle))
 	{
-		if ((strcmp(cmd->cmd, dtmd_response_succeeded) == 0)
-			&& (dtmd_helper_is_helper_poweroff_generic(cmd))
-			&& (dtmd_helper_is_helper_poweroff_parameters_match(cmd, params->device_path)))
+		*result = dtmd_invalid_state;
+		return 1;
+	}
+
+	pthread_mutex_lock(&(handle->mirror_mutex));
+
+	if (!handle->is_mirror_synchronized)
+	{
+		pthread_mutex_unlock(&(handle->mirror_mutex));
+		return 0;
+	}
+
+	*result_list = NULL;
+	res = dtmd_ok;
+
+	if (strcmp(device_path, dtmd_root_device_path) == 0)
+	{
+		if (dtmd_helper_copy_removable_devices_list(handle->mirror_root, NULL, result_list) < 0)
 		{
-			handle->result_state = dtmd_ok;
-			return dtmd_helper_result_exit;
+			res = dtmd_memory_error;
 		}
-		else if ((strcmp(cmd->cmd, dtmd_response_failed) == 0)
-			&& (dtmd_helper_is_helper_poweroff_failed(cmd))
-			&& (dtmd_helper_is_helper_poweroff_parameters_match(cmd, params->device_path)))
+	}
+	else
+	{
+		media_ptr = dtmd_helper_mirror_find(handle, device_path);
+		if (media_ptr == NULL)
 		{
-			handle->result_state = dt_command_failed;
-			handle->error_code = dtmd_string_to_error_code(cmd->args[cmd->args_count - 1]);
-			return dtmd_helper_result_exit;
+			res = dt_command_failed;
+		}
+		else if (dtmd_helper_copy_removable_device(media_ptr, NULL, result_list) < 0)
+		{
+			res = dtmd_memory_error;
 		}
 	}
 
-	res = dtmd_helper_handle_cmd(handle, cmd);
-	if (res != dtmd_ok)
+	pthread_mutex_unlock(&(handle->mirror_mutex));
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+
+	if (!dtmd_helper_is_state_invalid(handle->result_state))
 	{
 		handle->result_state = res;
+	}
 
-		if (dtmd_helper_is_state_invalid(res))
-		{
-			return dtmd_helper_result_error;
-		}
-		else
-		{
-			return dtmd_helper_result_exit;
-		}
+	if (res == dt_command_failed)
+	{
+		handle->error_code = dtmd_error_code_no_such_removable_device;
 	}
 
-	return dtmd_helper_result_ok;
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	*result = res;
+	return 1;
 }
 
-static dtmd_helper_result_t dtmd_helper_process_poweroff(dtmd_t *handle, dt_command_t *cmd, void *params, void *state)
+static size_t dtmd_helper_mirror_path_hash(const char *path)
 {
-	return dtmd_helper_process_poweroff_implementation(handle, cmd, (dtmd_helper_params_poweroff_t*) params, state);
+	size_t hash = 2166136261u;
+
+	while (*path != 0)
+	{
+		hash ^= (unsigned char) *path;
+		hash *= 16777619u;
+		++path;
+	}
+
+	return hash;
 }
-#endif /* (defined OS_Linux) */
 
-inline static int dtmd_helper_exit_list_all_removable_devices_implementation(dtmd_t *handle, dtmd_helper_state_list_all_removable_devices_t *state)
+/* mirror_mutex must be locked */
+static int dtmd_helper_mirror_index_grow(dtmd_t *handle)
 {
-	if (handle->result_state == dtmd_ok)
+	dtmd_removable_media_t **new_index;
+	size_t new_size;
+	size_t i;
+	size_t pos;
+
+	new_size = (handle->mirror_index_size > 0) ? (handle->mirror_index_size * 2) : dtmd_mirror_index_initial_size;
+
+	new_index = (dtmd_removable_media_t**) calloc(new_size, sizeof(dtmd_removable_media_t*));
+	if (new_index == NULL)
 	{
-		if (!state->got_started)
+		return -1;
+	}
+
+	for (i = 0; i < handle->mirror_index_size; ++i)
+	{
+		if (handle->mirror_index[i] != NULL)
 		{
-			handle->result_state = dtmd_invalid_state;
-			return 0;
+			pos = dtmd_helper_mirror_path_hash(handle->mirror_index[i]->path) & (new_size - 1);
+
+			while (new_index[pos] != NULL)
+			{
+				pos = (pos + 1) & (new_size - 1);
+			}
+
+			new_index[pos] = handle->mirror_index[i];
 		}
 	}
-	else
+
+	if (handle->mirror_index != NULL)
 	{
-		dtmd_helper_exit_clear_list_all_removable_devices(state);
+		free(handle->mirror_index);
 	}
 
+	handle->mirror_index = new_index;
+	handle->mirror_index_size = new_size;
+
 	return 1;
 }
 
-static int dtmd_helper_exit_list_all_removable_devices(dtmd_t *handle, void *state)
+/* mirror_mutex must be locked. Fails if device with same path is already indexed */
+static int dtmd_helper_mirror_index_add(dtmd_t *handle, dtmd_removable_media_t *device)
 {
-	return dtmd_helper_exit_list_all_removable_devices_implementation(handle, (dtmd_helper_state_list_all_removable_devices_t*) state);
-}
+	size_t pos;
 
-inline static void dtmd_helper_exit_clear_list_all_removable_devices_implementation(dtmd_helper_state_list_all_removable_devices_t *state)
-{
-	if (state->result != NULL)
+	// load factor is kept at most 1/2 to keep probe sequences short
+	if ((handle->mirror_index_count + 1) * 2 > handle->mirror_index_size)
 	{
-		dtmd_helper_free_removable_device(state->result);
-		state->result = NULL;
+		if (dtmd_helper_mirror_index_grow(handle) < 0)
+		{
+			return -1;
+		}
 	}
-}
 
-static void dtmd_helper_exit_clear_list_all_removable_devices(void *state)
-{
-	dtmd_helper_exit_clear_list_all_removable_devices_implementation((dtmd_helper_state_list_all_removable_devices_t*) state);
-}
+	pos = dtmd_helper_mirror_path_hash(device->path) & (handle->mirror_index_size - 1);
 
-inline static int dtmd_helper_exit_list_removable_device_implementation(dtmd_t *handle, dtmd_helper_state_list_removable_device_t *state)
-{
-	if (handle->result_state == dtmd_ok)
+	while (handle->mirror_index[pos] != NULL)
 	{
-		if ((!state->got_started)
-			|| (state->result == NULL)
-			|| ((!state->accept_multiple_devices) && (state->result->next_node != NULL)))
+		if (strcmp(handle->mirror_index[pos]->path, device->path) == 0)
 		{
-			handle->result_state = dtmd_invalid_state;
-			return 0;
+			return -1;
 		}
-	}
-	else
-	{
-		dtmd_helper_exit_clear_list_removable_device(state);
+
+		pos = (pos + 1) & (handle->mirror_index_size - 1);
 	}
 
+	handle->mirror_index[pos] = device;
+	++(handle->mirror_index_count);
+
 	return 1;
 }
 
-static int dtmd_helper_exit_list_removable_device(dtmd_t *handle, void *state)
+/* mirror_mutex must be locked */
+static int dtmd_helper_mirror_index_add_recursive(dtmd_t *handle, dtmd_removable_media_t *devices_list)
 {
-	return dtmd_helper_exit_list_removable_device_implementation(handle, (dtmd_helper_state_list_removable_device_t*) state);
+	for (; devices_list != NULL; devices_list = devices_list->next_node)
+	{
+		if ((dtmd_helper_mirror_index_add(handle, devices_list) < 0)
+			|| (dtmd_helper_mirror_index_add_recursive(handle, devices_list->children_list) < 0))
+		{
+			return -1;
+		}
+	}
+
+	return 1;
 }
 
-inline static void dtmd_helper_exit_clear_list_removable_device_implementation(dtmd_helper_state_list_removable_device_t *state)
+/* mirror_mutex must be locked */
+static void dtmd_helper_mirror_index_remove(dtmd_t *handle, dtmd_removable_media_t *device)
 {
-	if (state->result != NULL)
+	size_t mask;
+	size_t pos;
+	size_t next;
+	size_t home;
+
+	if (handle->mirror_index_count == 0)
 	{
-		dtmd_helper_free_removable_device(state->result);
-		state->result = NULL;
+		return;
 	}
-}
 
-static void dtmd_helper_exit_clear_list_removable_device(void *state)
-{
-	dtmd_helper_exit_clear_list_removable_device_implementation((dtmd_helper_state_list_removable_device_t*) state);
-}
+	mask = handle->mirror_index_size - 1;
+	pos = dtmd_helper_mirror_path_hash(device->path) & mask;
 
-inline static int dtmd_helper_exit_list_supported_filesystems_implementation(dtmd_t *handle, dtmd_helper_state_list_supported_filesystems_t *state)
-{
-	if (handle->result_state == dtmd_ok)
+	while (handle->mirror_index[pos] != device)
 	{
-		if (!state->got_result)
+		if (handle->mirror_index[pos] == NULL)
 		{
-			handle->result_state = dtmd_invalid_state;
-			return 0;
+			return;
 		}
+
+		pos = (pos + 1) & mask;
 	}
-	else
+
+	handle->mirror_index[pos] = NULL;
+	--(handle->mirror_index_count);
+
+	// shift following entries of probe sequence back, so that lookups don't stop at the hole
+	for (next = (pos + 1) & mask; handle->mirror_index[next] != NULL; next = (next + 1) & mask)
 	{
-		dtmd_helper_exit_clear_list_supported_filesystems(state);
-	}
+		home = dtmd_helper_mirror_path_hash(handle->mirror_index[next]->path) & mask;
 
-	return 1;
+		if (((next - home) & mask) >= ((next - pos) & mask))
+		{
+			handle->mirror_index[pos] = handle->mirror_index[next];
+			handle->mirror_index[next] = NULL;
+			pos = next;
+		}
+	}
 }
 
-static int dtmd_helper_exit_list_supported_filesystems(dtmd_t *handle, void *state)
+/* mirror_mutex must be locked */
+static void dtmd_helper_mirror_index_remove_recursive(dtmd_t *handle, dtmd_removable_media_t *devices_list)
 {
-	return dtmd_helper_exit_list_supported_filesystems_implementation(handle, (dtmd_helper_state_list_supported_filesystems_t*) state);
+	for (; devices_list != NULL; devices_list = devices_list->next_node)
+	{
+		dtmd_helper_mirror_index_remove(handle, devices_list);
+		dtmd_helper_mirror_index_remove_recursive(handle, devices_list->children_list);
+	}
 }
 
-inline static void dtmd_helper_exit_clear_list_supported_filesystems_implementation(dtmd_helper_state_list_supported_filesystems_t *state)
+/* mirror_mutex must be locked */
+static dtmd_removable_media_t* dtmd_helper_mirror_find(dtmd_t *handle, const char *path)
 {
-	if (state->result_list != NULL)
+	size_t pos;
+
+	if (handle->mirror_index_count == 0)
 	{
-		dtmd_helper_free_supported_filesystems(state->result_count, state->result_list);
+		return NULL;
 	}
 
-	state->result_list  = NULL;
-	state->result_count = 0;
-}
+	pos = dtmd_helper_mirror_path_hash(path) & (handle->mirror_index_size - 1);
 
-static void dtmd_helper_exit_clear_list_supported_filesystems(void *state)
-{
-	dtmd_helper_exit_clear_list_supported_filesystems_implementation((dtmd_helper_state_list_supported_filesystems_t*) state);
+	while (handle->mirror_index[pos] != NULL)
+	{
+		if (strcmp(handle->mirror_index[pos]->path, path) == 0)
+		{
+			return handle->mirror_index[pos];
+		}
+
+		pos = (pos + 1) & (handle->mirror_index_size - 1);
+	}
+
+	return NULL;
 }
 
-inline static int dtmd_helper_exit_list_supported_filesystem_options_implementation(dtmd_t *handle, dtmd_helper_state_list_supported_filesystem_options_t *state)
+/* keeps list sorted by path, same as daemon does */
+static void dtmd_helper_insert_removable_device(dtmd_removable_media_t **root_ptr, dtmd_removable_media_t *device)
 {
-	if (handle->result_state == dtmd_ok)
+	dtmd_removable_media_t *media_ptr;
+	dtmd_removable_media_t *last_ptr = NULL;
+
+	for (media_ptr = *root_ptr; media_ptr != NULL; media_ptr = media_ptr->next_node)
 	{
-		if (!state->got_result)
+		if (strcmp(device->path, media_ptr->path) < 0)
 		{
-			handle->result_state = dtmd_invalid_state;
-			return 0;
+			break;
 		}
+
+		last_ptr = media_ptr;
 	}
-	else
+
+	device->prev_node = last_ptr;
+	device->next_node = media_ptr;
+
+	if (media_ptr != NULL)
 	{
-		dtmd_helper_exit_clear_list_supported_filesystem_options(state);
+		media_ptr->prev_node = device;
 	}
 
-	return 1;
+	if (last_ptr != NULL)
+	{
+		last_ptr->next_node = device;
+	}
+	else
+	{
+		*root_ptr = device;
+	}
 }
 
-static int dtmd_helper_exit_list_supported_filesystem_options(dtmd_t *handle, void *state)
+/* copies device with its children, but without siblings */
+static int dtmd_helper_copy_removable_device(const dtmd_removable_media_t *device, dtmd_removable_media_t *parent, dtmd_removable_media_t **result)
 {
-	return dtmd_helper_exit_list_supported_filesystem_options_implementation(handle, (dtmd_helper_state_list_supported_filesystem_options_t*) state);
-}
+	dtmd_removable_media_t *constructed_media;
 
-inline static void dtmd_helper_exit_clear_list_supported_filesystem_options_implementation(dtmd_helper_state_list_supported_filesystem_options_t *state)
-{
-	if (state->result_list != NULL)
+	constructed_media = (dtmd_removable_media_t*) malloc(sizeof(dtmd_removable_media_t));
+	if (constructed_media == NULL)
 	{
-		dtmd_helper_free_supported_filesystem_options(state->result_count, state->result_list);
+		return -1;
 	}
 
-	state->result_list  = NULL;
-	state->result_count = 0;
+	constructed_media->path          = NULL;
+	constructed_media->type          = device->type;
+	constructed_media->subtype       = device->subtype;
+	constructed_media->state         = device->state;
+	constructed_media->fstype        = NULL;
+	constructed_media->label         = NULL;
+	constructed_media->mnt_point     = NULL;
+	constructed_media->mnt_opts      = NULL;
+	constructed_media->parent        = parent;
+	constructed_media->children_list = NULL;
+	constructed_media->next_node     = NULL;
+	constructed_media->prev_node     = NULL;
+	constructed_media->private_data  = NULL;
+
+	/* it's safe to do a cast here since copying doesn't modify source */
+	if ((!dtmd_helper_fill_data(&(constructed_media->path), (char**) &(device->path), dtmd_internal_fill_copy))
+		|| (!dtmd_helper_fill_data(&(constructed_media->fstype), (char**) &(device->fstype), dtmd_internal_fill_copy))
+		|| (!dtmd_helper_fill_data(&(constructed_media->label), (char**) &(device->label), dtmd_internal_fill_copy))
+		|| (!dtmd_helper_fill_data(&(constructed_media->mnt_point), (char**) &(device->mnt_point), dtmd_internal_fill_copy))
+		|| (!dtmd_helper_fill_data(&(constructed_media->mnt_opts), (char**) &(device->mnt_opts), dtmd_internal_fill_copy))
+		|| (dtmd_helper_copy_removable_devices_list(device->children_list, constructed_media, &(constructed_media->children_list)) < 0))
+	{
+		dtmd_helper_free_removable_device_recursive(constructed_media);
+		return -1;
+	}
+
+	*result = constructed_media;
+
+	return 1;
 }
 
-static void dtmd_helper_exit_clear_list_supported_filesystem_options(void *state)
+/* copies all devices in list with their children */
+static int dtmd_helper_copy_removable_devices_list(const dtmd_removable_media_t *devices_list, dtmd_removable_media_t *parent, dtmd_removable_media_t **result)
 {
-	dtmd_helper_exit_clear_list_supported_filesystem_options_implementation((dtmd_helper_state_list_supported_filesystem_options_t*) state);
+	dtmd_removable_media_t *first = NULL;
+	dtmd_removable_media_t *last = NULL;
+	dtmd_removable_media_t *constructed_media;
+
+	for (; devices_list != NULL; devices_list = devices_list->next_node)
+	{
+		if (dtmd_helper_copy_removable_device(devices_list, parent, &constructed_media) < 0)
+		{
+			if (first != NULL)
+			{
+				dtmd_helper_free_removable_device(first);
+			}
+
+			return -1;
+		}
+
+		constructed_media->prev_node = last;
+
+		if (last != NULL)
+		{
+			last->next_node = constructed_media;
+		}
+		else
+		{
+			first = constructed_media;
+		}
+
+		last = constructed_media;
+	}
+
+	*result = first;
+
+	return 1;
 }
 
 static void dtmd_helper_free_string_array(size_t count, const char **data)
@@ -2781,6 +5446,31 @@ static void dtmd_helper_free_string_array(size_t count, const char **data)
 	free(data);
 }
 
+static int dtmd_helper_copy_string_array(size_t count, char **data, const char ***result)
+{
+	const char **copied_data;
+	size_t i;
+
+	copied_data = (const char**) calloc(count, sizeof(const char*));
+	if ((copied_data == NULL) && (count > 0))
+	{
+		return 0;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		if (!dtmd_helper_fill_data((char**) &(copied_data[i]), &(data[i]), dtmd_internal_fill_copy))
+		{
+			dtmd_helper_free_string_array(i, copied_data);
+			return 0;
+		}
+	}
+
+	*result = copied_data;
+
+	return 1;
+}
+
 static int dtmd_helper_validate_string_array(size_t count, const char **data)
 {
 	size_t i;
@@ -34,6 +34,21 @@ extern "C" {
 
 #define dtmd_library_timeout_infinite (-1)
 
+// requests are sent without waiting for responses to previous ones, thus different threads don't wait for each other.
+// If daemon doesn't support tagged requests, requests are still sent one by one
+#define dtmd_init_flag_pipelined (1<<0)
+
+// library keeps a copy of daemon's device tree, updated from notifications.
+// While it's synchronized, dtmd_list_all_removable_devices and dtmd_list_removable_device are served from it without querying daemon.
+// Implies dtmd_init_flag_pipelined
+#define dtmd_init_flag_device_mirror (1<<1)
+
+// library doesn't start worker thread. Instead, application polls fd returned by dtmd_get_event_fd
+// for reading and calls dtmd_process_events when it's readable or when dtmd_get_event_timeout expires.
+// Callbacks are called from thread processing events.
+// Implies dtmd_init_flag_pipelined
+#define dtmd_init_flag_event_loop (1<<2)
+
 typedef enum dtmd_state
 {
 	dtmd_state_connected,
@@ -65,6 +80,13 @@ typedef enum dtmd_result
 	dtmd_label_decoding_error = -13
 } dtmd_result_t;
 
+// Completion callbacks of asynchronous requests are called from worker thread or from thread processing events, same as dtmd_callback_t.
+// Synchronous requests may not be issued from them, asynchronous ones may.
+// Lists passed to callbacks are owned by callee and should be freed with corresponding dtmd_free_* function
+typedef void (*dtmd_completion_callback_t)(dtmd_t *library, void *arg, dtmd_result_t result, dtmd_error_code_t error_code);
+typedef void (*dtmd_removable_devices_completion_callback_t)(dtmd_t *library, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, dtmd_removable_media_t *result_list);
+typedef void (*dtmd_string_list_completion_callback_t)(dtmd_t *library, void *arg, dtmd_result_t result, dtmd_error_code_t error_code, size_t result_count, const char **result_list);
+
 typedef enum dtmd_fill_type
 {
 	dtmd_fill_copy = 0, // copy the data from dt_command to structure
@@ -72,6 +94,7 @@ typedef enum dtmd_fill_type
 } dtmd_fill_type_t;
 
 dtmd_t* dtmd_init(dtmd_callback_t callback, dtmd_state_callback_t state_callback, void *arg, dtmd_result_t *result);
+dtmd_t* dtmd_init_with_flags(dtmd_callback_t callback, dtmd_state_callback_t state_callback, void *arg, unsigned int flags, dtmd_result_t *result);
 void dtmd_deinit(dtmd_t *handle);
 
 // timeout is in milliseconds, negative for infinite
@@ -86,9 +109,34 @@ dtmd_result_t dtmd_list_supported_filesystem_options(dtmd_t *handle, int timeout
 dtmd_result_t dtmd_poweroff(dtmd_t *handle, int timeout, const char *path);
 #endif /* (defined OS_Linux) */
 
+// Asynchronous requests are available only if library is initialized with dtmd_init_flag_pipelined, otherwise dtmd_input_error is returned.
+// If request is accepted, dtmd_ok is returned and callback is called exactly once, with result of request, timeout, or error.
+// Otherwise callback isn't called at all
+dtmd_result_t dtmd_list_all_removable_devices_async(dtmd_t *handle, int timeout, dtmd_removable_devices_completion_callback_t callback, void *arg);
+dtmd_result_t dtmd_list_removable_device_async(dtmd_t *handle, int timeout, const char *device_path, dtmd_removable_devices_completion_callback_t callback, void *arg);
+dtmd_result_t dtmd_mount_async(dtmd_t *handle, int timeout, const char *path, const char *mount_options, dtmd_completion_callback_t callback, void *arg);
+dtmd_result_t dtmd_unmount_async(dtmd_t *handle, int timeout, const char *path, dtmd_completion_callback_t callback, void *arg);
+dtmd_result_t dtmd_list_supported_filesystems_async(dtmd_t *handle, int timeout, dtmd_string_list_completion_callback_t callback, void *arg);
+dtmd_result_t dtmd_list_supported_filesystem_options_async(dtmd_t *handle, int timeout, const char *filesystem, dtmd_string_list_completion_callback_t callback, void *arg);
+
+#if (defined OS_Linux)
+dtmd_result_t dtmd_poweroff_async(dtmd_t *handle, int timeout, const char *path, dtmd_completion_callback_t callback, void *arg);
+#endif /* (defined OS_Linux) */
+
 dtmd_result_t dtmd_fill_removable_device_from_notification(dtmd_t *handle, const dt_command_t *cmd, dtmd_fill_type_t fill_type, dtmd_removable_media_t **result);
 
+// Following functions are available only if library is initialized with dtmd_init_flag_event_loop.
+// dtmd_get_event_fd returns -1 and dtmd_process_events returns dtmd_input_error otherwise.
+// dtmd_process_events doesn't block and handles at most max_events events, or all pending events if max_events isn't positive.
+// Synchronous requests process events themselves while waiting for response, then dtmd_process_events returns without doing anything.
+// Meanwhile fd may stay readable until response arrives, thus application's poll may return immediately.
+// dtmd_get_event_timeout returns time in milliseconds after which dtmd_process_events has to be called even without activity on fd, or -1
+int dtmd_get_event_fd(dtmd_t *handle);
+int dtmd_get_event_timeout(dtmd_t *handle);
+dtmd_result_t dtmd_process_events(dtmd_t *handle, int max_events);
+
 int dtmd_is_state_invalid(dtmd_t *handle);
+int dtmd_is_device_mirror_synchronized(dtmd_t *handle);
 int dtmd_is_notification_valid_removable_device(dtmd_t *handle, const dt_command_t *cmd);
 
 // if error is command_failed, detailed error code can be with following function
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_FAKE_DAEMON_H
+#define DT_FAKE_DAEMON_H
+
+/*
+ * Daemon scripted by test for testing library.
+ * This header is included before library source, which connects to one end of socketpair
+ * instead of daemon socket, and test reads requests from other end and writes responses to it.
+ */
+
+#include <dtmd.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+typedef struct fake_daemon
+{
+	int fd;
+	size_t used;
+	char buffer[dtmd_command_max_length + 1];
+} fake_daemon_t;
+
+/* end of socketpair which library gets on next connection attempt, or -1 if daemon isn't running */
+static int fake_daemon_library_fd = -1;
+
+static int fake_daemon_connect(int fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+	(void)addr;
+	(void)addrlen;
+
+	if (fake_daemon_library_fd < 0)
+	{
+		errno = ECONNREFUSED;
+		return -1;
+	}
+
+	if (dup2(fake_daemon_library_fd, fd) < 0)
+	{
+		return -1;
+	}
+
+	close(fake_daemon_library_fd);
+	fake_daemon_library_fd = -1;
+
+	return 0;
+}
+
+#define connect fake_daemon_connect
+
+static int fake_daemon_start(fake_daemon_t *daemon)
+{
+	int fds[2];
+
+	if (socketpair(AF_LOCAL, SOCK_STREAM, 0, fds) != 0)
+	{
+		return 0;
+	}
+
+	daemon->fd = fds[0];
+	daemon->used = 0;
+	fake_daemon_library_fd = fds[1];
+
+	return 1;
+}
+
+static void fake_daemon_stop(fake_daemon_t *daemon)
+{
+	if (fake_daemon_library_fd >= 0)
+	{
+		close(fake_daemon_library_fd);
+		fake_daemon_library_fd = -1;
+	}
+
+	close(daemon->fd);
+	daemon->fd = -1;
+}
+
+static int fake_daemon_send(fake_daemon_t *daemon, const char *data)
+{
+	size_t size = strlen(data);
+	ssize_t rc;
+
+	while (size > 0)
+	{
+		rc = send(daemon->fd, data, size, MSG_NOSIGNAL);
+		if (rc < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return 0;
+		}
+
+		data += rc;
+		size -= rc;
+	}
+
+	return 1;
+}
+
+/* returns 1 and line without newline, 0 if no line arrived in timeout milliseconds, -1 on error */
+static int fake_daemon_read_line(fake_daemon_t *daemon, char *line, size_t size, int timeout)
+{
+	struct pollfd pollfd;
+	char *end;
+	size_t length;
+	ssize_t rc;
+
+	for (;;)
+	{
+		daemon->buffer[daemon->used] = 0;
+
+		end = strchr(daemon->buffer, '\n');
+		if (end != NULL)
+		{
+			length = end - daemon->buffer;
+			if (length >= size)
+			{
+				return -1;
+			}
+
+			memcpy(line, daemon->buffer, length);
+			line[length] = 0;
+
+			daemon->used -= length + 1;
+			memmove(daemon->buffer, end + 1, daemon->used);
+
+			return 1;
+		}
+
+		if (daemon->used == dtmd_command_max_length)
+		{
+			return -1;
+		}
+
+		pollfd.fd     = daemon->fd;
+		pollfd.events = POLLIN;
+
+		rc = poll(&pollfd, 1, timeout);
+		if (rc == 0)
+		{
+			return 0;
+		}
+		else if (rc < 0)
+		{
+			return -1;
+		}
+
+		rc = read(daemon->fd, &(daemon->buffer[daemon->used]), dtmd_command_max_length - daemon->used);
+		if (rc <= 0)
+		{
+			return -1;
+		}
+
+		daemon->used += rc;
+	}
+}
+
+static int fake_daemon_expect(fake_daemon_t *daemon, const char *expected, int timeout)
+{
+	char line[dtmd_command_max_length + 1];
+
+	return (fake_daemon_read_line(daemon, line, sizeof(line), timeout) == 1)
+		&& (strcmp(line, expected) == 0);
+}
+
+/*
+ * Sends response with same arguments as request, e.g. "succeeded(5 mount, 6 /dev/a, -1)" for "mount(6 /dev/a, -1)".
+ * Tagged request gets its id as first argument, since it's first argument of request too.
+ * Error is appended as last argument unless it's NULL.
+ */
+static int fake_daemon_respond(fake_daemon_t *daemon, const char *response, const char *request, const char *error)
+{
+	char buffer[dtmd_command_max_length + 1];
+	const char *args;
+	size_t name_length;
+	size_t args_length;
+	int rc;
+	int error_rc;
+
+	args = strchr(request, '(');
+	if ((args == NULL) || (request[strlen(request) - 1] != ')'))
+	{
+		return 0;
+	}
+
+	name_length = args - request;
+	++args;
+	args_length = strlen(args) - 1;
+
+	if ((name_length == strlen(dtmd_command_tagged_request))
+		&& (strncmp(request, dtmd_command_tagged_request, name_length) == 0))
+	{
+		rc = snprintf(buffer, sizeof(buffer), "%s(%.*s)\n", response, (int) args_length, args);
+	}
+	else
+	{
+		rc = snprintf(buffer, sizeof(buffer), "%s(%zu %.*s%s%.*s)\n", response,
+			name_length, (int) name_length, request,
+			((args_length > 0) ? ", " : ""),
+			(int) args_length, args);
+	}
+
+	if ((rc < 0) || ((size_t) rc >= sizeof(buffer)))
+	{
+		return 0;
+	}
+
+	if (error != NULL)
+	{
+		// replace closing bracket and newline
+		rc -= 2;
+
+		error_rc = snprintf(&(buffer[rc]), sizeof(buffer) - rc, ", %zu %s)\n", strlen(error), error);
+		if ((error_rc < 0) || ((size_t) error_rc >= sizeof(buffer) - rc))
+		{
+			return 0;
+		}
+	}
+
+	return fake_daemon_send(daemon, buffer);
+}
+
+/* daemons without tagged requests don't reply to request for them at all */
+static int fake_daemon_negotiate(fake_daemon_t *daemon, int is_tagged)
+{
+	static const char filesystems[] =
+		dtmd_response_started "(26 " dtmd_command_list_supported_filesystems ")\n"
+		dtmd_response_argument_supported_filesystems_lists "(4 vfat)\n"
+		dtmd_response_finished "(26 " dtmd_command_list_supported_filesystems ")\n";
+
+	if ((!fake_daemon_expect(daemon, dtmd_command_request_ids "()", 2000))
+		|| (!fake_daemon_expect(daemon, dtmd_command_list_supported_filesystems "()", 2000)))
+	{
+		return 0;
+	}
+
+	if (is_tagged && (!fake_daemon_send(daemon, dtmd_response_succeeded "(11 " dtmd_command_request_ids ")\n")))
+	{
+		return 0;
+	}
+
+	return fake_daemon_send(daemon, filesystems);
+}
+
+#endif /* DT_FAKE_DAEMON_H */
@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "daemon/filesystem_opts.h"
+#include "daemon/client_io.h"
 #include "daemon/return_codes.h"
 #include "tests/dt_tests.h"
 
@@ -35,6 +36,11 @@ dtmd_removable_media_t *removable_media_root = NULL;
 struct client *client_root = NULL;
 size_t clients_count = 0;
 
+int client_printf(struct client *client_ptr, const char *format, ...)
+{
+	return result_success;
+}
+
 #define get_fsopts(fstype) \
 	fsopts_##fstype = get_fsopts_for_fs(#fstype); \
 	if (fsopts_##fstype == NULL) \
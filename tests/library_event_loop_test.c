@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Library driven by application's poll loop, while synchronous requests are issued from another thread.
+ * Events are processed either by poll loop or by thread waiting for response, whichever gets them first.
+ */
+
+#include "tests/fake_daemon.h"
+#include "library/dtmd-library.c"
+#include "tests/dt_tests.h"
+
+#define test_requests_count 50
+
+/* every few responses are preceded by notification */
+#define test_notifications_period 5
+
+typedef struct test_requester
+{
+	pthread_t thread;
+	dtmd_t *handle;
+	int count;
+
+	int is_finished; /* protected by test_mutex */
+	dtmd_result_t result;
+} test_requester_t;
+
+static pthread_mutex_t test_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int test_notifications_count = 0;
+
+static void test_callback(dtmd_t *library, void *arg, const dt_command_t *cmd)
+{
+	(void)library;
+	(void)arg;
+	(void)cmd;
+
+	pthread_mutex_lock(&test_mutex);
+	++test_notifications_count;
+	pthread_mutex_unlock(&test_mutex);
+}
+
+static void test_state_callback(dtmd_t *library, void *arg, dtmd_state_t state)
+{
+	(void)library;
+	(void)arg;
+	(void)state;
+}
+
+static int test_get_notifications_count(void)
+{
+	int result;
+
+	pthread_mutex_lock(&test_mutex);
+	result = test_notifications_count;
+	pthread_mutex_unlock(&test_mutex);
+
+	return result;
+}
+
+/* requests are issued one after another, first failure stops them */
+static void* test_requester_function(void *arg)
+{
+	test_requester_t *requester = (test_requester_t*) arg;
+	dtmd_result_t result = dtmd_ok;
+	int i;
+
+	for (i = 0; (i < requester->count) && (result == dtmd_ok); ++i)
+	{
+		if (i % 2 == 0)
+		{
+			result = dtmd_mount(requester->handle, 5000, "/dev/a", NULL);
+		}
+		else
+		{
+			result = dtmd_unmount(requester->handle, 5000, "/dev/a");
+		}
+	}
+
+	pthread_mutex_lock(&test_mutex);
+	requester->result = result;
+	requester->is_finished = 1;
+	pthread_mutex_unlock(&test_mutex);
+
+	return NULL;
+}
+
+static int test_requester_start(test_requester_t *requester, dtmd_t *handle, int count)
+{
+	requester->handle      = handle;
+	requester->count       = count;
+	requester->is_finished = 0;
+	requester->result      = dtmd_ok;
+
+	return pthread_create(&(requester->thread), NULL, &test_requester_function, requester) == 0;
+}
+
+static int test_requester_is_finished(test_requester_t *requester)
+{
+	int result;
+
+	pthread_mutex_lock(&test_mutex);
+	result = requester->is_finished;
+	pthread_mutex_unlock(&test_mutex);
+
+	return result;
+}
+
+static dtmd_result_t test_requester_join(test_requester_t *requester)
+{
+	pthread_join(requester->thread, NULL);
+
+	return requester->result;
+}
+
+/* responds to all requests which already arrived, returns count of them or -1 on error */
+static int test_serve_requests(fake_daemon_t *daemon, int *served)
+{
+	char line[dtmd_command_max_length + 1];
+	int count = 0;
+	int rc;
+
+	while ((rc = fake_daemon_read_line(daemon, line, sizeof(line), 0)) == 1)
+	{
+		if ((*served % test_notifications_period == 0)
+			&& (!fake_daemon_send(daemon, dtmd_notification_removable_device_removed "(6 /dev/z)\n")))
+		{
+			return -1;
+		}
+
+		if (!fake_daemon_respond(daemon, dtmd_response_succeeded, line, NULL))
+		{
+			return -1;
+		}
+
+		++(*served);
+		++count;
+	}
+
+	return (rc == 0) ? count : -1;
+}
+
+int main(int argc, char **argv)
+{
+	fake_daemon_t daemon;
+	dtmd_t *handle;
+	dtmd_result_t result;
+	test_requester_t requester;
+	struct pollfd pollfds[2];
+	struct timespec time_cur;
+	struct timespec time_end;
+	char line[dtmd_command_max_length + 1];
+	int served = 0;
+	int timeout;
+
+	(void)argc;
+	(void)argv;
+
+	tests_init();
+	tests_quit_on_error(1);
+
+	/* without application processing events, thread waiting for response processes them itself */
+	test_compare(fake_daemon_start(&daemon));
+
+	handle = dtmd_init_with_flags(&test_callback, &test_state_callback, NULL, dtmd_init_flag_event_loop, &result);
+	test_compare((handle != NULL) && (result == dtmd_ok));
+	test_compare(dtmd_get_event_fd(handle) >= 0);
+
+	test_compare(test_requester_start(&requester, handle, 1));
+
+	test_compare(fake_daemon_negotiate(&daemon, 1));
+	test_compare(fake_daemon_read_line(&daemon, line, sizeof(line), 2000) == 1);
+	test_compare(fake_daemon_respond(&daemon, dtmd_response_succeeded, line, NULL));
+
+	test_compare(test_requester_join(&requester) == dtmd_ok);
+	test_compare(!dtmd_is_state_invalid(handle));
+
+	dtmd_deinit(handle);
+	fake_daemon_stop(&daemon);
+
+	/* poll loop and waiting thread compete for events */
+	test_compare(fake_daemon_start(&daemon));
+
+	handle = dtmd_init_with_flags(&test_callback, &test_state_callback, NULL, dtmd_init_flag_event_loop, &result);
+	test_compare((handle != NULL) && (result == dtmd_ok));
+
+	test_compare(test_requester_start(&requester, handle, test_requests_count));
+
+	pollfds[0].fd     = dtmd_get_event_fd(handle);
+	pollfds[0].events = POLLIN;
+	pollfds[1].fd     = daemon.fd;
+	pollfds[1].events = POLLIN;
+
+	test_compare(fake_daemon_negotiate(&daemon, 1));
+
+	// poll returns immediately while events are processed by waiting thread, thus loop is limited by time
+	clock_gettime(CLOCK_MONOTONIC, &time_end);
+	time_end.tv_sec += 10;
+
+	while ((!test_requester_is_finished(&requester))
+		|| (test_get_notifications_count() < (served + test_notifications_period - 1) / test_notifications_period))
+	{
+		clock_gettime(CLOCK_MONOTONIC, &time_cur);
+		if (time_cur.tv_sec > time_end.tv_sec)
+		{
+			break;
+		}
+
+		timeout = dtmd_get_event_timeout(handle);
+		if ((timeout < 0) || (timeout > 10))
+		{
+			timeout = 10;
+		}
+
+		test_compare(poll(pollfds, 2, timeout) >= 0);
+
+		test_compare(dtmd_process_events(handle, 0) == dtmd_ok);
+		test_compare(test_serve_requests(&daemon, &served) >= 0);
+	}
+
+	test_compare(test_requester_join(&requester) == dtmd_ok);
+	test_compare(served == test_requests_count);
+
+	// notifications are delivered no matter which thread processed them
+	test_compare(test_get_notifications_count() == (test_requests_count + test_notifications_period - 1) / test_notifications_period);
+	test_compare(!dtmd_is_state_invalid(handle));
+
+	dtmd_deinit(handle);
+	fake_daemon_stop(&daemon);
+
+	/* library with worker thread has no events for application */
+	test_compare(fake_daemon_start(&daemon));
+
+	handle = dtmd_init(&test_callback, &test_state_callback, NULL, &result);
+	test_compare((handle != NULL) && (result == dtmd_ok));
+
+	test_compare(dtmd_get_event_fd(handle) == -1);
+	test_compare(dtmd_get_event_timeout(handle) == -1);
+	test_compare(dtmd_process_events(handle, 0) == dtmd_input_error);
+
+	dtmd_deinit(handle);
+	fake_daemon_stop(&daemon);
+
+	return tests_result();
+}
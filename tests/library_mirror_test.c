@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Device mirror kept from notifications of fake daemon.
+ * Paths of devices are picked so that they collide in index of initial size,
+ * one cluster of collisions is in the middle of index and another one wraps around its end.
+ */
+
+#include "tests/fake_daemon.h"
+#include "library/dtmd-library.c"
+#include "tests/dt_tests.h"
+
+#define test_paths_count 8
+#define test_path_size 32
+
+/* first four paths are in the middle of index, last four wrap around its end */
+#define test_middle_home 10
+#define test_wrap_home (dtmd_mirror_index_initial_size - 1)
+
+static pthread_mutex_t test_notifications_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t test_notifications_cond = PTHREAD_COND_INITIALIZER;
+static int test_notifications_count = 0;
+
+static void test_callback(dtmd_t *library, void *arg, const dt_command_t *cmd)
+{
+	(void)library;
+	(void)arg;
+	(void)cmd;
+
+	pthread_mutex_lock(&test_notifications_mutex);
+	++test_notifications_count;
+	pthread_cond_broadcast(&test_notifications_cond);
+	pthread_mutex_unlock(&test_notifications_mutex);
+}
+
+static void test_state_callback(dtmd_t *library, void *arg, dtmd_state_t state)
+{
+	(void)library;
+	(void)arg;
+	(void)state;
+}
+
+/* mirror is updated before callback is called, thus it's checked after waiting for notification */
+static int test_wait_notifications(int count)
+{
+	struct timespec time_end;
+	int rc = 0;
+
+	clock_gettime(CLOCK_REALTIME, &time_end);
+	time_end.tv_sec += 2;
+
+	pthread_mutex_lock(&test_notifications_mutex);
+
+	while ((test_notifications_count < count) && (rc == 0))
+	{
+		rc = pthread_cond_timedwait(&test_notifications_cond, &test_notifications_mutex, &time_end);
+	}
+
+	rc = (test_notifications_count >= count);
+
+	pthread_mutex_unlock(&test_notifications_mutex);
+
+	return rc;
+}
+
+static int test_wait_synchronized(dtmd_t *handle)
+{
+	struct timespec delay;
+	int i;
+
+	delay.tv_sec  = 0;
+	delay.tv_nsec = 10 * 1000000L;
+
+	for (i = 0; i < 200; ++i)
+	{
+		if (dtmd_is_device_mirror_synchronized(handle))
+		{
+			return 1;
+		}
+
+		nanosleep(&delay, NULL);
+	}
+
+	return 0;
+}
+
+static size_t test_home(const char *path)
+{
+	return dtmd_helper_mirror_path_hash(path) & (dtmd_mirror_index_initial_size - 1);
+}
+
+static void test_find_path(size_t home, unsigned int *counter, char *path)
+{
+	do
+	{
+		snprintf(path, test_path_size, "/dev/mirror%u", (*counter)++);
+	} while (test_home(path) != home);
+}
+
+/* mirror_mutex must be locked. Lookups stop at empty slot, thus none may be between device and its home slot */
+static int test_is_index_consistent(dtmd_t *handle)
+{
+	size_t mask = handle->mirror_index_size - 1;
+	size_t count = 0;
+	size_t i;
+	size_t pos;
+
+	for (i = 0; i < handle->mirror_index_size; ++i)
+	{
+		if (handle->mirror_index[i] == NULL)
+		{
+			continue;
+		}
+
+		++count;
+
+		for (pos = dtmd_helper_mirror_path_hash(handle->mirror_index[i]->path) & mask; pos != i; pos = (pos + 1) & mask)
+		{
+			if (handle->mirror_index[pos] == NULL)
+			{
+				return 0;
+			}
+		}
+	}
+
+	return count == handle->mirror_index_count;
+}
+
+/* checks which of paths are found in mirror, removed paths are marked by empty string */
+static int test_is_mirror_valid(dtmd_t *handle, char paths[][test_path_size], size_t count)
+{
+	size_t i;
+	size_t found = 0;
+	int result;
+
+	pthread_mutex_lock(&(handle->mirror_mutex));
+
+	result = test_is_index_consistent(handle);
+
+	for (i = 0; i < count; ++i)
+	{
+		if (paths[i][0] != 0)
+		{
+			result = result && (dtmd_helper_mirror_find(handle, paths[i]) != NULL);
+			++found;
+		}
+	}
+
+	result = result && (handle->mirror_index_count == found);
+
+	pthread_mutex_unlock(&(handle->mirror_mutex));
+
+	return result;
+}
+
+/* returns index of path of device in given slot of index */
+static size_t test_path_in_slot(dtmd_t *handle, size_t slot, char paths[][test_path_size], size_t count)
+{
+	size_t i;
+	const char *path = NULL;
+
+	pthread_mutex_lock(&(handle->mirror_mutex));
+
+	if ((slot < handle->mirror_index_size) && (handle->mirror_index[slot] != NULL))
+	{
+		path = handle->mirror_index[slot]->path;
+	}
+
+	pthread_mutex_unlock(&(handle->mirror_mutex));
+
+	for (i = 0; (path != NULL) && (i < count); ++i)
+	{
+		if (strcmp(paths[i], path) == 0)
+		{
+			return i;
+		}
+	}
+
+	return count;
+}
+
+static int test_send_devices(fake_daemon_t *daemon, const char *request, char paths[][test_path_size], size_t count)
+{
+	char line[dtmd_command_max_length + 1];
+	size_t i;
+
+	if (!fake_daemon_respond(daemon, dtmd_response_started, request, NULL))
+	{
+		return 0;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		snprintf(line, sizeof(line), dtmd_response_argument_removable_device "(1 " dtmd_root_device_path ", %zu %s, %zu %s, %zu %s)\n",
+			strlen(paths[i]), paths[i],
+			strlen(dtmd_string_device_type_stateless_device), dtmd_string_device_type_stateless_device,
+			strlen(dtmd_string_device_subtype_removable_disk), dtmd_string_device_subtype_removable_disk);
+
+		if (!fake_daemon_send(daemon, line))
+		{
+			return 0;
+		}
+	}
+
+	return fake_daemon_respond(daemon, dtmd_response_finished, request, NULL);
+}
+
+static int test_send_removed(fake_daemon_t *daemon, const char *path)
+{
+	char line[dtmd_command_max_length + 1];
+
+	snprintf(line, sizeof(line), dtmd_notification_removable_device_removed "(%zu %s)\n", strlen(path), path);
+
+	return fake_daemon_send(daemon, line);
+}
+
+static int test_is_seed_request(const char *line)
+{
+	const char *args;
+
+	return (strncmp(line, dtmd_command_tagged_request "(", strlen(dtmd_command_tagged_request "(")) == 0)
+		&& ((args = strchr(line, ',')) != NULL)
+		&& (strcmp(args, ", 26 " dtmd_command_list_all_removable_devices ")") == 0);
+}
+
+int main(int argc, char **argv)
+{
+	fake_daemon_t daemon;
+	dtmd_t *handle;
+	dtmd_result_t result;
+	dtmd_removable_media_t *devices;
+	dtmd_removable_media_t *media_ptr;
+	char paths[test_paths_count][test_path_size];
+	char new_paths[2][test_path_size];
+	char line[dtmd_command_max_length + 1];
+	unsigned int counter = 0;
+	size_t removed;
+	size_t i;
+
+	(void)argc;
+	(void)argv;
+
+	tests_init();
+	tests_quit_on_error(1);
+
+	for (i = 0; i < 3; ++i)
+	{
+		test_find_path(test_middle_home, &counter, paths[i]);
+		test_find_path(test_wrap_home, &counter, paths[i + 4]);
+	}
+
+	// devices whose home slot is occupied by previous cluster
+	test_find_path(test_middle_home + 1, &counter, paths[3]);
+	test_find_path(0, &counter, paths[7]);
+
+	test_find_path(test_middle_home, &counter, new_paths[0]);
+	test_find_path(test_middle_home, &counter, new_paths[1]);
+
+	test_compare(fake_daemon_start(&daemon));
+
+	handle = dtmd_init_with_flags(&test_callback, &test_state_callback, NULL, dtmd_init_flag_device_mirror, &result);
+	test_compare((handle != NULL) && (result == dtmd_ok));
+
+	test_compare(fake_daemon_negotiate(&daemon, 1));
+
+	/* mirror is seeded after negotiation */
+	test_compare(fake_daemon_read_line(&daemon, line, sizeof(line), 2000) == 1);
+	test_compare(test_is_seed_request(line));
+	test_compare(test_send_devices(&daemon, line, paths, test_paths_count));
+
+	test_compare(test_wait_synchronized(handle));
+	test_compare(test_is_mirror_valid(handle, paths, test_paths_count));
+
+	/* removal from middle of cluster, following devices are shifted back */
+	removed = test_path_in_slot(handle, test_middle_home, paths, test_paths_count);
+	test_compare(removed < test_paths_count);
+	test_compare(test_path_in_slot(handle, test_middle_home + 1, paths, test_paths_count) < test_paths_count);
+
+	test_compare(test_send_removed(&daemon, paths[removed]));
+	test_compare(test_wait_notifications(1));
+
+	paths[removed][0] = 0;
+	test_compare(dtmd_is_device_mirror_synchronized(handle));
+	test_compare(test_is_mirror_valid(handle, paths, test_paths_count));
+
+	/* removal from cluster wrapping around end of index */
+	removed = test_path_in_slot(handle, test_wrap_home, paths, test_paths_count);
+	test_compare(removed < test_paths_count);
+	test_compare(test_path_in_slot(handle, 0, paths, test_paths_count) < test_paths_count);
+
+	test_compare(test_send_removed(&daemon, paths[removed]));
+	test_compare(test_wait_notifications(2));
+
+	paths[removed][0] = 0;
+	test_compare(dtmd_is_device_mirror_synchronized(handle));
+	test_compare(test_is_mirror_valid(handle, paths, test_paths_count));
+
+	// lists are served from mirror without querying daemon
+	test_compare(dtmd_list_all_removable_devices(handle, 1000, &devices) == dtmd_ok);
+	for (i = 0, media_ptr = devices; media_ptr != NULL; media_ptr = media_ptr->next_node)
+	{
+		++i;
+	}
+	test_compare(i == test_paths_count - 2);
+	dtmd_free_removable_devices(handle, devices);
+
+	test_compare(fake_daemon_read_line(&daemon, line, sizeof(line), 100) == 0);
+
+	/* notification about unknown device invalidates mirror, then it's seeded again */
+	test_compare(test_send_removed(&daemon, "/dev/unknown"));
+	test_compare(test_wait_notifications(3));
+	test_compare(!dtmd_is_device_mirror_synchronized(handle));
+
+	test_compare(fake_daemon_read_line(&daemon, line, sizeof(line), 2000) == 1);
+	test_compare(test_is_seed_request(line));
+	test_compare(test_send_devices(&daemon, line, new_paths, 2));
+
+	test_compare(test_wait_synchronized(handle));
+	test_compare(test_is_mirror_valid(handle, new_paths, 2));
+
+	test_compare(dtmd_list_removable_device(handle, 1000, new_paths[1], &devices) == dtmd_ok);
+	test_compare((devices != NULL) && (strcmp(devices->path, new_paths[1]) == 0));
+	dtmd_free_removable_devices(handle, devices);
+
+	test_compare(dtmd_list_removable_device(handle, 1000, paths[1], &devices) == dt_command_failed);
+	test_compare(fake_daemon_read_line(&daemon, line, sizeof(line), 100) == 0);
+
+	dtmd_deinit(handle);
+	fake_daemon_stop(&daemon);
+
+	return tests_result();
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Synchronous requests of pipelined library issued from several threads
+ * against daemons with and without tagged requests.
+ */
+
+#include "tests/fake_daemon.h"
+#include "library/dtmd-library.c"
+#include "tests/dt_tests.h"
+
+typedef struct test_request
+{
+	pthread_t thread;
+	dtmd_t *handle;
+	const char *path;
+	int is_mount;
+	int timeout;
+
+	int is_finished; /* protected by test_requests_mutex */
+	dtmd_result_t result;
+} test_request_t;
+
+static pthread_mutex_t test_requests_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void test_callback(dtmd_t *library, void *arg, const dt_command_t *cmd)
+{
+	(void)library;
+	(void)arg;
+	(void)cmd;
+}
+
+static void test_state_callback(dtmd_t *library, void *arg, dtmd_state_t state)
+{
+	(void)library;
+	(void)arg;
+	(void)state;
+}
+
+static void* test_request_function(void *arg)
+{
+	test_request_t *request = (test_request_t*) arg;
+	dtmd_result_t result;
+
+	if (request->is_mount)
+	{
+		result = dtmd_mount(request->handle, request->timeout, request->path, NULL);
+	}
+	else
+	{
+		result = dtmd_unmount(request->handle, request->timeout, request->path);
+	}
+
+	pthread_mutex_lock(&test_requests_mutex);
+	request->result = result;
+	request->is_finished = 1;
+	pthread_mutex_unlock(&test_requests_mutex);
+
+	return NULL;
+}
+
+static int test_request_start(test_request_t *request, dtmd_t *handle, int is_mount, const char *path, int timeout)
+{
+	request->handle      = handle;
+	request->path        = path;
+	request->is_mount    = is_mount;
+	request->timeout     = timeout;
+	request->is_finished = 0;
+	request->result      = dtmd_ok;
+
+	return pthread_create(&(request->thread), NULL, &test_request_function, request) == 0;
+}
+
+static int test_request_is_finished(test_request_t *request)
+{
+	int result;
+
+	pthread_mutex_lock(&test_requests_mutex);
+	result = request->is_finished;
+	pthread_mutex_unlock(&test_requests_mutex);
+
+	return result;
+}
+
+static dtmd_result_t test_request_join(test_request_t *request)
+{
+	pthread_join(request->thread, NULL);
+
+	return request->result;
+}
+
+static dtmd_protocol_state_t test_protocol_state(dtmd_t *handle)
+{
+	dtmd_protocol_state_t result;
+
+	pthread_mutex_lock(&(handle->requests_mutex));
+	result = handle->protocol_state;
+	pthread_mutex_unlock(&(handle->requests_mutex));
+
+	return result;
+}
+
+static int test_is_untagged(const char *line)
+{
+	return (strncmp(line, dtmd_command_mount "(", strlen(dtmd_command_mount "(")) == 0)
+		|| (strncmp(line, dtmd_command_unmount "(", strlen(dtmd_command_unmount "(")) == 0);
+}
+
+static unsigned long long test_request_id(const char *line)
+{
+	unsigned long long id = 0;
+
+	if (sscanf(line, dtmd_command_tagged_request "(%*u %llu,", &id) != 1)
+	{
+		return 0;
+	}
+
+	return id;
+}
+
+int main(int argc, char **argv)
+{
+	fake_daemon_t daemon;
+	dtmd_t *handle;
+	dtmd_result_t result;
+	test_request_t requests[4];
+	char lines[4][dtmd_command_max_length + 1];
+	char line[dtmd_command_max_length + 1];
+	const char *slow_lines[3];
+	const char *late_line = NULL;
+	int slow_lines_count;
+	int i;
+	int j;
+
+	(void)argc;
+	(void)argv;
+
+	tests_init();
+	tests_quit_on_error(1);
+
+	/* daemon without tagged requests ignores request for them, requests are sent one by one */
+	test_compare(fake_daemon_start(&daemon));
+
+	handle = dtmd_init_with_flags(&test_callback, &test_state_callback, NULL, dtmd_init_flag_pipelined, &result);
+	test_compare((handle != NULL) && (result == dtmd_ok));
+
+	test_compare(fake_daemon_negotiate(&daemon, 0));
+
+	test_compare(test_request_start(&(requests[0]), handle, 1, "/dev/a", 5000));
+	test_compare(test_request_start(&(requests[1]), handle, 0, "/dev/b", 5000));
+
+	test_compare(fake_daemon_read_line(&daemon, lines[0], sizeof(lines[0]), 2000) == 1);
+	test_compare(test_is_untagged(lines[0]));
+	test_compare(test_protocol_state(handle) == dtmd_protocol_untagged);
+
+	// second request waits for response to first one
+	test_compare(fake_daemon_read_line(&daemon, line, sizeof(line), 200) == 0);
+
+	test_compare(fake_daemon_respond(&daemon, dtmd_response_succeeded, lines[0], NULL));
+
+	test_compare(fake_daemon_read_line(&daemon, lines[1], sizeof(lines[1]), 2000) == 1);
+	test_compare(test_is_untagged(lines[1]));
+	test_compare(strcmp(lines[0], lines[1]) != 0);
+
+	test_compare(fake_daemon_respond(&daemon, dtmd_response_succeeded, lines[1], NULL));
+
+	test_compare(test_request_join(&(requests[0])) == dtmd_ok);
+	test_compare(test_request_join(&(requests[1])) == dtmd_ok);
+
+	dtmd_deinit(handle);
+	fake_daemon_stop(&daemon);
+
+	/* daemon with tagged requests gets all requests at once and may respond in any order */
+	test_compare(fake_daemon_start(&daemon));
+
+	handle = dtmd_init_with_flags(&test_callback, &test_state_callback, NULL, dtmd_init_flag_pipelined, &result);
+	test_compare((handle != NULL) && (result == dtmd_ok));
+
+	test_compare(fake_daemon_negotiate(&daemon, 1));
+
+	test_compare(test_request_start(&(requests[0]), handle, 1, "/dev/a", 5000));
+	test_compare(test_request_start(&(requests[1]), handle, 0, "/dev/b", 5000));
+	test_compare(test_request_start(&(requests[2]), handle, 1, "/dev/c", 5000));
+	test_compare(test_request_start(&(requests[3]), handle, 0, "/dev/t", 300));
+
+	slow_lines_count = 0;
+
+	for (i = 0; i < 4; ++i)
+	{
+		test_compare(fake_daemon_read_line(&daemon, lines[i], sizeof(lines[i]), 2000) == 1);
+		test_compare(test_request_id(lines[i]) != 0);
+
+		if (strstr(lines[i], "6 /dev/t") != NULL)
+		{
+			late_line = lines[i];
+			continue;
+		}
+
+		// sorted by id
+		for (j = slow_lines_count; (j > 0) && (test_request_id(slow_lines[j - 1]) > test_request_id(lines[i])); --j)
+		{
+			slow_lines[j] = slow_lines[j - 1];
+		}
+
+		slow_lines[j] = lines[i];
+		++slow_lines_count;
+	}
+
+	test_compare(test_protocol_state(handle) == dtmd_protocol_tagged);
+	test_compare((late_line != NULL) && (slow_lines_count == 3));
+
+	// one request times out while others are still waiting for responses
+	test_compare(test_request_join(&(requests[3])) == dtmd_timeout);
+	test_compare(!test_request_is_finished(&(requests[0])));
+	test_compare(!test_request_is_finished(&(requests[1])));
+	test_compare(!test_request_is_finished(&(requests[2])));
+
+	// response to request which timed out is dropped
+	test_compare(fake_daemon_respond(&daemon, dtmd_response_succeeded, late_line, NULL));
+
+	// neither first nor last sent request is answered first
+	test_compare(fake_daemon_respond(&daemon, dtmd_response_succeeded, slow_lines[1], NULL));
+	test_compare(fake_daemon_respond(&daemon, dtmd_response_succeeded, slow_lines[2], NULL));
+	test_compare(fake_daemon_respond(&daemon, dtmd_response_succeeded, slow_lines[0], NULL));
+
+	test_compare(test_request_join(&(requests[0])) == dtmd_ok);
+	test_compare(test_request_join(&(requests[1])) == dtmd_ok);
+	test_compare(test_request_join(&(requests[2])) == dtmd_ok);
+	test_compare(!dtmd_is_state_invalid(handle));
+
+	// connection is still usable
+	test_compare(test_request_start(&(requests[0]), handle, 0, "/dev/d", 5000));
+	test_compare(fake_daemon_read_line(&daemon, lines[0], sizeof(lines[0]), 2000) == 1);
+	test_compare(fake_daemon_respond(&daemon, dtmd_response_failed, lines[0], dtmd_string_error_code_device_not_mounted));
+	test_compare(test_request_join(&(requests[0])) == dt_command_failed);
+	test_compare(dtmd_get_code_of_command_fail(handle) == dtmd_error_code_device_not_mounted);
+
+	dtmd_deinit(handle);
+	fake_daemon_stop(&daemon);
+
+	return tests_result();
+}
@@ -18,9 +18,13 @@
  *
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "daemon/lists.h"
+#include "daemon/client_io.h"
 #include "daemon/return_codes.h"
 #include "tests/dt_tests.h"
 
@@ -35,6 +39,10 @@ int daemonize = 1;
 #define sysfs_arg(N)
 #endif /* (defined OS_FreeBSD) */
 
+void client_free_queue(struct client *client_ptr)
+{
+}
+
 void notify_removable_device_added(const char *parent_path,
 	const char *path,
 	dtmd_removable_media_type_t media_type,
@@ -73,6 +81,11 @@ void notify_removable_device_removed(const char *path)
 
 int main(int argc, char **argv)
 {
+	int i;
+	char path[32];
+	int client_fds[2];
+	struct client *clients[3];
+
 	tests_init();
 
 	(void)argc;
@@ -81,9 +94,9 @@ int main(int argc, char **argv)
 	// media structures memory test (use with valgrind)
 
 	test_compare(is_result_successful(add_media("/","/dev/sdd", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, NULL, NULL, NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd3", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd2", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive2", NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd1", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd3", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd2", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive2", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd1", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
 
 	test_compare(is_result_successful(remove_media("/dev/sdd3")));
 	test_compare(is_result_successful(remove_media("/dev/sdd2")));
@@ -91,9 +104,9 @@ int main(int argc, char **argv)
 	test_compare(is_result_successful(remove_media("/dev/sdd")));
 
 	test_compare(is_result_successful(add_media("/","/dev/sdd", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, NULL, NULL, NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd1",sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd2", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive2", NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd3", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd1",sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd2", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive2", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd3", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
 
 	test_compare(is_result_successful(remove_media("/dev/sdd3")));
 	test_compare(is_result_successful(remove_media("/dev/sdd2")));
@@ -101,9 +114,9 @@ int main(int argc, char **argv)
 	test_compare(is_result_successful(remove_media("/dev/sdd")));
 
 	test_compare(is_result_successful(add_media("/","/dev/sdd", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, NULL, NULL, NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd3", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd2", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive2", NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd1", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd3", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd2", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive2", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd1", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
 
 	test_compare(is_result_successful(remove_media("/dev/sdd1")));
 	test_compare(is_result_successful(remove_media("/dev/sdd2")));
@@ -111,14 +124,99 @@ int main(int argc, char **argv)
 	test_compare(is_result_successful(remove_media("/dev/sdd")));
 
 	test_compare(is_result_successful(add_media("/","/dev/sdd", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, NULL, NULL, NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd1", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd2", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive2", NULL, NULL)));
-	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd3", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_type_device_partition, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd1", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd2", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive2", NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdd","/dev/sdd3", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", "drive1", NULL, NULL)));
 
 	test_compare(is_result_successful(remove_media("/dev/sdd1")));
 	test_compare(is_result_successful(remove_media("/dev/sdd2")));
 	test_compare(is_result_successful(remove_media("/dev/sdd3")));
 	test_compare(is_result_successful(remove_media("/dev/sdd")));
 
+	// index of devices
+	test_compare(find_media("/dev/sdd") == NULL);
+
+	test_compare(is_result_successful(add_media("/","/dev/sdd", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, NULL, NULL, NULL, NULL)));
+	test_compare(is_result_successful(add_media("/","/dev/sde", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, NULL, NULL, NULL, NULL)));
+
+	for (i = 0; i < 200; ++i)
+	{
+		snprintf(path, sizeof(path), "/dev/sdd%d", i + 1);
+		test_compare(is_result_successful(add_media("/dev/sdd", path, sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", NULL, NULL, NULL)));
+	}
+
+	test_compare((find_media("/dev/sdd") != NULL) && (strcmp(find_media("/dev/sdd")->path, "/dev/sdd") == 0));
+	test_compare((find_media("/dev/sde") != NULL) && (strcmp(find_media("/dev/sde")->path, "/dev/sde") == 0));
+
+	for (i = 0; i < 200; ++i)
+	{
+		snprintf(path, sizeof(path), "/dev/sdd%d", i + 1);
+		test_compare((find_media(path) != NULL) && (strcmp(find_media(path)->path, path) == 0) && (find_media(path)->parent == find_media("/dev/sdd")));
+	}
+
+	test_compare(find_media("/dev/sdd201") == NULL);
+
+	test_compare(is_result_successful(remove_media("/dev/sdd100")));
+	test_compare(find_media("/dev/sdd100") == NULL);
+	test_compare(find_media("/dev/sdd101") != NULL);
+
+	// children are removed together with parent
+	test_compare(is_result_successful(remove_media("/dev/sdd")));
+	test_compare(find_media("/dev/sdd") == NULL);
+	test_compare(find_media("/dev/sdd1") == NULL);
+	test_compare(find_media("/dev/sdd200") == NULL);
+	test_compare(find_media("/dev/sde") != NULL);
+
+	// devices which aren't found again are removed
+	test_compare(is_result_successful(add_media("/","/dev/sdf", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, NULL, NULL, NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdf","/dev/sdf1", sysfs_arg(NULL) dtmd_removable_media_type_device_partition, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", NULL, NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdf","/dev/sdf2", sysfs_arg(NULL) dtmd_removable_media_type_device_partition, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", NULL, NULL, NULL)));
+	test_compare(is_result_successful(add_media("/","/dev/sdg", sysfs_arg(NULL) dtmd_removable_media_type_stateless_device, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, NULL, NULL, NULL, NULL)));
+	test_compare(is_result_successful(add_media("/dev/sdg","/dev/sdg1", sysfs_arg(NULL) dtmd_removable_media_type_device_partition, dtmd_removable_media_subtype_removable_disk, dtmd_removable_media_state_unknown, "dummy", NULL, NULL, NULL)));
+
+	set_media_found(find_media("/dev/sde"));
+	set_media_found(find_media("/dev/sdf"));
+	set_media_found(find_media("/dev/sdf2"));
+	set_media_found(find_media("/dev/sdg1"));
+
+	remove_not_found_media();
+	test_compare(find_media("/dev/sde") != NULL);
+	test_compare((find_media("/dev/sdf") != NULL) && (find_media("/dev/sdf")->children_list == find_media("/dev/sdf2")));
+	test_compare(find_media("/dev/sdf1") == NULL);
+	test_compare(find_media("/dev/sdg") == NULL);
+	test_compare(find_media("/dev/sdg1") == NULL);
+
+	// marks are cleared
+	remove_not_found_media();
+	test_compare(removable_media_root == NULL);
+	test_compare(find_media("/dev/sde") == NULL);
+	test_compare(find_media("/dev/sdf2") == NULL);
+
+	remove_all_media();
+	test_compare(find_media("/dev/sde") == NULL);
+
+	// clients are kept in order of connection
+	for (i = 0; i < 3; ++i)
+	{
+		test_compare(socketpair(AF_UNIX, SOCK_STREAM, 0, client_fds) == 0);
+		close(client_fds[1]);
+		test_compare(is_result_successful(add_client(client_fds[0], &(clients[i]))));
+	}
+
+	test_compare((client_root == clients[0]) && (clients[0]->next_node == clients[1]) && (clients[1]->next_node == clients[2]));
+
+	remove_client(clients[2]);
+	test_compare(socketpair(AF_UNIX, SOCK_STREAM, 0, client_fds) == 0);
+	close(client_fds[1]);
+	test_compare(is_result_successful(add_client(client_fds[0], &(clients[2]))));
+	test_compare((clients[1]->next_node == clients[2]) && (clients[2]->prev_node == clients[1]) && (clients[2]->next_node == NULL));
+
+	remove_client(clients[0]);
+	test_compare((client_root == clients[1]) && (clients[1]->prev_node == NULL));
+	test_compare(clients_count == 2);
+
+	remove_all_clients();
+	test_compare((client_root == NULL) && (clients_count == 0));
+
 	return tests_result();
 }
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "daemon/mount_table.h"
+#include "daemon/return_codes.h"
+#include "tests/dt_tests.h"
+
+static const char *table_initial =
+	"21 1 0:20 / /proc rw,nosuid,nodev,noexec,relatime shared:12 - proc proc rw\n"
+	"25 1 8:2 / / rw,relatime shared:1 - ext4 /dev/sda2 rw\n"
+	"30 25 8:17 / /media/my\\040disk rw,nosuid,relatime shared:40 master:2 - vfat /dev/sdb1 rw,fmask=0022,dmask=0022\n";
+
+static const char *table_remounted =
+	"21 1 0:20 / /proc rw,nosuid,nodev,noexec,relatime shared:12 - proc proc rw\n"
+	"25 1 8:2 / / rw,relatime shared:1 - ext4 /dev/sda2 rw\n"
+	"30 25 8:17 / /media/my\\040disk ro,nosuid,relatime shared:40 master:2 - vfat /dev/sdb1 ro,fmask=0022,dmask=0022\n";
+
+static const char *table_bind_mounted =
+	"21 1 0:20 / /proc rw,nosuid,nodev,noexec,relatime shared:12 - proc proc rw\n"
+	"25 1 8:2 / / rw,relatime shared:1 - ext4 /dev/sda2 rw\n"
+	"30 25 8:17 / /media/my\\040disk ro,nosuid,relatime shared:40 master:2 - vfat /dev/sdb1 ro,fmask=0022,dmask=0022\n"
+	"41 25 8:17 / /mnt ro,relatime shared:40 - vfat /dev/sdb1 ro,fmask=0022,dmask=0022\n";
+
+static const char *table_first_unmounted =
+	"21 1 0:20 / /proc rw,nosuid,nodev,noexec,relatime shared:12 - proc proc rw\n"
+	"25 1 8:2 / / rw,relatime shared:1 - ext4 /dev/sda2 rw\n"
+	"41 25 8:17 / /mnt ro,relatime shared:40 - vfat /dev/sdb1 ro,fmask=0022,dmask=0022\n";
+
+static const char *table_id_reused =
+	"21 1 0:20 / /proc rw,nosuid,nodev,noexec,relatime shared:12 - proc proc rw\n"
+	"25 1 8:2 / / rw,relatime shared:1 - ext4 /dev/sda2 rw\n"
+	"41 25 8:33 / /mnt rw,relatime - ext4 /dev/sdc1 rw";
+
+static const char *table_id_reused_mounted =
+	"21 1 0:20 / /proc rw,nosuid,nodev,noexec,relatime shared:12 - proc proc rw\n"
+	"25 1 8:2 / / rw,relatime shared:1 - ext4 /dev/sda2 rw\n"
+	"41 25 8:33 / /mnt rw,relatime - ext4 /dev/sdc1 rw\n"
+	"50 25 8:17 / /media/my\\040disk rw,nosuid,relatime - vfat /dev/sdb1 rw,fmask=0022\n";
+
+static const char *table_stacked =
+	"25 1 8:2 / / rw,relatime shared:1 - ext4 /dev/sda2 rw\n"
+	"41 25 8:33 / /mnt rw,relatime - ext4 /dev/sdc1 rw\n"
+	"42 41 8:17 / /mnt rw,relatime - vfat /dev/sdb1 rw\n"
+	"43 42 0:40 / /mnt rw,relatime - tmpfs tmpfs rw\n";
+
+static size_t count_changes(const mount_table_entry_t *entry)
+{
+	size_t result = 0;
+
+	while (entry != NULL)
+	{
+		++result;
+		entry = entry->next_changed;
+	}
+
+	return result;
+}
+
+/* every mount of device found in mountinfo must be reported by kernel the same way */
+static int compare_with_kernel_table(const mount_table_t *text_table, const mount_table_t *kernel_table)
+{
+	const mount_table_entry_t *text_entry;
+	const mount_table_entry_t *kernel_entry;
+	size_t i, j;
+	int found;
+
+	for (i = 0; i < text_table->index_size; ++i)
+	{
+		for (text_entry = text_table->by_id[i]; text_entry != NULL; text_entry = text_entry->next_by_id)
+		{
+			if (text_entry->source[0] != '/')
+			{
+				continue;
+			}
+
+			found = 0;
+
+			for (j = 0; (j < kernel_table->index_size) && (!found); ++j)
+			{
+				for (kernel_entry = kernel_table->by_id[j]; kernel_entry != NULL; kernel_entry = kernel_entry->next_by_id)
+				{
+					if ((strcmp(text_entry->source, kernel_entry->source) == 0)
+						&& (strcmp(text_entry->mount_point, kernel_entry->mount_point) == 0)
+						&& (strcmp(text_entry->options, kernel_entry->options) == 0))
+					{
+						found = 1;
+						break;
+					}
+				}
+			}
+
+			if (!found)
+			{
+				printf("Mount of %s at %s with options %s is not reported by kernel\n", text_entry->source, text_entry->mount_point, text_entry->options);
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	mount_table_t table;
+	mount_table_changes_t changes;
+	mount_table_entry_t *entry;
+	char filename[] = "/tmp/dtmd_mount_table_XXXXXX";
+	char line[128];
+	int fd;
+	int i;
+
+	tests_init();
+
+	mount_table_init(&table);
+
+	/* initial contents */
+	test_compare(is_result_successful(mount_table_update(&table, table_initial, strlen(table_initial), &changes)));
+	test_compare(count_changes(changes.added) == 3);
+	test_compare(changes.modified == NULL);
+	test_compare(changes.removed == NULL);
+	test_compare((changes.added != NULL) && (changes.added->mount_id == 21));
+	mount_table_release_changes(&changes);
+
+	test_compare(table.count == 3);
+
+	entry = mount_table_find_source(&table, "/dev/sdb1");
+	test_compare(entry != NULL);
+	if (entry != NULL)
+	{
+		test_compare(entry->mount_id == 30);
+		test_compare(strcmp(entry->mount_point, "/media/my disk") == 0);
+		test_compare(strcmp(entry->options, "rw,nosuid,relatime,fmask=0022,dmask=0022") == 0);
+	}
+
+	entry = mount_table_find_source(&table, "/dev/sda2");
+	test_compare((entry != NULL) && (strcmp(entry->options, "rw,relatime") == 0));
+
+	/* sources which aren't paths are not indexed */
+	test_compare(mount_table_find_source(&table, "proc") == NULL);
+	test_compare(mount_table_find_source(&table, "/dev/sdc1") == NULL);
+
+	/* nothing changed */
+	test_compare(is_result_successful(mount_table_update(&table, table_initial, strlen(table_initial), &changes)));
+	test_compare(changes.added == NULL);
+	test_compare(changes.modified == NULL);
+	test_compare(changes.removed == NULL);
+	mount_table_release_changes(&changes);
+
+	/* remount */
+	test_compare(is_result_successful(mount_table_update(&table, table_remounted, strlen(table_remounted), &changes)));
+	test_compare(changes.added == NULL);
+	test_compare(count_changes(changes.modified) == 1);
+	test_compare(changes.removed == NULL);
+	if (changes.modified != NULL)
+	{
+		test_compare(changes.modified->mount_id == 30);
+		test_compare(strcmp(changes.modified->options, "ro,nosuid,relatime,fmask=0022,dmask=0022") == 0);
+	}
+	mount_table_release_changes(&changes);
+
+	/* same device mounted second time */
+	test_compare(is_result_successful(mount_table_update(&table, table_bind_mounted, strlen(table_bind_mounted), &changes)));
+	test_compare(count_changes(changes.added) == 1);
+	test_compare(changes.modified == NULL);
+	test_compare(changes.removed == NULL);
+	mount_table_release_changes(&changes);
+
+	entry = mount_table_find_source(&table, "/dev/sdb1");
+	test_compare((entry != NULL) && (entry->mount_id == 30));
+
+	test_compare(mount_table_count_mount_point(&table, "/mnt", 0) == 1);
+	test_compare(mount_table_count_mount_point(&table, "/media/my disk", 0) == 1);
+	test_compare(mount_table_count_mount_point(&table, "/media/my\\040disk", 0) == 0);
+	test_compare(mount_table_count_mount_point(&table, "/media", 0) == 0);
+
+	/* first mount of device is gone */
+	test_compare(is_result_successful(mount_table_update(&table, table_first_unmounted, strlen(table_first_unmounted), &changes)));
+	test_compare(changes.added == NULL);
+	test_compare(changes.modified == NULL);
+	test_compare(count_changes(changes.removed) == 1);
+	if (changes.removed != NULL)
+	{
+		test_compare(changes.removed->mount_id == 30);
+		test_compare(strcmp(changes.removed->source, "/dev/sdb1") == 0);
+	}
+	mount_table_release_changes(&changes);
+
+	entry = mount_table_find_source(&table, "/dev/sdb1");
+	test_compare((entry != NULL) && (entry->mount_id == 41) && (strcmp(entry->mount_point, "/mnt") == 0));
+
+	/* mount id reused by other device, last line without newline */
+	test_compare(is_result_successful(mount_table_update(&table, table_id_reused, strlen(table_id_reused), &changes)));
+	test_compare(count_changes(changes.added) == 1);
+	test_compare(changes.modified == NULL);
+	test_compare(count_changes(changes.removed) == 1);
+	test_compare((changes.added != NULL) && (strcmp(changes.added->source, "/dev/sdc1") == 0));
+	test_compare((changes.removed != NULL) && (strcmp(changes.removed->source, "/dev/sdb1") == 0));
+	mount_table_release_changes(&changes);
+
+	test_compare(mount_table_find_source(&table, "/dev/sdb1") == NULL);
+	test_compare(mount_table_find_source(&table, "/dev/sdc1") != NULL);
+	test_compare(table.count == 3);
+
+	test_compare(mount_table_count_mount_point(&table, "/media/my disk", 0) == 0);
+	test_compare(mount_table_count_mount_point(&table, "/mnt", 0) == 1);
+
+	/* mount done by daemon is replaced with one reported by kernel */
+	entry = mount_table_add_provisional(&table, "/dev/sdb1", "/media/my disk", "rw,nosuid");
+	test_compare((entry != NULL) && (entry->mount_id < -1));
+	test_compare(mount_table_count_mount_point(&table, "/media/my disk", 0) == 1);
+	test_compare(mount_table_find_source(&table, "/dev/sdb1") == entry);
+
+	test_compare(is_result_successful(mount_table_update(&table, table_id_reused_mounted, strlen(table_id_reused_mounted), &changes)));
+	test_compare(count_changes(changes.added) == 1);
+	test_compare(changes.modified == NULL);
+	test_compare(count_changes(changes.removed) == 1);
+	test_compare((changes.added != NULL) && (changes.added->mount_id == 50));
+	test_compare((changes.removed != NULL) && (changes.removed->mount_id < -1));
+	mount_table_release_changes(&changes);
+
+	test_compare(mount_table_count_mount_point(&table, "/media/my disk", 0) == 1);
+
+	/* mount reported by kernel before daemon finished mounting is found instead of adding provisional one */
+	entry = mount_table_find_mount(&table, "/dev/sdb1", "/media/my disk");
+	test_compare((entry != NULL) && (entry->mount_id == 50));
+	test_compare(mount_table_find_mount(&table, "/dev/sdb1", "/mnt") == NULL);
+	test_compare(mount_table_find_mount(&table, "/dev/sdc1", "/media/my disk") == NULL);
+
+	/* unmount done by daemon */
+	mount_table_remove(&table, 50);
+	test_compare(mount_table_find_source(&table, "/dev/sdb1") == NULL);
+	test_compare(mount_table_count_mount_point(&table, "/media/my disk", 0) == 0);
+
+	test_compare(is_result_successful(mount_table_update(&table, table_id_reused, strlen(table_id_reused), &changes)));
+	test_compare(changes.added == NULL);
+	test_compare(changes.modified == NULL);
+	test_compare(changes.removed == NULL);
+	mount_table_release_changes(&changes);
+
+	/* mounts stacked on same mount point */
+	test_compare(is_result_successful(mount_table_update(&table, table_stacked, strlen(table_stacked), &changes)));
+	mount_table_release_changes(&changes);
+
+	test_compare(mount_table_count_mount_point(&table, "/mnt", 0) == 3);
+	test_compare(mount_table_count_mount_point(&table, "/mnt", 2) == 2);
+
+	/* everything is unmounted */
+	test_compare(is_result_successful(mount_table_update(&table, "", 0, &changes)));
+	test_compare(count_changes(changes.removed) == 4);
+	mount_table_release_changes(&changes);
+
+	test_compare(table.count == 0);
+
+	/* big table read from file */
+	fd = mkstemp(filename);
+	test_compare(fd >= 0);
+	if (fd >= 0)
+	{
+		unlink(filename);
+
+		for (i = 0; i < 1000; ++i)
+		{
+			snprintf(line, sizeof(line), "%d 1 0:%d / /run/container/%d rw,relatime - tmpfs tmpfs rw\n", 100 + i, i, i);
+			test_compare(write(fd, line, strlen(line)) == (ssize_t) strlen(line));
+		}
+
+		test_compare(is_result_successful(mount_table_read(&table, fd)));
+		test_compare(is_result_successful(mount_table_update(&table, table.buffer, table.buffer_used, &changes)));
+		test_compare(count_changes(changes.added) == 1000);
+		mount_table_release_changes(&changes);
+
+		test_compare(table.count == 1000);
+
+		/* buffer is reused */
+		test_compare(is_result_successful(mount_table_read(&table, fd)));
+		test_compare(is_result_successful(mount_table_update(&table, table.buffer, table.buffer_used, &changes)));
+		test_compare(changes.added == NULL);
+		test_compare(changes.removed == NULL);
+		mount_table_release_changes(&changes);
+
+		close(fd);
+	}
+
+	mount_table_free(&table);
+
+	/* listmount() and statmount() report the same mounts as mountinfo */
+	if (is_result_successful(mount_table_kernel_supported()))
+	{
+		mount_table_t kernel_table;
+
+		mount_table_init(&table);
+		mount_table_init(&kernel_table);
+
+		fd = open("/proc/self/mountinfo", O_RDONLY);
+		test_compare(fd >= 0);
+		if (fd >= 0)
+		{
+			test_compare(is_result_successful(mount_table_read(&table, fd)));
+			test_compare(is_result_successful(mount_table_update(&table, table.buffer, table.buffer_used, &changes)));
+			mount_table_release_changes(&changes);
+
+			close(fd);
+		}
+
+		test_compare(is_result_successful(mount_table_update_kernel(&kernel_table, &changes)));
+		test_compare(count_changes(changes.added) == kernel_table.count);
+		mount_table_release_changes(&changes);
+
+		test_compare(compare_with_kernel_table(&table, &kernel_table));
+
+		test_compare(is_result_successful(mount_table_update_kernel(&kernel_table, &changes)));
+		test_compare(changes.added == NULL);
+		test_compare(changes.removed == NULL);
+		mount_table_release_changes(&changes);
+
+		mount_table_free(&kernel_table);
+		mount_table_free(&table);
+	}
+	else
+	{
+		printf("listmount() and statmount() are not supported, skipping\n");
+	}
+
+	return tests_result();
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "library/dt-parse-helpers.h"
+#include "tests/dt_tests.h"
+
+static int parse_line(const char *text, char *line, dt_helper_arena_t *arena, dt_command_t *cmd)
+{
+	strcpy(line, text);
+
+	return dt_helper_parse_command_in_place(line, strchr(line, '\n'), arena, cmd);
+}
+
+int main(int argc, char **argv)
+{
+	char line[256];
+	char second_line[256];
+	dt_helper_arena_t arena;
+	dt_command_t cmd;
+	dt_command_t second_cmd;
+	char **slots;
+	size_t i;
+
+	tests_init();
+
+	dt_helper_arena_init(&arena);
+
+	/* command without arguments */
+	test_compare(parse_line("list_all_removable_devices()\n", line, &arena, &cmd) == 1);
+	test_compare(strcmp(cmd.cmd, "list_all_removable_devices") == 0);
+	test_compare(cmd.args_count == 0);
+
+	/* regular, empty and missing arguments, data may contain separators */
+	test_compare(parse_line("removable_device(1 /, 9 /dev/sdb1, 0, -1, 4 a, b)\n", line, &arena, &cmd) == 1);
+	test_compare(strcmp(cmd.cmd, "removable_device") == 0);
+	test_compare(cmd.args_count == 5);
+	if (cmd.args_count == 5)
+	{
+		test_compare(strcmp(cmd.args[0], "/") == 0);
+		test_compare(strcmp(cmd.args[1], "/dev/sdb1") == 0);
+		test_compare((cmd.args[2] != NULL) && (cmd.args[2][0] == 0));
+		test_compare(cmd.args[3] == NULL);
+		test_compare(strcmp(cmd.args[4], "a, b") == 0);
+
+		/* arguments point into parsed line */
+		test_compare((cmd.args[1] > line) && (cmd.args[1] < line + sizeof(line)));
+	}
+
+	/* commands of one batch stay valid together */
+	test_compare(parse_line("succeeded(5 mount)\n", second_line, &arena, &second_cmd) == 1);
+	test_compare((cmd.args_count == 5) && (strcmp(cmd.args[4], "a, b") == 0));
+	test_compare((second_cmd.args_count == 1) && (strcmp(second_cmd.args[0], "mount") == 0));
+
+	/* invalid commands */
+	test_compare(parse_line("(1 a)\n", line, &arena, &cmd) == 0);
+	test_compare(parse_line("cmd\n", line, &arena, &cmd) == 0);
+	test_compare(parse_line("cmd(1 a\n", line, &arena, &cmd) == 0);
+	test_compare(parse_line("cmd(5 a)\n", line, &arena, &cmd) == 0);
+	test_compare(parse_line("cmd(1 a,1 b)\n", line, &arena, &cmd) == 0);
+	test_compare(parse_line("cmd(-2)\n", line, &arena, &cmd) == 0);
+	test_compare(parse_line("cmd(+1 a)\n", line, &arena, &cmd) == 0);
+	test_compare(parse_line("cmd(1a)\n", line, &arena, &cmd) == 0);
+	test_compare(parse_line("cmd(1 a) \n", line, &arena, &cmd) == 0);
+	test_compare(parse_line("cmd(99999999999999999999999 a)\n", line, &arena, &cmd) == 0);
+
+	/* arena grows past its block and merges blocks on reset */
+	dt_helper_arena_reset(&arena);
+
+	for (i = 0; i < 100; ++i)
+	{
+		slots = dt_helper_arena_alloc(&arena, 10);
+		test_compare(slots != NULL);
+	}
+
+	test_compare((arena.blocks != NULL) && (arena.blocks->next_block != NULL));
+
+	dt_helper_arena_reset(&arena);
+	test_compare((arena.blocks != NULL) && (arena.blocks->next_block == NULL) && (arena.blocks->size >= 1000));
+
+	for (i = 0; i < 100; ++i)
+	{
+		slots = dt_helper_arena_alloc(&arena, 10);
+		test_compare(slots != NULL);
+	}
+
+	test_compare(arena.blocks->next_block == NULL);
+
+	dt_helper_arena_free(&arena);
+	test_compare(arena.blocks == NULL);
+
+	return tests_result();
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daemon/modules/unix-userspace/probe_cache.h"
+#include "daemon/return_codes.h"
+#include "tests/dt_tests.h"
+
+static void free_results(const char **fstype, const char **label)
+{
+	if (*fstype != NULL)
+	{
+		free((char*) *fstype);
+		*fstype = NULL;
+	}
+
+	if (*label != NULL)
+	{
+		free((char*) *label);
+		*label = NULL;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	probe_cache_t cache;
+	probe_cache_identity_t identity;
+	probe_cache_identity_t other_identity;
+	const char *fstype = NULL;
+	const char *label = NULL;
+	char path[32];
+	int i;
+
+	tests_init();
+
+	test_compare(probe_cache_init(&cache) == result_success);
+
+	memset(&identity, 0, sizeof(identity));
+
+	identity.device        = 0x811;
+	identity.diskseq       = 7;
+	identity.size          = 2048;
+	identity.mtime.tv_sec  = 100;
+	identity.mtime.tv_nsec = 5;
+	identity.ctime.tv_sec  = 100;
+	identity.ctime.tv_nsec = 5;
+
+	/* unknown device */
+	test_compare(probe_cache_lookup(&cache, "/dev/sdb1", &identity, &fstype, &label) == result_fail);
+	test_compare(cache.misses == 1);
+
+	test_compare(probe_cache_store(&cache, "/dev/sdb1", &identity, "vfat", "my disk") == result_success);
+
+	/* same identity */
+	test_compare(probe_cache_lookup(&cache, "/dev/sdb1", &identity, &fstype, &label) == result_success);
+	test_compare((fstype != NULL) && (strcmp(fstype, "vfat") == 0));
+	test_compare((label != NULL) && (strcmp(label, "my disk") == 0));
+	test_compare(cache.hits == 1);
+	free_results(&fstype, &label);
+
+	/* device node was written to, e.g. by mkfs, even if disk sequence number is same */
+	other_identity = identity;
+	other_identity.mtime.tv_sec = 200;
+	test_compare(probe_cache_lookup(&cache, "/dev/sdb1", &other_identity, &fstype, &label) == result_fail);
+
+	test_compare(probe_cache_store(&cache, "/dev/sdb1", &identity, "vfat", "my disk") == result_success);
+	other_identity = identity;
+	other_identity.ctime.tv_nsec = 6;
+	test_compare(probe_cache_lookup(&cache, "/dev/sdb1", &other_identity, &fstype, &label) == result_fail);
+
+	/* disk device node was written to */
+	test_compare(probe_cache_store(&cache, "/dev/sdb1", &identity, "vfat", "my disk") == result_success);
+	other_identity = identity;
+	other_identity.parent_mtime.tv_sec = 300;
+	test_compare(probe_cache_lookup(&cache, "/dev/sdb1", &other_identity, &fstype, &label) == result_fail);
+
+	test_compare(probe_cache_store(&cache, "/dev/sdb1", &identity, "vfat", "my disk") == result_success);
+
+	/* media changed, entry is dropped */
+	other_identity = identity;
+	other_identity.diskseq = 8;
+	test_compare(probe_cache_lookup(&cache, "/dev/sdb1", &other_identity, &fstype, &label) == result_fail);
+	test_compare(cache.count == 0);
+	test_compare(probe_cache_lookup(&cache, "/dev/sdb1", &identity, &fstype, &label) == result_fail);
+
+	/* without disk sequence number modification time is compared */
+	identity.diskseq = 0;
+	test_compare(probe_cache_store(&cache, "/dev/sr0", &identity, NULL, NULL) == result_success);
+	test_compare(probe_cache_lookup(&cache, "/dev/sr0", &identity, &fstype, &label) == result_success);
+	test_compare((fstype == NULL) && (label == NULL));
+
+	other_identity = identity;
+	other_identity.mtime.tv_nsec = 6;
+	test_compare(probe_cache_lookup(&cache, "/dev/sr0", &other_identity, &fstype, &label) == result_fail);
+
+	/* size changed */
+	test_compare(probe_cache_store(&cache, "/dev/sr0", &identity, "iso9660", NULL) == result_success);
+	other_identity = identity;
+	other_identity.size = 4096;
+	test_compare(probe_cache_lookup(&cache, "/dev/sr0", &other_identity, &fstype, &label) == result_fail);
+
+	/* stored data replaces old one, removal */
+	test_compare(probe_cache_store(&cache, "/dev/sr0", &identity, "iso9660", NULL) == result_success);
+	test_compare(probe_cache_store(&cache, "/dev/sr0", &identity, "udf", "DVD") == result_success);
+	test_compare(cache.count == 1);
+	test_compare(probe_cache_lookup(&cache, "/dev/sr0", &identity, &fstype, &label) == result_success);
+	test_compare((fstype != NULL) && (strcmp(fstype, "udf") == 0));
+	free_results(&fstype, &label);
+
+	probe_cache_remove(&cache, "/dev/sr0");
+	test_compare(cache.count == 0);
+	test_compare(probe_cache_lookup(&cache, "/dev/sr0", &identity, &fstype, &label) == result_fail);
+
+	/* least recently used entries are dropped */
+	for (i = 0; i <= probe_cache_max_entries; ++i)
+	{
+		snprintf(path, sizeof(path), "/dev/sd%d", i);
+		test_compare(probe_cache_store(&cache, path, &identity, "ext4", NULL) == result_success);
+
+		if (i == 0)
+		{
+			test_compare(probe_cache_store(&cache, "/dev/sdb1", &identity, "vfat", NULL) == result_success);
+		}
+		else
+		{
+			test_compare(probe_cache_lookup(&cache, "/dev/sdb1", &identity, &fstype, &label) == result_success);
+			free_results(&fstype, &label);
+		}
+	}
+
+	test_compare(cache.count == probe_cache_max_entries);
+	test_compare(probe_cache_lookup(&cache, "/dev/sd0", &identity, &fstype, &label) == result_fail);
+	test_compare(probe_cache_lookup(&cache, "/dev/sd1", &identity, &fstype, &label) == result_fail);
+	test_compare(probe_cache_lookup(&cache, "/dev/sd2", &identity, &fstype, &label) == result_success);
+	free_results(&fstype, &label);
+
+	probe_cache_free(&cache);
+
+	return tests_result();
+}
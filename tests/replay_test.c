@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Enumerates devices and replays uevents on fake sysfs and devices trees.
+ * Names of devices don't exist on host, so device nodes are found only if
+ * every access goes through devices root.
+ */
+
+#include <limits.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "daemon/system_module.h"
+#include "daemon/modules/unix-userspace/uevent_record.h"
+#include "daemon/return_codes.h"
+#include "tests/dt_tests.h"
+
+int daemonize = 1;
+int use_syslog = 0;
+int announce_before_probe = 0;
+const char *uevent_record_file = NULL;
+const char *uevent_replay_file = NULL;
+int uevent_replay_fast = 0;
+const char *sysfs_root_dir = NULL;
+const char *devices_root_dir = NULL;
+
+#define disk_size (2 * 1024 * 1024)
+#define partition_start 2048
+#define partition_sectors 2048
+#define partition_size (partition_sectors * 512)
+
+static const char add_event[] =
+	"add@/devices/test/block/dtmdtestsda/dtmdtestsda1\0"
+	"ACTION=add\0"
+	"DEVPATH=/devices/test/block/dtmdtestsda/dtmdtestsda1\0"
+	"SUBSYSTEM=block\0"
+	"DEVNAME=dtmdtestsda1\0"
+	"DEVTYPE=partition\0"
+	"SEQNUM=1";
+
+static char root_path[64];
+static char sysfs_path[sizeof(root_path) + 8];
+static char devices_path[sizeof(root_path) + 8];
+static char record_path[sizeof(root_path) + 16];
+
+static int write_file(const char *name, const char *data)
+{
+	char path[PATH_MAX + 1];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/%s", root_path, name);
+
+	file = fopen(path, "w");
+	if (file == NULL)
+	{
+		return 0;
+	}
+
+	fputs(data, file);
+	fclose(file);
+
+	return 1;
+}
+
+static int write_image(const char *name, const unsigned char *data, size_t size)
+{
+	char path[PATH_MAX + 1];
+	FILE *file;
+	size_t written;
+
+	snprintf(path, sizeof(path), "%s/%s", root_path, name);
+
+	file = fopen(path, "w");
+	if (file == NULL)
+	{
+		return 0;
+	}
+
+	written = fwrite(data, 1, size, file);
+	fclose(file);
+
+	return written == size;
+}
+
+static int make_directory(const char *name)
+{
+	char path[PATH_MAX + 1];
+
+	snprintf(path, sizeof(path), "%s/%s", root_path, name);
+
+	return mkdir(path, 0755) == 0;
+}
+
+static int make_link(const char *target, const char *name)
+{
+	char path[PATH_MAX + 1];
+
+	snprintf(path, sizeof(path), "%s/%s", root_path, name);
+
+	return symlink(target, path) == 0;
+}
+
+static void put_le32(unsigned char *data, uint32_t value)
+{
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+	data[3] = (value >> 24) & 0xFF;
+}
+
+/* disk with dos partition table and partition with ext2 filesystem labelled "replay" */
+static int create_images(void)
+{
+	unsigned char *image;
+	int result;
+
+	image = (unsigned char*) calloc(1, disk_size);
+	if (image == NULL)
+	{
+		return 0;
+	}
+
+	image[446 + 4] = 0x83;
+	put_le32(&(image[446 + 8]), partition_start);
+	put_le32(&(image[446 + 12]), partition_sectors);
+	image[510] = 0x55;
+	image[511] = 0xAA;
+
+	result = write_image("dev/dtmdtestsda", image, disk_size);
+
+	memset(image, 0, disk_size);
+
+	image[1024 + 0x38] = 0x53;
+	image[1024 + 0x39] = 0xEF;
+	put_le32(&(image[1024 + 0x4C]), 1);
+	memcpy(&(image[1024 + 0x78]), "replay", strlen("replay"));
+
+	result = result && write_image("dev/dtmdtestsda1", image, partition_size);
+
+	free(image);
+
+	return result;
+}
+
+static int create_record(void)
+{
+	uevent_recorder_t recorder;
+
+	if (uevent_recorder_open(&recorder, record_path) != result_success)
+	{
+		return 0;
+	}
+
+	if ((uevent_recorder_write(&recorder, add_event, sizeof(add_event)) != result_success)
+		|| (uevent_recorder_flush(&recorder) != result_success))
+	{
+		uevent_recorder_close(&recorder);
+		return 0;
+	}
+
+	uevent_recorder_close(&recorder);
+
+	return 1;
+}
+
+static int create_tree(void)
+{
+	strcpy(root_path, "/tmp/dtmd-replay-test-XXXXXX");
+
+	if (mkdtemp(root_path) == NULL)
+	{
+		return 0;
+	}
+
+	snprintf(sysfs_path, sizeof(sysfs_path), "%s/sys", root_path);
+	snprintf(devices_path, sizeof(devices_path), "%s/dev", root_path);
+	snprintf(record_path, sizeof(record_path), "%s/uevents", root_path);
+
+	return make_directory("sys")
+		&& make_directory("sys/class")
+		&& make_directory("sys/class/block")
+		&& make_directory("sys/devices")
+		&& make_directory("sys/devices/test")
+		&& make_directory("sys/devices/test/device")
+		&& make_directory("sys/devices/test/block")
+		&& make_directory("sys/devices/test/block/dtmdtestsda")
+		&& make_directory("sys/devices/test/block/dtmdtestsda/dtmdtestsda1")
+		&& make_link("../..", "sys/devices/test/block/dtmdtestsda/device")
+		&& make_link("../../devices/test/block/dtmdtestsda", "sys/class/block/dtmdtestsda")
+		&& write_file("sys/devices/test/type", "0\n")
+		&& write_file("sys/devices/test/block/dtmdtestsda/dev", "8:240\n")
+		&& write_file("sys/devices/test/block/dtmdtestsda/removable", "1\n")
+		&& write_file("sys/devices/test/block/dtmdtestsda/dtmdtestsda1/dev", "8:241\n")
+		&& write_file("sys/devices/test/block/dtmdtestsda/dtmdtestsda1/partition", "1\n")
+		&& make_directory("dev")
+		&& create_images()
+		&& create_record();
+}
+
+static void remove_tree(void)
+{
+	char command[PATH_MAX + 16];
+
+	snprintf(command, sizeof(command), "rm -rf '%s'", root_path);
+	system(command);
+}
+
+static int is_string_equal(const char *value, const char *expected)
+{
+	return (value != NULL) && (strcmp(value, expected) == 0);
+}
+
+int main(int argc, char **argv)
+{
+	dtmd_device_system_t *system;
+	dtmd_device_monitor_t *monitor;
+	dtmd_device_enumeration_t *enumeration;
+	dtmd_info_t *device;
+	dtmd_device_action_type_t action;
+	struct pollfd pollfd;
+	int disks_count = 0;
+	int partitions_count = 0;
+	int is_added = 0;
+	int i;
+
+	(void)argc;
+	(void)argv;
+
+	tests_init();
+	tests_quit_on_error(1);
+
+	test_compare_comment_deinit(create_tree(), "failed to create test tree", remove_tree());
+
+	sysfs_root_dir     = sysfs_path;
+	devices_root_dir   = devices_path;
+	uevent_replay_file = record_path;
+	uevent_replay_fast = 1;
+
+	tests_quit_on_error(0);
+
+	system = device_system_init();
+	test_compare_comment_deinit(system != NULL, "failed to init device system", remove_tree());
+
+	monitor = device_system_start_monitoring(system);
+	test_compare(monitor != NULL);
+
+	// partitions are found and probed on devices root
+	enumeration = device_system_enumerate_devices(system);
+	test_compare(enumeration != NULL);
+
+	while ((enumeration != NULL) && is_result_successful(device_system_next_enumerated_device(enumeration, &device)))
+	{
+		if (is_string_equal(device->path, "/dev/dtmdtestsda"))
+		{
+			test_compare(device->media_type == dtmd_removable_media_type_stateless_device);
+			++disks_count;
+		}
+		else if (is_string_equal(device->path, "/dev/dtmdtestsda1"))
+		{
+			test_compare(device->media_type == dtmd_removable_media_type_device_partition);
+			test_compare(is_string_equal(device->path_parent, "/dev/dtmdtestsda"));
+			test_compare(is_string_equal(device->fstype, "ext2"));
+			test_compare(is_string_equal(device->label, "replay"));
+			++partitions_count;
+		}
+
+		device_system_free_enumerated_device(enumeration, device);
+	}
+
+	device_system_finish_enumerate_devices(enumeration);
+
+	test_compare(disks_count == 1);
+	test_compare(partitions_count == 1);
+
+	// replayed partition is probed on devices root too
+	pollfd.fd     = (monitor != NULL) ? device_system_get_monitor_fd(monitor) : -1;
+	pollfd.events = POLLIN;
+
+	for (i = 0; (monitor != NULL) && (!is_added) && (i < 50); ++i)
+	{
+		if (poll(&pollfd, 1, 100) <= 0)
+		{
+			continue;
+		}
+
+		while (device_system_monitor_has_device(monitor)
+			&& is_result_successful(device_system_monitor_get_device(monitor, &device, &action)))
+		{
+			if ((device != NULL) && is_string_equal(device->path, "/dev/dtmdtestsda1"))
+			{
+				test_compare(action == dtmd_device_action_add);
+				test_compare(is_string_equal(device->fstype, "ext2"));
+				test_compare(is_string_equal(device->label, "replay"));
+				is_added = 1;
+			}
+
+			if (device != NULL)
+			{
+				device_system_monitor_free_device(monitor, device);
+			}
+		}
+	}
+
+	test_compare(is_added);
+
+	if (monitor != NULL)
+	{
+		device_system_stop_monitoring(monitor);
+	}
+
+	device_system_deinit(system);
+
+	remove_tree();
+
+	return tests_result();
+}
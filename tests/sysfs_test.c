@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "daemon/modules/unix-userspace/sysfs.h"
+#include "daemon/return_codes.h"
+#include "tests/dt_tests.h"
+
+static char root_path[64];
+
+static int write_file(const char *name, const char *data)
+{
+	char path[PATH_MAX + 1];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/%s", root_path, name);
+
+	file = fopen(path, "w");
+	if (file == NULL)
+	{
+		return 0;
+	}
+
+	fputs(data, file);
+	fclose(file);
+
+	return 1;
+}
+
+static int make_directory(const char *name)
+{
+	char path[PATH_MAX + 1];
+
+	snprintf(path, sizeof(path), "%s/%s", root_path, name);
+
+	return mkdir(path, 0755) == 0;
+}
+
+static int make_link(const char *target, const char *name)
+{
+	char path[PATH_MAX + 1];
+
+	snprintf(path, sizeof(path), "%s/%s", root_path, name);
+
+	return symlink(target, path) == 0;
+}
+
+static int create_tree(void)
+{
+	strcpy(root_path, "/tmp/dtmd-sysfs-test-XXXXXX");
+
+	return (mkdtemp(root_path) != NULL)
+		&& make_directory("class")
+		&& make_directory("class/block")
+		&& make_directory("devices")
+		&& make_directory("devices/usb1")
+		&& make_directory("devices/usb1/1-1")
+		&& make_directory("devices/usb1/1-1/host0")
+		&& make_directory("devices/usb1/1-1/host0/block")
+		&& make_directory("devices/usb1/1-1/host0/block/sdb")
+		&& make_directory("devices/virtual")
+		&& make_directory("devices/virtual/loop0")
+		&& make_link("../../bus/usb", "devices/usb1/1-1/subsystem")
+		&& make_link("../../bus/usb", "devices/usb1/subsystem")
+		&& make_link("../../devices/usb1/1-1/host0/block/sdb", "class/block/sdb")
+		&& make_link("../../devices/virtual/loop0", "class/block/loop0")
+		&& write_file("devices/usb1/uevent", "DEVTYPE=usb_bus\n")
+		&& write_file("devices/usb1/1-1/uevent", "MAJOR=189\nDEVTYPE=usb_device\n")
+		&& write_file("devices/usb1/1-1/host0/block/sdb/removable", "1\n")
+		&& write_file("devices/usb1/1-1/host0/block/sdb/size", "15633408\n")
+		&& write_file("devices/usb1/1-1/host0/block/sdb/type", "SD\n")
+		&& write_file("devices/usb1/1-1/host0/block/sdb/garbage", "x1\n");
+}
+
+static void remove_tree(void)
+{
+	char command[PATH_MAX + 16];
+
+	snprintf(command, sizeof(command), "rm -rf '%s'", root_path);
+	system(command);
+}
+
+int main(int argc, char **argv)
+{
+	sysfs_root_t root;
+	sysfs_accessor_t sysfs;
+	const char *value;
+	char *syspath;
+	char expected[PATH_MAX + 1];
+	unsigned long long unsigned_value;
+	int int_value;
+
+	tests_init();
+	tests_quit_on_error(1);
+
+	test_compare(create_tree());
+	test_compare(sysfs_root_init(&root, root_path) == result_success);
+
+	sysfs_accessor_init(&sysfs, &root);
+
+	test_compare(sysfs_file_exists(root.class_block_fd, "sdb/removable") == result_success);
+	test_compare(sysfs_file_exists(root.class_block_fd, "sdb/missing") == result_fail);
+
+	test_compare(sysfs_read_int(&sysfs, root.class_block_fd, "sdb/removable", &int_value) == result_success);
+	test_compare(int_value == 1);
+	test_compare(sysfs_read_int(&sysfs, root.class_block_fd, "sdb/garbage", &int_value) == result_fail);
+	test_compare(sysfs_read_int(&sysfs, root.class_block_fd, "sdb/missing", &int_value) == result_fail);
+
+	test_compare(sysfs_read_unsigned(&sysfs, root.class_block_fd, "sdb/size", &unsigned_value) == result_success);
+	test_compare(unsigned_value == 15633408ULL);
+
+	test_compare(sysfs_read_string(&sysfs, root.class_block_fd, "sdb/type", &value) == result_success);
+	test_compare(strcmp(value, "SD") == 0);
+
+	test_compare(sysfs_file_has_line(&sysfs, root.sys_fd, "devices/usb1/1-1/uevent", "DEVTYPE=usb_device") == result_success);
+	test_compare(sysfs_file_has_line(&sysfs, root.sys_fd, "devices/usb1/1-1/uevent", "DEVTYPE=usb") == result_fail);
+
+	test_compare(sysfs_get_block_devpath(&sysfs, "sdb", &value) == result_success);
+	test_compare(strcmp(value, "devices/usb1/1-1/host0/block/sdb") == 0);
+
+	// usb bus above device is skipped because it isn't usb device
+	snprintf(expected, sizeof(expected), "%s/devices/usb1/1-1", root_path);
+
+	syspath = sysfs_get_usb_parent_syspath(&sysfs, value);
+	test_compare(syspath != NULL);
+	test_compare(strcmp(syspath, expected) == 0);
+	free(syspath);
+
+	syspath = sysfs_get_usb_parent_syspath(&sysfs, "/devices/usb1/1-1/host0/block/sdb");
+	test_compare(syspath != NULL);
+	test_compare(strcmp(syspath, expected) == 0);
+	free(syspath);
+
+	test_compare(sysfs_get_block_devpath(&sysfs, "loop0", &value) == result_success);
+	test_compare(sysfs_get_usb_parent_syspath(&sysfs, value) == NULL);
+
+	sysfs_root_free(&root);
+	remove_tree();
+
+	return tests_result();
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2020 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DTMD, Dark Templar Mount Daemon.
+ *
+ * DTMD is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DTMD is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DTMD.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "daemon/modules/unix-userspace/uevent_record.h"
+#include "daemon/return_codes.h"
+#include "tests/dt_tests.h"
+
+static const char first_event[] = "add@/devices/virtual/block/loop0\0ACTION=add\0SUBSYSTEM=block";
+static const char second_event[] = "remove@/devices/virtual/block/loop0\0ACTION=remove";
+
+int main(int argc, char **argv)
+{
+	char filename[64];
+	uevent_recorder_t recorder;
+	uevent_player_t player;
+	char buffer[256];
+	unsigned long long first_timestamp = 0;
+	unsigned long long timestamp = 0;
+	size_t length = 0;
+	FILE *file;
+	int fd;
+
+	tests_init();
+
+	strcpy(filename, "/tmp/dtmd-uevent-test-XXXXXX");
+	fd = mkstemp(filename);
+	test_compare(fd >= 0);
+	if (fd < 0)
+	{
+		return tests_result();
+	}
+
+	close(fd);
+
+	/* events are read back in order with payload intact */
+	test_compare(uevent_recorder_open(&recorder, filename) == result_success);
+	test_compare(uevent_recorder_write(&recorder, first_event, sizeof(first_event)) == result_success);
+	test_compare(uevent_recorder_write(&recorder, second_event, sizeof(second_event)) == result_success);
+	test_compare(uevent_recorder_flush(&recorder) == result_success);
+	uevent_recorder_close(&recorder);
+
+	test_compare(uevent_player_open(&player, filename) == result_success);
+
+	test_compare(uevent_player_read(&player, &first_timestamp, buffer, sizeof(buffer), &length) == result_success);
+	test_compare(length == sizeof(first_event));
+	test_compare(memcmp(buffer, first_event, sizeof(first_event)) == 0);
+
+	test_compare(uevent_player_read(&player, &timestamp, buffer, sizeof(buffer), &length) == result_success);
+	test_compare(length == sizeof(second_event));
+	test_compare(memcmp(buffer, second_event, sizeof(second_event)) == 0);
+	test_compare(timestamp >= first_timestamp);
+
+	test_compare(uevent_player_read(&player, &timestamp, buffer, sizeof(buffer), &length) == result_fail);
+	test_compare(player.records == 2);
+	uevent_player_close(&player);
+
+	/* record not fitting into buffer */
+	test_compare(uevent_player_open(&player, filename) == result_success);
+	test_compare(uevent_player_read(&player, &timestamp, buffer, 8, &length) == result_fatal_error);
+	uevent_player_close(&player);
+
+	/* interrupted recording */
+	test_compare(truncate(filename, strlen(uevent_record_magic) + sizeof(uevent_record_header_t) + sizeof(first_event) + 4) == 0);
+	test_compare(uevent_player_open(&player, filename) == result_success);
+	test_compare(uevent_player_read(&player, &timestamp, buffer, sizeof(buffer), &length) == result_success);
+	test_compare(uevent_player_read(&player, &timestamp, buffer, sizeof(buffer), &length) == result_fail);
+	uevent_player_close(&player);
+
+	/* not a recording */
+	file = fopen(filename, "w");
+	test_compare(file != NULL);
+	if (file != NULL)
+	{
+		fputs("ACTION=add", file);
+		fclose(file);
+	}
+
+	test_compare(uevent_player_open(&player, filename) == result_fail);
+
+	unlink(filename);
+
+	return tests_result();
+}